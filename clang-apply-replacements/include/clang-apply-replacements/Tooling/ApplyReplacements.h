@@ -21,6 +21,7 @@
 #include "clang/Tooling/Refactoring/AtomicChange.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
 #include <string>
 #include <system_error>
 #include <vector>
@@ -46,6 +47,14 @@ typedef llvm::DenseMap<const clang::FileEntry *,
                        std::vector<tooling::AtomicChange>>
     FileToChangesMap;
 
+/// \brief The replacements targeting one file.
+struct FileReplacements {
+  /// \brief Path of the file. If the file is described with different
+  /// spellings, the smallest one.
+  std::string FilePath;
+  std::vector<tooling::Replacement> Replacements;
+};
+
 /// \brief Recursively descends through a directory structure rooted at \p
 /// Directory and attempts to deserialize *.yaml files as
 /// TranslationUnitReplacements. All docs that successfully deserialize are
@@ -71,6 +80,34 @@ std::error_code collectReplacementsFromDirectory(
     const llvm::StringRef Directory, TUDiagnostics &TUs,
     TUReplacementFiles &TUFiles, clang::DiagnosticsEngine &Diagnostics);
 
+/// \brief Like collectReplacementsFromDirectory, but the *.yaml files are
+/// read and deserialized in parallel, and only the replacements they describe
+/// are kept, grouped by the file they target.
+///
+/// Files are identified like FileManager does, so different spellings of the
+/// path of a file are grouped together. Replacements targeting files that
+/// don't exist are ignored.
+///
+/// \param[in] Directory Directory to begin search for serialized
+/// TranslationUnitReplacements and TranslationUnitDiagnostics.
+/// \param[out] Files The replacements of each file, sorted by path.
+/// Replacements are sorted within each file.
+/// \param[out] TUFiles Collection of all TranslationUnitReplacement files
+/// found in \c Directory.
+/// \param[in] NumThreads The number of threads reading files. 0 is treated
+/// as 1.
+/// \param[out] Errors Where the files that can't be read and the missing
+/// target files are reported. They are written once all the files are read,
+/// sorted by path, so that the output doesn't depend on scheduling.
+///
+/// \returns An error_code indicating success or failure in navigating the
+/// directory structure.
+std::error_code collectReplacementsByFile(const llvm::StringRef Directory,
+                                          std::vector<FileReplacements> &Files,
+                                          TUReplacementFiles &TUFiles,
+                                          unsigned NumThreads,
+                                          llvm::raw_ostream &Errors);
+
 /// \brief Deduplicate, check for conflicts, and extract all Replacements stored
 /// in \c TUs. Conflicting replacements are skipped.
 ///
@@ -91,6 +128,23 @@ bool mergeAndDeduplicate(const TUReplacements &TUs, const TUDiagnostics &TUDs,
                          FileToChangesMap &FileChanges,
                          clang::SourceManager &SM);
 
+/// \brief Deduplicate and check for conflicts the replacements of a single
+/// file. Conflicting replacements are skipped.
+///
+/// Unlike the overload above, this can be called concurrently for different
+/// files.
+///
+/// \param[in] File The replacements of the file, sorted.
+/// \param[out] Changes The non conflicting changes of the file.
+/// \param[out] Errors Stream where conflicts are reported.
+///
+/// \returns \parblock
+///          \li true If all changes were converted successfully.
+///          \li false If there were conflicts.
+bool mergeAndDeduplicate(const FileReplacements &File,
+                         std::vector<tooling::AtomicChange> &Changes,
+                         llvm::raw_ostream &Errors);
+
 /// \brief Apply \c AtomicChange on File and rewrite it.
 ///
 /// \param[in] File Path of the file where to apply AtomicChange.
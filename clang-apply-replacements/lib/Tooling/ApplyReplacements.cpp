@@ -15,6 +15,7 @@
 ///
 //===----------------------------------------------------------------------===//
 #include "clang-apply-replacements/Tooling/ApplyReplacements.h"
+#include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Basic/LangOptions.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Format/Format.h"
@@ -23,10 +24,18 @@
 #include "clang/Tooling/DiagnosticsYaml.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <mutex>
+#include <set>
 
 using namespace llvm;
 using namespace clang;
@@ -124,6 +133,149 @@ std::error_code collectReplacementsFromDirectory(
   return ErrorCode;
 }
 
+namespace {
+/// Replacements collected by collectReplacementsByFile. They are stored in
+/// shards, selected by a hash of the target file, so that workers loading
+/// different files rarely wait for each other.
+struct ReplacementShard {
+  std::mutex Mutex;
+  std::map<llvm::sys::fs::UniqueID, FileReplacements> Files;
+};
+} // namespace
+
+std::error_code collectReplacementsByFile(const llvm::StringRef Directory,
+                                          std::vector<FileReplacements> &Files,
+                                          TUReplacementFiles &TUFiles,
+                                          unsigned NumThreads,
+                                          llvm::raw_ostream &Errors) {
+  using namespace llvm::sys::fs;
+  using namespace llvm::sys::path;
+
+  NumThreads = std::max(NumThreads, 1u);
+  std::vector<ReplacementShard> Shards(4 * NumThreads);
+  // Errors are reported after all the files are read, in path order. The
+  // mutex guards ReadErrors and MissingFiles.
+  std::mutex OutputMutex;
+  std::map<std::string, std::string> ReadErrors;
+  std::set<std::string> MissingFiles;
+
+  auto AddReplacements = [&](ArrayRef<const tooling::Replacement *> Replaces) {
+    // Look each file up once, and group the replacements by shard to lock
+    // each shard once per document.
+    llvm::StringMap<llvm::Optional<UniqueID>> IDs;
+    std::vector<std::vector<std::pair<UniqueID, const tooling::Replacement *>>>
+        ByShard(Shards.size());
+    for (const tooling::Replacement *R : Replaces) {
+      auto Inserted = IDs.insert({R->getFilePath(), llvm::None});
+      llvm::Optional<UniqueID> &ID = Inserted.first->second;
+      if (Inserted.second) {
+        file_status Status;
+        if (!status(R->getFilePath(), Status) && is_regular_file(Status)) {
+          ID = Status.getUniqueID();
+        } else {
+          std::lock_guard<std::mutex> Lock(OutputMutex);
+          MissingFiles.insert(R->getFilePath());
+        }
+      }
+      if (ID)
+        ByShard[llvm::hash_combine(ID->getDevice(), ID->getFile()) %
+                Shards.size()]
+            .push_back({*ID, R});
+    }
+    for (size_t I = 0; I < Shards.size(); ++I) {
+      if (ByShard[I].empty())
+        continue;
+      std::lock_guard<std::mutex> Lock(Shards[I].Mutex);
+      for (const auto &IDAndReplacement : ByShard[I]) {
+        FileReplacements &File = Shards[I].Files[IDAndReplacement.first];
+        StringRef Path = IDAndReplacement.second->getFilePath();
+        if (File.FilePath.empty() || Path < File.FilePath)
+          File.FilePath = Path;
+        File.Replacements.push_back(*IDAndReplacement.second);
+      }
+    }
+  };
+
+  // Documents are dropped as soon as their replacements are grouped, so that
+  // the diagnostics they describe are never all in memory.
+  auto Load = [&](const std::string &Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Out = MemoryBuffer::getFile(Path);
+    if (std::error_code BufferError = Out.getError()) {
+      std::lock_guard<std::mutex> Lock(OutputMutex);
+      ReadErrors[Path] = BufferError.message();
+      return;
+    }
+
+    std::vector<const tooling::Replacement *> Replaces;
+    tooling::TranslationUnitDiagnostics TUD;
+    yaml::Input DiagIn(Out.get()->getBuffer(), nullptr, &eatDiagnostics);
+    DiagIn >> TUD;
+    if (!DiagIn.error()) {
+      for (const auto &D : TUD.Diagnostics)
+        for (const auto &Fix : D.Fix)
+          for (const tooling::Replacement &R : Fix.second)
+            Replaces.push_back(&R);
+      AddReplacements(Replaces);
+      return;
+    }
+
+    tooling::TranslationUnitReplacements TUR;
+    yaml::Input ReplacementsIn(Out.get()->getBuffer(), nullptr,
+                               &eatDiagnostics);
+    ReplacementsIn >> TUR;
+    if (ReplacementsIn.error()) {
+      // File doesn't appear to be a header change description. Ignore it.
+      return;
+    }
+    for (const tooling::Replacement &R : TUR.Replacements)
+      Replaces.push_back(&R);
+    AddReplacements(Replaces);
+  };
+
+  std::error_code ErrorCode;
+  llvm::ThreadPool Pool(NumThreads);
+  for (recursive_directory_iterator I(Directory, ErrorCode), E;
+       I != E && !ErrorCode; I.increment(ErrorCode)) {
+    if (filename(I->path())[0] == '.') {
+      // Indicate not to descend into directories beginning with '.'
+      I.no_push();
+      continue;
+    }
+
+    if (extension(I->path()) != ".yaml")
+      continue;
+
+    TUFiles.push_back(I->path());
+    Pool.async(Load, I->path());
+  }
+  Pool.wait();
+
+  for (const auto &PathAndError : ReadErrors)
+    Errors << "Error reading " << PathAndError.first << ": "
+           << PathAndError.second << "\n";
+  for (const std::string &Path : MissingFiles)
+    Errors << "Described file '" << Path << "' doesn't exist. Ignoring...\n";
+
+  // Sort replacements per file to keep consistent behavior when
+  // clang-apply-replacements run on differents machine.
+  for (ReplacementShard &Shard : Shards)
+    Pool.async([&Shard] {
+      for (auto &IDAndFile : Shard.Files)
+        llvm::sort(IDAndFile.second.Replacements.begin(),
+                   IDAndFile.second.Replacements.end());
+    });
+  Pool.wait();
+
+  for (ReplacementShard &Shard : Shards)
+    for (auto &IDAndFile : Shard.Files)
+      Files.push_back(std::move(IDAndFile.second));
+  llvm::sort(Files.begin(), Files.end(),
+             [](const FileReplacements &L, const FileReplacements &R) {
+               return L.FilePath < R.FilePath;
+             });
+  return ErrorCode;
+}
+
 /// \brief Extract replacements from collected TranslationUnitReplacements and
 /// TranslationUnitDiagnostics and group them per file.
 ///
@@ -173,47 +325,85 @@ groupReplacements(const TUReplacements &TUs, const TUDiagnostics &TUDs,
   return GroupedReplacements;
 }
 
+/// \brief Put the sorted replacements of \p Entry into a single AtomicChange,
+/// reporting the conflicting ones to \p Errors.
+///
+/// \returns false If there were conflicts.
+static bool mergeFileReplacements(const FileEntry *Entry,
+                                  ArrayRef<tooling::Replacement> Replacements,
+                                  SourceManager &SM,
+                                  std::vector<tooling::AtomicChange> &Changes,
+                                  raw_ostream &Errors) {
+  bool ConflictDetected = false;
+
+  // To report conflicting replacements on corresponding file, all replacements
+  // are stored into 1 big AtomicChange.
+  const SourceLocation BeginLoc =
+      SM.getLocForStartOfFile(SM.getOrCreateFileID(Entry, SrcMgr::C_User));
+  tooling::AtomicChange FileChange(Entry->getName(), Entry->getName());
+  for (const auto &R : Replacements) {
+    llvm::Error Err =
+        FileChange.replace(SM, BeginLoc.getLocWithOffset(R.getOffset()),
+                           R.getLength(), R.getReplacementText());
+    if (Err) {
+      // FIXME: This will report conflicts by pair using a file+offset format
+      // which is not so much human readable.
+      // A first improvement could be to translate offset to line+col. For
+      // this and without loosing error message some modifications arround
+      // `tooling::ReplacementError` are need (access to
+      // `getReplacementErrString`).
+      // A better strategy could be to add a pretty printer methods for
+      // conflict reporting. Methods that could be parameterized to report a
+      // conflict in different format, file+offset, file+line+col, or even
+      // more human readable using VCS conflict markers.
+      // For now, printing directly the error reported by `AtomicChange` is
+      // the easiest solution.
+      Errors << llvm::toString(std::move(Err)) << "\n";
+      ConflictDetected = true;
+    }
+  }
+  Changes = {FileChange};
+
+  return !ConflictDetected;
+}
+
 bool mergeAndDeduplicate(const TUReplacements &TUs, const TUDiagnostics &TUDs,
                          FileToChangesMap &FileChanges,
                          clang::SourceManager &SM) {
   auto GroupedReplacements = groupReplacements(TUs, TUDs, SM);
   bool ConflictDetected = false;
 
-  // To report conflicting replacements on corresponding file, all replacements
-  // are stored into 1 big AtomicChange.
   for (const auto &FileAndReplacements : GroupedReplacements) {
     const FileEntry *Entry = FileAndReplacements.first;
-    const SourceLocation BeginLoc =
-        SM.getLocForStartOfFile(SM.getOrCreateFileID(Entry, SrcMgr::C_User));
-    tooling::AtomicChange FileChange(Entry->getName(), Entry->getName());
-    for (const auto &R : FileAndReplacements.second) {
-      llvm::Error Err =
-          FileChange.replace(SM, BeginLoc.getLocWithOffset(R.getOffset()),
-                             R.getLength(), R.getReplacementText());
-      if (Err) {
-        // FIXME: This will report conflicts by pair using a file+offset format
-        // which is not so much human readable.
-        // A first improvement could be to translate offset to line+col. For
-        // this and without loosing error message some modifications arround
-        // `tooling::ReplacementError` are need (access to
-        // `getReplacementErrString`).
-        // A better strategy could be to add a pretty printer methods for
-        // conflict reporting. Methods that could be parameterized to report a
-        // conflict in different format, file+offset, file+line+col, or even
-        // more human readable using VCS conflict markers.
-        // For now, printing directly the error reported by `AtomicChange` is
-        // the easiest solution.
-        errs() << llvm::toString(std::move(Err)) << "\n";
-        ConflictDetected = true;
-      }
-    }
-    FileChanges.try_emplace(Entry,
-                            std::vector<tooling::AtomicChange>{FileChange});
+    std::vector<tooling::AtomicChange> Changes;
+    if (!mergeFileReplacements(Entry, FileAndReplacements.second, SM, Changes,
+                               errs()))
+      ConflictDetected = true;
+    FileChanges.try_emplace(Entry, std::move(Changes));
   }
 
   return !ConflictDetected;
 }
 
+bool mergeAndDeduplicate(const FileReplacements &File,
+                         std::vector<tooling::AtomicChange> &Changes,
+                         llvm::raw_ostream &Errors) {
+  // SourceManagers are not thread-safe, each file gets its own.
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
+  DiagnosticsEngine Diagnostics(
+      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), DiagOpts.get());
+  FileManager Files((FileSystemOptions()));
+  SourceManager SM(Diagnostics, Files);
+
+  const FileEntry *Entry = Files.getFile(File.FilePath);
+  if (!Entry) {
+    Errors << "Described file '" << File.FilePath
+           << "' doesn't exist. Ignoring...\n";
+    return true;
+  }
+  return mergeFileReplacements(Entry, File.Replacements, SM, Changes, Errors);
+}
+
 llvm::Expected<std::string>
 applyChanges(StringRef File, const std::vector<tooling::AtomicChange> &Changes,
              const tooling::ApplyChangesSpec &Spec,
@@ -23,6 +23,9 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
 
 using namespace llvm;
 using namespace clang;
@@ -43,6 +46,12 @@ static cl::opt<bool> RemoveTUReplacementFiles(
              "merging/replacing."),
     cl::init(false), cl::cat(ReplacementCategory));
 
+static cl::opt<unsigned> Jobs(
+    "j",
+    cl::desc("The number of threads reading the change description files\n"
+             "and applying the changes. 0 means one per core."),
+    cl::init(0), cl::cat(ReplacementCategory));
+
 static cl::opt<bool> DoFormat(
     "format",
     cl::desc("Enable formatting of code changed by applying replacements.\n"
@@ -105,16 +114,13 @@ int main(int argc, char **argv) {
   }
   format::FormatStyle FormatStyle = std::move(*FormatStyleOrError);
 
-  TUReplacements TURs;
-  TUReplacementFiles TUFiles;
+  unsigned NumThreads =
+      std::max(Jobs ? Jobs : llvm::hardware_concurrency(), 1u);
 
+  std::vector<FileReplacements> Files;
+  TUReplacementFiles TUFiles;
   std::error_code ErrorCode =
-      collectReplacementsFromDirectory(Directory, TURs, TUFiles, Diagnostics);
-
-  TUDiagnostics TUDs;
-  TUFiles.clear();
-  ErrorCode =
-      collectReplacementsFromDirectory(Directory, TUDs, TUFiles, Diagnostics);
+      collectReplacementsByFile(Directory, Files, TUFiles, NumThreads, errs());
 
   if (ErrorCode) {
     errs() << "Trouble iterating over directory '" << Directory
@@ -128,11 +134,26 @@ int main(int argc, char **argv) {
   if (RemoveTUReplacementFiles)
     Remover.reset(new ScopedFileRemover(TUFiles, Diagnostics));
 
-  FileManager Files((FileSystemOptions()));
-  SourceManager SM(Diagnostics, Files);
-
-  FileToChangesMap Changes;
-  if (!mergeAndDeduplicate(TURs, TUDs, Changes, SM))
+  // Files are merged, then applied and written, in parallel. Errors are
+  // buffered per file and printed in the order of the files.
+  llvm::ThreadPool Pool(NumThreads);
+  std::vector<std::vector<tooling::AtomicChange>> Changes(Files.size());
+  std::vector<std::string> Errors(Files.size());
+  std::vector<char> Merged(Files.size());
+  for (size_t I = 0; I < Files.size(); ++I)
+    Pool.async([&, I] {
+      llvm::raw_string_ostream OS(Errors[I]);
+      Merged[I] = mergeAndDeduplicate(Files[I], Changes[I], OS);
+    });
+  Pool.wait();
+
+  bool ConflictDetected = false;
+  for (size_t I = 0; I < Files.size(); ++I) {
+    errs() << Errors[I];
+    Errors[I].clear();
+    ConflictDetected |= !Merged[I];
+  }
+  if (ConflictDetected)
     return 1;
 
   tooling::ApplyChangesSpec Spec;
@@ -141,25 +162,39 @@ int main(int argc, char **argv) {
   Spec.Format = DoFormat ? tooling::ApplyChangesSpec::kAll
                          : tooling::ApplyChangesSpec::kNone;
 
-  for (const auto &FileChange : Changes) {
-    const FileEntry *Entry = FileChange.first;
-    StringRef FileName = Entry->getName();
-    llvm::Expected<std::string> NewFileData =
-        applyChanges(FileName, FileChange.second, Spec, Diagnostics);
-    if (!NewFileData) {
-      errs() << llvm::toString(NewFileData.takeError()) << "\n";
-      continue;
-    }
-
-    // Write new file to disk
-    std::error_code EC;
-    llvm::raw_fd_ostream FileStream(FileName, EC, llvm::sys::fs::F_None);
-    if (EC) {
-      llvm::errs() << "Could not open " << FileName << " for writing\n";
+  for (size_t I = 0; I < Files.size(); ++I) {
+    if (Changes[I].empty())
       continue;
-    }
-    FileStream << *NewFileData;
+    Pool.async([&, I] {
+      llvm::raw_string_ostream OS(Errors[I]);
+      // DiagnosticsEngines are not thread-safe, each file gets its own.
+      IntrusiveRefCntPtr<DiagnosticOptions> FileDiagOpts(
+          new DiagnosticOptions());
+      DiagnosticsEngine FileDiagnostics(
+          IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+          FileDiagOpts.get());
+      StringRef FileName = Changes[I].front().getFilePath();
+      llvm::Expected<std::string> NewFileData =
+          applyChanges(FileName, Changes[I], Spec, FileDiagnostics);
+      if (!NewFileData) {
+        OS << llvm::toString(NewFileData.takeError()) << "\n";
+        return;
+      }
+
+      // Write new file to disk
+      std::error_code EC;
+      llvm::raw_fd_ostream FileStream(FileName, EC, llvm::sys::fs::F_None);
+      if (EC) {
+        OS << "Could not open " << FileName << " for writing\n";
+        return;
+      }
+      FileStream << *NewFileData;
+    });
   }
+  Pool.wait();
+
+  for (const std::string &Error : Errors)
+    errs() << Error;
 
   return 0;
 }
@@ -18,6 +18,7 @@
 #include "ClangTidy.h"
 #include "ClangTidyDiagnosticConsumer.h"
 #include "ClangTidyModuleRegistry.h"
+#include "ClangTidyResultCache.h"
 #include "clang/AST/ASTConsumer.h"
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/Decl.h"
@@ -28,6 +29,7 @@
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
 #include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Frontend/TextDiagnosticPrinter.h"
 #include "clang/Lex/PPCallbacks.h"
 #include "clang/Lex/Preprocessor.h"
@@ -39,9 +41,16 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Tooling/ReplacementsYaml.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <set>
 #include <utility>
 
 #define LOG_OPTIONS 0
@@ -266,18 +275,517 @@ namespace clang {
         unsigned WarningsAsErrors;
       };
 
+      /// Appends the files read through \p Sources to \p Inputs.
+      void recordInputs(const SourceManager &Sources,
+                        std::vector<ClangTidyInput> &Inputs,
+                        bool IncludeMainFile) {
+        const FileEntry *MainFile =
+          Sources.getFileEntryForID(Sources.getMainFileID());
+        for (auto I = Sources.fileinfo_begin(), E = Sources.fileinfo_end();
+             I != E; ++I) {
+          if (!IncludeMainFile && I->first == MainFile)
+            continue;
+          // Files that were looked up but never read don't affect the results.
+          const llvm::MemoryBuffer *Buffer = I->second->getRawBuffer();
+          if (!Buffer)
+            continue;
+          SmallString<256> Path(I->first->getName());
+          Sources.getFileManager().makeAbsolutePath(Path);
+          Inputs.push_back(
+            {Path.str(), ClangTidyResultCache::digest(Buffer->getBuffer())});
+        }
+      }
+
       class ClangTidyASTConsumer : public MultiplexConsumer {
       public:
         ClangTidyASTConsumer(std::vector<std::unique_ptr<ASTConsumer>> Consumers,
                              std::unique_ptr<ast_matchers::MatchFinder> Finder,
-                             std::vector<std::unique_ptr<ClangTidyCheck>> Checks)
+                             std::vector<std::unique_ptr<ClangTidyCheck>> Checks,
+                             ClangTidyContext &Context,
+                             std::unique_ptr<TranslationUnitProfile> Profile)
           : MultiplexConsumer(std::move(Consumers)),
+            Profile(std::move(Profile)),
             Finder(std::move(Finder)),
-            Checks(std::move(Checks)) {}
+            Checks(std::move(Checks)), Context(Context) {
+          if (this->Profile) {
+            this->Profile->Start =
+              std::chrono::time_point_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now());
+            ParseStart = llvm::TimeRecord::getCurrentTime(/*Start=*/true);
+          }
+        }
+
+        void HandleTranslationUnit(ASTContext &Ctx) override {
+          if (Profile) {
+            llvm::TimeRecord MatchStart =
+              llvm::TimeRecord::getCurrentTime(/*Start=*/true);
+            Profile->Parse = MatchStart;
+            Profile->Parse -= ParseStart;
+            MultiplexConsumer::HandleTranslationUnit(Ctx);
+            Profile->Match = llvm::TimeRecord::getCurrentTime(/*Start=*/false);
+            Profile->Match -= MatchStart;
+            Context.getCheckProfileData()->addTranslationUnit(
+              std::move(*Profile));
+          } else {
+            MultiplexConsumer::HandleTranslationUnit(Ctx);
+          }
+          if (std::vector<ClangTidyInput> *Inputs = Context.getInputRecorder())
+            recordInputs(Ctx.getSourceManager(), *Inputs,
+                         /*IncludeMainFile=*/true);
+        }
 
       private:
+        // The MatchFinder collects the check times into Profile, so it has to
+        // be destroyed first.
+        std::unique_ptr<TranslationUnitProfile> Profile;
+        llvm::TimeRecord ParseStart;
         std::unique_ptr<ast_matchers::MatchFinder> Finder;
         std::vector<std::unique_ptr<ClangTidyCheck>> Checks;
+        ClangTidyContext &Context;
+      };
+
+      /// Forwards to the options provider of the main context, which the
+      /// parallel workers share.
+      class SharedOptionsProvider : public ClangTidyOptionsProvider {
+      public:
+        SharedOptionsProvider(ClangTidyOptionsProvider &Base) : Base(Base) {}
+
+        const ClangTidyGlobalOptions &getGlobalOptions() override {
+          return Base.getGlobalOptions();
+        }
+
+        std::vector<OptionsSource>
+        getRawOptions(llvm::StringRef FileName) override {
+          return Base.getRawOptions(FileName);
+        }
+
+        ClangTidyOptions getOptions(llvm::StringRef FileName) override {
+          return Base.getOptions(FileName);
+        }
+
+      private:
+        ClangTidyOptionsProvider &Base;
+      };
+
+      /// Keeps a working directory of its own on top of a shared file system.
+      /// ClangTool changes the working directory for each compile command,
+      /// and for the real file system that is a process-wide setting, so the
+      /// parallel workers can't share it.
+      class WorkingDirectoryFileSystem : public vfs::FileSystem {
+      public:
+        WorkingDirectoryFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> Base)
+          : Base(std::move(Base)) {
+          if (auto Dir = this->Base->getCurrentWorkingDirectory())
+            WorkingDir = *Dir;
+        }
+
+        llvm::ErrorOr<vfs::Status> status(const Twine &Path) override {
+          return Base->status(makeAbsolute(Path));
+        }
+
+        llvm::ErrorOr<std::unique_ptr<vfs::File>>
+        openFileForRead(const Twine &Path) override {
+          return Base->openFileForRead(makeAbsolute(Path));
+        }
+
+        vfs::directory_iterator dir_begin(const Twine &Dir,
+                                          std::error_code &EC) override {
+          return Base->dir_begin(makeAbsolute(Dir), EC);
+        }
+
+        llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+          return WorkingDir;
+        }
+
+        std::error_code setCurrentWorkingDirectory(const Twine &Path) override {
+          std::string Dir = makeAbsolute(Path);
+          llvm::ErrorOr<vfs::Status> Status = Base->status(Dir);
+          if (!Status)
+            return Status.getError();
+          if (!Status->isDirectory())
+            return std::make_error_code(std::errc::not_a_directory);
+          WorkingDir = std::move(Dir);
+          return std::error_code();
+        }
+
+      private:
+        std::string makeAbsolute(const Twine &Path) const {
+          SmallString<256> Result;
+          Path.toVector(Result);
+          if (!llvm::sys::path::is_absolute(Result)) {
+            SmallString<256> Absolute(WorkingDir);
+            llvm::sys::path::append(Absolute, Result);
+            Result = std::move(Absolute);
+          }
+          return Result.str();
+        }
+
+        IntrusiveRefCntPtr<vfs::FileSystem> Base;
+        std::string WorkingDir;
+      };
+
+      /// Records the paths that could not be found through it, e.g. the
+      /// include directories tried before the one a header was found in. The
+      /// results of a file stay valid only while these are missing.
+      class MissingFileRecorder : public vfs::FileSystem {
+      public:
+        MissingFileRecorder(IntrusiveRefCntPtr<vfs::FileSystem> Base)
+          : Base(std::move(Base)) {}
+
+        llvm::ErrorOr<vfs::Status> status(const Twine &Path) override {
+          llvm::ErrorOr<vfs::Status> Result = Base->status(Path);
+          if (!Result)
+            record(Path);
+          return Result;
+        }
+
+        llvm::ErrorOr<std::unique_ptr<vfs::File>>
+        openFileForRead(const Twine &Path) override {
+          auto Result = Base->openFileForRead(Path);
+          if (!Result)
+            record(Path);
+          return Result;
+        }
+
+        vfs::directory_iterator dir_begin(const Twine &Dir,
+                                          std::error_code &EC) override {
+          return Base->dir_begin(Dir, EC);
+        }
+
+        llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const override {
+          return Base->getCurrentWorkingDirectory();
+        }
+
+        std::error_code setCurrentWorkingDirectory(const Twine &Path) override {
+          return Base->setCurrentWorkingDirectory(Path);
+        }
+
+        /// Appends the missing paths to \p Inputs, with an empty digest.
+        void appendTo(std::vector<ClangTidyInput> &Inputs) const {
+          for (const std::string &Path : Missing)
+            Inputs.push_back({Path, std::string()});
+        }
+
+      private:
+        void record(const Twine &Path) {
+          SmallString<256> Result;
+          Path.toVector(Result);
+          if (!llvm::sys::path::is_absolute(Result)) {
+            llvm::ErrorOr<std::string> WorkingDir =
+              Base->getCurrentWorkingDirectory();
+            if (!WorkingDir)
+              return;
+            SmallString<256> Absolute(*WorkingDir);
+            llvm::sys::path::append(Absolute, Result);
+            Result = std::move(Absolute);
+          }
+          Missing.insert(Result.str());
+        }
+
+        IntrusiveRefCntPtr<vfs::FileSystem> Base;
+        std::set<std::string> Missing;
+      };
+
+      /// A precompiled preamble, and the files read to build it.
+      struct SharedPreamble {
+        SharedPreamble(PrecompiledPreamble Preamble,
+                       std::vector<ClangTidyInput> Inputs)
+          : Preamble(std::move(Preamble)), Inputs(std::move(Inputs)) {}
+
+        PrecompiledPreamble Preamble;
+        std::vector<ClangTidyInput> Inputs;
+      };
+
+      /// Detects preprocessor events in the main file that make a preamble
+      /// specific to it, like clangd's MainFileDependenceChecker. Everything in
+      /// the preamble region of a file reusing the preamble keeps the locations
+      /// of the file it was built for: e.g. a macro defined there would be
+      /// reported in the other file.
+      class MainFileDependenceChecker : public PPCallbacks {
+      public:
+        MainFileDependenceChecker(SourceManager &SourceMgr,
+                                  bool &DependsOnMainFile)
+          : SourceMgr(SourceMgr), DependsOnMainFile(DependsOnMainFile) {}
+
+        void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                         SrcMgr::CharacteristicKind FileType,
+                         FileID PrevFID) override {
+          // #line directives and line markers.
+          if (Reason == RenameFile)
+            check(Loc);
+        }
+
+        void MacroDefined(const Token &MacroNameTok,
+                          const MacroDirective *MD) override {
+          check(MacroNameTok.getLocation());
+        }
+
+        void MacroUndefined(const Token &MacroNameTok,
+                            const MacroDefinition &MD,
+                            const MacroDirective *Undef) override {
+          check(MacroNameTok.getLocation());
+        }
+
+        void MacroExpands(const Token &MacroNameTok, const MacroDefinition &MD,
+                          SourceRange Range, const MacroArgs *Args) override {
+          // __BASE_FILE__ names the main file wherever it is expanded.
+          if (const IdentifierInfo *II = MacroNameTok.getIdentifierInfo()) {
+            if (II->getName() == "__BASE_FILE__")
+              DependsOnMainFile = true;
+            else if (II->getName() == "__FILE__")
+              check(MacroNameTok.getLocation());
+          }
+        }
+
+        void PragmaDirective(SourceLocation Loc,
+                             PragmaIntroducerKind Introducer) override {
+          check(Loc);
+        }
+
+      private:
+        void check(SourceLocation Loc) {
+          if (Loc.isValid() && SourceMgr.isWrittenInMainFile(Loc))
+            DependsOnMainFile = true;
+        }
+
+        SourceManager &SourceMgr;
+        bool &DependsOnMainFile;
+      };
+
+      /// Collects the files read by the preamble, for the result cache, and
+      /// checks whether other files can use it.
+      class PreambleInputsCollector : public PreambleCallbacks {
+      public:
+        void BeforeExecute(CompilerInstance &CI) override { Compiler = &CI; }
+
+        void AfterPCHEmitted(ASTWriter &Writer) override {
+          recordInputs(Compiler->getSourceManager(), Inputs,
+                       /*IncludeMainFile=*/false);
+        }
+
+        std::unique_ptr<PPCallbacks> createPPCallbacks() override {
+          assert(Compiler && "BeforeExecute must have been called");
+          return llvm::make_unique<MainFileDependenceChecker>(
+            Compiler->getSourceManager(), DependsOnMainFile);
+        }
+
+        std::vector<ClangTidyInput> Inputs;
+        bool DependsOnMainFile = false;
+
+      private:
+        CompilerInstance *Compiler = nullptr;
+      };
+
+      /// Shares the preambles of the translation units processed in a run,
+      /// like clangd's PreambleCache. A preamble is reused by files in the same
+      /// directory whose preamble regions and compile commands (apart from the
+      /// file name and the outputs) are the same. Preambles that depend on the
+      /// main file they were built for are not shared, see
+      /// MainFileDependenceChecker.
+      ///
+      /// This class is thread-safe.
+      class PreambleStore {
+      public:
+        /// Returns the preamble to use for the main file of \p Invocation,
+        /// building it if necessary, or null if the file is parsed without
+        /// one. \p Args and \p Filename are the compile command of the file.
+        std::shared_ptr<const SharedPreamble>
+        get(CompilerInvocation &Invocation, const CommandLineArguments &Args,
+            StringRef Filename, const llvm::MemoryBuffer &Buffer,
+            IntrusiveRefCntPtr<vfs::FileSystem> FS,
+            std::shared_ptr<PCHContainerOperations> PCHs) {
+          PreambleBounds Bounds =
+            ComputePreambleBounds(*Invocation.getLangOpts(), &Buffer, 0);
+          if (Bounds.Size == 0)
+            return nullptr;
+          std::string Key = getKey(Invocation, Args, Filename, Buffer, Bounds,
+                                   *FS);
+          std::shared_ptr<const SharedPreamble> Preamble;
+          bool Found = false;
+          {
+            std::lock_guard<std::mutex> Lock(Mutex);
+            auto It = llvm::find_if(
+              Entries, [&](const Entry &E) { return E.Key == Key; });
+            if (It != Entries.end()) {
+              Found = true;
+              Preamble = It->Preamble;
+              Entries.splice(Entries.begin(), Entries, It);
+            }
+          }
+          // A null entry means that files with this key are parsed without a
+          // preamble.
+          if (Found && !Preamble)
+            return nullptr;
+
+          // CanReuse checks that the files included by the preamble did not
+          // change since it was built. This stats all of them, so don't block
+          // the other workers meanwhile.
+          if (Preamble) {
+            if (Preamble->Preamble.CanReuse(Invocation, &Buffer, Bounds,
+                                            FS.get())) {
+              ++Reused;
+              return Preamble;
+            }
+            std::lock_guard<std::mutex> Lock(Mutex);
+            // The entry may have been replaced meanwhile.
+            Entries.remove_if([&](const Entry &E) {
+              return E.Key == Key && E.Preamble == Preamble;
+            });
+          }
+
+          // Files with the same preamble may be processed in parallel and build
+          // it at the same time. Only the last one is kept.
+          Preamble = build(Invocation, Buffer, Bounds, FS, std::move(PCHs));
+          if (Preamble)
+            ++Built;
+          std::lock_guard<std::mutex> Lock(Mutex);
+          Entries.remove_if([&](const Entry &E) { return E.Key == Key; });
+          Entries.push_front(Entry{std::move(Key), Preamble});
+          if (Entries.size() > MaxEntries)
+            Entries.pop_back();
+          return Preamble;
+        }
+
+        /// Whether the checks enabled by the \p Checks filter register
+        /// preprocessor callbacks, or None if no file using them was parsed
+        /// yet. These checks would not see the directives of a shared
+        /// preamble, so their files are parsed without one.
+        llvm::Optional<bool> checksUsePPCallbacks(StringRef Checks) {
+          std::lock_guard<std::mutex> Lock(Mutex);
+          auto It = UsePPCallbacks.find(Checks);
+          if (It == UsePPCallbacks.end())
+            return llvm::None;
+          return It->second;
+        }
+
+        /// Records whether the checks enabled by \p Checks registered
+        /// preprocessor callbacks when they were created for a file.
+        void setChecksUsePPCallbacks(StringRef Checks, bool Value) {
+          std::lock_guard<std::mutex> Lock(Mutex);
+          UsePPCallbacks[Checks] = Value;
+          if (Value)
+            SkippedForPPCallbacks = true;
+        }
+
+        /// Whether some files were parsed without a preamble because of
+        /// checks registering preprocessor callbacks.
+        bool skippedForPPCallbacks() const { return SkippedForPPCallbacks; }
+
+        /// The number of shared preambles built.
+        unsigned getBuilt() const { return Built; }
+        /// The number of files that used a preamble built for another file.
+        unsigned getReused() const { return Reused; }
+
+      private:
+        /// Preambles are stored in temporary files, keep a few of them only.
+        static const size_t MaxEntries = 16;
+
+        struct Entry {
+          std::string Key;
+          /// Null if the preamble can't be shared.
+          std::shared_ptr<const SharedPreamble> Preamble;
+        };
+
+        static std::string getKey(const CompilerInvocation &Invocation,
+                                  const CommandLineArguments &Args,
+                                  StringRef Filename,
+                                  const llvm::MemoryBuffer &Buffer,
+                                  const PreambleBounds &Bounds,
+                                  vfs::FileSystem &FS) {
+          // Flags naming the outputs of the compilation, which don't affect
+          // the preamble. Their values usually differ between files.
+          static const StringRef OutputFlags[] = {
+            "-o", "-MF", "-MT", "-MQ", "-MJ", "-dependency-file",
+            "--serialize-diagnostics"};
+          static const StringRef JoinedOutputFlags[] = {"-MF", "-MT", "-MQ",
+                                                        "-MJ"};
+          static const StringRef DependencyFlags[] = {"-MD", "-MMD", "-MP"};
+
+          std::string Directory;
+          if (llvm::ErrorOr<std::string> WorkingDir =
+                FS.getCurrentWorkingDirectory())
+            Directory = std::move(*WorkingDir);
+          auto Normalize = [&](StringRef Path) {
+            SmallString<128> Result;
+            if (!llvm::sys::path::is_absolute(Path))
+              Result = Directory;
+            llvm::sys::path::append(Result, Path);
+            llvm::sys::path::remove_dots(Result, /*remove_dot_dot=*/true);
+            return Result;
+          };
+          StringRef MainFile = Invocation.getFrontendOpts().Inputs[0].getFile();
+          SmallString<128> NormalizedMainFile = Normalize(MainFile);
+
+          std::string Key;
+          llvm::raw_string_ostream OS(Key);
+          // Relative paths in the command and the include directives are
+          // resolved against the working and the main file directories.
+          OS << Directory << '\0' << llvm::sys::path::parent_path(MainFile)
+             << '\0';
+          for (size_t I = 0; I < Args.size(); ++I) {
+            StringRef Arg = Args[I];
+            if (llvm::is_contained(OutputFlags, Arg)) {
+              ++I; // Skip the value too.
+              continue;
+            }
+            if (llvm::is_contained(DependencyFlags, Arg) ||
+                llvm::any_of(JoinedOutputFlags,
+                             [&](StringRef Flag) {
+                               return Arg.startswith(Flag);
+                             }) ||
+                (Arg.startswith("-o") && !Arg.startswith("-obj")))
+              continue;
+            // The main file may be spelled relative to the working directory.
+            if (Arg == Filename ||
+                (I > 0 && !Arg.startswith("-") &&
+                 Normalize(Arg) == NormalizedMainFile))
+              OS << "<main file>";
+            else
+              OS << Arg;
+            OS << '\0';
+          }
+          OS << Bounds.PreambleEndsAtStartOfLine << '\0'
+             << Buffer.getBuffer().take_front(Bounds.Size);
+          return OS.str();
+        }
+
+        static std::shared_ptr<const SharedPreamble>
+        build(CompilerInvocation &Invocation,
+              const llvm::MemoryBuffer &Buffer, const PreambleBounds &Bounds,
+              IntrusiveRefCntPtr<vfs::FileSystem> FS,
+              std::shared_ptr<PCHContainerOperations> PCHs) {
+          // The diagnostics of the preamble would only be reported for the
+          // file building it. Parse the files without a preamble instead of
+          // losing them.
+          DiagnosticConsumer Diagnostics;
+          IntrusiveRefCntPtr<DiagnosticsEngine> Engine =
+            CompilerInstance::createDiagnostics(&Invocation.getDiagnosticOpts(),
+                                                &Diagnostics,
+                                                /*ShouldOwnClient=*/false);
+          PreambleInputsCollector Collector;
+          IntrusiveRefCntPtr<MissingFileRecorder> Missing(
+            new MissingFileRecorder(FS));
+          // Checks need function bodies, so they can't be skipped.
+          llvm::ErrorOr<PrecompiledPreamble> Preamble =
+            PrecompiledPreamble::Build(Invocation, &Buffer, Bounds, *Engine,
+                                       Missing, std::move(PCHs),
+                                       /*StoreInMemory=*/false, Collector);
+          if (!Preamble || Diagnostics.getNumWarnings() ||
+              Diagnostics.getNumErrors() || Collector.DependsOnMainFile)
+            return nullptr;
+          // The files reusing the preamble don't look these up again.
+          Missing->appendTo(Collector.Inputs);
+          return std::make_shared<SharedPreamble>(
+            std::move(*Preamble), std::move(Collector.Inputs));
+        }
+
+        std::mutex Mutex;
+        /// Most recently used first.
+        std::list<Entry> Entries;
+        llvm::StringMap<bool> UsePPCallbacks;
+        std::atomic<bool> SkippedForPPCallbacks{false};
+        std::atomic<unsigned> Built{0};
+        std::atomic<unsigned> Reused{0};
       };
 
     } // namespace
@@ -357,8 +865,12 @@ namespace clang {
       CheckFactories->createChecks(&Context, Checks);
 
       ast_matchers::MatchFinder::MatchFinderOptions FinderOptions;
-      if (auto *P = Context.getCheckProfileData())
-        FinderOptions.CheckProfiling.emplace(P->Records);
+      std::unique_ptr<TranslationUnitProfile> Profile;
+      if (Context.getCheckProfileData()) {
+        Profile = llvm::make_unique<TranslationUnitProfile>();
+        Profile->File = File;
+        FinderOptions.CheckProfiling.emplace(Profile->Checks);
+      }
 
       std::unique_ptr<ast_matchers::MatchFinder> Finder(
                                                         new ast_matchers::MatchFinder(std::move(FinderOptions)));
@@ -392,7 +904,8 @@ namespace clang {
         Consumers.push_back(std::move(AnalysisConsumer));
       }
       return llvm::make_unique<ClangTidyASTConsumer>(
-                                                     std::move(Consumers), std::move(Finder), std::move(Checks));
+                                                     std::move(Consumers), std::move(Finder), std::move(Checks), Context,
+                                                     std::move(Profile));
     }
 
     std::vector<std::string> ClangTidyASTConsumerFactory::getCheckNames() {
@@ -491,11 +1004,11 @@ namespace clang {
       return Factory.getCheckOptions();
     }
 
-    void runClangTidy(clang::tidy::ClangTidyContext &Context,
-                      const CompilationDatabase &Compilations,
-                      ArrayRef<std::string> InputFiles,
-                      llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS,
-                      ProfileData *Profile) {
+    static void runClangTool(ClangTidyContext &Context,
+                             const CompilationDatabase &Compilations,
+                             ArrayRef<std::string> InputFiles,
+                             llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS,
+                             ProfileData *Profile, PreambleStore *Preambles) {
       ClangTool Tool(Compilations, InputFiles,
                      std::make_shared<PCHContainerOperations>(), BaseFS);
       
@@ -537,6 +1050,21 @@ namespace clang {
 
       Tool.appendArgumentsAdjuster(PerFileExtraArgumentsInserter);
       Tool.appendArgumentsAdjuster(PluginArgumentsRemover);
+
+      // The tool runs the commands one by one, right after adjusting their
+      // arguments. Remember the command being run, preambles are shared by
+      // files with the same command.
+      struct {
+        CommandLineArguments Args;
+        std::string Filename;
+      } Command;
+      if (Preambles)
+        Tool.appendArgumentsAdjuster(
+          [&Command](const CommandLineArguments &Args, StringRef Filename) {
+          Command.Args = Args;
+          Command.Filename = Filename.str();
+          return Args;
+        });
       if (Profile)
         Context.setCheckProfileData(Profile);
 
@@ -546,29 +1074,214 @@ namespace clang {
 
       class ActionFactory : public FrontendActionFactory {
       public:
-        ActionFactory(ClangTidyContext &Context) : ConsumerFactory(Context) {}
-        FrontendAction *create() override { return new Action(&ConsumerFactory); }
+        ActionFactory(ClangTidyContext &Context, PreambleStore *Preambles,
+                      const CommandLineArguments &Args,
+                      const std::string &Filename)
+          : Context(Context), ConsumerFactory(Context), Preambles(Preambles),
+            Args(Args), Filename(Filename) {}
+        FrontendAction *create() override { return new Action(this); }
+
+        bool
+        runInvocation(std::shared_ptr<CompilerInvocation> Invocation,
+                      FileManager *Files,
+                      std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                      DiagnosticConsumer *DiagConsumer) override {
+          if (!Preambles)
+            return FrontendActionFactory::runInvocation(
+              std::move(Invocation), Files, std::move(PCHContainerOps),
+              DiagConsumer);
+
+          // Whether the checks register preprocessor callbacks is only known
+          // once they are created: the first file with a set of checks is
+          // parsed without a preamble, and so are the next ones if they do.
+          Checks = Context.getOptionsForFile(Filename).Checks.getValueOr("");
+          llvm::Optional<bool> UsePPCallbacks =
+            Preambles->checksUsePPCallbacks(Checks);
+          if (!UsePPCallbacks || *UsePPCallbacks)
+            return FrontendActionFactory::runInvocation(
+              std::move(Invocation), Files, std::move(PCHContainerOps),
+              DiagConsumer);
+
+          IntrusiveRefCntPtr<vfs::FileSystem> FS =
+            Files->getVirtualFileSystem();
+          StringRef MainFile = Invocation->getFrontendOpts().Inputs[0].getFile();
+          llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+            FS->getBufferForFile(MainFile);
+          std::shared_ptr<const SharedPreamble> Preamble;
+          if (Buffer)
+            Preamble = Preambles->get(*Invocation, Args, Filename, **Buffer, FS,
+                                      PCHContainerOps);
+          if (!Preamble)
+            return FrontendActionFactory::runInvocation(
+              std::move(Invocation), Files, std::move(PCHContainerOps),
+              DiagConsumer);
+
+          // The headers in the preamble are not read again, record them as
+          // inputs of the file.
+          if (std::vector<ClangTidyInput> *Inputs = Context.getInputRecorder())
+            Inputs->insert(Inputs->end(), Preamble->Inputs.begin(),
+                           Preamble->Inputs.end());
+
+          // The invocation takes ownership of the main file buffer.
+          Preamble->Preamble.OverridePreamble(*Invocation, FS, Buffer->get());
+          Buffer->release();
+
+          // Same as FrontendActionFactory::runInvocation.
+          CompilerInstance Compiler(std::move(PCHContainerOps));
+          Compiler.setInvocation(std::move(Invocation));
+          Compiler.setFileManager(Files);
+          std::unique_ptr<FrontendAction> ScopedToolAction(create());
+          Compiler.createDiagnostics(DiagConsumer, /*ShouldOwnClient=*/false);
+          if (!Compiler.hasDiagnostics())
+            return false;
+          Compiler.createSourceManager(*Files);
+          const bool Success = Compiler.ExecuteAction(*ScopedToolAction);
+          Files->clearStatCaches();
+          return Success;
+        }
 
       private:
         class Action : public ASTFrontendAction {
         public:
-          Action(ClangTidyASTConsumerFactory *Factory) : Factory(Factory) {}
+          Action(ActionFactory *Owner) : Owner(Owner) {}
           std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler,
                                                          StringRef File) override {
-            return Factory->CreateASTConsumer(Compiler, File);
+            Preprocessor &PP = Compiler.getPreprocessor();
+            PPCallbacks *Callbacks = PP.getPPCallbacks();
+            std::unique_ptr<ASTConsumer> Consumer =
+              Owner->ConsumerFactory.CreateASTConsumer(Compiler, File);
+            if (Owner->Preambles)
+              Owner->Preambles->setChecksUsePPCallbacks(
+                Owner->Checks, PP.getPPCallbacks() != Callbacks);
+            return Consumer;
           }
 
         private:
-          ClangTidyASTConsumerFactory *Factory;
+          ActionFactory *Owner;
         };
 
+        ClangTidyContext &Context;
         ClangTidyASTConsumerFactory ConsumerFactory;
+        PreambleStore *Preambles;
+        const CommandLineArguments &Args;
+        const std::string &Filename;
+        /// The checks filter of the file being processed.
+        std::string Checks;
       };
 
-      ActionFactory Factory(Context);
+      ActionFactory Factory(Context, Preambles, Command.Args, Command.Filename);
       Tool.run(&Factory);
     }
 
+    /// Runs the checks on \p File with a ClangTidyContext of its own. If
+    /// \p Cache is set, the results are looked up there first and stored
+    /// there when they have to be computed.
+    static ClangTidyFileResults
+    runClangToolOnFile(ClangTidyOptionsProvider &OptionsProvider,
+                       const CompilationDatabase &Compilations,
+                       const std::string &File,
+                       llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                       ProfileData *Profile, ClangTidyResultCache *Cache,
+                       PreambleStore *Preambles) {
+      ClangTidyContext FileContext(
+        llvm::make_unique<SharedOptionsProvider>(OptionsProvider));
+      std::string Key;
+      if (Cache) {
+        Key = ClangTidyResultCache::getKey(
+          File, Compilations.getCompileCommands(File),
+          FileContext.getOptionsForFile(File), FileContext.getGlobalOptions());
+        if (llvm::Optional<ClangTidyFileResults> Results = Cache->lookup(Key))
+          return std::move(*Results);
+      }
+
+      ClangTidyFileResults Results;
+      IntrusiveRefCntPtr<MissingFileRecorder> Missing;
+      if (Cache) {
+        FileContext.setInputRecorder(&Results.Inputs);
+        Missing = new MissingFileRecorder(FS);
+        FS = Missing;
+      }
+      runClangTool(FileContext, Compilations, File, FS, Profile, Preambles);
+      if (Missing)
+        Missing->appendTo(Results.Inputs);
+      Results.Errors = FileContext.getErrors();
+      Results.Stats = FileContext.getStats();
+      if (Cache)
+        Cache->store(Key, Results);
+      return Results;
+    }
+
+    /// Runs the checks on each of \p InputFiles separately, using
+    /// \p NumThreads workers. Each worker takes the next file that nobody
+    /// processes yet. The results are added to \p Context in the order of
+    /// \p InputFiles, so the output doesn't depend on the scheduling.
+    static void runClangToolOnEachFile(
+        ClangTidyContext &Context, const CompilationDatabase &Compilations,
+        ArrayRef<std::string> InputFiles,
+        llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS,
+        ProfileData *Profile, unsigned NumThreads,
+        ClangTidyResultCache *Cache, PreambleStore *Preambles) {
+      std::vector<ClangTidyFileResults> FileResults(InputFiles.size());
+      std::vector<ProfileData> WorkerProfiles(NumThreads);
+      std::atomic<size_t> NextFile(0);
+
+      auto Work = [&](unsigned Worker) {
+        IntrusiveRefCntPtr<vfs::FileSystem> WorkerFS(
+          new WorkingDirectoryFileSystem(BaseFS));
+        for (size_t I = NextFile++; I < InputFiles.size(); I = NextFile++)
+          FileResults[I] = runClangToolOnFile(
+            Context.getOptionsProvider(), Compilations, InputFiles[I],
+            WorkerFS,
+            Profile ? &WorkerProfiles[Worker] : nullptr, Cache, Preambles);
+      };
+
+      {
+        llvm::ThreadPool Pool(NumThreads);
+        for (unsigned Worker = 0; Worker < NumThreads; ++Worker)
+          Pool.async(Work, Worker);
+        Pool.wait();
+      }
+
+      for (const auto &Results : FileResults)
+        Context.addResults(Results.Errors, Results.Stats);
+      if (!Profile)
+        return;
+      for (unsigned Worker = 0; Worker < NumThreads; ++Worker)
+        Profile->merge(std::move(WorkerProfiles[Worker]), Worker);
+    }
+
+    void runClangTidy(clang::tidy::ClangTidyContext &Context,
+                      const CompilationDatabase &Compilations,
+                      ArrayRef<std::string> InputFiles,
+                      llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS,
+                      ProfileData *Profile, unsigned NumThreads,
+                      ClangTidyResultCache *Cache, bool SharePreambles) {
+      if (NumThreads == 0)
+        NumThreads = llvm::hardware_concurrency();
+      NumThreads = std::max<size_t>(
+        std::min<size_t>(NumThreads, InputFiles.size()), 1);
+      PreambleStore Preambles;
+      PreambleStore *SharedPreambles = SharePreambles ? &Preambles : nullptr;
+      if (NumThreads == 1 && !Cache)
+        runClangTool(Context, Compilations, InputFiles, BaseFS, Profile,
+                     SharedPreambles);
+      else
+        runClangToolOnEachFile(Context, Compilations, InputFiles, BaseFS,
+                               Profile, NumThreads, Cache, SharedPreambles);
+      if (Profile && Cache) {
+        Profile->CacheHits = Cache->getHits();
+        Profile->CacheMisses = Cache->getMisses();
+      }
+      if (Profile && SharePreambles) {
+        Profile->PreamblesBuilt = Preambles.getBuilt();
+        Profile->PreamblesReused = Preambles.getReused();
+      }
+      if (Preambles.skippedForPPCallbacks())
+        llvm::errs() << "warning: preambles were not shared for files whose "
+                        "checks use preprocessor callbacks, which would not "
+                        "see the directives of a shared preamble\n";
+    }
+
     void handleErrors(ClangTidyContext &Context, bool Fix,
                       unsigned &WarningsAsErrorsCount,
                       llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS) {
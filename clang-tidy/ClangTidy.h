@@ -188,6 +188,7 @@ protected:
 };
 
 class ClangTidyCheckFactories;
+class ClangTidyResultCache;
 
 class ClangTidyASTConsumerFactory {
 public:
@@ -224,11 +225,21 @@ ClangTidyOptions::OptionMap getCheckOptions(const ClangTidyOptions &Options);
 ///
 /// \param Profile if provided, it enables check profile collection in
 /// MatchFinder, and will contain the result of the profile.
+/// \param NumThreads the number of files to process in parallel, 0 means one
+/// per hardware thread. The collected errors are in the order of
+/// \p InputFiles regardless of this setting.
+/// \param Cache if provided, results of files whose inputs didn't change are
+/// taken from it instead of running the checks, and new results are stored.
+/// \param SharePreambles if true, files starting with the same includes and
+/// compiled with the same command reuse a precompiled preamble of these
+/// includes instead of parsing them again.
 void runClangTidy(clang::tidy::ClangTidyContext &Context,
                   const tooling::CompilationDatabase &Compilations,
                   ArrayRef<std::string> InputFiles,
                   llvm::IntrusiveRefCntPtr<vfs::FileSystem> BaseFS,
-                  ProfileData *Profile = nullptr);
+                  ProfileData *Profile = nullptr, unsigned NumThreads = 1,
+                  ClangTidyResultCache *Cache = nullptr,
+                  bool SharePreambles = false);
 
 // FIXME: This interface will need to be significantly extended to be useful.
 // FIXME: Implement confidence levels for displaying/fixing errors.
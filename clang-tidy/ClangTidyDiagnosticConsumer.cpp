@@ -18,11 +18,15 @@
 
 #include "ClangTidyDiagnosticConsumer.h"
 #include "ClangTidyOptions.h"
+#include "ClangTidyResultCache.h"
 #include "clang/AST/ASTDiagnostic.h"
 #include "clang/Basic/DiagnosticOptions.h"
 #include "clang/Frontend/DiagnosticRenderer.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <cstring>
 #include <tuple>
 #include <vector>
 using namespace clang;
@@ -212,6 +216,7 @@ ClangTidyContext::ClangTidyContext(std::unique_ptr<ClangTidyOptionsProvider> Opt
   : DiagEngine(nullptr),
     OptionsProvider(std::move(OptionsProvider)),
     Profile(nullptr),
+    InputRecorder(nullptr),
     AstContext(nullptr)
 {
   // Before the first translation unit we can get errors related to command-line
@@ -319,9 +324,21 @@ ClangTidyContext::treatAsError(StringRef CheckName) const
 void
 ClangTidyContext::storeError(const ClangTidyError &Error)
 {
+  if (!Error.HeaderKey.empty() &&
+      !ReportedHeaderDiagnostics.insert(Error.HeaderKey).second)
+    return;
   Errors.push_back(Error);
 }
 
+void
+ClangTidyContext::addResults(ArrayRef<ClangTidyError> NewErrors,
+                             const ClangTidyStats &NewStats)
+{
+  for (const ClangTidyError &Error : NewErrors)
+    storeError(Error);
+  Stats += NewStats;
+}
+
 StringRef
 ClangTidyContext::getCheckName(unsigned DiagnosticID) const
 {
@@ -379,110 +396,201 @@ ClangTidyDiagnosticConsumer::finalizeLastError()
   LastErrorPassesLineFilter = false;
 }
 
-static bool
-IsNOLINTFound(StringRef NolintDirectiveText,
-              StringRef Line,
-              unsigned DiagID,
-              const ClangTidyContext &Context)
+NolintDirectives::NolintDirectives(StringRef Buffer)
 {
-  const size_t NolintIndex = Line.find(NolintDirectiveText);
-  if (NolintIndex == StringRef::npos)
-    return false;
-  
-  size_t BracketIndex = NolintIndex + NolintDirectiveText.size();
-  // Check if the specific checks are specified in brackets.
-  if (BracketIndex < Line.size() && Line[BracketIndex] == '(')
+  size_t Pos = Buffer.find("NOLINT");
+  if (Pos == StringRef::npos)
+    return;
+
+  LineStarts.push_back(0);
+  for (size_t I = 0, E = Buffer.size(); I < E; ++I)
+    if (Buffer[I] == '\n')
+      LineStarts.push_back(I + 1);
+
+  std::vector<Directive> OpenRanges;
+  for (; Pos != StringRef::npos; Pos = Buffer.find("NOLINT", Pos + 1))
     {
-      ++BracketIndex;
-      const size_t BracketEndIndex = Line.find(')', BracketIndex);
-      if (BracketEndIndex != StringRef::npos)
+      enum { OnLine, OnNextLine, Begin, End } Kind = OnLine;
+      StringRef Rest = Buffer.substr(Pos + strlen("NOLINT"));
+      size_t ChecksPos = Pos + strlen("NOLINT");
+      if (Rest.startswith("NEXTLINE"))
+        {
+          Kind = OnNextLine;
+          ChecksPos += strlen("NEXTLINE");
+        }
+      else if (Rest.startswith("BEGIN"))
+        {
+          Kind = Begin;
+          ChecksPos += strlen("BEGIN");
+        }
+      else if (Rest.startswith("END"))
+        {
+          Kind = End;
+          ChecksPos += strlen("END");
+        }
+
+      unsigned Line = getLine(Pos);
+      size_t LineEnd = Buffer.find_first_of("\r\n", Pos);
+      if (LineEnd == StringRef::npos)
+        LineEnd = Buffer.size();
+
+      Directive D;
+      D.Offset = Pos;
+      D.AllChecks = true;
+      // Check if the specific checks are specified in brackets. Without the
+      // closing bracket, all checks are suppressed.
+      if (ChecksPos < LineEnd && Buffer[ChecksPos] == '(')
         {
-          StringRef ChecksStr =
-            Line.substr(BracketIndex, BracketEndIndex - BracketIndex);
-          // Allow disabling all the checks with "*".
-          if (ChecksStr != "*")
+          size_t ChecksEnd = Buffer.find(')', ChecksPos + 1);
+          if (ChecksEnd < LineEnd)
             {
-              StringRef CheckName = Context.getCheckName(DiagID);
-              // Allow specifying a few check names, delimited with comma.
-              SmallVector<StringRef, 1> Checks;
-              ChecksStr.split(Checks, ',', -1, false);
-              llvm::transform(Checks,
-                              Checks.begin(),
-                              [](StringRef S)
-                              {
-                                return S.trim();
-                              });
-              return llvm::find(Checks, CheckName) != Checks.end();
+              StringRef ChecksStr = Buffer.slice(ChecksPos + 1, ChecksEnd);
+              // Allow disabling all the checks with "*".
+              if (ChecksStr.trim() != "*")
+                {
+                  D.AllChecks = false;
+                  // Allow specifying a few check names, delimited with comma.
+                  SmallVector<StringRef, 1> Checks;
+                  ChecksStr.split(Checks, ',', -1, false);
+                  for (StringRef Check : Checks)
+                    D.Checks.push_back(Check.trim().str());
+                }
             }
         }
+
+      switch (Kind)
+        {
+        case OnLine:
+          SameLine[Line].push_back(std::move(D));
+          break;
+        case OnNextLine:
+          NextLine.insert(std::make_pair(Line + 1, std::move(D)));
+          break;
+        case Begin:
+          OpenRanges.push_back(std::move(D));
+          break;
+        case End:
+          // Close the innermost range suppressing the same checks.
+          for (auto It = OpenRanges.rbegin(); It != OpenRanges.rend(); ++It)
+            {
+              if (!It->hasSameChecks(D))
+                continue;
+              Ranges.emplace_back(std::move(*It), Pos);
+              OpenRanges.erase(std::next(It).base());
+              break;
+            }
+          break;
+        }
+    }
+
+  // Ranges are closed in the order of their NOLINTEND, look them up by their
+  // NOLINTBEGIN instead.
+  std::sort(Ranges.begin(), Ranges.end(),
+            [](const std::pair<Directive, unsigned> &LHS,
+               const std::pair<Directive, unsigned> &RHS) {
+              return LHS.first.Offset < RHS.first.Offset;
+            });
+  unsigned MaxEnd = 0;
+  for (const auto &Range : Ranges)
+    {
+      MaxEnd = std::max(MaxEnd, Range.second);
+      RangeEnds.push_back(MaxEnd);
     }
-  return true;
 }
 
-static bool
-LineIsMarkedWithNOLINT(SourceManager &SM,
-                       SourceLocation Loc,
-                       unsigned DiagID,
-                       const ClangTidyContext &Context)
+bool
+NolintDirectives::suppresses(unsigned Offset, StringRef CheckName) const
 {
-  bool Invalid;
-  const char *CharacterData = SM.getCharacterData(Loc, &Invalid);
-  if (Invalid)
+  if (LineStarts.empty())
     return false;
-  
-  // Check if there's a NOLINT on this line.
-  const char *P = CharacterData;
-  while (*P != '\0' && *P != '\r' && *P != '\n')
-    ++P;
-  StringRef RestOfLine(CharacterData, P - CharacterData + 1);
-  if (IsNOLINTFound("NOLINT", RestOfLine, DiagID, Context))
+  unsigned Line = getLine(Offset);
+
+  // Only a NOLINT after the location of the diagnostic applies to it, and only
+  // the first one is considered.
+  auto OnLine = SameLine.find(Line);
+  if (OnLine != SameLine.end())
+    for (const Directive &D : OnLine->second)
+      if (D.Offset >= Offset)
+        {
+          if (D.appliesTo(CheckName))
+            return true;
+          break;
+        }
+
+  auto OnPreviousLine = NextLine.find(Line);
+  if (OnPreviousLine != NextLine.end() &&
+      OnPreviousLine->second.appliesTo(CheckName))
     return true;
-  
-  // Check if there's a NOLINTNEXTLINE on the previous line.
-  const char *BufBegin =
-    SM.getCharacterData(SM.getLocForStartOfFile(SM.getFileID(Loc)), &Invalid);
-  if (Invalid || P == BufBegin)
-    return false;
 
-  // Scan backwards over the current line.
-  P = CharacterData;
-  while (P != BufBegin && *P != '\n')
-    --P;
-  
-  // If we reached the begin of the file there is no line before it.
-  if (P == BufBegin)
-    return false;
+  // Walk back from the last range starting at or before Offset, until no
+  // range before can extend to it.
+  auto StartsAfter = std::upper_bound(
+    Ranges.begin(), Ranges.end(), Offset,
+    [](unsigned Pos, const std::pair<Directive, unsigned> &Range) {
+      return Pos < Range.first.Offset;
+    });
+  for (size_t I = StartsAfter - Ranges.begin();
+       I > 0 && RangeEnds[I - 1] >= Offset; --I)
+    if (Ranges[I - 1].second >= Offset &&
+        Ranges[I - 1].first.appliesTo(CheckName))
+      return true;
+  return false;
+}
 
-  // Skip over the newline.
-  --P;
-  const char *LineEnd = P;
+bool
+NolintDirectives::Directive::appliesTo(StringRef CheckName) const
+{
+  return AllChecks || llvm::find(Checks, CheckName) != Checks.end();
+}
 
-  // Now we're on the previous line. Skip to the beginning of it.
-  while (P != BufBegin && *P != '\n')
-    --P;
+bool
+NolintDirectives::Directive::hasSameChecks(const Directive &Other) const
+{
+  if (AllChecks || Other.AllChecks)
+    return AllChecks == Other.AllChecks;
+  return Checks == Other.Checks;
+}
 
-  RestOfLine = StringRef(P, LineEnd - P + 1);
-  if (IsNOLINTFound("NOLINTNEXTLINE", RestOfLine, DiagID, Context))
-    return true;
-  
-  return false;
+unsigned
+NolintDirectives::getLine(unsigned Offset) const
+{
+  return std::upper_bound(LineStarts.begin(), LineStarts.end(), Offset) -
+         LineStarts.begin();
+}
+
+const NolintDirectives *
+ClangTidyDiagnosticConsumer::getNolintDirectives(const SourceManager &Sources,
+                                                 FileID File)
+{
+  auto It = NolintCache.find(File);
+  if (It != NolintCache.end())
+    return It->second.get();
+  std::unique_ptr<NolintDirectives> &Directives = NolintCache[File];
+  bool Invalid = false;
+  StringRef Buffer = Sources.getBufferData(File, &Invalid);
+  if (!Invalid)
+    Directives = llvm::make_unique<NolintDirectives>(Buffer);
+  return Directives.get();
 }
 
-static bool
-LineIsMarkedWithNOLINTinMacro(SourceManager &SM,
-                              SourceLocation Loc,
-                              unsigned DiagID,
-                              const ClangTidyContext &Context)
+bool
+ClangTidyDiagnosticConsumer::isSuppressedByNOLINT(const SourceManager &Sources,
+                                                  SourceLocation Location,
+                                                  unsigned DiagID)
 {
+  StringRef CheckName = Context.getCheckName(DiagID);
   while (true)
     {
-      if (LineIsMarkedWithNOLINT(SM, Loc, DiagID, Context))
+      std::pair<FileID, unsigned> Spelling =
+        Sources.getDecomposedSpellingLoc(Location);
+      const NolintDirectives *Directives =
+        getNolintDirectives(Sources, Spelling.first);
+      if (Directives && Directives->suppresses(Spelling.second, CheckName))
         return true;
-      if (!Loc.isMacroID())
+      if (!Location.isMacroID())
         return false;
-      Loc = SM.getImmediateExpansionRange(Loc).first;
+      Location = Sources.getImmediateExpansionRange(Location).first;
     }
-  return false;
 }
 
 void
@@ -495,10 +603,8 @@ ClangTidyDiagnosticConsumer::HandleDiagnostic(DiagnosticsEngine::Level DiagLevel
   if (Info.getLocation().isValid() &&
       DiagLevel != DiagnosticsEngine::Error &&
       DiagLevel != DiagnosticsEngine::Fatal &&
-      LineIsMarkedWithNOLINTinMacro(Diags->getSourceManager(),
-                                    Info.getLocation(),
-                                    Info.getID(),
-                                    Context))
+      isSuppressedByNOLINT(Diags->getSourceManager(), Info.getLocation(),
+                           Info.getID()))
     {
       ++Context.Stats.ErrorsIgnoredNOLINT;
       // Ignored a warning, should ignore related notes as well
@@ -571,10 +677,63 @@ ClangTidyDiagnosticConsumer::HandleDiagnostic(DiagnosticsEngine::Level DiagLevel
     : FullSourceLoc(Info.getLocation(), Info.getSourceManager());
   Converter.emitDiagnostic(Loc, DiagLevel, Message, Info.getRanges(),
                            Info.getFixItHints());
+  if (DiagLevel != DiagnosticsEngine::Note && Loc.isValid())
+    recordHeaderContents(Info.getSourceManager(), Info.getLocation());
   
   checkFilters(Info.getLocation());
 }
 
+void
+ClangTidyDiagnosticConsumer::recordHeaderContents(const SourceManager &Sources,
+                                                  SourceLocation Location)
+{
+  // The diagnostic is reported at the file location, see DiagnosticRenderer.
+  FileID FID = Sources.getFileID(Sources.getFileLoc(Location));
+  const FileEntry *File = Sources.getFileEntryForID(FID);
+  if (!File || FID == Sources.getMainFileID() ||
+      HeaderHashes.count(File->getName()))
+    return;
+  bool Invalid = false;
+  StringRef Contents = Sources.getBufferData(FID, &Invalid);
+  if (!Invalid)
+    HeaderHashes[File->getName()] = ClangTidyResultCache::digest(Contents);
+}
+
+void
+ClangTidyDiagnosticConsumer::setHeaderKeys(
+  SmallVectorImpl<ClangTidyError> &Errors) const
+{
+  if (HeaderHashes.empty())
+    return;
+  // Checks and their options may change the diagnostics and fixes, only
+  // deduplicate diagnostics found with the same configuration.
+  const ClangTidyOptions &Options = Context.getOptions();
+  std::string Config;
+  llvm::raw_string_ostream ConfigOS(Config);
+  ConfigOS << *Options.Checks << '\0' << *Options.WarningsAsErrors;
+  for (const auto &Option : Options.CheckOptions)
+    ConfigOS << '\0' << Option.first << '\0' << Option.second;
+  std::string ConfigHash = ClangTidyResultCache::digest(ConfigOS.str());
+
+  for (ClangTidyError &Error : Errors)
+    {
+      const tooling::DiagnosticMessage &Message = Error.Message;
+      auto It = HeaderHashes.find(Message.FilePath);
+      if (It == HeaderHashes.end())
+        continue;
+      std::string Key;
+      llvm::raw_string_ostream OS(Key);
+      // Relative paths are only the same file in the same build directory.
+      if (!llvm::sys::path::is_absolute(Message.FilePath))
+        OS << Error.BuildDirectory << '\0';
+      OS << Message.FilePath << '\0' << It->second << '\0' << ConfigHash
+         << '\0' << Message.FileOffset << '\0' << Error.DiagnosticName << '\0'
+         << Message.Message;
+      // Keys are kept for many diagnostics, only store a digest.
+      Error.HeaderKey = ClangTidyResultCache::digest(OS.str());
+    }
+}
+
 bool
 ClangTidyDiagnosticConsumer::passesLineFilter(StringRef FileName,
                                               unsigned LineNumber) const
@@ -821,8 +980,11 @@ ClangTidyDiagnosticConsumer::finish()
   
   if (RemoveIncompatibleErrors)
     removeIncompatibleErrors(Errors);
+  setHeaderKeys(Errors);
   
   for (const ClangTidyError &Error : Errors)
     Context.storeError(Error);
   Errors.clear();
+  HeaderHashes.clear();
+  NolintCache.clear();
 }
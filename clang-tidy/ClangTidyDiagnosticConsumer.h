@@ -11,6 +11,7 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYDIAGNOSTICCONSUMER_H
 
 #include "ClangTidyOptions.h"
+#include "ClangTidyProfiling.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/Basic/SourceManager.h"
 #include "clang/Tooling/Core/Diagnostic.h"
@@ -19,8 +20,8 @@
 #include "clang/Frontend/CompilerInstance.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/Support/Regex.h"
-#include "llvm/Support/Timer.h"
 
 using namespace clang::tooling;
 
@@ -49,6 +50,14 @@ struct ClangTidyError : tooling::Diagnostic {
                  bool IsWarningAsError);
 
   bool IsWarningAsError;
+
+  /// \brief Identifies a diagnostic in a header: its location and message, the
+  /// contents of the header and the configuration it was found with. Empty for
+  /// diagnostics outside of headers.
+  ///
+  /// Headers included by many translation units produce the same diagnostics
+  /// in each of them, the \c ClangTidyContext only keeps the first one.
+  std::string HeaderKey;
 };
 
 /// \brief Read-only set of strings represented as a list of positive and
@@ -72,6 +81,49 @@ private:
   std::unique_ptr<GlobList> NextGlob;
 };
 
+/// \brief The NOLINT comments of a file, indexed so that checking whether a
+/// diagnostic is suppressed doesn't need to scan the source again.
+///
+/// Recognizes NOLINT (suppresses diagnostics on the rest of its line),
+/// NOLINTNEXTLINE (on the next line) and NOLINTBEGIN/NOLINTEND pairs (between
+/// them). Each can be followed by a parenthesized, comma-separated list of the
+/// suppressed checks. An unmatched NOLINTBEGIN or NOLINTEND has no effect.
+class NolintDirectives {
+public:
+  /// \brief Scans \p Buffer, the contents of a file.
+  explicit NolintDirectives(StringRef Buffer);
+
+  /// \brief Returns \c true if a diagnostic of the check \p CheckName at
+  /// \p Offset in the file is suppressed.
+  bool suppresses(unsigned Offset, StringRef CheckName) const;
+
+private:
+  struct Directive {
+    unsigned Offset;
+    bool AllChecks;
+    std::vector<std::string> Checks;
+
+    bool appliesTo(StringRef CheckName) const;
+    bool hasSameChecks(const Directive &Other) const;
+  };
+
+  unsigned getLine(unsigned Offset) const;
+
+  /// \brief Offsets of the line starts, only computed if there are directives.
+  std::vector<unsigned> LineStarts;
+  /// \brief NOLINT comments by line, in the order of appearance.
+  llvm::DenseMap<unsigned, SmallVector<Directive, 1>> SameLine;
+  /// \brief The first NOLINTNEXTLINE comment of each line, by the line it
+  /// applies to.
+  llvm::DenseMap<unsigned, Directive> NextLine;
+  /// \brief Matched NOLINTBEGIN comments and the offsets of their NOLINTEND,
+  /// sorted by the offset of the NOLINTBEGIN.
+  std::vector<std::pair<Directive, unsigned>> Ranges;
+  /// \brief The largest NOLINTEND offset of each prefix of \c Ranges, so that
+  /// lookups stop at the first range before which none can contain an offset.
+  std::vector<unsigned> RangeEnds;
+};
+
 /// \brief Contains displayed and ignored diagnostic counters for a ClangTidy
 /// run.
 struct ClangTidyStats {
@@ -89,11 +141,24 @@ struct ClangTidyStats {
     return ErrorsIgnoredNOLINT + ErrorsIgnoredCheckFilter +
            ErrorsIgnoredNonUserCode + ErrorsIgnoredLineFilter;
   }
+
+  ClangTidyStats &operator+=(const ClangTidyStats &Other) {
+    ErrorsDisplayed += Other.ErrorsDisplayed;
+    ErrorsIgnoredCheckFilter += Other.ErrorsIgnoredCheckFilter;
+    ErrorsIgnoredNOLINT += Other.ErrorsIgnoredNOLINT;
+    ErrorsIgnoredNonUserCode += Other.ErrorsIgnoredNonUserCode;
+    ErrorsIgnoredLineFilter += Other.ErrorsIgnoredLineFilter;
+    return *this;
+  }
 };
 
-/// \brief Container for clang-tidy profiling data.
-struct ProfileData {
-  llvm::StringMap<llvm::TimeRecord> Records;
+/// \brief A file read, or looked up but not found, while processing a
+/// translation unit.
+struct ClangTidyInput {
+  /// \brief Absolute path of the file.
+  std::string Path;
+  /// \brief Hex MD5 digest of the file contents, empty if it didn't exist.
+  std::string Digest;
 };
 
 /// \brief Every \c ClangTidyCheck reports errors through a \c DiagnosticsEngine
@@ -197,6 +262,15 @@ public:
   /// \brief Clears collected errors.
   void clearErrors() { Errors.clear(); }
 
+  /// \brief Appends \p Errors and adds \p Stats to the results of this
+  /// context, e.g. the results of a context that processed some of the files
+  /// on another thread. Header diagnostics that were already collected are
+  /// skipped.
+  void addResults(ArrayRef<ClangTidyError> Errors, const ClangTidyStats &Stats);
+
+  /// \brief Returns the provider used to get the options for each file.
+  ClangTidyOptionsProvider &getOptionsProvider() { return *OptionsProvider; }
+
   /// \brief Set the output struct for profile data.
   ///
   /// Setting a non-null pointer here will enable profile collection in
@@ -204,6 +278,15 @@ public:
   void setCheckProfileData(ProfileData *Profile);
   ProfileData *getCheckProfileData() const { return Profile; }
 
+  /// \brief If \p Inputs is not null, the files read by the translation units
+  /// processed from now on are appended to it.
+  void setInputRecorder(std::vector<ClangTidyInput> *Inputs) {
+    InputRecorder = Inputs;
+  }
+  std::vector<ClangTidyInput> *getInputRecorder() const {
+    return InputRecorder;
+  }
+
   /// \brief Should be called when starting to process new translation unit.
   void setCurrentBuildDirectory(StringRef BuildDirectory) {
     CurrentBuildDirectory = BuildDirectory;
@@ -232,6 +315,9 @@ private:
   void storeError(const ClangTidyError &Error);
 
   std::vector<ClangTidyError> Errors;
+  /// \brief HeaderKeys of the collected header diagnostics, including the ones
+  /// removed by clearErrors().
+  llvm::StringSet<> ReportedHeaderDiagnostics;
   DiagnosticsEngine *DiagEngine;
   std::unique_ptr<ClangTidyOptionsProvider> OptionsProvider;
 
@@ -250,6 +336,7 @@ private:
   llvm::DenseMap<unsigned, std::string> CheckNamesByDiagnosticID;
 
   ProfileData *Profile;
+  std::vector<ClangTidyInput> *InputRecorder;
   ASTContext *AstContext;
   ClangTool *m_tool;
   CompilerInstance* TheCompilerInstance;
@@ -279,6 +366,24 @@ private:
 
   void removeIncompatibleErrors(SmallVectorImpl<ClangTidyError> &Errors) const;
 
+  /// \brief Remembers the contents of the header \p Location is in, so that
+  /// its diagnostics can be recognized in other translation units.
+  void recordHeaderContents(const SourceManager &Sources,
+                            SourceLocation Location);
+
+  /// \brief Returns \c true if a NOLINT comment suppresses the diagnostic
+  /// \p DiagID at \p Location or anywhere in its macro expansion chain.
+  bool isSuppressedByNOLINT(const SourceManager &Sources,
+                            SourceLocation Location, unsigned DiagID);
+
+  /// \brief Returns the NOLINT comments of \p File, scanning it the first
+  /// time. Null if the file can't be read.
+  const NolintDirectives *getNolintDirectives(const SourceManager &Sources,
+                                              FileID File);
+
+  /// \brief Sets the \c HeaderKey of the \p Errors reported in headers.
+  void setHeaderKeys(SmallVectorImpl<ClangTidyError> &Errors) const;
+
   /// \brief Returns the \c HeaderFilter constructed for the options set in the
   /// context.
   llvm::Regex *getHeaderFilter();
@@ -293,6 +398,11 @@ private:
   std::unique_ptr<DiagnosticsEngine> Diags;
   SmallVector<ClangTidyError, 8> Errors;
   std::unique_ptr<llvm::Regex> HeaderFilter;
+  /// \brief Content digests of the headers with diagnostics in the current
+  /// translation unit, by file name.
+  llvm::StringMap<std::string> HeaderHashes;
+  /// \brief The NOLINT comments of the files of the current translation unit.
+  llvm::DenseMap<FileID, std::unique_ptr<NolintDirectives>> NolintCache;
   bool LastErrorRelatesToUserCode;
   bool LastErrorPassesLineFilter;
   bool LastErrorWasIgnored;
@@ -208,7 +208,9 @@ FileOptionsProvider::FileOptionsProvider(
     const ClangTidyOptions &OverrideOptions,
     llvm::IntrusiveRefCntPtr<vfs::FileSystem> VFS)
     : DefaultOptionsProvider(GlobalOptions, DefaultOptions),
-      OverrideOptions(OverrideOptions), FS(std::move(VFS)) {
+      OverrideOptions(OverrideOptions), FS(std::move(VFS)),
+      NoConfigOptions(DefaultOptions.mergeWith(OverrideOptions)),
+      RevalidationInterval(std::chrono::seconds(5)) {
   if (!FS)
     FS = vfs::getRealFileSystem();
   ConfigHandlers.emplace_back(".clang-tidy", parseConfiguration);
@@ -220,11 +222,11 @@ FileOptionsProvider::FileOptionsProvider(
     const ClangTidyOptions &OverrideOptions,
     const FileOptionsProvider::ConfigFileHandlers &ConfigHandlers)
     : DefaultOptionsProvider(GlobalOptions, DefaultOptions),
-      OverrideOptions(OverrideOptions), ConfigHandlers(ConfigHandlers) {}
+      OverrideOptions(OverrideOptions), ConfigHandlers(ConfigHandlers),
+      FS(vfs::getRealFileSystem()),
+      NoConfigOptions(DefaultOptions.mergeWith(OverrideOptions)),
+      RevalidationInterval(std::chrono::seconds(5)) {}
 
-// FIXME: This method has some common logic with clang::format::getStyle().
-// Consider pulling out common bits to a findParentFileWithName function or
-// similar.
 std::vector<OptionsSource>
 FileOptionsProvider::getRawOptions(StringRef FileName) {
   DEBUG(llvm::dbgs() << "Getting options for file " << FileName << "...\n");
@@ -237,45 +239,102 @@ FileOptionsProvider::getRawOptions(StringRef FileName) {
 
   std::vector<OptionsSource> RawOptions =
       DefaultOptionsProvider::getRawOptions(AbsoluteFilePath.str());
-  OptionsSource CommandLineOptions(OverrideOptions,
-                                   OptionsSourceTypeCheckCommandLineOption);
-  // Look for a suitable configuration file in all parent directories of the
-  // file. Start with the immediate parent directory and move up.
-  StringRef Path = llvm::sys::path::parent_path(AbsoluteFilePath.str());
-  for (StringRef CurrentPath = Path; !CurrentPath.empty();
-       CurrentPath = llvm::sys::path::parent_path(CurrentPath)) {
-    llvm::Optional<OptionsSource> Result;
+  if (std::shared_ptr<const ParsedConfig> Config =
+          findConfig(llvm::sys::path::parent_path(AbsoluteFilePath.str())))
+    RawOptions.push_back(Config->Source);
+  RawOptions.emplace_back(OverrideOptions,
+                          OptionsSourceTypeCheckCommandLineOption);
+  return RawOptions;
+}
 
-    auto Iter = CachedOptions.find(CurrentPath);
-    if (Iter != CachedOptions.end())
-      Result = Iter->second;
+ClangTidyOptions FileOptionsProvider::getOptions(StringRef FileName) {
+  llvm::SmallString<128> AbsoluteFilePath(FileName);
+  if (FS->makeAbsolute(AbsoluteFilePath))
+    return ClangTidyOptions();
+  if (std::shared_ptr<const ParsedConfig> Config =
+          findConfig(llvm::sys::path::parent_path(AbsoluteFilePath.str())))
+    return Config->Options;
+  return NoConfigOptions;
+}
 
-    if (!Result)
-      Result = tryReadConfigFile(CurrentPath);
+// FIXME: This method has some common logic with clang::format::getStyle().
+// Consider pulling out common bits to a findParentFileWithName function or
+// similar.
+std::shared_ptr<const FileOptionsProvider::ParsedConfig>
+FileOptionsProvider::findConfig(StringRef Directory) {
+  std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+  std::shared_ptr<const ParsedConfig> Result;
+  {
+    llvm::sys::ScopedReader Lock(Mutex);
+    if (lookupConfig(Directory, Now, /*Update=*/false, Result))
+      return Result;
+  }
+  llvm::sys::ScopedWriter Lock(Mutex);
+  lookupConfig(Directory, Now, /*Update=*/true, Result);
+  return Result;
+}
 
-    if (Result) {
-      // Store cached value for all intermediate directories.
-      while (Path != CurrentPath) {
-        DEBUG(llvm::dbgs() << "Caching configuration for path " << Path
+bool FileOptionsProvider::lookupConfig(
+    StringRef Directory, std::chrono::steady_clock::time_point Now, bool Update,
+    std::shared_ptr<const ParsedConfig> &Result) {
+  // Look for a suitable configuration file in all parent directories of the
+  // file. Start with the immediate parent directory and move up.
+  for (StringRef CurrentPath = Directory; !CurrentPath.empty();
+       CurrentPath = llvm::sys::path::parent_path(CurrentPath)) {
+    auto Iter = Directories.find(CurrentPath);
+    if (Iter == Directories.end() ||
+        Now - Iter->second.Validated > RevalidationInterval) {
+      if (!Update)
+        return false;
+      std::string Signature = getSignature(CurrentPath);
+      auto Inserted = Directories.insert({CurrentPath, DirectoryConfig()});
+      Iter = Inserted.first;
+      DirectoryConfig &Entry = Iter->second;
+      if (Inserted.second || Entry.Signature != Signature) {
+        DEBUG(llvm::dbgs() << "Reading configuration for path " << CurrentPath
                            << ".\n");
-        CachedOptions[Path] = *Result;
-        Path = llvm::sys::path::parent_path(Path);
+        Entry.Config = nullptr;
+        if (llvm::Optional<OptionsSource> Source =
+                tryReadConfigFile(CurrentPath)) {
+          ClangTidyOptions Options = DefaultOptions.mergeWith(Source->first)
+                                         .mergeWith(OverrideOptions);
+          Entry.Config = std::make_shared<ParsedConfig>(
+              ParsedConfig{std::move(*Source), std::move(Options)});
+        }
+        Entry.Signature = std::move(Signature);
       }
-      CachedOptions[Path] = *Result;
-
-      RawOptions.push_back(*Result);
-      break;
+      Entry.Validated = Now;
+    }
+    if (Iter->second.Config) {
+      Result = Iter->second.Config;
+      return true;
     }
   }
-  RawOptions.push_back(CommandLineOptions);
-  return RawOptions;
+  Result = nullptr;
+  return true;
+}
+
+std::string FileOptionsProvider::getSignature(StringRef Directory) {
+  std::string Signature;
+  llvm::raw_string_ostream OS(Signature);
+  for (const ConfigFileHandler &ConfigHandler : ConfigHandlers) {
+    SmallString<128> ConfigFile(Directory);
+    llvm::sys::path::append(ConfigFile, ConfigHandler.first);
+    llvm::ErrorOr<vfs::Status> Status = FS->status(ConfigFile);
+    if (Status && Status->isRegularFile())
+      OS << Status->getSize() << ':'
+         << Status->getLastModificationTime().time_since_epoch().count();
+    OS << ';';
+  }
+  return OS.str();
 }
 
 llvm::Optional<OptionsSource>
 FileOptionsProvider::tryReadConfigFile(StringRef Directory) {
   assert(!Directory.empty());
 
-  if (!llvm::sys::fs::is_directory(Directory)) {
+  llvm::ErrorOr<vfs::Status> DirectoryStatus = FS->status(Directory);
+  if (!DirectoryStatus || !DirectoryStatus->isDirectory()) {
     llvm::errs() << "Error reading configuration from " << Directory
                  << ": directory doesn't exist.\n";
     return llvm::None;
@@ -289,15 +348,14 @@ FileOptionsProvider::tryReadConfigFile(StringRef Directory) {
     Lllvm::outs() << "Trying " << ConfigFile << "...\n";
 #endif
 
-    bool IsFile = false;
-    // Ignore errors from is_regular_file: we only need to know if we can read
-    // the file or not.
-    llvm::sys::fs::is_regular_file(Twine(ConfigFile), IsFile);
-    if (!IsFile)
+    // Ignore errors from status: we only need to know if we can read the file
+    // or not.
+    llvm::ErrorOr<vfs::Status> Status = FS->status(ConfigFile);
+    if (!Status || !Status->isRegularFile())
       continue;
 
     llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Text =
-        llvm::MemoryBuffer::getFile(ConfigFile.c_str());
+        FS->getBufferForFile(ConfigFile);
     if (std::error_code EC = Text.getError()) {
       llvm::errs() << "Can't read " << ConfigFile << ": " << EC.message()
                    << "\n";
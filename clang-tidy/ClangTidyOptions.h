@@ -15,8 +15,11 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/IntrusiveRefCntPtr.h"
 #include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/RWMutex.h"
 #include "clang/Basic/VirtualFileSystem.h"
+#include <chrono>
 #include <functional>
+#include <memory>
 #include <map>
 #include <string>
 #include <system_error>
@@ -117,6 +120,9 @@ struct ClangTidyOptions {
 };
 
 /// \brief Abstract interface for retrieving various ClangTidy options.
+///
+/// \c runClangTidy calls the provider from several threads when it processes
+/// files in parallel, so implementations need to be thread-safe.
 class ClangTidyOptionsProvider {
 public:
   static const char OptionsSourceTypeDefaultBinary[];
@@ -145,7 +151,9 @@ public:
 
   /// \brief Returns options applying to a specific translation unit with the
   /// specified \p FileName.
-  ClangTidyOptions getOptions(llvm::StringRef FileName);
+  ///
+  /// The default implementation merges the result of \c getRawOptions.
+  virtual ClangTidyOptions getOptions(llvm::StringRef FileName);
 };
 
 /// \brief Implementation of the \c ClangTidyOptionsProvider interface, which
@@ -160,7 +168,7 @@ public:
   }
   std::vector<OptionsSource> getRawOptions(llvm::StringRef FileName) override;
 
-private:
+protected:
   ClangTidyGlobalOptions GlobalOptions;
   ClangTidyOptions DefaultOptions;
 };
@@ -188,6 +196,11 @@ private:
 /// \c clang::tidy::parseConfiguration function will be used for parsing, but a
 /// custom set of configuration file names and parsing functions can be
 /// specified using the appropriate constructor.
+///
+/// The configuration of each directory is read once, and the options of each
+/// configuration file are merged once. Configuration files are checked for
+/// changes when they are used after the revalidation interval, so that
+/// long-running tools see the edits. This class is thread-safe.
 class FileOptionsProvider : public DefaultOptionsProvider {
 public:
   // \brief A pair of configuration file base name and a function parsing
@@ -254,15 +267,60 @@ public:
 
   std::vector<OptionsSource> getRawOptions(llvm::StringRef FileName) override;
 
+  ClangTidyOptions getOptions(llvm::StringRef FileName) override;
+
+  /// \brief Sets how long configuration files are assumed not to change after
+  /// they were checked. Changes are detected by comparing the size and the
+  /// modification time of the files. The default is 5 seconds, 0 checks them
+  /// every time they are used.
+  void setRevalidationInterval(std::chrono::milliseconds Interval) {
+    RevalidationInterval = Interval;
+  }
+
 protected:
   /// \brief Try to read configuration files from \p Directory using registered
   /// \c ConfigHandlers.
   llvm::Optional<OptionsSource> tryReadConfigFile(llvm::StringRef Directory);
 
-  llvm::StringMap<OptionsSource> CachedOptions;
   ClangTidyOptions OverrideOptions;
   ConfigFileHandlers ConfigHandlers;
   llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS;
+
+private:
+  /// \brief A configuration file, and the options it results in.
+  struct ParsedConfig {
+    OptionsSource Source;
+    ClangTidyOptions Options;
+  };
+
+  /// \brief The configuration file found in a directory, if any.
+  struct DirectoryConfig {
+    std::shared_ptr<const ParsedConfig> Config;
+    /// \brief The sizes and modification times of the configuration files
+    /// when they were read.
+    std::string Signature;
+    std::chrono::steady_clock::time_point Validated;
+  };
+
+  /// \brief Returns the configuration file closest to \p Directory, if any.
+  std::shared_ptr<const ParsedConfig> findConfig(llvm::StringRef Directory);
+
+  /// \brief Walks up from \p Directory to the closest configuration file. If
+  /// \p Update is false, returns false when a directory needs to be checked.
+  /// Otherwise \c Mutex must be held for writing.
+  bool lookupConfig(llvm::StringRef Directory,
+                    std::chrono::steady_clock::time_point Now, bool Update,
+                    std::shared_ptr<const ParsedConfig> &Result);
+
+  /// \brief Returns the sizes and modification times of the configuration
+  /// files in \p Directory.
+  std::string getSignature(llvm::StringRef Directory);
+
+  llvm::sys::RWMutex Mutex;
+  llvm::StringMap<DirectoryConfig> Directories;
+  /// \brief The options of files without a configuration file.
+  ClangTidyOptions NoConfigOptions;
+  std::chrono::milliseconds RevalidationInterval;
 };
 
 /// \brief Parses LineFilter from JSON and stores it to the \p Options.
@@ -0,0 +1,161 @@
+//===--- ClangTidyProfiling.cpp - clang-tidy --------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyProfiling.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace llvm;
+
+namespace clang {
+namespace tidy {
+
+void ProfileData::addTranslationUnit(TranslationUnitProfile Profile) {
+  for (const auto &Check : Profile.Checks)
+    Records[Check.getKey()] += Check.getValue();
+  TranslationUnits.push_back(std::move(Profile));
+}
+
+void ProfileData::merge(ProfileData Other, unsigned Thread) {
+  for (const auto &Record : Other.Records)
+    Records[Record.getKey()] += Record.getValue();
+  for (auto &Profile : Other.TranslationUnits) {
+    Profile.Thread = Thread;
+    TranslationUnits.push_back(std::move(Profile));
+  }
+  CacheHits += Other.CacheHits;
+  CacheMisses += Other.CacheMisses;
+  PreamblesBuilt += Other.PreamblesBuilt;
+  PreamblesReused += Other.PreamblesReused;
+}
+
+static void writeString(raw_ostream &OS, StringRef Str) {
+  OS << '"';
+  for (unsigned char C : Str) {
+    if (C == '"' || C == '\\')
+      OS << '\\' << C;
+    else if (C < 0x20)
+      OS << format("\\u%04x", C);
+    else
+      OS << C;
+  }
+  OS << '"';
+}
+
+static void writeTime(raw_ostream &OS, const TimeRecord &Time) {
+  OS << format("{\"wall\": %.6f, \"user\": %.6f, \"sys\": %.6f}",
+               Time.getWallTime(), Time.getUserTime(), Time.getSystemTime());
+}
+
+// Writes the check times as an object sorted by check name, so that the output
+// is stable.
+static void writeChecks(raw_ostream &OS,
+                        const StringMap<TimeRecord> &Checks, StringRef Indent) {
+  std::vector<StringRef> Names;
+  for (const auto &Check : Checks)
+    Names.push_back(Check.getKey());
+  std::sort(Names.begin(), Names.end());
+  OS << '{';
+  for (size_t I = 0; I < Names.size(); ++I) {
+    OS << (I ? ",\n" : "\n") << Indent << "  ";
+    writeString(OS, Names[I]);
+    OS << ": ";
+    writeTime(OS, Checks.lookup(Names[I]));
+  }
+  if (!Names.empty())
+    OS << '\n' << Indent;
+  OS << '}';
+}
+
+static std::vector<const TranslationUnitProfile *>
+sortedByStart(const ProfileData &Profile) {
+  std::vector<const TranslationUnitProfile *> Result;
+  for (const auto &TU : Profile.TranslationUnits)
+    Result.push_back(&TU);
+  std::stable_sort(Result.begin(), Result.end(),
+                   [](const TranslationUnitProfile *A,
+                      const TranslationUnitProfile *B) {
+                     return A->Start < B->Start;
+                   });
+  return Result;
+}
+
+void exportProfileSummary(const ProfileData &Profile, raw_ostream &OS) {
+  OS << "{\n  \"checks\": ";
+  writeChecks(OS, Profile.Records, "  ");
+  OS << ",\n  \"files\": [";
+  bool First = true;
+  for (const TranslationUnitProfile *TU : sortedByStart(Profile)) {
+    OS << (First ? "\n" : ",\n") << "    {\n      \"file\": ";
+    First = false;
+    writeString(OS, TU->File);
+    OS << ",\n      \"thread\": " << TU->Thread << ",\n      \"parse\": ";
+    writeTime(OS, TU->Parse);
+    OS << ",\n      \"match\": ";
+    writeTime(OS, TU->Match);
+    OS << ",\n      \"checks\": ";
+    writeChecks(OS, TU->Checks, "      ");
+    OS << "\n    }";
+  }
+  OS << (First ? "" : "\n  ") << "],\n";
+  OS << "  \"cache\": {\"hits\": " << Profile.CacheHits
+     << ", \"misses\": " << Profile.CacheMisses << "}\n}\n";
+}
+
+// Writes a complete event ("ph": "X"). Times are in microseconds.
+static void writeEvent(raw_ostream &OS, StringRef Name, StringRef Category,
+                       unsigned Thread, double Start, double Duration) {
+  OS << "{\"name\": ";
+  writeString(OS, Name);
+  OS << ", \"cat\": ";
+  writeString(OS, Category);
+  OS << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << Thread
+     << format(", \"ts\": %.0f, \"dur\": %.0f", Start, Duration);
+}
+
+void exportProfileTrace(const ProfileData &Profile, raw_ostream &OS) {
+  std::vector<const TranslationUnitProfile *> TUs = sortedByStart(Profile);
+  OS << "{\"traceEvents\": [";
+  bool First = true;
+  for (const TranslationUnitProfile *TU : TUs) {
+    double Start = std::chrono::duration<double, std::micro>(
+                       TU->Start - TUs.front()->Start)
+                       .count();
+    double Parse = TU->Parse.getWallTime() * 1e6;
+    double Match = TU->Match.getWallTime() * 1e6;
+
+    OS << (First ? "\n" : ",\n");
+    First = false;
+    writeEvent(OS, TU->File, "file", TU->Thread, Start, Parse + Match);
+    OS << "},\n";
+    writeEvent(OS, "parse", "phase", TU->Thread, Start, Parse);
+    OS << "},\n";
+    // The callbacks of the checks are interleaved, so their times can't be
+    // placed on the timeline. Their wall times in microseconds are attached
+    // to the event instead.
+    writeEvent(OS, "match", "phase", TU->Thread, Start + Parse, Match);
+    OS << ", \"args\": {";
+    std::vector<StringRef> Names;
+    for (const auto &Check : TU->Checks)
+      Names.push_back(Check.getKey());
+    std::sort(Names.begin(), Names.end());
+    for (size_t I = 0; I < Names.size(); ++I) {
+      OS << (I ? ", " : "");
+      writeString(OS, Names[I]);
+      OS << format(": %.0f", TU->Checks.lookup(Names[I]).getWallTime() * 1e6);
+    }
+    OS << "}}";
+  }
+  OS << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+} // end namespace tidy
+} // end namespace clang
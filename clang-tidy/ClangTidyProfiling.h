@@ -0,0 +1,88 @@
+//===--- ClangTidyProfiling.h - clang-tidy ----------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPROFILING_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPROFILING_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Timer.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+class raw_ostream;
+} // namespace llvm
+
+namespace clang {
+namespace tidy {
+
+/// \brief Profiling data of a single translation unit.
+struct TranslationUnitProfile {
+  /// \brief The main file of the translation unit.
+  std::string File;
+
+  /// \brief Index of the worker that processed the translation unit.
+  unsigned Thread = 0;
+
+  /// \brief When the frontend started parsing the translation unit.
+  llvm::sys::TimePoint<> Start;
+
+  /// \brief Preprocessing, parsing and semantic analysis.
+  llvm::TimeRecord Parse;
+
+  /// \brief Running the checks on the complete AST: the AST matchers, the
+  /// callbacks of the checks and the static analyzer.
+  llvm::TimeRecord Match;
+
+  /// \brief Time spent in the callbacks of each check, keyed by check name.
+  llvm::StringMap<llvm::TimeRecord> Checks;
+};
+
+/// \brief Container for clang-tidy profiling data.
+struct ProfileData {
+  /// \brief Time spent in the callbacks of each check, summed over all
+  /// translation units.
+  llvm::StringMap<llvm::TimeRecord> Records;
+
+  /// \brief The processed translation units, in order of completion.
+  std::vector<TranslationUnitProfile> TranslationUnits;
+
+  /// \brief Result cache lookups, see \c ClangTidyResultCache.
+  unsigned CacheHits = 0;
+  unsigned CacheMisses = 0;
+
+  /// \brief Preambles built for -share-preambles, and the number of files
+  /// that used a preamble built for another file.
+  unsigned PreamblesBuilt = 0;
+  unsigned PreamblesReused = 0;
+
+  /// \brief Adds the profile of a translation unit, and its check times to
+  /// \c Records.
+  void addTranslationUnit(TranslationUnitProfile Profile);
+
+  /// \brief Adds the data collected by the worker \p Thread.
+  void merge(ProfileData Other, unsigned Thread);
+};
+
+/// \brief Writes \p Profile as a JSON object. Tools can read and aggregate it.
+///
+/// The object has the check times summed over all translation units under
+/// "checks". Each translation unit is listed under "files" with its phases and
+/// check times. Times are objects with "wall", "user" and "sys" seconds.
+void exportProfileSummary(const ProfileData &Profile, llvm::raw_ostream &OS);
+
+/// \brief Writes the translation units of \p Profile in the Chrome trace event
+/// format, which chrome://tracing can display. Each worker is a thread.
+void exportProfileTrace(const ProfileData &Profile, llvm::raw_ostream &OS);
+
+} // end namespace tidy
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYPROFILING_H
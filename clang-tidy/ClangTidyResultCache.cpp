@@ -0,0 +1,372 @@
+//===--- ClangTidyResultCache.cpp - clang-tidy ------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidyResultCache.h"
+#include "clang/Basic/Version.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using namespace clang;
+using namespace clang::tidy;
+
+namespace {
+
+// Part of the keys, change it when the format of the entries changes.
+const char CacheFormatVersion[] = "clang-tidy-results-2";
+
+// The types below mirror ClangTidyError in a form that is easy to map to YAML.
+struct CachedMessage {
+  std::string Message;
+  std::string FilePath;
+  unsigned FileOffset;
+};
+
+struct CachedError {
+  std::string DiagnosticName;
+  unsigned Level;
+  std::string BuildDirectory;
+  bool IsWarningAsError;
+  std::string HeaderKey;
+  CachedMessage Message;
+  std::vector<CachedMessage> Notes;
+  std::vector<tooling::Replacement> Replacements;
+};
+
+struct CacheEntry {
+  std::vector<ClangTidyInput> Inputs;
+  std::vector<CachedError> Errors;
+  ClangTidyStats Stats;
+};
+
+} // namespace
+
+LLVM_YAML_IS_SEQUENCE_VECTOR(ClangTidyInput)
+LLVM_YAML_IS_SEQUENCE_VECTOR(CachedMessage)
+LLVM_YAML_IS_SEQUENCE_VECTOR(CachedError)
+
+namespace llvm {
+namespace yaml {
+
+template <> struct MappingTraits<ClangTidyInput> {
+  static void mapping(IO &IO, ClangTidyInput &Input) {
+    IO.mapRequired("Path", Input.Path);
+    IO.mapRequired("Digest", Input.Digest);
+  }
+};
+
+template <> struct MappingTraits<CachedMessage> {
+  static void mapping(IO &IO, CachedMessage &Message) {
+    IO.mapRequired("Message", Message.Message);
+    IO.mapRequired("FilePath", Message.FilePath);
+    IO.mapRequired("FileOffset", Message.FileOffset);
+  }
+};
+
+template <> struct MappingTraits<CachedError> {
+  static void mapping(IO &IO, CachedError &Error) {
+    IO.mapRequired("DiagnosticName", Error.DiagnosticName);
+    IO.mapRequired("Level", Error.Level);
+    IO.mapRequired("BuildDirectory", Error.BuildDirectory);
+    IO.mapRequired("IsWarningAsError", Error.IsWarningAsError);
+    IO.mapOptional("HeaderKey", Error.HeaderKey);
+    IO.mapRequired("Message", Error.Message);
+    IO.mapOptional("Notes", Error.Notes);
+    IO.mapOptional("Replacements", Error.Replacements);
+  }
+};
+
+template <> struct MappingTraits<ClangTidyStats> {
+  static void mapping(IO &IO, ClangTidyStats &Stats) {
+    IO.mapRequired("ErrorsDisplayed", Stats.ErrorsDisplayed);
+    IO.mapRequired("ErrorsIgnoredCheckFilter", Stats.ErrorsIgnoredCheckFilter);
+    IO.mapRequired("ErrorsIgnoredNOLINT", Stats.ErrorsIgnoredNOLINT);
+    IO.mapRequired("ErrorsIgnoredNonUserCode", Stats.ErrorsIgnoredNonUserCode);
+    IO.mapRequired("ErrorsIgnoredLineFilter", Stats.ErrorsIgnoredLineFilter);
+  }
+};
+
+template <> struct MappingTraits<CacheEntry> {
+  static void mapping(IO &IO, CacheEntry &Entry) {
+    IO.mapRequired("Inputs", Entry.Inputs);
+    IO.mapOptional("Errors", Entry.Errors);
+    IO.mapRequired("Stats", Entry.Stats);
+  }
+};
+
+} // namespace yaml
+} // namespace llvm
+
+static CachedMessage toCached(const tooling::DiagnosticMessage &Message) {
+  CachedMessage Result;
+  Result.Message = Message.Message;
+  Result.FilePath = Message.FilePath;
+  Result.FileOffset = Message.FileOffset;
+  return Result;
+}
+
+static CachedError toCached(const ClangTidyError &Error) {
+  CachedError Result;
+  Result.DiagnosticName = Error.DiagnosticName;
+  Result.Level = Error.DiagLevel;
+  Result.BuildDirectory = Error.BuildDirectory;
+  Result.IsWarningAsError = Error.IsWarningAsError;
+  Result.HeaderKey = Error.HeaderKey;
+  Result.Message = toCached(Error.Message);
+  for (const auto &Note : Error.Notes)
+    Result.Notes.push_back(toCached(Note));
+  for (const auto &FileAndReplacements : Error.Fix)
+    Result.Replacements.insert(Result.Replacements.end(),
+                               FileAndReplacements.second.begin(),
+                               FileAndReplacements.second.end());
+  return Result;
+}
+
+static tooling::DiagnosticMessage fromCached(const CachedMessage &Message) {
+  tooling::DiagnosticMessage Result(Message.Message);
+  Result.FilePath = Message.FilePath;
+  Result.FileOffset = Message.FileOffset;
+  return Result;
+}
+
+static llvm::Optional<ClangTidyError> fromCached(const CachedError &Error) {
+  if (Error.Level != ClangTidyError::Warning &&
+      Error.Level != ClangTidyError::Error)
+    return llvm::None;
+  ClangTidyError Result(Error.DiagnosticName,
+                        static_cast<ClangTidyError::Level>(Error.Level),
+                        Error.BuildDirectory, Error.IsWarningAsError);
+  Result.HeaderKey = Error.HeaderKey;
+  Result.Message = fromCached(Error.Message);
+  for (const auto &Note : Error.Notes)
+    Result.Notes.push_back(fromCached(Note));
+  for (const auto &Replacement : Error.Replacements) {
+    if (llvm::Error Err =
+            Result.Fix[Replacement.getFilePath()].add(Replacement)) {
+      llvm::consumeError(std::move(Err));
+      return llvm::None;
+    }
+  }
+  return Result;
+}
+
+/// Reads the entry stored in \p Path, if it is valid and its inputs are
+/// unchanged in \p FS.
+static llvm::Optional<ClangTidyFileResults> readEntry(StringRef Path,
+                                                      vfs::FileSystem &FS) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return llvm::None;
+  CacheEntry Entry;
+  llvm::yaml::Input YAML((*Buffer)->getBuffer());
+  YAML >> Entry;
+  if (YAML.error() || Entry.Inputs.empty())
+    return llvm::None;
+
+  for (const ClangTidyInput &Input : Entry.Inputs) {
+    // Files that were missing must still be missing, e.g. a header added to
+    // an include directory searched earlier would be used instead.
+    if (Input.Digest.empty()) {
+      if (FS.status(Input.Path))
+        return llvm::None;
+      continue;
+    }
+    auto Contents = FS.getBufferForFile(Input.Path);
+    if (!Contents ||
+        ClangTidyResultCache::digest((*Contents)->getBuffer()) != Input.Digest)
+      return llvm::None;
+  }
+
+  ClangTidyFileResults Results;
+  Results.Inputs = std::move(Entry.Inputs);
+  for (const CachedError &Error : Entry.Errors) {
+    llvm::Optional<ClangTidyError> Result = fromCached(Error);
+    if (!Result)
+      return llvm::None;
+    Results.Errors.push_back(std::move(*Result));
+  }
+  Results.Stats = Entry.Stats;
+  return std::move(Results);
+}
+
+/// Marks the entry in \p Path as recently used.
+static void touchEntry(StringRef Path) {
+  int FD;
+  if (llvm::sys::fs::openFileForRead(Path, FD))
+    return;
+  llvm::sys::fs::setLastModificationAndAccessTime(
+      FD, std::chrono::time_point_cast<std::chrono::nanoseconds>(
+              std::chrono::system_clock::now()));
+  llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+ClangTidyResultCache::ClangTidyResultCache(
+    StringRef Directory, uint64_t MaxSize,
+    llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS)
+    : Directory(Directory), MaxSize(MaxSize), FS(std::move(FS)), Hits(0),
+      Misses(0) {
+  // If this fails, so will the stores, and every lookup is a miss.
+  llvm::sys::fs::create_directories(Directory);
+}
+
+std::string ClangTidyResultCache::getKey(
+    StringRef File, ArrayRef<tooling::CompileCommand> Commands,
+    const ClangTidyOptions &Options,
+    const ClangTidyGlobalOptions &GlobalOptions) {
+  llvm::MD5 Hash;
+  auto Add = [&Hash](StringRef Data) {
+    Hash.update(Data);
+    Hash.update(StringRef("\0", 1));
+  };
+  Add(CacheFormatVersion);
+  // Checks aren't versioned on their own, any change to the binary may change
+  // the results.
+  Add(getClangToolFullVersion("clang-tidy"));
+  Add(File);
+  for (const tooling::CompileCommand &Command : Commands) {
+    Add(Command.Directory);
+    Add(Command.Filename);
+    Add(std::to_string(Command.CommandLine.size()));
+    for (const std::string &Argument : Command.CommandLine)
+      Add(Argument);
+  }
+  Add(configurationAsText(Options));
+  Add(Options.SystemHeaders && *Options.SystemHeaders ? "1" : "0");
+  for (const FileFilter &Filter : GlobalOptions.LineFilter) {
+    Add(Filter.Name);
+    for (const FileFilter::LineRange &Range : Filter.LineRanges)
+      Add(std::to_string(Range.first) + "-" + std::to_string(Range.second));
+  }
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str();
+}
+
+std::string ClangTidyResultCache::digest(StringRef Contents) {
+  llvm::MD5 Hash;
+  Hash.update(Contents);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result.digest().str();
+}
+
+std::string ClangTidyResultCache::getEntryPath(StringRef Key) const {
+  SmallString<256> Path(Directory);
+  llvm::sys::path::append(Path, Key + ".yaml");
+  return Path.str();
+}
+
+llvm::Optional<ClangTidyFileResults>
+ClangTidyResultCache::lookup(StringRef Key) {
+  std::string Path = getEntryPath(Key);
+  llvm::Optional<ClangTidyFileResults> Results = readEntry(Path, *FS);
+  if (!Results) {
+    ++Misses;
+    return llvm::None;
+  }
+  ++Hits;
+  touchEntry(Path);
+  return Results;
+}
+
+void ClangTidyResultCache::store(StringRef Key,
+                                 const ClangTidyFileResults &Results) {
+  if (Results.Inputs.empty())
+    return;
+
+  CacheEntry Entry;
+  Entry.Inputs = Results.Inputs;
+  for (const ClangTidyError &Error : Results.Errors)
+    Entry.Errors.push_back(toCached(Error));
+  Entry.Stats = Results.Stats;
+  std::string Data;
+  {
+    llvm::raw_string_ostream OS(Data);
+    llvm::yaml::Output YAML(OS);
+    YAML << Entry;
+  }
+
+  // Write to a temporary file first, so that concurrent lookups never see a
+  // partially written entry.
+  SmallString<256> Model(Directory);
+  llvm::sys::path::append(Model, "%%%%%%%%%%%%.tmp");
+  SmallString<256> TempPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(Model, FD, TempPath))
+    return;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Data;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(TempPath, getEntryPath(Key))) {
+    llvm::sys::fs::remove(TempPath);
+    return;
+  }
+
+  if (!MaxSize)
+    return;
+  std::lock_guard<std::mutex> Lock(Mutex);
+  if (TotalSize)
+    *TotalSize += Data.size();
+  if (!TotalSize || *TotalSize > MaxSize)
+    evict();
+}
+
+void ClangTidyResultCache::evict() {
+  struct StoredEntry {
+    std::string Path;
+    llvm::sys::TimePoint<> LastUsed;
+    uint64_t Size;
+  };
+  std::vector<StoredEntry> Entries;
+  uint64_t Size = 0;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator I(Directory, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    if (llvm::sys::path::extension(I->path()) != ".yaml")
+      continue;
+    llvm::sys::fs::file_status Status;
+    if (llvm::sys::fs::status(I->path(), Status))
+      continue;
+    Entries.push_back(
+        {I->path(), Status.getLastModificationTime(), Status.getSize()});
+    Size += Status.getSize();
+  }
+
+  if (Size > MaxSize) {
+    // Leave some room, so that the next stores don't scan the directory again.
+    uint64_t Target = MaxSize - MaxSize / 10;
+    std::sort(Entries.begin(), Entries.end(),
+              [](const StoredEntry &A, const StoredEntry &B) {
+                return A.LastUsed < B.LastUsed;
+              });
+    for (const StoredEntry &Entry : Entries) {
+      if (Size <= Target)
+        break;
+      if (!llvm::sys::fs::remove(Entry.Path))
+        Size -= Entry.Size;
+    }
+  }
+  // Other processes may share the directory, so this is only an estimate.
+  TotalSize = Size;
+}
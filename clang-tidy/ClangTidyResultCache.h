@@ -0,0 +1,102 @@
+//===--- ClangTidyResultCache.h - clang-tidy --------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
+
+#include "ClangTidyDiagnosticConsumer.h"
+#include "ClangTidyOptions.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tooling {
+struct CompileCommand;
+} // namespace tooling
+
+namespace tidy {
+
+/// \brief The results of running clang-tidy on a single input file.
+struct ClangTidyFileResults {
+  /// \brief Files read while processing the input file, including itself,
+  /// and the files that were looked up but didn't exist.
+  std::vector<ClangTidyInput> Inputs;
+  std::vector<ClangTidyError> Errors;
+  ClangTidyStats Stats;
+};
+
+/// \brief Stores the results of clang-tidy runs in a directory, so that files
+/// which didn't change since the last run don't need to be processed again.
+///
+/// Results are stored under a key computed from the input file, its compile
+/// commands and the clang-tidy configuration used for it. They are only
+/// returned if all the files read when computing them still have the same
+/// contents, and the files that were not found (e.g. in the include
+/// directories searched before the one a header was found in) still don't
+/// exist. Entries are written atomically, so several clang-tidy processes
+/// can share a directory.
+///
+/// This class is thread-safe.
+class ClangTidyResultCache {
+public:
+  /// \brief Uses \p Directory to store results, creating it if necessary.
+  ///
+  /// When the stored results exceed \p MaxSize bytes, the least recently used
+  /// ones are removed. 0 means no limit. Input files are read from \p FS.
+  ClangTidyResultCache(StringRef Directory, uint64_t MaxSize,
+                       llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS);
+
+  /// \brief Computes the key for the results of running clang-tidy on \p File.
+  static std::string getKey(StringRef File,
+                            ArrayRef<tooling::CompileCommand> Commands,
+                            const ClangTidyOptions &Options,
+                            const ClangTidyGlobalOptions &GlobalOptions);
+
+  /// \brief Returns the hex MD5 digest of \p Contents, as stored in
+  /// \c ClangTidyInput.
+  static std::string digest(StringRef Contents);
+
+  /// \brief Returns the results stored for \p Key, unless some of their inputs
+  /// have changed since.
+  llvm::Optional<ClangTidyFileResults> lookup(StringRef Key);
+
+  /// \brief Stores \p Results for \p Key. Results without inputs are dropped,
+  /// as there is no way to tell whether they are still valid.
+  void store(StringRef Key, const ClangTidyFileResults &Results);
+
+  unsigned getHits() const { return Hits; }
+  unsigned getMisses() const { return Misses; }
+
+private:
+  std::string getEntryPath(StringRef Key) const;
+
+  /// \brief Removes the least recently used entries until the cache is below
+  /// its size limit. Requires \c Mutex to be held.
+  void evict();
+
+  std::string Directory;
+  uint64_t MaxSize;
+  llvm::IntrusiveRefCntPtr<vfs::FileSystem> FS;
+  std::atomic<unsigned> Hits;
+  std::atomic<unsigned> Misses;
+
+  std::mutex Mutex;
+  /// \brief Approximate size of the stored entries, computed on first store.
+  llvm::Optional<uint64_t> TotalSize;
+};
+
+} // end namespace tidy
+} // end namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANG_TIDY_CLANGTIDYRESULTCACHE_H
@@ -0,0 +1,132 @@
+//===--- ClangTidyBenchmark.cpp - clang-tidy driver benchmarks --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs runClangTidy on a generated project kept in memory, to compare the
+// driver modes (-j, -share-preambles) on the same inputs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ClangTidy.h"
+#include "ClangTidyDiagnosticConsumer.h"
+#include "ClangTidyOptions.h"
+#include "benchmark/benchmark.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace tidy {
+
+// Link in the checks the benchmarks enable.
+extern volatile int ModernizeModuleAnchorSource;
+static int LLVM_ATTRIBUTE_UNUSED ModernizeModuleAnchorDestination =
+    ModernizeModuleAnchorSource;
+extern volatile int ReadabilityModuleAnchorSource;
+static int LLVM_ATTRIBUTE_UNUSED ReadabilityModuleAnchorDestination =
+    ReadabilityModuleAnchorSource;
+
+namespace {
+
+constexpr const char *Directory = "/clang-tidy-benchmark";
+
+// A project of NumFiles source files, each with some code for the enabled
+// checks to match and warn on. With HeaderSize > 0, all the files start by
+// including a header declaring that many classes.
+struct Project {
+  llvm::IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS;
+  std::vector<std::string> Files;
+
+  Project(size_t NumFiles, size_t HeaderSize = 0)
+      : FS(new vfs::InMemoryFileSystem) {
+    FS->setCurrentWorkingDirectory(Directory);
+    if (HeaderSize) {
+      std::string Header;
+      for (size_t I = 0; I < HeaderSize; ++I)
+        Header += llvm::formatv("template <typename T> struct S{0} {{\n"
+                                "  T *Value = nullptr;\n"
+                                "  T *get() const {{ return Value; }\n"
+                                "};\n",
+                                I);
+      FS->addFile(llvm::formatv("{0}/common.h", Directory).str(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy(Header));
+    }
+    for (size_t I = 0; I < NumFiles; ++I) {
+      std::string Code = HeaderSize ? "#include \"common.h\"\n" : "";
+      for (int F = 0; F < 20; ++F)
+        Code += llvm::formatv("int *f{0}_{1}(int *P, int N) {{\n"
+                              "  for (int I = 0; I < N; ++I)\n"
+                              "    if (P[I] == {1})\n"
+                              "      return 0;\n"
+                              "  return P;\n"
+                              "}\n",
+                              I, F);
+      std::string File = llvm::formatv("{0}/file{1}.cpp", Directory, I);
+      FS->addFile(File, 0, llvm::MemoryBuffer::getMemBufferCopy(Code));
+      Files.push_back(std::move(File));
+    }
+  }
+};
+
+std::unique_ptr<ClangTidyOptionsProvider> createOptionsProvider() {
+  ClangTidyOptions Options = ClangTidyOptions::getDefaults();
+  Options.Checks = "-*,modernize-use-nullptr,readability-braces-around-"
+                   "statements";
+  return llvm::make_unique<DefaultOptionsProvider>(ClangTidyGlobalOptions(),
+                                                   Options);
+}
+
+void runOnProject(benchmark::State &State, const Project &P,
+                  unsigned NumThreads, bool SharePreambles) {
+  tooling::FixedCompilationDatabase Compilations(Directory, {"-std=c++11"});
+  for (auto _ : State) {
+    ClangTidyContext Context(createOptionsProvider());
+    runClangTidy(Context, Compilations, P.Files, P.FS, /*Profile=*/nullptr,
+                 NumThreads, /*Cache=*/nullptr, SharePreambles);
+    benchmark::DoNotOptimize(Context.getErrors().size());
+  }
+  State.SetItemsProcessed(State.iterations() * P.Files.size());
+}
+
+// Arguments: number of files, number of threads.
+void parallelArgs(benchmark::internal::Benchmark *B) {
+  for (int Files : {500, 5000})
+    for (int Threads : {1, 2, 4, 8, 16})
+      B->Args({Files, Threads});
+}
+
+void BM_Parallel(benchmark::State &State) {
+  Project P(State.range(0));
+  runOnProject(State, P, State.range(1), /*SharePreambles=*/false);
+}
+BENCHMARK(BM_Parallel)
+    ->Apply(parallelArgs)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(1);
+
+// Arguments: number of files, whether preambles are shared.
+void BM_SharePreambles(benchmark::State &State) {
+  Project P(State.range(0), /*HeaderSize=*/5000);
+  runOnProject(State, P, /*NumThreads=*/1, State.range(1));
+}
+BENCHMARK(BM_SharePreambles)
+    ->Args({100, false})
+    ->Args({100, true})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime()
+    ->Iterations(1);
+
+} // namespace
+} // namespace tidy
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -16,7 +16,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "../ClangTidy.h"
+#include "../ClangTidyResultCache.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/TargetSelect.h"
 
@@ -183,6 +185,23 @@ report to stderr.
                                         cl::init(false),
                                         cl::cat(ClangTidyCategory));
 
+static cl::opt<std::string> ExportProfile("export-profile", cl::desc(R"(
+JSON file to store the time spent in each check
+and each file in. run-clang-tidy.py can merge
+the files of several runs.
+)"),
+                                          cl::value_desc("filename"),
+                                          cl::cat(ClangTidyCategory));
+
+static cl::opt<std::string> ExportProfileTrace("export-profile-trace",
+                                               cl::desc(R"(
+File to store a trace of the processed files in,
+in the Chrome trace event format. It can be
+viewed in chrome://tracing.
+)"),
+                                               cl::value_desc("filename"),
+                                               cl::cat(ClangTidyCategory));
+
 static cl::opt<bool> AnalyzeTemporaryDtors("analyze-temporary-dtors",
                                            cl::desc(R"(
 Enable temporary destructor-aware analysis in
@@ -226,6 +245,45 @@ options are specified.
                            cl::init(false),
                            cl::cat(ClangTidyCategory));
 
+static cl::opt<unsigned> NumThreads("j", cl::desc(R"(
+Number of files to process in parallel.
+0 uses one thread per hardware thread.
+The output doesn't depend on this setting.
+)"),
+                                   cl::init(1),
+                                   cl::cat(ClangTidyCategory));
+
+static cl::opt<std::string> CacheDir("cache-dir", cl::desc(R"(
+Directory to store the results for each file in.
+Files whose contents, included files, compile
+command and configuration didn't change since
+they were stored aren't processed again.
+)"),
+                                     cl::value_desc("directory"),
+                                     cl::cat(ClangTidyCategory));
+
+static cl::opt<unsigned> CacheSize("cache-size", cl::desc(R"(
+Maximum size of -cache-dir in megabytes. The
+least recently used results are removed when it
+is exceeded. 0 means no limit.
+)"),
+                                   cl::init(1024),
+                                   cl::cat(ClangTidyCategory));
+
+static cl::opt<bool> SharePreambles("share-preambles", cl::desc(R"(
+Parse the headers included at the beginning of
+a file once, and share them as a precompiled
+preamble with the files in the same directory
+that start with the same includes and use the
+same compile command. Preambles that define
+macros or use pragmas are not shared, nor are
+the preambles of files whose checks use
+preprocessor callbacks, as these would not see
+the directives of a shared preamble.
+)"),
+                                    cl::init(false),
+                                    cl::cat(ClangTidyCategory));
+
 static cl::opt<std::string> VfsOverlay("vfsoverlay", cl::desc(R"(
 Overlay the virtual filesystem described by file
 over the real file system.
@@ -300,6 +358,14 @@ static void printProfileData(const ProfileData &Profile,
   Total.print(Total, OS);
   OS << "Total\n";
   OS << Line << "\n";
+  if (unsigned Lookups = Profile.CacheHits + Profile.CacheMisses)
+    OS << "Result cache: " << Profile.CacheHits << " hits, "
+       << Profile.CacheMisses << " misses ("
+       << format("%.1f", 100.0 * Profile.CacheHits / Lookups)
+       << "% hit rate)\n";
+  if (Profile.PreamblesBuilt || Profile.PreamblesReused)
+    OS << "Shared preambles: " << Profile.PreamblesBuilt << " built, "
+       << Profile.PreamblesReused << " reused\n";
   OS.flush();
 }
 
@@ -467,9 +533,17 @@ static int clangTidyMain(int argc, const char **argv) {
   llvm::InitializeAllTargetMCs();
   llvm::InitializeAllAsmParsers();
 
+  std::unique_ptr<ClangTidyResultCache> Cache;
+  if (!CacheDir.empty())
+    Cache = llvm::make_unique<ClangTidyResultCache>(
+        CacheDir, uint64_t(CacheSize) * 1024 * 1024, BaseFS);
+
   ClangTidyContext Context(std::move(OwningOptionsProvider));
+  bool CollectProfile = EnableCheckProfile || !ExportProfile.empty() ||
+                        !ExportProfileTrace.empty();
   runClangTidy(Context, OptionsParser.getCompilations(), PathList, BaseFS,
-               EnableCheckProfile ? &Profile : nullptr);
+               CollectProfile ? &Profile : nullptr, NumThreads, Cache.get(),
+               SharePreambles);
 
   ArrayRef<ClangTidyError> Errors = Context.getErrors();
   bool FoundErrors = llvm::find_if(Errors, [](const ClangTidyError &E) {
@@ -519,6 +593,28 @@ static int clangTidyMain(int argc, const char **argv) {
   if (EnableCheckProfile)
     printProfileData(Profile, llvm::errs());
 
+  if (!ExportProfile.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(ExportProfile, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Error opening profile output file: " << EC.message()
+                   << '\n';
+      return 1;
+    }
+    exportProfileSummary(Profile, OS);
+  }
+
+  if (!ExportProfileTrace.empty()) {
+    std::error_code EC;
+    llvm::raw_fd_ostream OS(ExportProfileTrace, EC, llvm::sys::fs::F_None);
+    if (EC) {
+      llvm::errs() << "Error opening profile trace output file: "
+                   << EC.message() << '\n';
+      return 1;
+    }
+    exportProfileTrace(Profile, OS);
+  }
+
   if (WErrorCount)
     {
       if (!Quiet) {
@@ -76,7 +76,7 @@ def make_absolute(f, directory):
 
 def get_tidy_invocation(f, clang_tidy_binary, checks, tmpdir, build_path,
                         header_filter, extra_arg, extra_arg_before, quiet,
-                        config):
+                        config, profile_dir=None):
   """Gets a command line for clang-tidy."""
   start = [clang_tidy_binary]
   if header_filter is not None:
@@ -93,6 +93,10 @@ def get_tidy_invocation(f, clang_tidy_binary, checks, tmpdir, build_path,
     (handle, name) = tempfile.mkstemp(suffix='.yaml', dir=tmpdir)
     os.close(handle)
     start.append(name)
+  if profile_dir is not None:
+    (handle, name) = tempfile.mkstemp(suffix='.json', dir=profile_dir)
+    os.close(handle)
+    start.append('-export-profile=' + name)
   for arg in extra_arg:
       start.append('-extra-arg=%s' % arg)
   for arg in extra_arg_before:
@@ -131,6 +135,41 @@ def merge_replacement_files(tmpdir, mergefile):
     open(mergefile, 'w').close()
 
 
+def add_times(total, time):
+  """Adds a time object of a clang-tidy profile to another one."""
+  for key in ('wall', 'user', 'sys'):
+    total[key] = total.get(key, 0.0) + time[key]
+
+
+def merge_profile_files(profile_dir, mergefile):
+  """Merge all profiles exported by clang-tidy in a directory into a single
+  file in the same format."""
+  checks = {}
+  files = []
+  cache = {'hits': 0, 'misses': 0}
+  for profile_file in glob.iglob(os.path.join(profile_dir, '*.json')):
+    with open(profile_file, 'r') as f:
+      try:
+        content = json.load(f)
+      except ValueError:
+        continue # Skip the files of failed runs.
+    for name, time in content['checks'].items():
+      add_times(checks.setdefault(name, {}), time)
+    files.extend(content['files'])
+    for key in cache:
+      cache[key] += content['cache'][key]
+
+  with open(mergefile, 'w') as out:
+    json.dump({'checks': checks, 'files': files, 'cache': cache}, out,
+              indent=2, sort_keys=True)
+
+  # Print the slowest checks, like -enable-check-profile does for one run.
+  slowest = sorted(checks.items(), key=lambda item: item[1]['wall'],
+                   reverse=True)
+  for name, time in slowest[:10]:
+    print('%10.4f  %s' % (time['wall'], name))
+
+
 def check_clang_apply_replacements_binary(args):
   """Checks if invoking supplied clang-apply-replacements binary works."""
   try:
@@ -153,14 +192,14 @@ def apply_fixes(args, tmpdir):
   subprocess.call(invocation)
 
 
-def run_tidy(args, tmpdir, build_path, queue, failed_files):
+def run_tidy(args, tmpdir, build_path, queue, failed_files, profile_dir):
   """Takes filenames out of queue and runs clang-tidy on them."""
   while True:
     name = queue.get()
     invocation = get_tidy_invocation(name, args.clang_tidy_binary, args.checks,
                                      tmpdir, build_path, args.header_filter,
                                      args.extra_arg, args.extra_arg_before,
-                                     args.quiet, args.config)
+                                     args.quiet, args.config, profile_dir)
     sys.stdout.write(' '.join(invocation) + '\n')
     return_code = subprocess.call(invocation)
     if return_code != 0:
@@ -198,6 +237,10 @@ def main():
   parser.add_argument('-export-fixes', metavar='filename', dest='export_fixes',
                       help='Create a yaml file to store suggested fixes in, '
                       'which can be applied with clang-apply-replacements.')
+  parser.add_argument('-export-profile', metavar='filename',
+                      dest='export_profile',
+                      help='Create a JSON file with the time spent in each '
+                      'check and each file, merged over all runs')
   parser.add_argument('-j', type=int, default=0,
                       help='number of tidy instances to be run in parallel.')
   parser.add_argument('files', nargs='*', default=['.*'],
@@ -254,6 +297,10 @@ def main():
     check_clang_apply_replacements_binary(args)
     tmpdir = tempfile.mkdtemp()
 
+  profile_dir = None
+  if args.export_profile:
+    profile_dir = tempfile.mkdtemp()
+
   # Build up a big regexy filter from all command line arguments.
   file_name_re = re.compile('|'.join(args.files))
 
@@ -265,7 +312,8 @@ def main():
     failed_files = []
     for _ in range(max_task):
       t = threading.Thread(target=run_tidy,
-                           args=(args, tmpdir, build_path, task_queue, failed_files))
+                           args=(args, tmpdir, build_path, task_queue,
+                                 failed_files, profile_dir))
       t.daemon = True
       t.start()
 
@@ -285,6 +333,8 @@ def main():
     print('\nCtrl-C detected, goodbye.')
     if tmpdir:
       shutil.rmtree(tmpdir)
+    if profile_dir:
+      shutil.rmtree(profile_dir)
     os.kill(0, 9)
 
   if args.export_fixes:
@@ -296,6 +346,16 @@ def main():
       traceback.print_exc()
       return_code=1
 
+  if args.export_profile:
+    print('Writing profile to ' + args.export_profile + ' ...')
+    try:
+      merge_profile_files(profile_dir, args.export_profile)
+    except:
+      print('Error exporting profile.\n', file=sys.stderr)
+      traceback.print_exc()
+      return_code=1
+    shutil.rmtree(profile_dir)
+
   if args.fix:
     print('Applying fixes ...')
     try:
@@ -0,0 +1,52 @@
+//===--- Cancellation.cpp -----------------------------------------*-C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Cancellation.h"
+#include <atomic>
+#include <system_error>
+
+namespace clang {
+namespace clangd {
+
+namespace {
+struct CancelState {
+  std::atomic<bool> Cancelled = {false};
+  // The state of the enclosing cancelable task, if any.
+  std::shared_ptr<const CancelState> Parent;
+};
+static Key<std::shared_ptr<const CancelState>> StateKey;
+} // namespace
+
+std::pair<Context, Canceler> cancelableTask() {
+  auto State = std::make_shared<CancelState>();
+  if (auto *Parent = Context::current().get(StateKey))
+    State->Parent = *Parent;
+  Canceler Cancel = [State] { State->Cancelled = true; };
+  return {Context::current().derive(StateKey, std::move(State)),
+          std::move(Cancel)};
+}
+
+bool isCancelled(const Context &Ctx) {
+  auto *State = Ctx.get(StateKey);
+  if (!State)
+    return false;
+  for (const CancelState *S = State->get(); S; S = S->Parent.get())
+    if (S->Cancelled)
+      return true;
+  return false;
+}
+
+llvm::Error cancelledError() {
+  return llvm::make_error<llvm::StringError>(
+      "request was cancelled",
+      std::make_error_code(std::errc::operation_canceled));
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,56 @@
+//===--- Cancellation.h - Cancelling long-running requests ------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Cancellation of requests is cooperative: the code handling a request checks
+// isCancelled() at points where it is cheap to stop, and bails out early.
+// The cancellation flag is stored in the Context, so it is propagated to the
+// worker threads along with the rest of the request data.
+//
+// Example:
+//   std::pair<Context, Canceler> Task = cancelableTask();
+//   {
+//     WithContext Cancelable(std::move(Task.first));
+//     Server.codeComplete(...); // Captures the current context.
+//   }
+//   Task.second(); // The completion returns cancelledError() if it can.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_CANCELLATION_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_CANCELLATION_H
+
+#include "Context.h"
+#include "llvm/Support/Error.h"
+#include <functional>
+#include <utility>
+
+namespace clang {
+namespace clangd {
+
+/// Marks the task created by cancelableTask() as cancelled. Thread-safe.
+using Canceler = std::function<void()>;
+
+/// Creates a context for a new cancelable task, derived from the current one,
+/// and a function that cancels the task.
+/// Nested tasks are cancelled when any of their enclosing tasks is.
+std::pair<Context, Canceler> cancelableTask();
+
+/// Returns true if the task that \p Ctx belongs to was cancelled.
+/// Long-running operations should check this periodically and stop early,
+/// usually returning cancelledError() to the caller.
+bool isCancelled(const Context &Ctx = Context::current());
+
+/// An error reported by the tasks that stopped because they were cancelled.
+/// Its error code is std::errc::operation_canceled.
+llvm::Error cancelledError();
+
+} // namespace clangd
+} // namespace clang
+
+#endif
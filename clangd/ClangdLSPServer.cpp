@@ -60,7 +60,7 @@ public:
 static URISchemeRegistry::Add<TestScheme>
     X("test", "Test scheme for clangd lit tests.");
 
-TextEdit replacementToEdit(StringRef Code, const tooling::Replacement &R) {
+TextEdit replacementToEdit(const Rope &Code, const tooling::Replacement &R) {
   Range ReplacementRange = {
       offsetToPosition(Code, R.getOffset()),
       offsetToPosition(Code, R.getOffset() + R.getLength())};
@@ -68,7 +68,7 @@ TextEdit replacementToEdit(StringRef Code, const tooling::Replacement &R) {
 }
 
 std::vector<TextEdit>
-replacementsToEdits(StringRef Code,
+replacementsToEdits(const Rope &Code,
                     const std::vector<tooling::Replacement> &Replacements) {
   // Turn the replacements into the format specified by the Language Server
   // Protocol. Fuse them into one big JSON array.
@@ -78,7 +78,20 @@ replacementsToEdits(StringRef Code,
   return Edits;
 }
 
-std::vector<TextEdit> replacementsToEdits(StringRef Code,
+/// Replies to a request that failed with \p Err. Requests that were cancelled
+/// (by the client, or by a newer request) are reported as RequestCancelled,
+/// all other errors with \p Code.
+void replyWithError(ErrorCode Code, llvm::Error Err) {
+  std::string Message;
+  llvm::handleAllErrors(std::move(Err), [&](const llvm::ErrorInfoBase &EI) {
+    if (EI.convertToErrorCode() == std::errc::operation_canceled)
+      Code = ErrorCode::RequestCancelled;
+    Message = EI.message();
+  });
+  replyError(Code, Message);
+}
+
+std::vector<TextEdit> replacementsToEdits(const Rope &Code,
                                           const tooling::Replacements &Repls) {
   std::vector<TextEdit> Edits;
   for (const auto &R : Repls)
@@ -175,7 +188,7 @@ void ClangdLSPServer::onDocumentDidChange(DidChangeTextDocumentParams &Params) {
                                                   : WantDiagnostics::No;
 
   PathRef File = Params.textDocument.uri.file();
-  llvm::Expected<std::string> Contents =
+  llvm::Expected<Rope> Contents =
       DraftMgr.updateDraft(File, Params.contentChanges);
   if (!Contents) {
     // If this fails, we are most likely going to be not in sync anymore with
@@ -233,7 +246,7 @@ void ClangdLSPServer::onCommand(ExecuteCommandParams &Params) {
           "declaringHeader must be provided for include insertion.");
     llvm::StringRef PreferredHeader = Params.includeInsertion->preferredHeader;
     auto Replaces = Server.insertInclude(
-        FileURI.file(), *Code, DeclaringHeader,
+        FileURI.file(), Code->str(), DeclaringHeader,
         PreferredHeader.empty() ? DeclaringHeader : PreferredHeader);
     if (!Replaces) {
       std::string ErrMsg =
@@ -278,7 +291,7 @@ void ClangdLSPServer::onWorkspaceSymbol(WorkspaceSymbolParams &Params) {
 
 void ClangdLSPServer::onRename(RenameParams &Params) {
   Path File = Params.textDocument.uri.file();
-  llvm::Optional<std::string> Code = DraftMgr.getDraft(File);
+  llvm::Optional<Rope> Code = DraftMgr.getDraft(File);
   if (!Code)
     return replyError(ErrorCode::InvalidParams,
                       "onRename called for non-added file");
@@ -312,7 +325,8 @@ void ClangdLSPServer::onDocumentOnTypeFormatting(
     return replyError(ErrorCode::InvalidParams,
                       "onDocumentOnTypeFormatting called for non-added file");
 
-  auto ReplacementsOrError = Server.formatOnType(*Code, File, Params.position);
+  auto ReplacementsOrError =
+      Server.formatOnType(Code->str(), File, Params.position);
   if (ReplacementsOrError)
     reply(json::ary(replacementsToEdits(*Code, ReplacementsOrError.get())));
   else
@@ -328,7 +342,8 @@ void ClangdLSPServer::onDocumentRangeFormatting(
     return replyError(ErrorCode::InvalidParams,
                       "onDocumentRangeFormatting called for non-added file");
 
-  auto ReplacementsOrError = Server.formatRange(*Code, File, Params.range);
+  auto ReplacementsOrError =
+      Server.formatRange(Code->str(), File, Params.range);
   if (ReplacementsOrError)
     reply(json::ary(replacementsToEdits(*Code, ReplacementsOrError.get())));
   else
@@ -343,7 +358,7 @@ void ClangdLSPServer::onDocumentFormatting(DocumentFormattingParams &Params) {
     return replyError(ErrorCode::InvalidParams,
                       "onDocumentFormatting called for non-added file");
 
-  auto ReplacementsOrError = Server.formatFile(*Code, File);
+  auto ReplacementsOrError = Server.formatFile(Code->str(), File);
   if (ReplacementsOrError)
     reply(json::ary(replacementsToEdits(*Code, ReplacementsOrError.get())));
   else
@@ -379,9 +394,11 @@ void ClangdLSPServer::onCompletion(TextDocumentPositionParams &Params) {
   Server.codeComplete(Params.textDocument.uri.file(), Params.position, CCOpts,
                       [](llvm::Expected<CompletionList> List) {
                         if (!List)
-                          return replyError(ErrorCode::InvalidParams,
-                                            llvm::toString(List.takeError()));
-                        reply(*List);
+                          return replyWithError(ErrorCode::InvalidParams,
+                                                List.takeError());
+                        replyStreamed([&](json::OStream &J) {
+                          writeJSON(J, *List);
+                        });
                       });
 }
 
@@ -389,9 +406,8 @@ void ClangdLSPServer::onSignatureHelp(TextDocumentPositionParams &Params) {
   Server.signatureHelp(Params.textDocument.uri.file(), Params.position,
                        [](llvm::Expected<SignatureHelp> SignatureHelp) {
                          if (!SignatureHelp)
-                           return replyError(
-                               ErrorCode::InvalidParams,
-                               llvm::toString(SignatureHelp.takeError()));
+                           return replyWithError(ErrorCode::InvalidParams,
+                                                 SignatureHelp.takeError());
                          reply(*SignatureHelp);
                        });
 }
@@ -401,8 +417,7 @@ void ClangdLSPServer::onGoToDefinition(TextDocumentPositionParams &Params) {
       Params.textDocument.uri.file(), Params.position,
       [](llvm::Expected<std::vector<Location>> Items) {
         if (!Items)
-          return replyError(ErrorCode::InvalidParams,
-                            llvm::toString(Items.takeError()));
+          return replyWithError(ErrorCode::InvalidParams, Items.takeError());
         reply(json::ary(*Items));
       });
 }
@@ -417,8 +432,8 @@ void ClangdLSPServer::onDocumentHighlight(TextDocumentPositionParams &Params) {
       Params.textDocument.uri.file(), Params.position,
       [](llvm::Expected<std::vector<DocumentHighlight>> Highlights) {
         if (!Highlights)
-          return replyError(ErrorCode::InternalError,
-                            llvm::toString(Highlights.takeError()));
+          return replyWithError(ErrorCode::InternalError,
+                                Highlights.takeError());
         reply(json::ary(*Highlights));
       });
 }
@@ -427,8 +442,8 @@ void ClangdLSPServer::onHover(TextDocumentPositionParams &Params) {
   Server.findHover(Params.textDocument.uri.file(), Params.position,
                    [](llvm::Expected<Hover> H) {
                      if (!H) {
-                       replyError(ErrorCode::InternalError,
-                                  llvm::toString(H.takeError()));
+                       replyWithError(ErrorCode::InternalError,
+                                      H.takeError());
                        return;
                      }
 
@@ -456,7 +471,7 @@ ClangdLSPServer::ClangdLSPServer(JSONOutput &Out,
       SupportedSymbolKinds(defaultSymbolKinds()),
       Server(CDB, FSProvider, /*DiagConsumer=*/*this, Opts) {}
 
-bool ClangdLSPServer::run(std::istream &In, JSONStreamStyle InputStyle) {
+bool ClangdLSPServer::run(int InputFD, JSONStreamStyle InputStyle) {
   assert(!IsDone && "Run was called before");
 
   // Set up JSONRPCDispatcher.
@@ -466,7 +481,7 @@ bool ClangdLSPServer::run(std::istream &In, JSONStreamStyle InputStyle) {
   registerCallbackHandlers(Dispatcher, /*Callbacks=*/*this);
 
   // Run the Language Server loop.
-  runLanguageServerLoop(In, Out, InputStyle, Dispatcher, IsDone);
+  runLanguageServerLoop(InputFD, Out, InputStyle, Dispatcher, IsDone);
 
   // Make sure IsDone is set to true after this method exits to ensure assertion
   // at the start of the method fires if it's ever executed again.
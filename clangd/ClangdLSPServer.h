@@ -37,13 +37,15 @@ public:
                   llvm::Optional<Path> CompileCommandsDir,
                   const ClangdServer::Options &Opts);
 
-  /// Run LSP server loop, receiving input for it from \p In. \p In must be
-  /// opened in binary mode. Output will be written using Out variable passed to
-  /// class constructor. This method must not be executed more than once for
+  /// Run LSP server loop, receiving input for it from the file descriptor
+  /// \p InputFD. \p InputFD must be opened in binary mode, and stay open
+  /// after this returns unless it is a regular file or the input ended, see
+  /// runLanguageServerLoop. Output will be written using Out variable passed
+  /// to class constructor. This method must not be executed more than once for
   /// each instance of ClangdLSPServer.
   ///
   /// \return Wether we received a 'shutdown' request before an 'exit' request
-  bool run(std::istream &In,
+  bool run(int InputFD,
            JSONStreamStyle InputStyle = JSONStreamStyle::Standard);
 
 private:
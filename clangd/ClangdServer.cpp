@@ -8,6 +8,7 @@
 //===-------------------------------------------------------------------===//
 
 #include "ClangdServer.h"
+#include "Cancellation.h"
 #include "CodeComplete.h"
 #include "FindSymbols.h"
 #include "Headers.h"
@@ -97,7 +98,9 @@ ClangdServer::ClangdServer(GlobalCompilationDatabase &CDB,
                         ? [this](PathRef Path,
                                  ParsedAST *AST) { FileIdx->update(Path, AST); }
                         : ASTParsedCallback(),
-                    Opts.UpdateDebounce) {
+                    Opts.UpdateDebounce, Opts.PreambleCacheBytes,
+                    Opts.ASTCacheBytes, Opts.PreambleCacheDir,
+                    Opts.PreambleCacheDirBytes) {
   if (FileIdx && Opts.StaticIndex) {
     MergedIndex = mergeIndex(FileIdx.get(), Opts.StaticIndex);
     Index = MergedIndex.get();
@@ -118,12 +121,22 @@ void ClangdServer::setRootPath(PathRef RootPath) {
 
 void ClangdServer::addDocument(PathRef File, StringRef Contents,
                                WantDiagnostics WantDiags, bool SkipCache) {
+  updateDocument(File, Rope(Contents), WantDiags, SkipCache);
+}
+
+void ClangdServer::addDocument(PathRef File, const Rope &Contents,
+                               WantDiagnostics WantDiags, bool SkipCache) {
+  updateDocument(File, Contents, WantDiags, SkipCache);
+}
+
+void ClangdServer::updateDocument(PathRef File, Rope Contents,
+                                  WantDiagnostics WantDiags, bool SkipCache) {
   if (SkipCache)
     CompileArgs.invalidate(File);
 
   DocVersion Version = ++InternalVersion[File];
   ParseInputs Inputs = {CompileArgs.getCompileCommand(File),
-                        FSProvider.getFileSystem(), Contents.str()};
+                        FSProvider.getFileSystem(), std::move(Contents)};
 
   Path FileStr = File.str();
   WorkScheduler.update(File, std::move(Inputs), WantDiags,
@@ -156,17 +169,24 @@ void ClangdServer::codeComplete(PathRef File, Position Pos,
       return CB(IP.takeError());
 
     auto PreambleData = IP->Preamble;
+    const PreamblePCH *Preamble =
+        PreambleData ? PreambleData->Preamble.get() : nullptr;
 
     // FIXME(ibiryukov): even if Preamble is non-null, we may want to check
     // both the old and the new version in case only one of them matches.
-    CompletionList Result = clangd::codeComplete(
-        File, IP->Command, PreambleData ? &PreambleData->Preamble : nullptr,
-        IP->Contents, Pos, FS, PCHs, CodeCompleteOpts);
+    CompletionList Result =
+        clangd::codeComplete(File, IP->Command, Preamble, IP->Contents, Pos, FS,
+                             PCHs, CodeCompleteOpts);
+    // Completion stops early if cancelled, don't report partial results.
+    if (isCancelled())
+      return CB(cancelledError());
     CB(std::move(Result));
   };
 
   WorkScheduler.runWithPreamble("CodeComplete", File,
-                                Bind(Task, File.str(), std::move(CB)));
+                                Bind(Task, File.str(), std::move(CB)),
+                                TaskPriority::Interactive,
+                                ReadPolicy::CancelIfSuperseded);
 }
 
 void ClangdServer::signatureHelp(PathRef File, Position Pos,
@@ -180,13 +200,16 @@ void ClangdServer::signatureHelp(PathRef File, Position Pos,
       return CB(IP.takeError());
 
     auto PreambleData = IP->Preamble;
-    CB(clangd::signatureHelp(File, IP->Command,
-                             PreambleData ? &PreambleData->Preamble : nullptr,
-                             IP->Contents, Pos, FS, PCHs));
+    const PreamblePCH *Preamble =
+        PreambleData ? PreambleData->Preamble.get() : nullptr;
+    CB(clangd::signatureHelp(File, IP->Command, Preamble, IP->Contents, Pos, FS,
+                             PCHs));
   };
 
   WorkScheduler.runWithPreamble("SignatureHelp", File,
-                                Bind(Action, File.str(), std::move(CB)));
+                                Bind(Action, File.str(), std::move(CB)),
+                                TaskPriority::Interactive,
+                                ReadPolicy::CancelIfSuperseded);
 }
 
 llvm::Expected<tooling::Replacements>
@@ -462,7 +485,9 @@ void ClangdServer::findDocumentHighlights(
     CB(clangd::findDocumentHighlights(InpAST->AST, Pos));
   };
 
-  WorkScheduler.runWithAST("Highlights", File, Bind(Action, std::move(CB)));
+  WorkScheduler.runWithAST("Highlights", File, Bind(Action, std::move(CB)),
+                           TaskPriority::Interactive,
+                           ReadPolicy::CancelIfSuperseded);
 }
 
 void ClangdServer::findHover(PathRef File, Position Pos, Callback<Hover> CB) {
@@ -474,7 +499,9 @@ void ClangdServer::findHover(PathRef File, Position Pos, Callback<Hover> CB) {
     CB(clangd::getHover(InpAST->AST, Pos));
   };
 
-  WorkScheduler.runWithAST("Hover", File, Bind(Action, std::move(CB)));
+  WorkScheduler.runWithAST("Hover", File, Bind(Action, std::move(CB)),
+                           TaskPriority::Interactive,
+                           ReadPolicy::CancelIfSuperseded);
 }
 
 void ClangdServer::consumeDiagnostics(PathRef File, DocVersion Version,
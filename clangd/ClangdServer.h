@@ -16,6 +16,7 @@
 #include "Function.h"
 #include "GlobalCompilationDatabase.h"
 #include "Protocol.h"
+#include "Rope.h"
 #include "TUScheduler.h"
 #include "index/FileIndex.h"
 #include "clang/Tooling/CompilationDatabase.h"
@@ -73,6 +74,23 @@ public:
     /// Cached preambles are potentially large. If false, store them on disk.
     bool StorePreamblesInMemory = true;
 
+    /// Limit on the total size of the preambles kept around after the files
+    /// using them are closed, so that they can be reused when the files are
+    /// opened again. If 0, preambles are not kept.
+    std::size_t PreambleCacheBytes = 0;
+
+    /// Directory to store preambles in, so that they can be reused after a
+    /// restart. If empty, preambles are not stored.
+    std::string PreambleCacheDir;
+
+    /// Limit on the total size of the preambles in PreambleCacheDir.
+    std::size_t PreambleCacheDirBytes = 0;
+
+    /// Limit on the total size of the ASTs of open files. When it is exceeded,
+    /// the ASTs of the least recently used files are dropped, and rebuilt when
+    /// they are needed again. If 0, there is no limit.
+    std::size_t ASTCacheBytes = 0;
+
     /// If true, ClangdServer builds a dynamic in-memory index for symbols in
     /// opened files and uses the index to augment code completion results.
     bool BuildDynamicSymbolIndex = false;
@@ -121,6 +139,11 @@ public:
   void addDocument(PathRef File, StringRef Contents,
                    WantDiagnostics WD = WantDiagnostics::Auto,
                    bool SkipCache = false);
+  /// Same as above, for contents kept in a Rope, e.g. by a DraftStore. The
+  /// text is shared with the scheduler rather than copied.
+  void addDocument(PathRef File, const Rope &Contents,
+                   WantDiagnostics WD = WantDiagnostics::Auto,
+                   bool SkipCache = false);
 
   /// Remove \p File from list of tracked files, schedule a request to free
   /// resources associated with it.
@@ -225,6 +248,11 @@ private:
 
   typedef uint64_t DocVersion;
 
+  /// Implements addDocument(). The contents are only flattened by the
+  /// workers, where the parser needs them in a single buffer.
+  void updateDocument(PathRef File, Rope Contents, WantDiagnostics WantDiags,
+                      bool SkipCache);
+
   void consumeDiagnostics(PathRef File, DocVersion Version,
                           std::vector<Diag> Diags);
 
@@ -10,6 +10,7 @@
 #include "ClangdUnit.h"
 #include "Compiler.h"
 #include "Diagnostics.h"
+#include "DiskPreambleCache.h"
 #include "Logger.h"
 #include "SourceCode.h"
 #include "Trace.h"
@@ -28,6 +29,7 @@
 #include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 
@@ -111,8 +113,69 @@ private:
   InclusionLocations &IncLocations;
 };
 
+/// Detects preprocessor events in the main file that make a preamble specific
+/// to it, i.e. unsuitable for other files with the same preamble text.
+/// When another file reuses the preamble, everything in the preamble region of
+/// its main file keeps the locations of the file the preamble was built for.
+/// Include directives and conditionals only matter through their effect on the
+/// included headers, which is the same for both files. But e.g. macros defined
+/// in the main file would point into the other file.
+class MainFileDependenceChecker : public PPCallbacks {
+public:
+  MainFileDependenceChecker(SourceManager &SourceMgr, bool &DependsOnMainFile)
+      : SourceMgr(SourceMgr), DependsOnMainFile(DependsOnMainFile) {}
+
+  void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                   SrcMgr::CharacteristicKind FileType,
+                   FileID PrevFID) override {
+    // #line directives and line markers.
+    if (Reason == RenameFile)
+      check(Loc);
+  }
+
+  void MacroDefined(const Token &MacroNameTok,
+                    const MacroDirective *MD) override {
+    check(MacroNameTok.getLocation());
+  }
+
+  void MacroUndefined(const Token &MacroNameTok, const MacroDefinition &MD,
+                      const MacroDirective *Undef) override {
+    check(MacroNameTok.getLocation());
+  }
+
+  void MacroExpands(const Token &MacroNameTok, const MacroDefinition &MD,
+                    SourceRange Range, const MacroArgs *Args) override {
+    // __BASE_FILE__ names the main file wherever it is expanded.
+    if (const IdentifierInfo *II = MacroNameTok.getIdentifierInfo()) {
+      if (II->getName() == "__BASE_FILE__")
+        DependsOnMainFile = true;
+      else if (II->getName() == "__FILE__")
+        check(MacroNameTok.getLocation());
+    }
+  }
+
+  void PragmaDirective(SourceLocation Loc,
+                       PragmaIntroducerKind Introducer) override {
+    check(Loc);
+  }
+
+private:
+  void check(SourceLocation Loc) {
+    if (Loc.isValid() && SourceMgr.isWrittenInMainFile(Loc))
+      DependsOnMainFile = true;
+  }
+
+  SourceManager &SourceMgr;
+  bool &DependsOnMainFile;
+};
+
 class CppFilePreambleCallbacks : public PreambleCallbacks {
 public:
+  /// If \p CollectDependencies is true, the files included by the preamble
+  /// are recorded, to validate the preamble when it is loaded from disk.
+  CppFilePreambleCallbacks(bool CollectDependencies)
+      : CollectDependencies(CollectDependencies) {}
+
   std::vector<serialization::DeclID> takeTopLevelDeclIDs() {
     return std::move(TopLevelDeclIDs);
   }
@@ -121,6 +184,14 @@ public:
     return std::move(IncLocations);
   }
 
+  /// Whether the preamble depends on the main file it was built for, see
+  /// MainFileDependenceChecker.
+  bool dependsOnMainFile() const { return DependsOnMainFile; }
+
+  std::vector<PreambleDependency> takeDependencies() {
+    return std::move(Dependencies);
+  }
+
   void AfterPCHEmitted(ASTWriter &Writer) override {
     TopLevelDeclIDs.reserve(TopLevelDecls.size());
     for (Decl *D : TopLevelDecls) {
@@ -143,19 +214,73 @@ public:
     SourceMgr = &CI.getSourceManager();
   }
 
+  void AfterExecute(CompilerInstance &CI) override {
+    if (!CollectDependencies)
+      return;
+    SourceManager &SM = CI.getSourceManager();
+    const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+    for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It) {
+      const FileEntry *File = It->first;
+      if (File == MainFile)
+        continue;
+      bool Invalid = false;
+      const llvm::MemoryBuffer *Buffer =
+          SM.getMemoryBufferForFile(File, &Invalid);
+      if (Invalid || !Buffer)
+        continue;
+      Dependencies.push_back(
+          makePreambleDependency(*File, Buffer->getBuffer()));
+    }
+  }
+
   std::unique_ptr<PPCallbacks> createPPCallbacks() override {
     assert(SourceMgr && "SourceMgr must be set at this point");
-    return llvm::make_unique<InclusionLocationsCollector>(*SourceMgr,
-                                                          IncLocations);
+    return llvm::make_unique<PPChainedCallbacks>(
+        llvm::make_unique<InclusionLocationsCollector>(*SourceMgr,
+                                                       IncLocations),
+        llvm::make_unique<MainFileDependenceChecker>(*SourceMgr,
+                                                     DependsOnMainFile));
   }
 
 private:
   std::vector<Decl *> TopLevelDecls;
   std::vector<serialization::DeclID> TopLevelDeclIDs;
   InclusionLocations IncLocations;
+  bool DependsOnMainFile = false;
+  const bool CollectDependencies;
+  std::vector<PreambleDependency> Dependencies;
   SourceManager *SourceMgr = nullptr;
 };
 
+std::unique_ptr<CompilerInvocation>
+buildCompilerInvocation(PathRef FileName, const ParseInputs &Inputs) {
+  std::vector<const char *> ArgStrs;
+  for (const auto &S : Inputs.CompileCommand.CommandLine)
+    ArgStrs.push_back(S.c_str());
+
+  if (Inputs.FS->setCurrentWorkingDirectory(Inputs.CompileCommand.Directory)) {
+    log("Couldn't set working directory");
+    // We run parsing anyway, our lit-tests rely on results for non-existing
+    // working dirs.
+  }
+
+  // FIXME(ibiryukov): store diagnostics from CommandLine when we start
+  // reporting them.
+  IgnoreDiagnostics IgnoreDiagnostics;
+  IntrusiveRefCntPtr<DiagnosticsEngine> CommandLineDiagsEngine =
+      CompilerInstance::createDiagnostics(new DiagnosticOptions,
+                                          &IgnoreDiagnostics, false);
+  std::unique_ptr<CompilerInvocation> CI = createInvocationFromCommandLine(
+      ArgStrs, CommandLineDiagsEngine, Inputs.FS);
+  if (!CI) {
+    log("Could not build CompilerInvocation for file " + FileName);
+    return nullptr;
+  }
+  // createInvocationFromCommandLine sets DisableFree.
+  CI->getFrontendOpts().DisableFree = false;
+  return CI;
+}
+
 } // namespace
 
 void clangd::dumpAST(ParsedAST &AST, llvm::raw_ostream &OS) {
@@ -168,12 +293,11 @@ ParsedAST::Build(std::unique_ptr<clang::CompilerInvocation> CI,
                  std::unique_ptr<llvm::MemoryBuffer> Buffer,
                  std::shared_ptr<PCHContainerOperations> PCHs,
                  IntrusiveRefCntPtr<vfs::FileSystem> VFS) {
-  const PrecompiledPreamble *PreamblePCH =
-      Preamble ? &Preamble->Preamble : nullptr;
+  const PreamblePCH *PCH = Preamble ? Preamble->Preamble.get() : nullptr;
 
   StoreDiags ASTDiags;
   auto Clang =
-      prepareCompilerInstance(std::move(CI), PreamblePCH, std::move(Buffer),
+      prepareCompilerInstance(std::move(CI), PCH, std::move(Buffer),
                               std::move(PCHs), std::move(VFS), ASTDiags);
   if (!Clang)
     return llvm::None;
@@ -295,13 +419,13 @@ const InclusionLocations &ParsedAST::getInclusionLocations() const {
   return IncLocations;
 }
 
-PreambleData::PreambleData(PrecompiledPreamble Preamble,
+PreambleData::PreambleData(std::unique_ptr<PreamblePCH> Preamble,
                            std::vector<serialization::DeclID> TopLevelDeclIDs,
                            std::vector<Diag> Diags,
-                           InclusionLocations IncLocations)
+                           InclusionLocations IncLocations, bool Shareable)
     : Preamble(std::move(Preamble)),
       TopLevelDeclIDs(std::move(TopLevelDeclIDs)), Diags(std::move(Diags)),
-      IncLocations(std::move(IncLocations)) {}
+      IncLocations(std::move(IncLocations)), Shareable(Shareable) {}
 
 ParsedAST::ParsedAST(std::shared_ptr<const PreambleData> Preamble,
                      std::unique_ptr<CompilerInstance> Clang,
@@ -316,11 +440,171 @@ ParsedAST::ParsedAST(std::shared_ptr<const PreambleData> Preamble,
   assert(this->Action);
 }
 
+PreambleCache::PreambleCache(std::size_t MaxBytes) : MaxBytes(MaxBytes) {}
+
+tooling::CompileCommand
+PreambleCache::getSharedCommand(PathRef File, tooling::CompileCommand Command) {
+  // Flags naming the outputs of the compilation, which don't affect the
+  // preamble. Their values usually differ between files.
+  static const StringRef OutputFlags[] = {"-o", "-MF", "-MT", "-MQ", "-MJ",
+                                          "-dependency-file",
+                                          "--serialize-diagnostics"};
+  static const StringRef JoinedOutputFlags[] = {"-MF", "-MT", "-MQ", "-MJ"};
+  static const StringRef DependencyFlags[] = {"-MD", "-MMD", "-MP"};
+  auto Normalize = [&](StringRef Path) {
+    llvm::SmallString<128> Result;
+    if (!llvm::sys::path::is_absolute(Path))
+      Result = Command.Directory;
+    llvm::sys::path::append(Result, Path);
+    llvm::sys::path::remove_dots(Result, /*remove_dot_dot=*/true);
+    return Result;
+  };
+  auto MainFile = Normalize(File);
+
+  std::vector<std::string> CommandLine;
+  for (std::size_t I = 0; I < Command.CommandLine.size(); ++I) {
+    StringRef Arg = Command.CommandLine[I];
+    if (llvm::is_contained(OutputFlags, Arg)) {
+      ++I; // Skip the value too.
+      continue;
+    }
+    if (llvm::is_contained(DependencyFlags, Arg) ||
+        llvm::any_of(JoinedOutputFlags,
+                     [&](StringRef Flag) { return Arg.startswith(Flag); }) ||
+        (Arg.startswith("-o") && !Arg.startswith("-obj")))
+      continue;
+    // The main file may be spelled relative to the working directory.
+    if (I > 0 && !Arg.startswith("-") && Normalize(Arg) == MainFile)
+      CommandLine.push_back("<main file>");
+    else
+      CommandLine.push_back(Arg);
+  }
+  Command.CommandLine = std::move(CommandLine);
+  Command.Filename = llvm::sys::path::parent_path(File).str();
+  Command.Output.clear();
+  return Command;
+}
+
+llvm::hash_code
+PreambleCache::computeKey(const tooling::CompileCommand &Command,
+                          const llvm::MemoryBuffer &Contents,
+                          const PreambleBounds &Bounds) {
+  return llvm::hash_combine(
+      Contents.getBuffer().take_front(Bounds.Size),
+      Bounds.PreambleEndsAtStartOfLine, Command.Directory, Command.Filename,
+      llvm::hash_combine_range(Command.CommandLine.begin(),
+                               Command.CommandLine.end()));
+}
+
+std::shared_ptr<const PreambleData>
+PreambleCache::get(PathRef File, const tooling::CompileCommand &Command,
+                   const CompilerInvocation &CI,
+                   const llvm::MemoryBuffer &Contents,
+                   const PreambleBounds &Bounds, vfs::FileSystem &FS) {
+  auto SharedCommand = getSharedCommand(File, Command);
+  llvm::hash_code Key = computeKey(SharedCommand, Contents, Bounds);
+  std::shared_ptr<const PreambleData> Preamble;
+  {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (auto It = Entries.begin(); It != Entries.end();) {
+      auto Candidate = It->Preamble.lock();
+      // Drop the entries of preambles which are not used anymore.
+      if (!Candidate) {
+        It = Entries.erase(It);
+        continue;
+      }
+      if (It->Key == Key && (It->File.empty() || It->File == File) &&
+          compileCommandsAreEqual(It->Command, SharedCommand)) {
+        Preamble = std::move(Candidate);
+        break;
+      }
+      ++It;
+    }
+  }
+  if (!Preamble)
+    return nullptr;
+
+  // CanReuse checks the preamble text, and that the files included by the
+  // preamble did not change since it was built. This stats all of them, so
+  // don't block the other files meanwhile.
+  bool Valid = Preamble->Preamble->canReuse(CI, &Contents, Bounds, &FS);
+
+  std::lock_guard<std::mutex> Lock(Mutex);
+  // The entry may have been replaced or dropped meanwhile.
+  auto It = llvm::find_if(Entries, [&](const Entry &E) {
+    return E.Preamble.lock() == Preamble;
+  });
+  if (It == Entries.end())
+    return Valid ? Preamble : nullptr;
+  if (!Valid) {
+    release(*It);
+    Entries.erase(It);
+    return nullptr;
+  }
+  Entries.splice(Entries.begin(), Entries, It);
+  retain(*It, Preamble);
+  evict();
+  return Preamble;
+}
+
+void PreambleCache::put(PathRef File, const tooling::CompileCommand &Command,
+                        const llvm::MemoryBuffer &Contents,
+                        const PreambleBounds &Bounds,
+                        std::shared_ptr<const PreambleData> Preamble) {
+  auto SharedCommand = getSharedCommand(File, Command);
+  llvm::hash_code Key = computeKey(SharedCommand, Contents, Bounds);
+  Path OwnerFile = Preamble->Shareable ? "" : File.str();
+  std::lock_guard<std::mutex> Lock(Mutex);
+  // Replace the preamble for the same inputs, if any.
+  for (auto It = Entries.begin(); It != Entries.end(); ++It) {
+    if (It->Key == Key && It->File == OwnerFile &&
+        compileCommandsAreEqual(It->Command, SharedCommand)) {
+      release(*It);
+      Entries.erase(It);
+      break;
+    }
+  }
+  Entries.push_front(Entry{Key, std::move(OwnerFile), std::move(SharedCommand),
+                           Preamble, nullptr});
+  retain(Entries.front(), std::move(Preamble));
+  evict();
+}
+
+std::size_t PreambleCache::getUsedBytes() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  return UsedBytes;
+}
+
+void PreambleCache::retain(Entry &E,
+                           std::shared_ptr<const PreambleData> Preamble) {
+  if (E.Retained)
+    return;
+  UsedBytes += Preamble->Preamble->getSize();
+  E.Retained = std::move(Preamble);
+}
+
+void PreambleCache::release(Entry &E) {
+  if (!E.Retained)
+    return;
+  UsedBytes -= E.Retained->Preamble->getSize();
+  E.Retained = nullptr;
+}
+
+void PreambleCache::evict() {
+  // Files using the released preambles keep them alive, and they can still be
+  // shared until then.
+  for (auto It = Entries.rbegin(); It != Entries.rend() && UsedBytes > MaxBytes;
+       ++It)
+    release(*It);
+}
+
 CppFile::CppFile(PathRef FileName, bool StorePreamblesInMemory,
                  std::shared_ptr<PCHContainerOperations> PCHs,
-                 ASTParsedCallback ASTCallback)
+                 ASTParsedCallback ASTCallback, PreambleCache *Cache,
+                 DiskPreambleCache *DiskCache)
     : FileName(FileName), StorePreamblesInMemory(StorePreamblesInMemory),
-      PCHs(std::move(PCHs)), ASTCallback(std::move(ASTCallback)) {
+      PCHs(std::move(PCHs)), ASTCallback(std::move(ASTCallback)),
+      Cache(Cache), DiskCache(DiskCache) {
   log("Created CppFile for " + FileName);
 }
 
@@ -329,39 +613,16 @@ llvm::Optional<std::vector<Diag>> CppFile::rebuild(ParseInputs &&Inputs) {
       Inputs.CompileCommand.Directory + "] " +
       llvm::join(Inputs.CompileCommand.CommandLine, " "));
 
-  std::vector<const char *> ArgStrs;
-  for (const auto &S : Inputs.CompileCommand.CommandLine)
-    ArgStrs.push_back(S.c_str());
-
-  if (Inputs.FS->setCurrentWorkingDirectory(Inputs.CompileCommand.Directory)) {
-    log("Couldn't set working directory");
-    // We run parsing anyway, our lit-tests rely on results for non-existing
-    // working dirs.
-  }
-
-  // Prepare CompilerInvocation.
-  std::unique_ptr<CompilerInvocation> CI;
-  {
-    // FIXME(ibiryukov): store diagnostics from CommandLine when we start
-    // reporting them.
-    IgnoreDiagnostics IgnoreDiagnostics;
-    IntrusiveRefCntPtr<DiagnosticsEngine> CommandLineDiagsEngine =
-        CompilerInstance::createDiagnostics(new DiagnosticOptions,
-                                            &IgnoreDiagnostics, false);
-    CI = createInvocationFromCommandLine(ArgStrs, CommandLineDiagsEngine,
-                                         Inputs.FS);
-    if (!CI) {
-      log("Could not build CompilerInvocation for file " + FileName);
-      AST = llvm::None;
-      Preamble = nullptr;
-      return llvm::None;
-    }
-    // createInvocationFromCommandLine sets DisableFree.
-    CI->getFrontendOpts().DisableFree = false;
+  std::unique_ptr<CompilerInvocation> CI =
+      buildCompilerInvocation(FileName, Inputs);
+  if (!CI) {
+    AST = llvm::None;
+    Preamble = nullptr;
+    return llvm::None;
   }
 
   std::unique_ptr<llvm::MemoryBuffer> ContentsBuffer =
-      llvm::MemoryBuffer::getMemBufferCopy(Inputs.Contents, FileName);
+      Inputs.Contents.toMemoryBuffer(FileName);
 
   // Compute updated Preamble.
   std::shared_ptr<const PreambleData> NewPreamble =
@@ -398,6 +659,18 @@ llvm::Optional<std::vector<Diag>> CppFile::rebuild(ParseInputs &&Inputs) {
   return Diagnostics;
 }
 
+llvm::Optional<ParsedAST> CppFile::buildAST(const ParseInputs &Inputs) const {
+  std::unique_ptr<CompilerInvocation> CI =
+      buildCompilerInvocation(FileName, Inputs);
+  if (!CI)
+    return llvm::None;
+  trace::Span Tracer("Build");
+  SPAN_ATTACH(Tracer, "File", FileName);
+  return ParsedAST::Build(std::move(CI), Preamble,
+                          Inputs.Contents.toMemoryBuffer(FileName), PCHs,
+                          Inputs.FS);
+}
+
 const std::shared_ptr<const PreambleData> &CppFile::getPreamble() const {
   return Preamble;
 }
@@ -408,12 +681,18 @@ ParsedAST *CppFile::getAST() const {
   return AST ? const_cast<ParsedAST *>(AST.getPointer()) : nullptr;
 }
 
+llvm::Optional<ParsedAST> CppFile::takeAST() {
+  llvm::Optional<ParsedAST> Result = std::move(AST);
+  AST = llvm::None;
+  return Result;
+}
+
 std::size_t CppFile::getUsedBytes() const {
   std::size_t Total = 0;
   if (AST)
     Total += AST->getUsedBytes();
   if (StorePreamblesInMemory && Preamble)
-    Total += Preamble->Preamble.getSize();
+    Total += Preamble->Preamble->getSize();
   return Total;
 }
 
@@ -425,10 +704,26 @@ CppFile::rebuildPreamble(CompilerInvocation &CI,
   const auto &OldPreamble = this->Preamble;
   auto Bounds = ComputePreambleBounds(*CI.getLangOpts(), &ContentsBuffer, 0);
   if (OldPreamble && compileCommandsAreEqual(this->Command, Command) &&
-      OldPreamble->Preamble.CanReuse(CI, &ContentsBuffer, Bounds, FS.get())) {
+      OldPreamble->Preamble->canReuse(CI, &ContentsBuffer, Bounds, FS.get())) {
     log("Reusing preamble for file " + Twine(FileName));
     return OldPreamble;
   }
+  if (Cache) {
+    if (auto Cached =
+            Cache->get(FileName, Command, CI, ContentsBuffer, Bounds, *FS)) {
+      log("Reusing shared preamble for file " + Twine(FileName));
+      return Cached;
+    }
+  }
+  if (DiskCache) {
+    if (auto Stored = DiskCache->load(FileName, Command, CI, ContentsBuffer,
+                                      Bounds, *FS)) {
+      log("Reusing stored preamble for file " + Twine(FileName));
+      if (Cache)
+        Cache->put(FileName, Command, ContentsBuffer, Bounds, Stored);
+      return Stored;
+    }
+  }
   log("Preamble for file " + Twine(FileName) +
       " cannot be reused. Attempting to rebuild it.");
 
@@ -444,7 +739,8 @@ CppFile::rebuildPreamble(CompilerInvocation &CI,
   assert(!CI.getFrontendOpts().SkipFunctionBodies);
   CI.getFrontendOpts().SkipFunctionBodies = true;
 
-  CppFilePreambleCallbacks SerializedDeclsCollector;
+  CppFilePreambleCallbacks SerializedDeclsCollector(
+      /*CollectDependencies=*/DiskCache != nullptr);
   auto BuiltPreamble = PrecompiledPreamble::Build(
       CI, &ContentsBuffer, Bounds, *PreambleDiagsEngine, FS, PCHs,
       /*StoreInMemory=*/StorePreamblesInMemory, SerializedDeclsCollector);
@@ -457,11 +753,21 @@ CppFile::rebuildPreamble(CompilerInvocation &CI,
     log("Built preamble of size " + Twine(BuiltPreamble->getSize()) +
         " for file " + Twine(FileName));
 
-    return std::make_shared<PreambleData>(
-        std::move(*BuiltPreamble),
-        SerializedDeclsCollector.takeTopLevelDeclIDs(),
-        PreambleDiagnostics.take(),
-        SerializedDeclsCollector.takeInclusionLocations());
+    auto Diags = PreambleDiagnostics.take();
+    // Diagnostics would be attributed to the main file the preamble was built
+    // for, don't share the preamble with other files.
+    bool Shareable =
+        Diags.empty() && !SerializedDeclsCollector.dependsOnMainFile();
+    auto Preamble = std::make_shared<PreambleData>(
+        wrapPreamble(std::move(*BuiltPreamble)),
+        SerializedDeclsCollector.takeTopLevelDeclIDs(), std::move(Diags),
+        SerializedDeclsCollector.takeInclusionLocations(), Shareable);
+    if (Cache)
+      Cache->put(FileName, Command, ContentsBuffer, Bounds, Preamble);
+    if (DiskCache)
+      DiskCache->store(FileName, Command, CI, ContentsBuffer, Bounds, *Preamble,
+                       SerializedDeclsCollector.takeDependencies(), FS);
+    return Preamble;
   } else {
     log("Could not build a preamble for file " + Twine(FileName));
     return nullptr;
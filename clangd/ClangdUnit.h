@@ -10,16 +10,21 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_CLANGDUNIT_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_CLANGDUNIT_H
 
+#include "Compiler.h"
 #include "Diagnostics.h"
 #include "Function.h"
 #include "Path.h"
 #include "Protocol.h"
+#include "Rope.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Serialization/ASTBitCodes.h"
 #include "clang/Tooling/CompilationDatabase.h"
 #include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/Hashing.h"
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -39,26 +44,33 @@ struct CompileCommand;
 }
 
 namespace clangd {
+class DiskPreambleCache;
 
 using InclusionLocations = std::vector<std::pair<Range, Path>>;
 
 // Stores Preamble and associated data.
 struct PreambleData {
-  PreambleData(PrecompiledPreamble Preamble,
+  PreambleData(std::unique_ptr<PreamblePCH> Preamble,
                std::vector<serialization::DeclID> TopLevelDeclIDs,
-               std::vector<Diag> Diags, InclusionLocations IncLocations);
+               std::vector<Diag> Diags, InclusionLocations IncLocations,
+               bool Shareable);
 
-  PrecompiledPreamble Preamble;
+  std::unique_ptr<PreamblePCH> Preamble;
   std::vector<serialization::DeclID> TopLevelDeclIDs;
   std::vector<Diag> Diags;
   InclusionLocations IncLocations;
+  /// Whether files other than the one the preamble was built for may use it.
+  /// Locations in the preamble region of the main file, e.g. of diagnostics
+  /// and macro definitions, refer to the file it was built for.
+  bool Shareable;
 };
 
 /// Information required to run clang, e.g. to parse AST or do code completion.
 struct ParseInputs {
   tooling::CompileCommand CompileCommand;
   IntrusiveRefCntPtr<vfs::FileSystem> FS;
-  std::string Contents;
+  /// Copies share the text, it is only flattened for the parser.
+  Rope Contents;
 };
 
 /// Stores and provides access to parsed AST.
@@ -127,28 +139,111 @@ private:
 
 using ASTParsedCallback = std::function<void(PathRef Path, ParsedAST *)>;
 
+/// Shares preambles between files, and keeps recently built preambles alive
+/// after the files using them are closed or reparsed, so that reopening a file
+/// does not require a preamble rebuild.
+/// Files can share a preamble if their preamble parts are identical and they
+/// are compiled with the same flags from the same directory: the directory of
+/// the main file matters, as quoted includes are resolved relative to it.
+/// Flags naming the outputs of the compilation are ignored. Only preambles
+/// which don't depend on their main file are shared (see
+/// PreambleData::Shareable), the others are only reused for the same file.
+/// Before a preamble is reused, it is validated against the file system, i.e.
+/// the headers it depends on must not have changed since it was built.
+/// Preambles stay available for sharing while any file uses them. In addition,
+/// the most recently used ones are retained by the cache, up to a limit on
+/// their total size.
+/// This class is thread-safe.
+class PreambleCache {
+public:
+  /// \p MaxBytes is the limit on the total size of the retained preambles. If
+  /// it is 0, the cache only shares preambles of files that are in use.
+  explicit PreambleCache(std::size_t MaxBytes);
+
+  /// Returns a preamble for \p Contents of \p File compiled with \p Command,
+  /// if one is available and still valid, and nullptr otherwise.
+  std::shared_ptr<const PreambleData>
+  get(PathRef File, const tooling::CompileCommand &Command,
+      const CompilerInvocation &CI, const llvm::MemoryBuffer &Contents,
+      const PreambleBounds &Bounds, vfs::FileSystem &FS);
+
+  /// Adds a preamble built for \p Contents of \p File with \p Command.
+  void put(PathRef File, const tooling::CompileCommand &Command,
+           const llvm::MemoryBuffer &Contents, const PreambleBounds &Bounds,
+           std::shared_ptr<const PreambleData> Preamble);
+
+  /// Returns the total size of the retained preambles, in bytes.
+  std::size_t getUsedBytes() const;
+
+private:
+  struct Entry {
+    llvm::hash_code Key;
+    /// The main file the preamble was built for if it isn't shareable, empty
+    /// otherwise.
+    Path File;
+    /// The compile command, without the name of the main file and outputs.
+    tooling::CompileCommand Command;
+    /// Valid while the preamble is used by any file, or retained.
+    std::weak_ptr<const PreambleData> Preamble;
+    /// Keeps the preamble alive when no file uses it. Null once evicted.
+    std::shared_ptr<const PreambleData> Retained;
+  };
+
+  static tooling::CompileCommand
+  getSharedCommand(PathRef File, tooling::CompileCommand Command);
+  static llvm::hash_code computeKey(const tooling::CompileCommand &Command,
+                                    const llvm::MemoryBuffer &Contents,
+                                    const PreambleBounds &Bounds);
+
+  /// Starts or stops retaining the preamble of \p E. Requires Mutex to be
+  /// held.
+  void retain(Entry &E, std::shared_ptr<const PreambleData> Preamble);
+  void release(Entry &E);
+  /// Releases the least recently used preambles until the retained ones fit
+  /// the limit. Requires Mutex to be held.
+  void evict();
+
+  const std::size_t MaxBytes;
+  mutable std::mutex Mutex;
+  /// The most recently used entries go first.
+  std::list<Entry> Entries;
+  std::size_t UsedBytes = 0;
+};
+
 /// Manages resources, required by clangd. Allows to rebuild file with new
 /// contents, and provides AST and Preamble for it.
 class CppFile {
 public:
+  /// If \p Cache is non-null, preambles are looked up in it before they are
+  /// built, and the built preambles are added to it, so that they can be
+  /// shared with other files. The same goes for \p DiskCache, which is
+  /// consulted after \p Cache.
   CppFile(PathRef FileName, bool StorePreamblesInMemory,
           std::shared_ptr<PCHContainerOperations> PCHs,
-          ASTParsedCallback ASTCallback);
+          ASTParsedCallback ASTCallback, PreambleCache *Cache = nullptr,
+          DiskPreambleCache *DiskCache = nullptr);
 
   /// Rebuild the AST and the preamble.
   /// Returns a list of diagnostics or llvm::None, if an error occured.
   llvm::Optional<std::vector<Diag>> rebuild(ParseInputs &&Inputs);
+  /// Builds an AST for \p Inputs with the last built preamble, without
+  /// changing the state of the file or running the callback. Used to rebuild
+  /// ASTs that were dropped to save memory, \p Inputs must be the ones of the
+  /// last rebuild().
+  llvm::Optional<ParsedAST> buildAST(const ParseInputs &Inputs) const;
   /// Returns the last built preamble.
   const std::shared_ptr<const PreambleData> &getPreamble() const;
   /// Returns the last built AST.
   ParsedAST *getAST() const;
+  /// Moves the last built AST out, getAST() returns null afterwards.
+  llvm::Optional<ParsedAST> takeAST();
   /// Returns an estimated size, in bytes, currently occupied by the AST and the
   /// Preamble.
   std::size_t getUsedBytes() const;
 
 private:
-  /// Build a new preamble for \p Inputs. If the current preamble can be reused,
-  /// it is returned instead.
+  /// Build a new preamble for \p Inputs. If the current preamble or a cached
+  /// one can be reused, it is returned instead.
   /// This method is const to ensure we don't incidentally modify any fields.
   std::shared_ptr<const PreambleData>
   rebuildPreamble(CompilerInvocation &CI,
@@ -170,6 +265,10 @@ private:
   /// This is called after the file is parsed. This can be nullptr if there is
   /// no callback.
   ASTParsedCallback ASTCallback;
+  /// Preambles shared with other files, can be nullptr.
+  PreambleCache *Cache;
+  /// Preambles stored on disk, can be nullptr.
+  DiskPreambleCache *DiskCache;
 };
 
 /// Get the beginning SourceLocation at a specified \p Pos.
@@ -15,6 +15,7 @@
 //===---------------------------------------------------------------------===//
 
 #include "CodeComplete.h"
+#include "Cancellation.h"
 #include "CodeCompletionStrings.h"
 #include "Compiler.h"
 #include "FuzzyMatch.h"
@@ -666,7 +667,7 @@ private:
 struct SemaCompleteInput {
   PathRef FileName;
   const tooling::CompileCommand &Command;
-  PrecompiledPreamble const *Preamble;
+  PreamblePCH const *Preamble;
   StringRef Contents;
   Position Pos;
   IntrusiveRefCntPtr<vfs::FileSystem> VFS;
@@ -713,7 +714,7 @@ bool semaCodeComplete(std::unique_ptr<CodeCompleteConsumer> Consumer,
     // clients relying on getting stats for preamble files during code
     // completion.
     // Note that results of CanReuse() are ignored, see the comment above.
-    Input.Preamble->CanReuse(*CI, ContentsBuffer.get(), Bounds,
+    Input.Preamble->canReuse(*CI, ContentsBuffer.get(), Bounds,
                              Input.VFS.get());
   }
   // The diagnostic options must be set before creating a CompilerInstance.
@@ -867,6 +868,11 @@ public:
     });
 
     Recorder = RecorderOwner.get();
+    // Don't start the expensive Sema run if nobody needs the results.
+    if (isCancelled()) {
+      SPAN_ATTACH(Tracer, "cancelled", true);
+      return Output;
+    }
     semaCodeComplete(std::move(RecorderOwner), Opts.getClangCompleteOpts(),
                      SemaCCInput);
 
@@ -889,6 +895,9 @@ private:
   // This is called by run() once Sema code completion is done, but before the
   // Sema data structures are torn down. It does all the real work.
   CompletionList runWithSema() {
+    // The request may have been cancelled while Sema was running.
+    if (isCancelled())
+      return CompletionList();
     Filter = FuzzyMatcher(
         Recorder->CCSema->getPreprocessor().getCodeCompletionFilter());
     // Sema provides the needed context to query the index.
@@ -925,8 +934,15 @@ private:
                       Req.Query,
                       llvm::join(Req.Scopes.begin(), Req.Scopes.end(), ",")));
     // Run the query against the index.
-    if (Opts.Index->fuzzyFind(
-            Req, [&](const Symbol &Sym) { ResultsBuilder.insert(Sym); }))
+    auto More = Opts.Index->fuzzyFind(
+        Req, [&](const Symbol &Sym) { ResultsBuilder.insert(Sym); });
+    if (!More) {
+      // The request was cancelled, the results won't be used.
+      log("Code complete: index query failed: " +
+          llvm::toString(More.takeError()));
+      return SymbolSlab();
+    }
+    if (*More)
       Incomplete = true;
     return std::move(ResultsBuilder).build();
   }
@@ -1000,7 +1016,7 @@ private:
 
 CompletionList codeComplete(PathRef FileName,
                             const tooling::CompileCommand &Command,
-                            PrecompiledPreamble const *Preamble,
+                            PreamblePCH const *Preamble,
                             StringRef Contents, Position Pos,
                             IntrusiveRefCntPtr<vfs::FileSystem> VFS,
                             std::shared_ptr<PCHContainerOperations> PCHs,
@@ -1011,7 +1027,7 @@ CompletionList codeComplete(PathRef FileName,
 
 SignatureHelp signatureHelp(PathRef FileName,
                             const tooling::CompileCommand &Command,
-                            PrecompiledPreamble const *Preamble,
+                            PreamblePCH const *Preamble,
                             StringRef Contents, Position Pos,
                             IntrusiveRefCntPtr<vfs::FileSystem> VFS,
                             std::shared_ptr<PCHContainerOperations> PCHs) {
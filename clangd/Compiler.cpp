@@ -16,6 +16,35 @@
 
 namespace clang {
 namespace clangd {
+namespace {
+
+class BuiltPreamble : public PreamblePCH {
+public:
+  BuiltPreamble(PrecompiledPreamble Preamble) : Preamble(std::move(Preamble)) {}
+
+  bool canReuse(const CompilerInvocation &Invocation,
+                const llvm::MemoryBuffer *MainFileBuffer, PreambleBounds Bounds,
+                vfs::FileSystem *VFS) const override {
+    return Preamble.CanReuse(Invocation, MainFileBuffer, Bounds, VFS);
+  }
+
+  void overridePreamble(CompilerInvocation &CI,
+                        IntrusiveRefCntPtr<vfs::FileSystem> &VFS,
+                        llvm::MemoryBuffer *MainFileBuffer) const override {
+    Preamble.OverridePreamble(CI, VFS, MainFileBuffer);
+  }
+
+  std::size_t getSize() const override { return Preamble.getSize(); }
+
+private:
+  PrecompiledPreamble Preamble;
+};
+
+} // namespace
+
+std::unique_ptr<PreamblePCH> wrapPreamble(PrecompiledPreamble Preamble) {
+  return llvm::make_unique<BuiltPreamble>(std::move(Preamble));
+}
 
 void IgnoreDiagnostics::log(DiagnosticsEngine::Level DiagLevel,
                             const clang::Diagnostic &Info) {
@@ -41,7 +70,7 @@ void IgnoreDiagnostics::HandleDiagnostic(DiagnosticsEngine::Level DiagLevel,
 
 std::unique_ptr<CompilerInstance>
 prepareCompilerInstance(std::unique_ptr<clang::CompilerInvocation> CI,
-                        const PrecompiledPreamble *Preamble,
+                        const PreamblePCH *Preamble,
                         std::unique_ptr<llvm::MemoryBuffer> Buffer,
                         std::shared_ptr<PCHContainerOperations> PCHs,
                         IntrusiveRefCntPtr<vfs::FileSystem> VFS,
@@ -54,7 +83,7 @@ prepareCompilerInstance(std::unique_ptr<clang::CompilerInvocation> CI,
   // NOTE: we use Buffer.get() when adding remapped files, so we have to make
   // sure it will be released if no error is emitted.
   if (Preamble) {
-    Preamble->OverridePreamble(*CI, VFS, Buffer.get());
+    Preamble->overridePreamble(*CI, VFS, Buffer.get());
   } else {
     CI->getPreprocessorOpts().addRemappedFile(
         CI->getFrontendOpts().Inputs[0].getFile(), Buffer.get());
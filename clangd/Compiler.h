@@ -31,6 +31,33 @@ public:
                         const clang::Diagnostic &Info) override;
 };
 
+/// A precompiled preamble, used to parse the main file faster. Either built by
+/// clang in this process (see PrecompiledPreamble), or loaded from the preamble
+/// cache on disk (see DiskPreambleCache).
+class PreamblePCH {
+public:
+  virtual ~PreamblePCH() = default;
+
+  /// Checks that the preamble can be used for \p MainFileBuffer, i.e. that the
+  /// preamble part of the file is the same, and so are the files it includes.
+  virtual bool canReuse(const CompilerInvocation &Invocation,
+                        const llvm::MemoryBuffer *MainFileBuffer,
+                        PreambleBounds Bounds, vfs::FileSystem *VFS) const = 0;
+
+  /// Changes options inside \p CI to use the preamble when parsing
+  /// \p MainFileBuffer. \p VFS may be replaced by an overlay, which makes the
+  /// PCH accessible.
+  virtual void overridePreamble(CompilerInvocation &CI,
+                                IntrusiveRefCntPtr<vfs::FileSystem> &VFS,
+                                llvm::MemoryBuffer *MainFileBuffer) const = 0;
+
+  /// Returns the size of the PCH, in bytes.
+  virtual std::size_t getSize() const = 0;
+};
+
+/// Wraps a preamble built by clang.
+std::unique_ptr<PreamblePCH> wrapPreamble(PrecompiledPreamble Preamble);
+
 /// Creates a compiler instance, configured so that:
 ///   - Contents of the parsed file are remapped to \p MainFile.
 ///   - Preamble is overriden to use PCH passed to this function. It means the
@@ -42,7 +69,7 @@ public:
 /// be consumed by FrontendAction::BeginSourceFile to properly destroy \p
 /// MainFile.
 std::unique_ptr<CompilerInstance> prepareCompilerInstance(
-    std::unique_ptr<clang::CompilerInvocation>, const PrecompiledPreamble *,
+    std::unique_ptr<clang::CompilerInvocation>, const PreamblePCH *,
     std::unique_ptr<llvm::MemoryBuffer> MainFile,
     std::shared_ptr<PCHContainerOperations>,
     IntrusiveRefCntPtr<vfs::FileSystem>, DiagnosticConsumer &);
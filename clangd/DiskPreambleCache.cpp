@@ -0,0 +1,458 @@
+//===--- DiskPreambleCache.cpp - Preambles persisted across runs -*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DiskPreambleCache.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/Version.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include <algorithm>
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+namespace {
+
+constexpr char Magic[] = {'C', 'd', 'P', 'r'};
+constexpr uint32_t Version = 1;
+constexpr size_t HeaderSize = 16;
+constexpr char Extension[] = ".preamble";
+
+void write8(uint8_t V, raw_ostream &OS) { OS << static_cast<char>(V); }
+
+void write32(uint32_t V, raw_ostream &OS) {
+  char Buf[4];
+  support::endian::write32le(Buf, V);
+  OS.write(Buf, sizeof(Buf));
+}
+
+void write64(uint64_t V, raw_ostream &OS) {
+  char Buf[8];
+  support::endian::write64le(Buf, V);
+  OS.write(Buf, sizeof(Buf));
+}
+
+void writeString(StringRef S, raw_ostream &OS) {
+  write32(S.size(), OS);
+  OS << S;
+}
+
+// Reads the values written by the functions above, in the same order. Reading
+// past the end sets the error flag, and returns zeroes and empty strings.
+class Reader {
+public:
+  explicit Reader(StringRef Data) : Data(Data) {}
+
+  StringRef consume(uint64_t N) {
+    if (N > Data.size()) {
+      Err = true;
+      Data = "";
+      return "";
+    }
+    StringRef Result = Data.take_front(N);
+    Data = Data.drop_front(N);
+    return Result;
+  }
+  uint8_t consume8() {
+    StringRef Bytes = consume(1);
+    return Bytes.empty() ? 0 : static_cast<uint8_t>(Bytes[0]);
+  }
+  uint32_t consume32() {
+    StringRef Bytes = consume(4);
+    return Bytes.empty() ? 0 : support::endian::read32le(Bytes.data());
+  }
+  uint64_t consume64() {
+    StringRef Bytes = consume(8);
+    return Bytes.empty() ? 0 : support::endian::read64le(Bytes.data());
+  }
+  StringRef consumeString() { return consume(consume32()); }
+
+  bool err() const { return Err; }
+  bool eof() const { return Data.empty(); }
+
+private:
+  StringRef Data;
+  bool Err = false;
+};
+
+MD5::MD5Result hashContents(StringRef Contents) {
+  MD5 Hash;
+  Hash.update(Contents);
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  return Result;
+}
+
+bool isUnchanged(const PreambleDependency &Dep, vfs::FileSystem &FS) {
+  auto Status = FS.status(Dep.Path);
+  if (!Status || Status->getSize() != Dep.Size)
+    return false;
+  if (sys::toTimeT(Status->getLastModificationTime()) == Dep.ModificationTime)
+    return true;
+  // The file was touched, e.g. by checking out another revision and back.
+  auto Buffer = FS.getBufferForFile(Dep.Path);
+  return Buffer && hashContents((*Buffer)->getBuffer()) == Dep.Hash;
+}
+
+// Bumps the modification time of a stored preamble, which serves as its last
+// use time for eviction.
+void touch(StringRef Path) {
+  int FD;
+  if (sys::fs::openFileForRead(Path, FD))
+    return;
+  sys::fs::setLastModificationAndAccessTime(FD,
+                                            std::chrono::system_clock::now());
+  sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+// A PCH loaded from the preamble cache. Owns the (typically memory-mapped)
+// file it was loaded from.
+class DiskPreamble : public PreamblePCH {
+public:
+  DiskPreamble(std::unique_ptr<MemoryBuffer> Buffer, std::string PCHPath)
+      : Buffer(std::move(Buffer)), PCHPath(std::move(PCHPath)) {}
+
+  bool canReuse(const CompilerInvocation &Invocation,
+                const MemoryBuffer *MainFileBuffer, PreambleBounds Bounds,
+                vfs::FileSystem *VFS) const override {
+    if (Bounds.Size != PreambleText.size() ||
+        Bounds.PreambleEndsAtStartOfLine != PreambleEndsAtStartOfLine ||
+        !MainFileBuffer->getBuffer().startswith(PreambleText))
+      return false;
+    return llvm::all_of(Dependencies, [&](const PreambleDependency &Dep) {
+      return isUnchanged(Dep, *VFS);
+    });
+  }
+
+  void overridePreamble(CompilerInvocation &CI,
+                        IntrusiveRefCntPtr<vfs::FileSystem> &VFS,
+                        MemoryBuffer *MainFileBuffer) const override {
+    // Sets the same options as PrecompiledPreamble::OverridePreamble.
+    auto Bounds = ComputePreambleBounds(*CI.getLangOpts(), MainFileBuffer, 0);
+    auto &PPOpts = CI.getPreprocessorOpts();
+    PPOpts.addRemappedFile(CI.getFrontendOpts().Inputs[0].getFile(),
+                           MainFileBuffer);
+    PPOpts.PrecompiledPreambleBytes.first = Bounds.Size;
+    PPOpts.PrecompiledPreambleBytes.second = Bounds.PreambleEndsAtStartOfLine;
+    PPOpts.DisablePCHValidation = true;
+    PPOpts.ImplicitPCHInclude = PCHPath;
+
+    // Serve the PCH from the buffer, so that it isn't read again.
+    IntrusiveRefCntPtr<vfs::InMemoryFileSystem> PCHFS(
+        new vfs::InMemoryFileSystem());
+    PCHFS->addFile(
+        PCHPath, /*ModificationTime=*/0,
+        MemoryBuffer::getMemBuffer(PCH, PCHPath,
+                                   /*RequiresNullTerminator=*/false));
+    IntrusiveRefCntPtr<vfs::OverlayFileSystem> Overlay(
+        new vfs::OverlayFileSystem(VFS));
+    Overlay->pushOverlay(PCHFS);
+    VFS = Overlay;
+  }
+
+  std::size_t getSize() const override { return PCH.size(); }
+
+  // Point into Buffer.
+  StringRef PCH;
+  StringRef PreambleText;
+  bool PreambleEndsAtStartOfLine = false;
+  std::vector<PreambleDependency> Dependencies;
+
+private:
+  std::unique_ptr<MemoryBuffer> Buffer;
+  // A path under which the PCH is made available to the compiler. It does not
+  // exist on disk.
+  std::string PCHPath;
+};
+
+Expected<std::shared_ptr<const PreambleData>>
+readPreamble(std::unique_ptr<MemoryBuffer> Buffer, StringRef Path,
+             StringRef File, const tooling::CompileCommand &Command) {
+  auto Invalid = [](const Twine &Message) {
+    return make_error<StringError>("invalid stored preamble: " + Message,
+                                   errc::invalid_argument);
+  };
+  StringRef Data = Buffer->getBuffer();
+  if (Data.size() < HeaderSize || !Data.startswith(StringRef(Magic, 4)))
+    return Invalid("bad magic");
+  Reader In(Data.drop_front(sizeof(Magic)));
+  uint32_t StoredVersion = In.consume32();
+  if (StoredVersion != Version)
+    return Invalid("unsupported version " + Twine(StoredVersion));
+
+  SmallString<128> PCHPath(Path);
+  sys::path::replace_extension(PCHPath, ".pch");
+  auto PCH = llvm::make_unique<DiskPreamble>(std::move(Buffer), PCHPath.str());
+  PCH->PCH = In.consume(In.consume64());
+  PCH->PreambleText = In.consumeString();
+  PCH->PreambleEndsAtStartOfLine = In.consume8();
+
+  // The file name is a hash of these, make sure they match.
+  bool SameCommand = In.consumeString() == File &&
+                     In.consumeString() == Command.Directory &&
+                     In.consume32() == Command.CommandLine.size();
+  for (std::size_t I = 0; SameCommand && I < Command.CommandLine.size(); ++I)
+    SameCommand = In.consumeString() == Command.CommandLine[I];
+  if (!SameCommand)
+    return Invalid("stored for a different compile command");
+
+  uint32_t NumDependencies = In.consume32();
+  for (uint32_t I = 0; I < NumDependencies && !In.err(); ++I) {
+    PreambleDependency Dep;
+    Dep.Path = In.consumeString();
+    Dep.Size = In.consume64();
+    Dep.ModificationTime = static_cast<int64_t>(In.consume64());
+    StringRef Hash = In.consume(Dep.Hash.Bytes.size());
+    std::copy(Hash.begin(), Hash.end(), Dep.Hash.Bytes.begin());
+    PCH->Dependencies.push_back(std::move(Dep));
+  }
+
+  std::vector<serialization::DeclID> TopLevelDeclIDs;
+  uint32_t NumDecls = In.consume32();
+  for (uint32_t I = 0; I < NumDecls && !In.err(); ++I)
+    TopLevelDeclIDs.push_back(In.consume32());
+
+  InclusionLocations IncLocations;
+  uint32_t NumInclusions = In.consume32();
+  for (uint32_t I = 0; I < NumInclusions && !In.err(); ++I) {
+    Range Loc;
+    Loc.start.line = In.consume32();
+    Loc.start.character = In.consume32();
+    Loc.end.line = In.consume32();
+    Loc.end.character = In.consume32();
+    IncLocations.emplace_back(Loc, In.consumeString());
+  }
+  bool Shareable = In.consume8();
+
+  if (In.err() || !In.eof())
+    return Invalid("size mismatch");
+  return std::make_shared<PreambleData>(std::move(PCH),
+                                        std::move(TopLevelDeclIDs),
+                                        /*Diags=*/std::vector<Diag>(),
+                                        std::move(IncLocations), Shareable);
+}
+
+} // namespace
+
+PreambleDependency makePreambleDependency(const FileEntry &File,
+                                          StringRef Contents) {
+  PreambleDependency Dep;
+  Dep.Path = File.getName();
+  Dep.Size = File.getSize();
+  Dep.ModificationTime = File.getModificationTime();
+  Dep.Hash = hashContents(Contents);
+  return Dep;
+}
+
+DiskPreambleCache::DiskPreambleCache(StringRef Directory, std::size_t MaxBytes)
+    : Directory([&] {
+        SmallString<128> Path(Directory);
+        sys::fs::make_absolute(Path);
+        return Path.str().str();
+      }()),
+      MaxBytes(MaxBytes) {
+  if (auto EC = sys::fs::create_directories(this->Directory))
+    log("Could not create preamble cache directory " + this->Directory + ": " +
+        EC.message());
+}
+
+std::string
+DiskPreambleCache::getPath(PathRef File, const tooling::CompileCommand &Command,
+                           const MemoryBuffer &Contents,
+                           const PreambleBounds &Bounds) const {
+  MD5 Hash;
+  auto Add = [&](StringRef Data) {
+    Hash.update(Data);
+    Hash.update(StringRef("\0", 1));
+  };
+  // PCHs can only be read by the same version of clang.
+  Add(getClangFullRepositoryVersion());
+  Add(File);
+  Add(Command.Directory);
+  for (const std::string &Arg : Command.CommandLine)
+    Add(Arg);
+  Add(Contents.getBuffer().take_front(Bounds.Size));
+  Add(Bounds.PreambleEndsAtStartOfLine ? "1" : "0");
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  SmallString<128> Path(Directory);
+  sys::path::append(Path, Twine(Result.digest()) + Extension);
+  return Path.str();
+}
+
+std::shared_ptr<const PreambleData>
+DiskPreambleCache::load(PathRef File, const tooling::CompileCommand &Command,
+                        const CompilerInvocation &CI,
+                        const MemoryBuffer &Contents,
+                        const PreambleBounds &Bounds, vfs::FileSystem &FS) {
+  std::string Path = getPath(File, Command, Contents, Bounds);
+  auto Buffer = MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return nullptr; // Not stored.
+
+  trace::Span Tracer("LoadPreamble");
+  SPAN_ATTACH(Tracer, "File", File);
+  auto Preamble = readPreamble(std::move(*Buffer), Path, File, Command);
+  if (!Preamble) {
+    log("Ignoring stored preamble " + Path + ": " +
+        llvm::toString(Preamble.takeError()));
+    return nullptr;
+  }
+  // Checks the preamble text and the files the preamble depends on.
+  if (!(*Preamble)->Preamble->canReuse(CI, &Contents, Bounds, &FS)) {
+    log("Stored preamble for " + Twine(File) + " is out of date");
+    SPAN_ATTACH(Tracer, "valid", false);
+    return nullptr;
+  }
+  SPAN_ATTACH(Tracer, "valid", true);
+  touch(Path);
+  return std::move(*Preamble);
+}
+
+void DiskPreambleCache::store(PathRef File,
+                              const tooling::CompileCommand &Command,
+                              const CompilerInvocation &CI,
+                              MemoryBuffer &Contents,
+                              const PreambleBounds &Bounds,
+                              const PreambleData &Preamble,
+                              ArrayRef<PreambleDependency> Dependencies,
+                              IntrusiveRefCntPtr<vfs::FileSystem> FS) {
+  // We don't serialize diagnostics.
+  if (!Preamble.Diags.empty())
+    return;
+  trace::Span Tracer("StorePreamble");
+  SPAN_ATTACH(Tracer, "File", File);
+
+  // Read the PCH back the way the compiler would, through the options and the
+  // file system set up for it. This works for PCHs stored in memory and in
+  // temporary files alike.
+  CompilerInvocation PCHInvocation(CI);
+  Preamble.Preamble->overridePreamble(PCHInvocation, FS, &Contents);
+  auto PCH = FS->getBufferForFile(
+      PCHInvocation.getPreprocessorOpts().ImplicitPCHInclude);
+  if (!PCH) {
+    log("Could not read the PCH of the preamble for " + Twine(File) + ": " +
+        PCH.getError().message());
+    return;
+  }
+
+  // Write to a temporary file and rename it, so that the preamble never
+  // appears partially written to other clangd instances.
+  std::string Path = getPath(File, Command, Contents, Bounds);
+  SmallString<128> TempPath;
+  int FD;
+  if (auto EC = sys::fs::createUniqueFile(Path + ".tmp-%%%%%%%%", FD,
+                                          TempPath)) {
+    log("Could not create a file in the preamble cache: " + EC.message());
+    return;
+  }
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS.write(Magic, sizeof(Magic));
+    write32(Version, OS);
+    write64((*PCH)->getBufferSize(), OS);
+    OS << (*PCH)->getBuffer();
+    writeString(Contents.getBuffer().take_front(Bounds.Size), OS);
+    write8(Bounds.PreambleEndsAtStartOfLine, OS);
+
+    writeString(File, OS);
+    writeString(Command.Directory, OS);
+    write32(Command.CommandLine.size(), OS);
+    for (const std::string &Arg : Command.CommandLine)
+      writeString(Arg, OS);
+
+    write32(Dependencies.size(), OS);
+    for (const PreambleDependency &Dep : Dependencies) {
+      writeString(Dep.Path, OS);
+      write64(Dep.Size, OS);
+      write64(static_cast<uint64_t>(Dep.ModificationTime), OS);
+      OS.write(reinterpret_cast<const char *>(Dep.Hash.Bytes.data()),
+               Dep.Hash.Bytes.size());
+    }
+
+    write32(Preamble.TopLevelDeclIDs.size(), OS);
+    for (serialization::DeclID ID : Preamble.TopLevelDeclIDs)
+      write32(ID, OS);
+
+    write32(Preamble.IncLocations.size(), OS);
+    for (const auto &Inclusion : Preamble.IncLocations) {
+      write32(Inclusion.first.start.line, OS);
+      write32(Inclusion.first.start.character, OS);
+      write32(Inclusion.first.end.line, OS);
+      write32(Inclusion.first.end.character, OS);
+      writeString(Inclusion.second, OS);
+    }
+    write8(Preamble.Shareable, OS);
+
+    if (OS.has_error()) {
+      log("Could not write to the preamble cache: " + TempPath);
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (auto EC = sys::fs::rename(TempPath, Path)) {
+    log("Could not write to the preamble cache: " + EC.message());
+    sys::fs::remove(TempPath);
+    return;
+  }
+  evict();
+}
+
+void DiskPreambleCache::evict() {
+  std::lock_guard<std::mutex> Lock(EvictionMutex);
+  struct StoredPreamble {
+    std::string Path;
+    uint64_t Size;
+    sys::TimePoint<> LastUsed;
+  };
+  std::vector<StoredPreamble> Stored;
+  uint64_t TotalBytes = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator It(Directory, EC), End; It != End && !EC;
+       It.increment(EC)) {
+    if (sys::path::extension(It->path()) != Extension)
+      continue;
+    sys::fs::file_status Status;
+    if (sys::fs::status(It->path(), Status))
+      continue;
+    Stored.push_back(
+        {It->path(), Status.getSize(), Status.getLastModificationTime()});
+    TotalBytes += Status.getSize();
+  }
+  if (TotalBytes <= MaxBytes)
+    return;
+
+  std::sort(Stored.begin(), Stored.end(),
+            [](const StoredPreamble &L, const StoredPreamble &R) {
+              return L.LastUsed < R.LastUsed;
+            });
+  for (const StoredPreamble &S : Stored) {
+    if (TotalBytes <= MaxBytes)
+      break;
+    // Another clangd may still use the file, it keeps it open.
+    sys::fs::remove(S.Path);
+    TotalBytes -= S.Size;
+    log("Evicted stored preamble " + S.Path);
+  }
+}
+
+} // namespace clangd
+} // namespace clang
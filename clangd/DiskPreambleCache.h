@@ -0,0 +1,97 @@
+//===--- DiskPreambleCache.h - Preambles persisted across runs --*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A directory of preamble PCHs, which lets clangd reuse preambles after a
+// restart instead of building them again.
+//
+// Each preamble is stored in a single file, named after a hash of the main
+// file, its compile command, the preamble text and the clang version. The file
+// consists of (all integers are little-endian):
+//  - a header: the "CdPr" magic, the format version (uint32) and the size of
+//    the PCH (uint64);
+//  - the PCH;
+//  - the data needed to validate and use the PCH: the preamble text and the
+//    compile command (to rule out hash collisions), the files the preamble
+//    depends on, and the remaining fields of PreambleData.
+//
+//===---------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_DISKPREAMBLECACHE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_DISKPREAMBLECACHE_H
+
+#include "ClangdUnit.h"
+#include "llvm/Support/MD5.h"
+#include <mutex>
+
+namespace clang {
+class FileEntry;
+
+namespace clangd {
+
+/// A file included by a preamble, as it was when the preamble was built.
+struct PreambleDependency {
+  std::string Path;
+  uint64_t Size;
+  /// Modification time, in seconds since the epoch.
+  int64_t ModificationTime;
+  llvm::MD5::MD5Result Hash;
+};
+
+/// Records the state of \p File with \p Contents, included by a preamble.
+PreambleDependency makePreambleDependency(const FileEntry &File,
+                                          llvm::StringRef Contents);
+
+/// Stores preambles in a directory, so that they survive restarts of clangd.
+/// A stored preamble is reused only for the same main file and compile
+/// command. Before it is reused, every file it depends on is checked: the size
+/// must match, and if the modification time differs, the content hash must
+/// match.
+/// Preambles with diagnostics are not stored.
+/// When the stored preambles take more than the size limit, the least recently
+/// used ones are removed. Several clangd instances can share the directory.
+/// This class is thread-safe.
+class DiskPreambleCache {
+public:
+  /// \p MaxBytes is the limit on the total size of the stored preambles.
+  DiskPreambleCache(llvm::StringRef Directory, std::size_t MaxBytes);
+
+  /// Returns the stored preamble for \p Contents of \p File compiled with
+  /// \p Command, if there is one and it is still valid, and nullptr otherwise.
+  std::shared_ptr<const PreambleData>
+  load(PathRef File, const tooling::CompileCommand &Command,
+       const CompilerInvocation &CI, const llvm::MemoryBuffer &Contents,
+       const PreambleBounds &Bounds, vfs::FileSystem &FS);
+
+  /// Stores \p Preamble, built for \p Contents of \p File with \p Command.
+  /// \p Dependencies are the files included by the preamble. \p FS must be
+  /// the file system the preamble was built with.
+  void store(PathRef File, const tooling::CompileCommand &Command,
+             const CompilerInvocation &CI, llvm::MemoryBuffer &Contents,
+             const PreambleBounds &Bounds, const PreambleData &Preamble,
+             llvm::ArrayRef<PreambleDependency> Dependencies,
+             IntrusiveRefCntPtr<vfs::FileSystem> FS);
+
+private:
+  std::string getPath(PathRef File, const tooling::CompileCommand &Command,
+                      const llvm::MemoryBuffer &Contents,
+                      const PreambleBounds &Bounds) const;
+  /// Removes the least recently used preambles until the others fit the
+  /// limit.
+  void evict();
+
+  const std::string Directory;
+  const std::size_t MaxBytes;
+  /// Serializes evictions, loads and stores don't need it.
+  std::mutex EvictionMutex;
+};
+
+} // namespace clangd
+} // namespace clang
+
+#endif
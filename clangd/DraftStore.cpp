@@ -14,7 +14,7 @@
 using namespace clang;
 using namespace clang::clangd;
 
-llvm::Optional<std::string> DraftStore::getDraft(PathRef File) const {
+llvm::Optional<Rope> DraftStore::getDraft(PathRef File) const {
   std::lock_guard<std::mutex> Lock(Mutex);
 
   auto It = Drafts.find(File);
@@ -37,10 +37,10 @@ std::vector<Path> DraftStore::getActiveFiles() const {
 void DraftStore::addDraft(PathRef File, StringRef Contents) {
   std::lock_guard<std::mutex> Lock(Mutex);
 
-  Drafts[File] = Contents;
+  Drafts[File] = Rope(Contents);
 }
 
-llvm::Expected<std::string> DraftStore::updateDraft(
+llvm::Expected<Rope> DraftStore::updateDraft(
     PathRef File, llvm::ArrayRef<TextDocumentContentChangeEvent> Changes) {
   std::lock_guard<std::mutex> Lock(Mutex);
 
@@ -51,11 +51,11 @@ llvm::Expected<std::string> DraftStore::updateDraft(
         llvm::errc::invalid_argument);
   }
 
-  std::string Contents = EntryIt->second;
+  Rope Contents = EntryIt->second;
 
   for (const TextDocumentContentChangeEvent &Change : Changes) {
     if (!Change.range) {
-      Contents = Change.text;
+      Contents = Rope(Change.text);
       continue;
     }
 
@@ -85,15 +85,7 @@ llvm::Expected<std::string> DraftStore::updateDraft(
                         *Change.rangeLength, *EndIndex - *StartIndex),
           llvm::errc::invalid_argument);
 
-    std::string NewContents;
-    NewContents.reserve(*StartIndex + Change.text.length() +
-                        (Contents.length() - *EndIndex));
-
-    NewContents = Contents.substr(0, *StartIndex);
-    NewContents += Change.text;
-    NewContents += Contents.substr(*EndIndex);
-
-    Contents = std::move(NewContents);
+    Contents = Contents.replace(*StartIndex, *EndIndex, Change.text);
   }
 
   EntryIt->second = Contents;
@@ -12,6 +12,7 @@
 
 #include "Path.h"
 #include "Protocol.h"
+#include "Rope.h"
 #include "clang/Basic/LLVM.h"
 #include "llvm/ADT/StringMap.h"
 #include <mutex>
@@ -24,11 +25,15 @@ namespace clangd {
 /// A thread-safe container for files opened in a workspace, addressed by
 /// filenames. The contents are owned by the DraftStore. This class supports
 /// both whole and incremental updates of the documents.
+///
+/// The documents are stored as ropes, so incremental updates take O(log n) per
+/// change and readers get immutable snapshots without copying the contents.
 class DraftStore {
 public:
-  /// \return Contents of the stored document.
+  /// \return A snapshot of the stored document, which is not affected by
+  /// later updates. This doesn't copy the contents.
   /// For untracked files, a llvm::None is returned.
-  llvm::Optional<std::string> getDraft(PathRef File) const;
+  llvm::Optional<Rope> getDraft(PathRef File) const;
 
   /// \return List of names of the drafts in this store.
   std::vector<Path> getActiveFiles() const;
@@ -40,9 +45,9 @@ public:
   /// If a position in \p Changes is invalid (e.g. out-of-range), the
   /// draft is not modified.
   ///
-  /// \return The new version of the draft for \p File, or an error if the
-  /// changes couldn't be applied.
-  llvm::Expected<std::string>
+  /// \return A snapshot of the new version of the draft for \p File, or an
+  /// error if the changes couldn't be applied.
+  llvm::Expected<Rope>
   updateDraft(PathRef File,
               llvm::ArrayRef<TextDocumentContentChangeEvent> Changes);
 
@@ -51,7 +56,7 @@ public:
 
 private:
   mutable std::mutex Mutex;
-  llvm::StringMap<std::string> Drafts;
+  llvm::StringMap<Rope> Drafts;
 };
 
 } // namespace clangd
@@ -101,7 +101,7 @@ getWorkspaceSymbols(StringRef Query, int Limit,
     Req.Scopes = {Names.first};
   if (Limit)
     Req.MaxCandidateCount = Limit;
-  Index->fuzzyFind(Req, [&Result](const Symbol &Sym) {
+  auto More = Index->fuzzyFind(Req, [&Result](const Symbol &Sym) {
     // Prefer the definition over e.g. a function declaration in a header
     auto &CD = Sym.Definition ? Sym.Definition : Sym.CanonicalDeclaration;
     auto Uri = URI::parse(CD.FileURI);
@@ -134,6 +134,8 @@ getWorkspaceSymbols(StringRef Query, int Limit,
     ScopeRef.consume_back("::");
     Result.push_back({Sym.Name, SK, L, ScopeRef});
   });
+  if (!More)
+    return More.takeError();
   return Result;
 }
 
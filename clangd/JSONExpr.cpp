@@ -425,79 +425,116 @@ void quote(llvm::raw_ostream &OS, llvm::StringRef S) {
   OS << '\"';
 }
 
-enum IndenterAction {
-  Indent,
-  Outdent,
-  Newline,
-  Space,
-};
 } // namespace
 
-// Prints JSON. The indenter can be used to control formatting.
-template <typename Indenter>
-void clang::clangd::json::Expr::print(raw_ostream &OS,
-                                      const Indenter &I) const {
-  switch (Type) {
-  case T_Null:
+namespace clang {
+namespace clangd {
+namespace json {
+void OStream::value(const Expr &E) {
+  switch (E.kind()) {
+  case Expr::Null:
+    valueBegin();
     OS << "null";
-    break;
-  case T_Boolean:
-    OS << (as<bool>() ? "true" : "false");
-    break;
-  case T_Number:
-    OS << format("%g", as<double>());
-    break;
-  case T_StringRef:
-    quote(OS, as<StringRef>());
-    break;
-  case T_String:
-    quote(OS, as<std::string>());
-    break;
-  case T_Object: {
-    bool Comma = false;
-    OS << '{';
-    I(Indent);
-    for (const auto &P : as<Expr::ObjectExpr>()) {
-      if (Comma)
-        OS << ',';
-      Comma = true;
-      I(Newline);
-      quote(OS, P.first);
-      OS << ':';
-      I(Space);
-      P.second.print(OS, I);
-    }
-    I(Outdent);
-    if (Comma)
-      I(Newline);
-    OS << '}';
-    break;
+    return;
+  case Expr::Boolean:
+    valueBegin();
+    OS << (*E.asBoolean() ? "true" : "false");
+    return;
+  case Expr::Number:
+    valueBegin();
+    OS << format("%g", *E.asNumber());
+    return;
+  case Expr::String:
+    valueBegin();
+    quote(OS, *E.asString());
+    return;
+  case Expr::Array:
+    return array([&] {
+      for (const Expr &Element : *E.asArray())
+        value(Element);
+    });
+  case Expr::Object:
+    return object([&] {
+      for (const auto &P : *E.asObject())
+        attribute(P.first, P.second);
+    });
   }
-  case T_Array: {
-    bool Comma = false;
-    OS << '[';
-    I(Indent);
-    for (const auto &E : as<Expr::ArrayExpr>()) {
-      if (Comma)
-        OS << ',';
-      Comma = true;
-      I(Newline);
-      E.print(OS, I);
-    }
-    I(Outdent);
-    if (Comma)
-      I(Newline);
-    OS << ']';
-    break;
+  llvm_unreachable("Unknown expression kind");
+}
+
+void OStream::valueBegin() {
+  assert(Stack.back().Ctx != Object && "Only attributes allowed here");
+  if (Stack.back().HasValue) {
+    assert(Stack.back().Ctx != Singleton && "Only one value allowed here");
+    OS << ',';
   }
+  if (Stack.back().Ctx == Array)
+    newline();
+  Stack.back().HasValue = true;
+}
+
+void OStream::newline() {
+  if (IndentSize) {
+    OS << '\n';
+    OS.indent(Indent);
   }
 }
 
-namespace clang {
-namespace clangd {
-namespace json {
+void OStream::arrayBegin() {
+  valueBegin();
+  Stack.emplace_back();
+  Stack.back().Ctx = Array;
+  Indent += IndentSize;
+  OS << '[';
+}
+
+void OStream::arrayEnd() {
+  assert(Stack.back().Ctx == Array);
+  Indent -= IndentSize;
+  if (Stack.back().HasValue)
+    newline();
+  OS << ']';
+  Stack.pop_back();
+}
+
+void OStream::objectBegin() {
+  valueBegin();
+  Stack.emplace_back();
+  Stack.back().Ctx = Object;
+  Indent += IndentSize;
+  OS << '{';
+}
+
+void OStream::objectEnd() {
+  assert(Stack.back().Ctx == Object);
+  Indent -= IndentSize;
+  if (Stack.back().HasValue)
+    newline();
+  OS << '}';
+  Stack.pop_back();
+}
+
+void OStream::attributeBegin(StringRef Key) {
+  assert(Stack.back().Ctx == Object);
+  if (Stack.back().HasValue)
+    OS << ',';
+  newline();
+  Stack.back().HasValue = true;
+  Stack.emplace_back();
+  quote(OS, Key);
+  OS << ':';
+  if (IndentSize)
+    OS << ' ';
+}
+
+void OStream::attributeEnd() {
+  assert(Stack.back().Ctx == Singleton && Stack.back().HasValue &&
+         "Attribute must have a value");
+  Stack.pop_back();
+}
+
 llvm::raw_ostream &operator<<(raw_ostream &OS, const Expr &E) {
-  E.print(OS, [](IndenterAction A) { /*ignore*/ });
+  OStream(OS).value(E);
   return OS;
 }
 
@@ -533,22 +570,5 @@ void llvm::format_provider<clang::clangd::json::Expr>::format(
   unsigned IndentAmount = 0;
   if (Options.getAsInteger(/*Radix=*/10, IndentAmount))
     assert(false && "json::Expr format options should be an integer");
-  unsigned IndentLevel = 0;
-  E.print(OS, [&](IndenterAction A) {
-    switch (A) {
-    case Newline:
-      OS << '\n';
-      OS.indent(IndentLevel);
-      break;
-    case Space:
-      OS << ' ';
-      break;
-    case Indent:
-      IndentLevel += IndentAmount;
-      break;
-    case Outdent:
-      IndentLevel -= IndentAmount;
-      break;
-    };
-  });
+  clang::clangd::json::OStream(OS, IndentAmount).value(E);
 }
@@ -12,6 +12,7 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_JSON_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_JSON_H
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/Error.h"
@@ -93,6 +94,9 @@ namespace json {
 //   2) raw_ostream << formatv("{0}", Expr)    // Basic formatting.
 //   3) raw_ostream << formatv("{0:2}", Expr)  // Pretty-print with indent 2.
 //
+// Large outputs can be written with json::OStream instead, which streams the
+// JSON without building an Expr for the whole document (see below).
+//
 // And parsed:
 //   Expected<Expr> E = json::parse("[1, 2, null]");
 //   assert(E && E->kind() == Expr::Array);
@@ -248,10 +252,6 @@ private:
     return *reinterpret_cast<T *>(Union.buffer);
   }
 
-  template <typename Indenter>
-  void print(llvm::raw_ostream &, const Indenter &) const;
-  friend struct llvm::format_provider<clang::clangd::json::Expr>;
-
   enum ExprType : char {
     T_Null,
     T_Boolean,
@@ -565,6 +565,91 @@ public:
   }
 };
 
+// OStream writes JSON to a raw_ostream as it is produced, without building an
+// Expr first. The calls must form a single JSON value:
+//   json::OStream J(OS);
+//   J.object([&] {
+//     J.attribute("isIncomplete", false);
+//     J.attributeArray("items", [&] {
+//       for (const Item &I : Items)
+//         J.value(toJSON(I)); // Only one item is built at a time.
+//     });
+//   });
+// Object attributes are written in the order they are added, unlike the sorted
+// properties of an Expr object.
+// With a non-zero IndentSize, the output is pretty-printed like
+// formatv("{0:N}", Expr).
+class OStream {
+public:
+  explicit OStream(llvm::raw_ostream &OS, unsigned IndentSize = 0)
+      : OS(OS), IndentSize(IndentSize) {
+    Stack.emplace_back();
+  }
+  ~OStream() {
+    assert(Stack.size() == 1 && "Unmatched begin()/end()");
+    assert(Stack.back().HasValue && "Did not write top-level value");
+  }
+
+  // Writes a JSON value: a scalar or a complete array or object.
+  void value(const Expr &E);
+  // Writes an array or object, whose elements are written by Contents.
+  void array(llvm::function_ref<void()> Contents) {
+    arrayBegin();
+    Contents();
+    arrayEnd();
+  }
+  void object(llvm::function_ref<void()> Contents) {
+    objectBegin();
+    Contents();
+    objectEnd();
+  }
+
+  // Writes a property of the enclosing object.
+  void attribute(llvm::StringRef Key, const Expr &Contents) {
+    attributeBegin(Key);
+    value(Contents);
+    attributeEnd();
+  }
+  void attributeArray(llvm::StringRef Key,
+                      llvm::function_ref<void()> Contents) {
+    attributeBegin(Key);
+    array(Contents);
+    attributeEnd();
+  }
+  void attributeObject(llvm::StringRef Key,
+                       llvm::function_ref<void()> Contents) {
+    attributeBegin(Key);
+    object(Contents);
+    attributeEnd();
+  }
+
+  // The callback-based methods above are preferred, these must be balanced.
+  void arrayBegin();
+  void arrayEnd();
+  void objectBegin();
+  void objectEnd();
+  void attributeBegin(llvm::StringRef Key);
+  void attributeEnd();
+
+private:
+  void valueBegin();
+  void newline();
+
+  enum Context {
+    Singleton, // Top level, or an attribute value.
+    Array,
+    Object,
+  };
+  struct State {
+    Context Ctx = Singleton;
+    bool HasValue = false;
+  };
+  llvm::SmallVector<State, 16> Stack;
+  llvm::raw_ostream &OS;
+  unsigned IndentSize;
+  unsigned Indent = 0;
+};
+
 } // namespace json
 } // namespace clangd
 } // namespace clang
@@ -11,11 +11,23 @@
 #include "JSONExpr.h"
 #include "ProtocolHandlers.h"
 #include "Trace.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/Chrono.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/SourceMgr.h"
-#include <istream>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace clang;
 using namespace clangd;
@@ -53,12 +65,17 @@ Key<std::unique_ptr<RequestSpan>> RequestSpan::RSKey;
 } // namespace
 
 void JSONOutput::writeMessage(const json::Expr &Message) {
+  writeMessage([&](json::OStream &J) { J.value(Message); });
+}
+
+void JSONOutput::writeMessage(
+    llvm::function_ref<void(json::OStream &)> WriteMessage) {
   std::string S;
   llvm::raw_string_ostream OS(S);
-  if (Pretty)
-    OS << llvm::formatv("{0:2}", Message);
-  else
-    OS << Message;
+  {
+    json::OStream J(OS, Pretty ? 2 : 0);
+    WriteMessage(J);
+  }
   OS.flush();
 
   {
@@ -101,6 +118,39 @@ void clangd::reply(json::Expr &&Result) {
       });
 }
 
+void clangd::replyStreamed(
+    llvm::function_ref<void(json::OStream &)> WriteResult) {
+  auto ID = Context::current().get(RequestID);
+  if (!ID) {
+    log("Attempted to reply to a notification!");
+    return;
+  }
+  // Only tracing needs the result as an Expr, so only parse it back then.
+  RequestSpan::attach([&](json::obj &Args) {
+    std::string S;
+    llvm::raw_string_ostream OS(S);
+    {
+      json::OStream J(OS);
+      WriteResult(J);
+    }
+    if (auto Result = json::parse(OS.str()))
+      Args["Reply"] = std::move(*Result);
+    else
+      llvm::consumeError(Result.takeError());
+  });
+  // Attributes are written in the sorted order an Expr object would use.
+  Context::current().getExisting(RequestOut)->writeMessage(
+      [&](json::OStream &J) {
+        J.object([&] {
+          J.attribute("id", *ID);
+          J.attribute("jsonrpc", "2.0");
+          J.attributeBegin("result");
+          WriteResult(J);
+          J.attributeEnd();
+        });
+      });
+}
+
 void clangd::replyError(ErrorCode code, const llvm::StringRef &Message) {
   log("Error " + Twine(static_cast<int>(code)) + ": " + Message);
   RequestSpan::attach([&](json::obj &Args) {
@@ -136,6 +186,37 @@ void clangd::call(StringRef Method, json::Expr &&Params) {
       });
 }
 
+// IDs may be numbers or strings, use their JSON form as the key.
+static std::string requestKey(const json::Expr &ID) {
+  return llvm::formatv("{0}", ID);
+}
+
+JSONRPCDispatcher::JSONRPCDispatcher(Handler UnknownHandler)
+    : UnknownHandler(std::move(UnknownHandler)),
+      Running(std::make_shared<RunningRequests>()) {
+  registerHandler("$/cancelRequest",
+                  [this](const json::Expr &Params) { cancelRequest(Params); });
+}
+
+void JSONRPCDispatcher::cancelRequest(const json::Expr &Params) {
+  auto *Object = Params.asObject();
+  const json::Expr *ID = Object ? Object->get("id") : nullptr;
+  if (!ID) {
+    log("Ignoring $/cancelRequest without an id");
+    return;
+  }
+  Canceler Cancel;
+  {
+    std::lock_guard<std::mutex> Lock(Running->Mu);
+    auto It = Running->Cancelers.find(requestKey(*ID));
+    // The request may have finished already.
+    if (It == Running->Cancelers.end())
+      return;
+    Cancel = It->second;
+  }
+  Cancel();
+}
+
 void JSONRPCDispatcher::registerHandler(StringRef Method, Handler H) {
   assert(!Handlers.count(Method) && "Handler already registered!");
   Handlers[Method] = std::move(H);
@@ -168,6 +249,33 @@ bool JSONRPCDispatcher::call(const json::Expr &Message, JSONOutput &Out) const {
   if (ID)
     WithID.emplace(RequestID, *ID);
 
+  // Requests can be cancelled by the client until their context is destroyed,
+  // i.e. until all the work they have started (even asynchronously) is done.
+  llvm::Optional<WithContext> WithCancel;
+  if (ID) {
+    auto Task = cancelableTask();
+    std::string Key = requestKey(*ID);
+    bool Inserted;
+    {
+      std::lock_guard<std::mutex> Lock(Running->Mu);
+      Inserted = Running->Cancelers.try_emplace(Key, std::move(Task.second))
+                     .second;
+    }
+    // IDs of running requests must be unique, or we could not tell which one
+    // a $/cancelRequest (or the cleanup below) refers to.
+    if (!Inserted) {
+      replyError(ErrorCode::InvalidRequest,
+                 "Request " + Key + " is already running");
+      return true;
+    }
+    std::shared_ptr<RunningRequests> Requests = Running;
+    auto Done = llvm::make_scope_exit([Requests, Key] {
+      std::lock_guard<std::mutex> Lock(Requests->Mu);
+      Requests->Cancelers.erase(Key);
+    });
+    WithCancel.emplace(std::move(Task.first).derive(std::move(Done)));
+  }
+
   // Create a tracing Span covering the whole request lifetime.
   trace::Span Tracer(*Method);
   if (ID)
@@ -180,143 +288,302 @@ bool JSONRPCDispatcher::call(const json::Expr &Message, JSONOutput &Out) const {
   return true;
 }
 
-static llvm::Optional<std::string> readStandardMessage(std::istream &In,
-                                                       JSONOutput &Out) {
-  // A Language Server Protocol message starts with a set of HTTP headers,
-  // delimited  by \r\n, and terminated by an empty line (\r\n).
-  unsigned long long ContentLength = 0;
-  while (In.good()) {
-    std::string Line;
-    std::getline(In, Line);
-    if (!In.good() && errno == EINTR) {
-      In.clear();
-      continue;
+namespace {
+// Reads JSON-RPC messages from a file descriptor.
+// The input is read in large chunks into a buffer that is reused for all
+// messages, and headers are parsed in place. Messages are returned as views
+// into the buffer, so their contents are not copied before JSON parsing.
+class InputReader {
+public:
+  // Mirror receives the raw input, Log the messages about malformed input.
+  InputReader(int FD, JSONStreamStyle Style,
+              std::function<void(const Twine &)> Mirror,
+              std::function<void(const Twine &)> Log)
+      : FD(FD), Style(Style), Mirror(std::move(Mirror)), Log(std::move(Log)),
+        Buffer(64 * 1024) {}
+
+  // Reads the next message into JSON. It points into the buffer and is valid
+  // until the next call. JSON is empty if the message was skipped.
+  // Returns false at the end of the input.
+  bool readMessage(StringRef &JSON) {
+    return Style == Delimited ? readDelimitedMessage(JSON)
+                              : readStandardMessage(JSON);
+  }
+
+private:
+  size_t available() const { return End - Begin; }
+
+  // Reads more input, making room for at least MinSize unconsumed bytes.
+  // Returns false at the end of the input.
+  bool fill(size_t MinSize) {
+    if (AtEOF)
+      return false;
+    if (Begin > 0 && Buffer.size() - Begin < MinSize + 1) {
+      std::memmove(Buffer.data(), Buffer.data() + Begin, available());
+      End -= Begin;
+      Begin = 0;
+    }
+    if (Buffer.size() - Begin < MinSize + 1)
+      Buffer.resize(std::max(MinSize + 1, 2 * Buffer.size()));
+    int64_t Read = llvm::sys::RetryAfterSignal(
+        -1, readInput, FD, Buffer.data() + End, Buffer.size() - End);
+    if (Read <= 0) {
+      if (Read < 0)
+        Log("Input error while reading message!");
+      AtEOF = true;
+      return false;
     }
+    // The standard input is mirrored as it is read, including the bytes that
+    // are not part of any message.
+    if (Style == Standard)
+      Mirror(StringRef(Buffer.data() + End, Read));
+    End += Read;
+    return true;
+  }
 
-    Out.mirrorInput(Line);
-    // Mirror '\n' that gets consumed by std::getline, but is not included in
-    // the resulting Line.
-    // Note that '\r' is part of Line, so we don't need to mirror it
-    // separately.
-    if (!In.eof())
-      Out.mirrorInput("\n");
-
-    llvm::StringRef LineRef(Line);
-
-    // We allow comments in headers. Technically this isn't part
-    // of the LSP specification, but makes writing tests easier.
-    if (LineRef.startswith("#"))
-      continue;
-
-    // Content-Type is a specified header, but does nothing.
-    // Content-Length is a mandatory header. It specifies the length of the
-    // following JSON.
-    // It is unspecified what sequence headers must be supplied in, so we
-    // allow any sequence.
-    // The end of headers is signified by an empty line.
-    if (LineRef.consume_front("Content-Length: ")) {
-      if (ContentLength != 0) {
-        log("Warning: Duplicate Content-Length header received. "
-            "The previous value for this message (" +
-            llvm::Twine(ContentLength) + ") was ignored.\n");
+  // Reads a line without its '\n'. The last line may not be terminated.
+  bool readLine(StringRef &Line) {
+    size_t Searched = 0;
+    while (true) {
+      StringRef Available(Buffer.data() + Begin, available());
+      size_t Newline = Available.find('\n', Searched);
+      if (Newline != StringRef::npos) {
+        Line = Available.take_front(Newline);
+        Begin += Newline + 1;
+        return true;
+      }
+      Searched = Available.size();
+      // fill() may move the unconsumed input, Available is invalid after it.
+      if (!fill(Searched + 1)) {
+        if (available() == 0)
+          return false;
+        Line = StringRef(Buffer.data() + Begin, available());
+        Begin = End;
+        return true;
       }
-
-      llvm::getAsUnsignedInteger(LineRef.trim(), 0, ContentLength);
-      continue;
-    } else if (!LineRef.trim().empty()) {
-      // It's another header, ignore it.
-      continue;
-    } else {
-      // An empty line indicates the end of headers.
-      // Go ahead and read the JSON.
-      break;
     }
   }
 
-  // Guard against large messages. This is usually a bug in the client code
-  // and we don't want to crash downstream because of it.
-  if (ContentLength > 1 << 30) { // 1024M
-    In.ignore(ContentLength);
-    log("Skipped overly large message of " + Twine(ContentLength) +
-        " bytes.\n");
-    return llvm::None;
-  }
+  bool readStandardMessage(StringRef &JSON) {
+    JSON = StringRef();
+    // A Language Server Protocol message starts with a set of HTTP headers,
+    // delimited  by \r\n, and terminated by an empty line (\r\n).
+    unsigned long long ContentLength = 0;
+    StringRef Line;
+    while (true) {
+      if (!readLine(Line))
+        return false;
+
+      // We allow comments in headers. Technically this isn't part
+      // of the LSP specification, but makes writing tests easier.
+      if (Line.startswith("#"))
+        continue;
+
+      // Content-Type is a specified header, but does nothing.
+      // Content-Length is a mandatory header. It specifies the length of the
+      // following JSON.
+      // It is unspecified what sequence headers must be supplied in, so we
+      // allow any sequence.
+      // The end of headers is signified by an empty line.
+      if (Line.consume_front("Content-Length: ")) {
+        if (ContentLength != 0) {
+          Log("Warning: Duplicate Content-Length header received. "
+              "The previous value for this message (" +
+              llvm::Twine(ContentLength) + ") was ignored.\n");
+        }
+
+        llvm::getAsUnsignedInteger(Line.trim(), 0, ContentLength);
+        continue;
+      } else if (!Line.trim().empty()) {
+        // It's another header, ignore it.
+        continue;
+      } else {
+        // An empty line indicates the end of headers.
+        // Go ahead and read the JSON.
+        break;
+      }
+    }
 
-  if (ContentLength > 0) {
-    std::string JSON(ContentLength, '\0');
-    In.read(&JSON[0], ContentLength);
-    Out.mirrorInput(StringRef(JSON.data(), In.gcount()));
-
-    // If the stream is aborted before we read ContentLength bytes, In
-    // will have eofbit and failbit set.
-    if (!In) {
-      log("Input was aborted. Read only " + llvm::Twine(In.gcount()) +
-          " bytes of expected " + llvm::Twine(ContentLength) + ".\n");
-      return llvm::None;
+    // Guard against large messages. This is usually a bug in the client code
+    // and we don't want to crash downstream because of it.
+    if (ContentLength > 1 << 30) { // 1024M
+      Log("Skipped overly large message of " + Twine(ContentLength) +
+          " bytes.\n");
+      while (available() < ContentLength) {
+        ContentLength -= available();
+        Begin = End;
+        if (!fill(1))
+          return false;
+      }
+      Begin += ContentLength;
+      return true;
     }
-    return std::move(JSON);
-  } else {
-    log("Warning: Missing Content-Length header, or message has zero "
-        "length.\n");
-    return llvm::None;
+
+    if (ContentLength == 0) {
+      Log("Warning: Missing Content-Length header, or message has zero "
+          "length.\n");
+      return true;
+    }
+
+    while (available() < ContentLength) {
+      if (!fill(ContentLength)) {
+        Log("Input was aborted. Read only " + llvm::Twine(available()) +
+            " bytes of expected " + llvm::Twine(ContentLength) + ".\n");
+        return false;
+      }
+    }
+    JSON = StringRef(Buffer.data() + Begin, ContentLength);
+    Begin += ContentLength;
+    return true;
   }
-}
 
-// For lit tests we support a simplified syntax:
-// - messages are delimited by '---' on a line by itself
-// - lines starting with # are ignored.
-// This is a testing path, so favor simplicity over performance here.
-static llvm::Optional<std::string> readDelimitedMessage(std::istream &In,
-                                                        JSONOutput &Out) {
-  std::string JSON;
-  std::string Line;
-  while (std::getline(In, Line)) {
-    Line.push_back('\n'); // getline() consumed the newline.
-
-    auto LineRef = llvm::StringRef(Line).trim();
-    if (LineRef.startswith("#")) // comment
-      continue;
-
-    // found a delimiter
-    if (LineRef.rtrim() == "---")
-      break;
+  // For lit tests we support a simplified syntax:
+  // - messages are delimited by '---' on a line by itself
+  // - lines starting with # are ignored.
+  // This is a testing path, so favor simplicity over performance here.
+  bool readDelimitedMessage(StringRef &JSON) {
+    Message.clear();
+    bool FoundDelimiter = false;
+    StringRef Line;
+    while (readLine(Line)) {
+      StringRef Trimmed = Line.trim();
+      if (Trimmed.startswith("#")) // comment
+        continue;
+
+      // found a delimiter
+      if (Trimmed == "---") {
+        FoundDelimiter = true;
+        break;
+      }
+
+      Message += Line;
+      Message += '\n';
+    }
+    if (!FoundDelimiter && Message.empty())
+      return false;
 
-    JSON += Line;
+    Mirror(llvm::formatv("Content-Length: {0}\r\n\r\n{1}", Message.size(),
+                         Message));
+    JSON = Message;
+    return true;
   }
 
-  if (In.bad()) {
-    log("Input error while reading message!");
-    return llvm::None;
-  } else {
-    Out.mirrorInput(
-        llvm::formatv("Content-Length: {0}\r\n\r\n{1}", JSON.size(), JSON));
-    return std::move(JSON);
+  static int64_t readInput(int FD, char *Data, size_t Size) {
+#ifdef _WIN32
+    return ::_read(FD, Data, std::min<size_t>(Size, INT_MAX));
+#else
+    return ::read(FD, Data, Size);
+#endif
   }
-}
 
-void clangd::runLanguageServerLoop(std::istream &In, JSONOutput &Out,
+  int FD;
+  JSONStreamStyle Style;
+  std::function<void(const Twine &)> Mirror;
+  std::function<void(const Twine &)> Log;
+  std::vector<char> Buffer;
+  // The unconsumed input is [Begin, End).
+  size_t Begin = 0;
+  size_t End = 0;
+  bool AtEOF = false;
+  // Delimited messages are copied here, without the comments.
+  std::string Message;
+};
+
+// Messages parsed by the input thread, waiting to be handled.
+struct InputQueue {
+  std::mutex Mu;
+  std::condition_variable MessageAvailable;
+  std::deque<json::Expr> Messages;
+  // Set by the input thread at the end of the input.
+  bool Closed = false;
+  // Reset when the main loop exits, the input thread may still be blocked
+  // reading then. From then on, it must not use the output or the logger,
+  // which may be destroyed.
+  JSONOutput *Out;
+};
+} // namespace
+
+void clangd::runLanguageServerLoop(int InputFD, JSONOutput &Out,
                                    JSONStreamStyle InputStyle,
                                    JSONRPCDispatcher &Dispatcher,
                                    bool &IsDone) {
-  auto &ReadMessage =
-      (InputStyle == Delimited) ? readDelimitedMessage : readStandardMessage;
-  while (In.good()) {
-    if (auto JSON = ReadMessage(In, Out)) {
-      if (auto Doc = json::parse(*JSON)) {
-        // Log the formatted message.
-        log(llvm::formatv(Out.Pretty ? "<-- {0:2}\n" : "<-- {0}\n", *Doc));
-        // Finally, execute the action for this JSON message.
-        if (!Dispatcher.call(*Doc, Out))
-          log("JSON dispatch failed!\n");
-      } else {
+  // Messages are read and parsed on a thread of their own, so that the next
+  // message is parsed while the current one is handled.
+  auto Queue = std::make_shared<InputQueue>();
+  Queue->Out = &Out;
+  bool Pretty = Out.Pretty;
+  std::thread InputThread([Queue, InputFD, InputStyle, Pretty] {
+    // The lock is held while logging, so that the main loop can't exit and
+    // let the logger be destroyed meanwhile.
+    auto Log = [Queue](const Twine &Message) {
+      std::lock_guard<std::mutex> Lock(Queue->Mu);
+      if (Queue->Out)
+        log(Message);
+    };
+    auto Mirror = [Queue](const Twine &Input) {
+      std::lock_guard<std::mutex> Lock(Queue->Mu);
+      if (Queue->Out)
+        Queue->Out->mirrorInput(Input);
+    };
+    InputReader Reader(InputFD, InputStyle, Mirror, Log);
+    StringRef JSON;
+    while (Reader.readMessage(JSON)) {
+      if (JSON.empty())
+        continue;
+      auto Doc = json::parse(JSON);
+      if (!Doc) {
         // Parse error. Log the raw message.
-        log(llvm::formatv("<-- {0}\n" , *JSON));
-        log(llvm::Twine("JSON parse error: ") +
+        Log(llvm::formatv("<-- {0}\n", JSON));
+        Log(llvm::Twine("JSON parse error: ") +
             llvm::toString(Doc.takeError()) + "\n");
+        continue;
       }
+      // Log the formatted message.
+      Log(llvm::formatv(Pretty ? "<-- {0:2}\n" : "<-- {0}\n", *Doc));
+      std::lock_guard<std::mutex> Lock(Queue->Mu);
+      if (!Queue->Out)
+        return;
+      Queue->Messages.push_back(std::move(*Doc));
+      Queue->MessageAvailable.notify_one();
+    }
+    std::lock_guard<std::mutex> Lock(Queue->Mu);
+    Queue->Closed = true;
+    Queue->MessageAvailable.notify_one();
+  });
+
+  while (true) {
+    llvm::Optional<json::Expr> Message;
+    {
+      std::unique_lock<std::mutex> Lock(Queue->Mu);
+      Queue->MessageAvailable.wait(
+          Lock, [&] { return !Queue->Messages.empty() || Queue->Closed; });
+      if (Queue->Messages.empty())
+        break;
+      Message = std::move(Queue->Messages.front());
+      Queue->Messages.pop_front();
     }
+    // Finally, execute the action for this JSON message.
+    if (!Dispatcher.call(*Message, Out))
+      log("JSON dispatch failed!\n");
     // If we're done, exit the loop.
     if (IsDone)
       break;
   }
+
+  std::unique_lock<std::mutex> Lock(Queue->Mu);
+  Queue->Out = nullptr;
+  bool Closed = Queue->Closed;
+  Lock.unlock();
+  // Reading a regular file doesn't block, the input thread stops at the next
+  // message or at the end of the file.
+  llvm::sys::fs::file_status Status;
+  if (Closed || (!llvm::sys::fs::status(InputFD, Status) &&
+                 llvm::sys::fs::is_regular_file(Status))) {
+    InputThread.join();
+    return;
+  }
+  // The client may not close a pipe after the exit notification, and the
+  // input thread may stay blocked reading it. Don't wait for it then, it only
+  // uses the queue and InputFD from now on.
+  InputThread.detach();
 }
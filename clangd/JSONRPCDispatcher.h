@@ -10,6 +10,7 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_JSONRPCDISPATCHER_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_JSONRPCDISPATCHER_H
 
+#include "Cancellation.h"
 #include "JSONExpr.h"
 #include "Logger.h"
 #include "Protocol.h"
@@ -17,7 +18,6 @@
 #include "clang/Basic/LLVM.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringMap.h"
-#include <iosfwd>
 #include <mutex>
 
 namespace clang {
@@ -35,6 +35,9 @@ public:
 
   /// Emit a JSONRPC message.
   void writeMessage(const json::Expr &Result);
+  /// Emit a JSONRPC message written by \p WriteMessage, which must write a
+  /// single JSON value.
+  void writeMessage(llvm::function_ref<void(json::OStream &)> WriteMessage);
 
   /// Write a line to the logging stream.
   void log(const Twine &Message) override;
@@ -58,6 +61,10 @@ private:
 /// Sends a successful reply.
 /// Current context must derive from JSONRPCDispatcher::Handler.
 void reply(json::Expr &&Result);
+/// Sends a successful reply, streaming the result written by \p WriteResult
+/// rather than building it as a json::Expr first. Use for large results.
+/// Current context must derive from JSONRPCDispatcher::Handler.
+void replyStreamed(llvm::function_ref<void(json::OStream &)> WriteResult);
 /// Sends an error response to the client, and logs it.
 /// Current context must derive from JSONRPCDispatcher::Handler.
 void replyError(ErrorCode code, const llvm::StringRef &Message);
@@ -74,8 +81,12 @@ public:
 
   /// Create a new JSONRPCDispatcher. UnknownHandler is called when an unknown
   /// method is received.
-  JSONRPCDispatcher(Handler UnknownHandler)
-      : UnknownHandler(std::move(UnknownHandler)) {}
+  /// The dispatcher handles "$/cancelRequest" notifications itself: every
+  /// request runs in a cancelable task (see Cancellation.h) that is cancelled
+  /// when the client asks for it.
+  /// A request reusing the ID of a request that is still running is rejected
+  /// with an InvalidRequest error.
+  JSONRPCDispatcher(Handler UnknownHandler);
 
   /// Registers a Handler for the specified Method.
   void registerHandler(StringRef Method, Handler H);
@@ -84,8 +95,18 @@ public:
   bool call(const json::Expr &Message, JSONOutput &Out) const;
 
 private:
+  /// Cancelers of the requests that are still running, keyed by request ID.
+  /// Shared with the request contexts, which may outlive the dispatcher.
+  struct RunningRequests {
+    std::mutex Mu;
+    llvm::StringMap<Canceler> Cancelers;
+  };
+
+  void cancelRequest(const json::Expr &Params);
+
   llvm::StringMap<Handler> Handlers;
   Handler UnknownHandler;
+  std::shared_ptr<RunningRequests> Running;
 };
 
 /// Controls the way JSON-RPC messages are encoded (both input and output).
@@ -96,13 +117,18 @@ enum JSONStreamStyle {
   Delimited
 };
 
-/// Parses input queries from LSP client (coming from \p In) and runs call
-/// method of \p Dispatcher for each query.
+/// Parses input queries from LSP client (read from the file descriptor
+/// \p InputFD) and runs call method of \p Dispatcher for each query.
+/// The input is read and parsed on a separate thread, the queries are handled
+/// on the calling thread.
 /// After handling each query checks if \p IsDone is set true and exits the loop
 /// if it is.
-/// Input stream(\p In) must be opened in binary mode to avoid preliminary
+/// The input (\p InputFD) must be opened in binary mode to avoid preliminary
 /// replacements of \r\n with \n.
-void runLanguageServerLoop(std::istream &In, JSONOutput &Out,
+/// If \p InputFD is a regular file, or the input ended, the input thread has
+/// finished when this returns. Otherwise it may still be blocked reading
+/// \p InputFD, which must stay open until the process exits.
+void runLanguageServerLoop(int InputFD, JSONOutput &Out,
                            JSONStreamStyle InputStyle,
                            JSONRPCDispatcher &Dispatcher, bool &IsDone);
 
@@ -541,6 +541,16 @@ json::Expr toJSON(const CompletionList &L) {
   };
 }
 
+void writeJSON(json::OStream &J, const CompletionList &L) {
+  J.object([&] {
+    J.attribute("isIncomplete", L.isIncomplete);
+    J.attributeArray("items", [&] {
+      for (const CompletionItem &Item : L.items)
+        J.value(toJSON(Item));
+    });
+  });
+}
+
 json::Expr toJSON(const ParameterInformation &PI) {
   assert(!PI.label.empty() && "parameter information label is required");
   json::obj Result{{"label", PI.label}};
@@ -770,6 +770,8 @@ struct CompletionList {
   std::vector<CompletionItem> items;
 };
 json::Expr toJSON(const CompletionList &);
+/// Writes the same JSON as toJSON(), building one item at a time.
+void writeJSON(json::OStream &, const CompletionList &);
 
 /// A single parameter of a particular signature.
 struct ParameterInformation {
@@ -0,0 +1,229 @@
+//===--- Rope.cpp - Immutable text with efficient edits ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Rope.h"
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace clang {
+namespace clangd {
+
+// The tree is an AVL tree: the heights of the children of a node differ by at
+// most one. Leaves have no children and hold the text.
+struct Rope::Node {
+  std::shared_ptr<const Node> Left;
+  std::shared_ptr<const Node> Right;
+  std::string Text;
+  size_t Size;
+  size_t Newlines;
+  unsigned Height;
+
+  bool isLeaf() const { return !Left; }
+};
+
+namespace {
+using NodePtr = std::shared_ptr<const Rope::Node>;
+
+// Text is stored in leaves of at most this size. Smaller leaves are merged
+// when they are concatenated.
+constexpr size_t MaxLeafSize = 1024;
+
+unsigned heightOf(const NodePtr &N) { return N ? N->Height : 0; }
+
+NodePtr makeLeaf(llvm::StringRef Text) {
+  if (Text.empty())
+    return nullptr;
+  auto N = std::make_shared<Rope::Node>();
+  N->Text = Text.str();
+  N->Size = Text.size();
+  N->Newlines = Text.count('\n');
+  N->Height = 1;
+  return N;
+}
+
+NodePtr makeNode(NodePtr Left, NodePtr Right) {
+  assert(Left && Right);
+  auto N = std::make_shared<Rope::Node>();
+  N->Size = Left->Size + Right->Size;
+  N->Newlines = Left->Newlines + Right->Newlines;
+  N->Height = std::max(Left->Height, Right->Height) + 1;
+  N->Left = std::move(Left);
+  N->Right = std::move(Right);
+  return N;
+}
+
+// Makes a node of two balanced trees whose heights differ by at most two,
+// rotating it if necessary.
+NodePtr balance(NodePtr Left, NodePtr Right) {
+  if (heightOf(Left) > heightOf(Right) + 1) {
+    if (heightOf(Left->Left) >= heightOf(Left->Right))
+      return makeNode(Left->Left, makeNode(Left->Right, std::move(Right)));
+    const NodePtr &Middle = Left->Right;
+    return makeNode(makeNode(Left->Left, Middle->Left),
+                    makeNode(Middle->Right, std::move(Right)));
+  }
+  if (heightOf(Right) > heightOf(Left) + 1) {
+    if (heightOf(Right->Right) >= heightOf(Right->Left))
+      return makeNode(makeNode(std::move(Left), Right->Left), Right->Right);
+    const NodePtr &Middle = Right->Left;
+    return makeNode(makeNode(std::move(Left), Middle->Left),
+                    makeNode(Middle->Right, Right->Right));
+  }
+  return makeNode(std::move(Left), std::move(Right));
+}
+
+// Takes O(|height(Left) - height(Right)|).
+NodePtr concat(NodePtr Left, NodePtr Right) {
+  if (!Left)
+    return Right;
+  if (!Right)
+    return Left;
+  if (Left->isLeaf() && Right->isLeaf() &&
+      Left->Size + Right->Size <= MaxLeafSize)
+    return makeLeaf(Left->Text + Right->Text);
+  if (Left->Height > Right->Height + 1)
+    return balance(Left->Left, concat(Left->Right, std::move(Right)));
+  if (Right->Height > Left->Height + 1)
+    return balance(concat(std::move(Left), Right->Left), Right->Right);
+  return makeNode(std::move(Left), std::move(Right));
+}
+
+// Splits N into the first Offset characters and the rest.
+std::pair<NodePtr, NodePtr> split(const NodePtr &N, size_t Offset) {
+  if (!N || Offset == 0)
+    return {nullptr, N};
+  if (Offset >= N->Size)
+    return {N, nullptr};
+  if (N->isLeaf()) {
+    llvm::StringRef Text = N->Text;
+    return {makeLeaf(Text.take_front(Offset)),
+            makeLeaf(Text.drop_front(Offset))};
+  }
+  if (Offset <= N->Left->Size) {
+    auto Parts = split(N->Left, Offset);
+    return {std::move(Parts.first), concat(std::move(Parts.second), N->Right)};
+  }
+  auto Parts = split(N->Right, Offset - N->Left->Size);
+  return {concat(N->Left, std::move(Parts.first)), std::move(Parts.second)};
+}
+
+NodePtr build(llvm::StringRef Text) {
+  if (Text.size() <= MaxLeafSize)
+    return makeLeaf(Text);
+  size_t Half = Text.size() / 2;
+  return makeNode(build(Text.take_front(Half)), build(Text.drop_front(Half)));
+}
+
+// Returns the offset of the newline number Index, counting from 0.
+size_t findNewline(const Rope::Node *N, size_t Index) {
+  assert(Index < N->Newlines);
+  size_t Offset = 0;
+  while (!N->isLeaf()) {
+    if (Index < N->Left->Newlines) {
+      N = N->Left.get();
+    } else {
+      Index -= N->Left->Newlines;
+      Offset += N->Left->Size;
+      N = N->Right.get();
+    }
+  }
+  for (size_t I = 0;; ++I)
+    if (N->Text[I] == '\n' && Index-- == 0)
+      return Offset + I;
+}
+
+template <typename Func> void forEachLeaf(const Rope::Node *N, Func &&F) {
+  if (!N)
+    return;
+  if (N->isLeaf())
+    return F(llvm::StringRef(N->Text));
+  forEachLeaf(N->Left.get(), F);
+  forEachLeaf(N->Right.get(), F);
+}
+} // namespace
+
+Rope::Rope(llvm::StringRef Text) : Root(build(Text)) {}
+
+size_t Rope::size() const { return Root ? Root->Size : 0; }
+
+size_t Rope::newlines() const { return Root ? Root->Newlines : 0; }
+
+Rope Rope::replace(size_t Begin, size_t End, llvm::StringRef Text) const {
+  assert(Begin <= End && End <= size() && "Invalid range");
+  auto Prefix = split(Root, Begin);
+  auto Suffix = split(Prefix.second, End - Begin);
+  return Rope(concat(concat(std::move(Prefix.first), build(Text)),
+                     std::move(Suffix.second)));
+}
+
+size_t Rope::getLineOffset(size_t Line) const {
+  if (Line == 0)
+    return 0;
+  if (Line > newlines())
+    return llvm::StringRef::npos;
+  return findNewline(Root.get(), Line - 1) + 1;
+}
+
+size_t Rope::getLineEnd(size_t Offset) const {
+  size_t Before = countNewlines(Offset);
+  if (Before == newlines())
+    return size();
+  return findNewline(Root.get(), Before);
+}
+
+size_t Rope::countNewlines(size_t Offset) const {
+  size_t Count = 0;
+  const Node *N = Root.get();
+  if (!N || Offset >= N->Size)
+    return newlines();
+  while (!N->isLeaf()) {
+    if (Offset < N->Left->Size) {
+      N = N->Left.get();
+    } else {
+      Count += N->Left->Newlines;
+      Offset -= N->Left->Size;
+      N = N->Right.get();
+    }
+  }
+  return Count + llvm::StringRef(N->Text).take_front(Offset).count('\n');
+}
+
+std::string Rope::str() const {
+  std::string Result;
+  Result.reserve(size());
+  forEachLeaf(Root.get(), [&](llvm::StringRef Text) { Result += Text; });
+  return Result;
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+Rope::toMemoryBuffer(llvm::StringRef BufferName) const {
+  std::unique_ptr<llvm::WritableMemoryBuffer> Buffer =
+      llvm::WritableMemoryBuffer::getNewUninitMemBuffer(size(), BufferName);
+  char *Out = Buffer->getBufferStart();
+  forEachLeaf(Root.get(), [&](llvm::StringRef Text) {
+    std::copy(Text.begin(), Text.end(), Out);
+    Out += Text.size();
+  });
+  return std::move(Buffer);
+}
+
+bool operator==(const Rope &LHS, llvm::StringRef RHS) {
+  if (LHS.size() != RHS.size())
+    return false;
+  bool Equal = true;
+  forEachLeaf(LHS.Root.get(), [&](llvm::StringRef Text) {
+    Equal = Equal && RHS.startswith(Text);
+    RHS = RHS.drop_front(Text.size());
+  });
+  return Equal;
+}
+
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,82 @@
+//===--- Rope.h - Immutable text with efficient edits -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A rope stores text in a balanced tree of chunks. Edits copy only the path to
+// the edited chunks, so they take O(log n), and the previous versions of the
+// text stay valid and can be shared between threads without copying.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_ROPE_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_ROPE_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <string>
+
+namespace clang {
+namespace clangd {
+
+/// An immutable string. Copies are cheap and share the contents.
+///
+/// The tree keeps the number of newlines of each subtree, so that the offsets
+/// of lines can be found in O(log n).
+class Rope {
+public:
+  Rope() = default;
+  explicit Rope(llvm::StringRef Text);
+
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+
+  /// Returns the number of '\n' characters.
+  size_t newlines() const;
+
+  /// Returns a copy of this rope with [Begin, End) replaced by \p Text.
+  /// Requires Begin <= End <= size().
+  Rope replace(size_t Begin, size_t End, llvm::StringRef Text) const;
+
+  /// Returns the offset of the first character of the line \p Line (counting
+  /// from 0), or llvm::StringRef::npos if there are less lines.
+  size_t getLineOffset(size_t Line) const;
+
+  /// Returns the offset of the first '\n' at or after \p Offset, or size() if
+  /// there is none.
+  size_t getLineEnd(size_t Offset) const;
+
+  /// Returns the number of '\n' characters before \p Offset.
+  size_t countNewlines(size_t Offset) const;
+
+  /// Returns the contents as a single string. This takes O(n).
+  std::string str() const;
+
+  /// Returns a buffer holding a copy of the contents, e.g. for the parser.
+  /// This takes O(n).
+  std::unique_ptr<llvm::MemoryBuffer>
+  toMemoryBuffer(llvm::StringRef BufferName) const;
+
+  friend bool operator==(const Rope &LHS, llvm::StringRef RHS);
+
+  struct Node;
+
+private:
+  explicit Rope(std::shared_ptr<const Node> Root) : Root(std::move(Root)) {}
+
+  std::shared_ptr<const Node> Root;
+};
+
+inline bool operator!=(const Rope &LHS, llvm::StringRef RHS) {
+  return !(LHS == RHS);
+}
+
+} // namespace clangd
+} // namespace clang
+
+#endif
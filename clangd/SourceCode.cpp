@@ -16,8 +16,7 @@ namespace clang {
 namespace clangd {
 using namespace llvm;
 
-llvm::Expected<size_t> positionToOffset(StringRef Code, Position P,
-                                        bool AllowColumnsBeyondLineLength) {
+static llvm::Error checkPosition(Position P) {
   if (P.line < 0)
     return llvm::make_error<llvm::StringError>(
         llvm::formatv("Line value can't be negative ({0})", P.line),
@@ -26,26 +25,54 @@ llvm::Expected<size_t> positionToOffset(StringRef Code, Position P,
     return llvm::make_error<llvm::StringError>(
         llvm::formatv("Character value can't be negative ({0})", P.character),
         llvm::errc::invalid_argument);
+  return llvm::Error::success();
+}
+
+static llvm::Error lineOutOfRange(Position P) {
+  return llvm::make_error<llvm::StringError>(
+      llvm::formatv("Line value is out of range ({0})", P.line),
+      llvm::errc::invalid_argument);
+}
+
+// Finds the character in the line [StartOfLine, NextNL).
+static llvm::Expected<size_t> offsetInLine(size_t StartOfLine, size_t NextNL,
+                                           Position P,
+                                           bool AllowColumnsBeyondLineLength) {
+  if (StartOfLine + P.character > NextNL && !AllowColumnsBeyondLineLength)
+    return llvm::make_error<llvm::StringError>(
+        llvm::formatv("Character value is out of range ({0})", P.character),
+        llvm::errc::invalid_argument);
+  // FIXME: officially P.character counts UTF-16 code units, not UTF-8 bytes!
+  return std::min(NextNL, StartOfLine + P.character);
+}
+
+llvm::Expected<size_t> positionToOffset(StringRef Code, Position P,
+                                        bool AllowColumnsBeyondLineLength) {
+  if (llvm::Error Err = checkPosition(P))
+    return std::move(Err);
   size_t StartOfLine = 0;
   for (int I = 0; I != P.line; ++I) {
     size_t NextNL = Code.find('\n', StartOfLine);
     if (NextNL == StringRef::npos)
-      return llvm::make_error<llvm::StringError>(
-          llvm::formatv("Line value is out of range ({0})", P.line),
-          llvm::errc::invalid_argument);
+      return lineOutOfRange(P);
     StartOfLine = NextNL + 1;
   }
 
   size_t NextNL = Code.find('\n', StartOfLine);
   if (NextNL == StringRef::npos)
     NextNL = Code.size();
+  return offsetInLine(StartOfLine, NextNL, P, AllowColumnsBeyondLineLength);
+}
 
-  if (StartOfLine + P.character > NextNL && !AllowColumnsBeyondLineLength)
-    return llvm::make_error<llvm::StringError>(
-        llvm::formatv("Character value is out of range ({0})", P.character),
-        llvm::errc::invalid_argument);
-  // FIXME: officially P.character counts UTF-16 code units, not UTF-8 bytes!
-  return std::min(NextNL, StartOfLine + P.character);
+llvm::Expected<size_t> positionToOffset(const Rope &Code, Position P,
+                                        bool AllowColumnsBeyondLineLength) {
+  if (llvm::Error Err = checkPosition(P))
+    return std::move(Err);
+  size_t StartOfLine = Code.getLineOffset(P.line);
+  if (StartOfLine == StringRef::npos)
+    return lineOutOfRange(P);
+  return offsetInLine(StartOfLine, Code.getLineEnd(StartOfLine), P,
+                      AllowColumnsBeyondLineLength);
 }
 
 Position offsetToPosition(StringRef Code, size_t Offset) {
@@ -61,6 +88,16 @@ Position offsetToPosition(StringRef Code, size_t Offset) {
   return Pos;
 }
 
+Position offsetToPosition(const Rope &Code, size_t Offset) {
+  Offset = std::min(Code.size(), Offset);
+  size_t Lines = Code.countNewlines(Offset);
+  // FIXME: officially character counts UTF-16 code units, not UTF-8 bytes!
+  Position Pos;
+  Pos.line = static_cast<int>(Lines);
+  Pos.character = static_cast<int>(Offset - Code.getLineOffset(Lines));
+  return Pos;
+}
+
 Position sourceLocToPosition(const SourceManager &SM, SourceLocation Loc) {
   Position P;
   P.line = static_cast<int>(SM.getSpellingLineNumber(Loc)) - 1;
@@ -14,6 +14,7 @@
 #ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_SOURCECODE_H
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_SOURCECODE_H
 #include "Protocol.h"
+#include "Rope.h"
 #include "clang/Basic/SourceLocation.h"
 
 namespace clang {
@@ -37,10 +38,18 @@ llvm::Expected<size_t>
 positionToOffset(llvm::StringRef Code, Position P,
                  bool AllowColumnsBeyondLineLength = true);
 
+/// Same as above, in O(log n).
+llvm::Expected<size_t>
+positionToOffset(const Rope &Code, Position P,
+                 bool AllowColumnsBeyondLineLength = true);
+
 /// Turn an offset in Code into a [line, column] pair.
 /// FIXME: This should return an error if the offset is invalid.
 Position offsetToPosition(llvm::StringRef Code, size_t Offset);
 
+/// Same as above, in O(log n).
+Position offsetToPosition(const Rope &Code, size_t Offset);
+
 /// Turn a SourceLocation into a [line, column] pair.
 /// FIXME: This should return an error if the location is invalid.
 Position sourceLocToPosition(const SourceManager &SM, SourceLocation Loc);
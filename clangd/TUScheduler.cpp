@@ -41,13 +41,24 @@
 //   pending inputs and reset the timer.
 // - If any reads of the AST are scheduled, we start building the AST
 //   immediately.
+//
+// Between requests, the ASTs are stored in an ASTCache shared by all workers,
+// which evicts the least recently used ASTs when they use more memory than
+// allowed. Evicted ASTs are rebuilt by their worker on the next read.
 
 #include "TUScheduler.h"
+#include "Cancellation.h"
+#include "DiskPreambleCache.h"
 #include "Logger.h"
 #include "Trace.h"
 #include "clang/Frontend/PCHContainerOperations.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Path.h"
+#include <atomic>
+#include <functional>
+#include <list>
 #include <memory>
 #include <queue>
 #include <thread>
@@ -55,9 +66,138 @@
 namespace clang {
 namespace clangd {
 using std::chrono::steady_clock;
+
+/// An LRU cache of the ASTs of open files, limited by their total size.
+/// ASTWorkers store their AST in the cache between requests, and take it out
+/// while processing a request. An AST which is taken out still counts towards
+/// the limit, but can't be evicted.
+/// This class is thread-safe.
+class ASTCache {
+public:
+  /// Identifies the owner of an AST, i.e. an ASTWorker.
+  using Key = const void *;
+
+  /// \p MaxBytes is the limit on the total size of the ASTs, 0 means there is
+  /// no limit.
+  explicit ASTCache(std::size_t MaxBytes) : MaxBytes(MaxBytes) {}
+
+  /// Stores the AST of \p K, which is None if it could not be built. This may
+  /// evict other ASTs, but never the one that was just stored.
+  void put(Key K, llvm::Optional<ParsedAST> AST) {
+    std::vector<ParsedAST> Evicted;
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      auto Inserted = Index.insert({K, Entries.end()});
+      auto &It = Inserted.first->second;
+      if (Inserted.second)
+        It = Entries.emplace(Entries.begin(), K);
+      else
+        Entries.splice(Entries.begin(), Entries, It);
+      UsedBytes -= It->Bytes;
+      It->Bytes = AST ? AST->getUsedBytes() : 0;
+      It->AST = std::move(AST);
+      UsedBytes += It->Bytes;
+
+      for (auto Last = Entries.rbegin();
+           MaxBytes > 0 && UsedBytes > MaxBytes && Last->K != K; ++Last) {
+        if (!Last->AST)
+          continue; // Not cached, or in use.
+        Evicted.push_back(std::move(*Last->AST));
+        Last->AST = llvm::None;
+        UsedBytes -= Last->Bytes;
+        Last->Bytes = 0;
+        ++Evictions;
+      }
+    }
+    // Destroying the ASTs takes a while, don't hold the lock.
+  }
+
+  /// Takes the AST of \p K out of the cache. Returns None if it was evicted.
+  llvm::Optional<ParsedAST> take(Key K) {
+    llvm::Optional<ParsedAST> AST;
+    Stats Current;
+    {
+      std::lock_guard<std::mutex> Lock(Mutex);
+      auto It = Index.find(K);
+      if (It != Index.end() && It->second->AST) {
+        AST = std::move(It->second->AST);
+        It->second->AST = llvm::None;
+        ++Hits;
+      } else {
+        ++Misses;
+      }
+      Current = {Hits, Misses, Evictions, UsedBytes};
+    }
+    trace::Span Tracer("ASTCache");
+    SPAN_ATTACH(Tracer, "hit", bool(AST));
+    SPAN_ATTACH(Tracer, "hits", Current.Hits);
+    SPAN_ATTACH(Tracer, "misses", Current.Misses);
+    SPAN_ATTACH(Tracer, "evictions", Current.Evictions);
+    SPAN_ATTACH(Tracer, "used_bytes", Current.UsedBytes);
+    return AST;
+  }
+
+  /// Removes the AST of \p K, if any.
+  void remove(Key K) {
+    // Destroyed after the lock is released.
+    llvm::Optional<ParsedAST> Removed;
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto It = Index.find(K);
+    if (It == Index.end())
+      return;
+    Removed = std::move(It->second->AST);
+    UsedBytes -= It->second->Bytes;
+    Entries.erase(It->second);
+    Index.erase(It);
+  }
+
+  /// Returns the size of the AST of \p K, or 0 if it has been evicted.
+  std::size_t getUsedBytes(Key K) const {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto It = Index.find(K);
+    return It == Index.end() ? 0 : It->second->Bytes;
+  }
+
+private:
+  struct Entry {
+    Entry(Key K) : K(K) {}
+
+    Key K;
+    /// None if evicted or in use.
+    llvm::Optional<ParsedAST> AST;
+    /// Size of the AST, also while it is in use.
+    std::size_t Bytes = 0;
+  };
+
+  /// Counters reported through tracing.
+  struct Stats {
+    unsigned Hits;
+    unsigned Misses;
+    unsigned Evictions;
+    std::size_t UsedBytes;
+  };
+
+  const std::size_t MaxBytes;
+  mutable std::mutex Mutex;
+  /// The most recently used entries go first.
+  std::list<Entry> Entries;
+  /// Entries by their key.
+  llvm::DenseMap<Key, std::list<Entry>::iterator> Index;
+  std::size_t UsedBytes = 0;
+  unsigned Hits = 0;
+  unsigned Misses = 0;
+  unsigned Evictions = 0;
+};
+
 namespace {
 class ASTWorkerHandle;
 
+llvm::Error supersededError() {
+  return llvm::make_error<llvm::StringError>(
+      "request was superseded by a newer one",
+      std::make_error_code(std::errc::operation_canceled));
+}
+
 /// Owns one instance of the AST, schedules updates and reads of it.
 /// Also responsible for building and providing access to the preamble.
 /// Each ASTWorker processes the async requests sent to it on a separate
@@ -70,8 +210,8 @@ class ASTWorkerHandle;
 /// worker.
 class ASTWorker {
   friend class ASTWorkerHandle;
-  ASTWorker(llvm::StringRef File, Semaphore &Barrier, CppFile AST, bool RunSync,
-            steady_clock::duration UpdateDebounce);
+  ASTWorker(llvm::StringRef File, Semaphore &Barrier, ASTCache &IdleASTs,
+            CppFile AST, bool RunSync, steady_clock::duration UpdateDebounce);
 
 public:
   /// Create a new ASTWorker and return a handle to it.
@@ -79,18 +219,25 @@ public:
   /// is null, all requests will be processed on the calling thread
   /// synchronously instead. \p Barrier is acquired when processing each
   /// request, it is be used to limit the number of actively running threads.
+  /// The AST is stored in \p IdleASTs between requests.
   static ASTWorkerHandle Create(llvm::StringRef File, AsyncTaskRunner *Tasks,
-                                Semaphore &Barrier, CppFile AST,
+                                Semaphore &Barrier, ASTCache &IdleASTs,
+                                CppFile AST,
                                 steady_clock::duration UpdateDebounce);
   ~ASTWorker();
 
   void update(ParseInputs Inputs, WantDiagnostics,
               UniqueFunction<void(std::vector<Diag>)> OnUpdated);
+  /// If \p IsSuperseded is set and returns true when the read is about to run,
+  /// the read is cancelled.
   void runWithAST(llvm::StringRef Name,
-                  UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action);
+                  UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action,
+                  TaskPriority Priority, std::function<bool()> IsSuperseded);
   bool blockUntilIdle(Deadline Timeout) const;
 
   std::shared_ptr<const PreambleData> getPossiblyStalePreamble() const;
+  /// Returns the estimated size of the AST, excluding the preamble, or 0 if
+  /// the AST was evicted.
   std::size_t getUsedBytes() const;
 
 private:
@@ -102,7 +249,8 @@ private:
   void stop();
   /// Adds a new task to the end of the request queue.
   void startTask(llvm::StringRef Name, UniqueFunction<void()> Task,
-                 llvm::Optional<WantDiagnostics> UpdateType);
+                 llvm::Optional<WantDiagnostics> UpdateType,
+                 TaskPriority Priority);
   /// Determines the next action to perform.
   /// All actions that should never run are disarded.
   /// Returns a deadline for the next action. If it's expired, run now.
@@ -117,6 +265,7 @@ private:
     steady_clock::time_point AddTime;
     Context Ctx;
     llvm::Optional<WantDiagnostics> UpdateType;
+    TaskPriority Priority;
   };
 
   const std::string File;
@@ -125,15 +274,15 @@ private:
   const steady_clock::duration UpdateDebounce;
 
   Semaphore &Barrier;
+  ASTCache &IdleASTs;
   // AST and FileInputs are only accessed on the processing thread from run().
+  // The last built AST is moved from AST to IdleASTs after each request.
   CppFile AST;
   // Inputs, corresponding to the current state of AST.
   ParseInputs FileInputs;
   // Guards members used by both TUScheduler and the worker thread.
   mutable std::mutex Mutex;
   std::shared_ptr<const PreambleData> LastBuiltPreamble; /* GUARDED_BY(Mutex) */
-  // Result of getUsedBytes() after the last rebuild or read of AST.
-  std::size_t LastASTSize; /* GUARDED_BY(Mutex) */
   // Set to true to signal run() to finish processing.
   bool Done;                    /* GUARDED_BY(Mutex) */
   std::deque<Request> Requests; /* GUARDED_BY(Mutex) */
@@ -183,10 +332,12 @@ private:
 };
 
 ASTWorkerHandle ASTWorker::Create(llvm::StringRef File, AsyncTaskRunner *Tasks,
-                                  Semaphore &Barrier, CppFile AST,
+                                  Semaphore &Barrier, ASTCache &IdleASTs,
+                                  CppFile AST,
                                   steady_clock::duration UpdateDebounce) {
-  std::shared_ptr<ASTWorker> Worker(new ASTWorker(
-      File, Barrier, std::move(AST), /*RunSync=*/!Tasks, UpdateDebounce));
+  std::shared_ptr<ASTWorker> Worker(
+      new ASTWorker(File, Barrier, IdleASTs, std::move(AST),
+                    /*RunSync=*/!Tasks, UpdateDebounce));
   if (Tasks)
     Tasks->runAsync("worker:" + llvm::sys::path::filename(File),
                     [Worker]() { Worker->run(); });
@@ -194,15 +345,17 @@ ASTWorkerHandle ASTWorker::Create(llvm::StringRef File, AsyncTaskRunner *Tasks,
   return ASTWorkerHandle(std::move(Worker));
 }
 
-ASTWorker::ASTWorker(llvm::StringRef File, Semaphore &Barrier, CppFile AST,
-                     bool RunSync, steady_clock::duration UpdateDebounce)
+ASTWorker::ASTWorker(llvm::StringRef File, Semaphore &Barrier,
+                     ASTCache &IdleASTs, CppFile AST, bool RunSync,
+                     steady_clock::duration UpdateDebounce)
     : File(File), RunSync(RunSync), UpdateDebounce(UpdateDebounce),
-      Barrier(Barrier), AST(std::move(AST)), Done(false) {
+      Barrier(Barrier), IdleASTs(IdleASTs), AST(std::move(AST)), Done(false) {
   if (RunSync)
     return;
 }
 
 ASTWorker::~ASTWorker() {
+  IdleASTs.remove(this);
 #ifndef NDEBUG
   std::lock_guard<std::mutex> Lock(Mutex);
   assert(Done && "handle was not destroyed");
@@ -214,14 +367,16 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
                        UniqueFunction<void(std::vector<Diag>)> OnUpdated) {
   auto Task = [=](decltype(OnUpdated) OnUpdated) mutable {
     FileInputs = Inputs;
+    // Free the old AST before building the new one.
+    IdleASTs.remove(this);
     auto Diags = AST.rebuild(std::move(Inputs));
 
     {
       std::lock_guard<std::mutex> Lock(Mutex);
       if (AST.getPreamble())
         LastBuiltPreamble = AST.getPreamble();
-      LastASTSize = AST.getUsedBytes();
     }
+    IdleASTs.put(this, AST.takeAST());
     // We want to report the diagnostics even if this update was cancelled.
     // It seems more useful than making the clients wait indefinitely if they
     // spam us with updates.
@@ -229,15 +384,27 @@ void ASTWorker::update(ParseInputs Inputs, WantDiagnostics WantDiags,
       OnUpdated(std::move(*Diags));
   };
 
-  startTask("Update", Bind(Task, std::move(OnUpdated)), WantDiags);
+  startTask("Update", Bind(Task, std::move(OnUpdated)), WantDiags,
+            WantDiags == WantDiagnostics::No ? TaskPriority::Background
+                                             : TaskPriority::Diagnostics);
 }
 
 void ASTWorker::runWithAST(
     llvm::StringRef Name,
-    UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action) {
+    UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action,
+    TaskPriority Priority, std::function<bool()> IsSuperseded) {
   auto Task = [=](decltype(Action) Action) {
-    ParsedAST *ActualAST = AST.getAST();
+    if (IsSuperseded && IsSuperseded())
+      return Action(supersededError());
+    if (isCancelled())
+      return Action(cancelledError());
+    llvm::Optional<ParsedAST> ActualAST = IdleASTs.take(this);
     if (!ActualAST) {
+      // The AST was evicted, rebuild it from the same inputs and preamble.
+      ActualAST = AST.buildAST(FileInputs);
+    }
+    if (!ActualAST) {
+      IdleASTs.put(this, llvm::None);
       Action(llvm::make_error<llvm::StringError>("invalid AST",
                                                  llvm::errc::invalid_argument));
       return;
@@ -245,13 +412,12 @@ void ASTWorker::runWithAST(
     Action(InputsAndAST{FileInputs, *ActualAST});
 
     // Size of the AST might have changed after reads too, e.g. if some decls
-    // were deserialized from preamble.
-    std::lock_guard<std::mutex> Lock(Mutex);
-    LastASTSize = ActualAST->getUsedBytes();
+    // were deserialized from preamble, put() takes care of it.
+    IdleASTs.put(this, std::move(ActualAST));
   };
 
   startTask(Name, Bind(Task, std::move(Action)),
-            /*UpdateType=*/llvm::None);
+            /*UpdateType=*/llvm::None, Priority);
 }
 
 std::shared_ptr<const PreambleData>
@@ -261,8 +427,7 @@ ASTWorker::getPossiblyStalePreamble() const {
 }
 
 std::size_t ASTWorker::getUsedBytes() const {
-  std::lock_guard<std::mutex> Lock(Mutex);
-  return LastASTSize;
+  return IdleASTs.getUsedBytes(this);
 }
 
 void ASTWorker::stop() {
@@ -275,7 +440,8 @@ void ASTWorker::stop() {
 }
 
 void ASTWorker::startTask(llvm::StringRef Name, UniqueFunction<void()> Task,
-                          llvm::Optional<WantDiagnostics> UpdateType) {
+                          llvm::Optional<WantDiagnostics> UpdateType,
+                          TaskPriority Priority) {
   if (RunSync) {
     assert(!Done && "running a task after stop()");
     trace::Span Tracer(Name + ":" + llvm::sys::path::filename(File));
@@ -287,7 +453,7 @@ void ASTWorker::startTask(llvm::StringRef Name, UniqueFunction<void()> Task,
     std::lock_guard<std::mutex> Lock(Mutex);
     assert(!Done && "running a task after stop()");
     Requests.push_back({std::move(Task), Name, steady_clock::now(),
-                        Context::current().clone(), UpdateType});
+                        Context::current().clone(), UpdateType, Priority});
   }
   RequestsCV.notify_all();
 }
@@ -327,7 +493,8 @@ void ASTWorker::run() {
     } // unlock Mutex
 
     {
-      std::lock_guard<Semaphore> BarrierLock(Barrier);
+      Barrier.lock(Req.Priority);
+      auto BarrierUnlock = llvm::make_scope_exit([&] { Barrier.unlock(); });
       WithContext Guard(std::move(Req.Ctx));
       trace::Span Tracer(Req.Name);
       Req.Action();
@@ -407,18 +574,43 @@ unsigned getDefaultAsyncThreadsCount() {
 
 struct TUScheduler::FileData {
   /// Latest inputs, passed to TUScheduler::update().
-  std::string Contents;
+  Rope Contents;
   tooling::CompileCommand Command;
   ASTWorkerHandle Worker;
+  /// Number of reads scheduled with ReadPolicy::CancelIfSuperseded, by name.
+  llvm::StringMap<std::shared_ptr<std::atomic<unsigned>>> Reads;
+
+  /// Returns a function telling whether a read, which is being scheduled, was
+  /// superseded by a later one. Returns null if the read can't be cancelled.
+  std::function<bool()> scheduleRead(llvm::StringRef Name, ReadPolicy Policy) {
+    if (Policy != ReadPolicy::CancelIfSuperseded)
+      return nullptr;
+    auto &Counter = Reads[Name];
+    if (!Counter)
+      Counter = std::make_shared<std::atomic<unsigned>>(0);
+    unsigned Read = ++*Counter;
+    std::shared_ptr<const std::atomic<unsigned>> Latest = Counter;
+    return [Latest, Read]() { return *Latest != Read; };
+  }
 };
 
 TUScheduler::TUScheduler(unsigned AsyncThreadsCount,
                          bool StorePreamblesInMemory,
                          ASTParsedCallback ASTCallback,
-                         steady_clock::duration UpdateDebounce)
+                         steady_clock::duration UpdateDebounce,
+                         std::size_t PreambleCacheBytes,
+                         std::size_t ASTCacheBytes,
+                         llvm::StringRef PreambleCacheDir,
+                         std::size_t PreambleCacheDirBytes)
     : StorePreamblesInMemory(StorePreamblesInMemory),
       PCHOps(std::make_shared<PCHContainerOperations>()),
-      ASTCallback(std::move(ASTCallback)), Barrier(AsyncThreadsCount),
+      ASTCallback(std::move(ASTCallback)), Preambles(PreambleCacheBytes),
+      StoredPreambles(PreambleCacheDir.empty()
+                          ? nullptr
+                          : llvm::make_unique<DiskPreambleCache>(
+                                PreambleCacheDir, PreambleCacheDirBytes)),
+      IdleASTs(llvm::make_unique<ASTCache>(ASTCacheBytes)),
+      Barrier(AsyncThreadsCount),
       UpdateDebounce(UpdateDebounce) {
   if (0 < AsyncThreadsCount) {
     PreambleTasks.emplace();
@@ -455,7 +647,9 @@ void TUScheduler::update(PathRef File, ParseInputs Inputs,
     // Create a new worker to process the AST-related tasks.
     ASTWorkerHandle Worker = ASTWorker::Create(
         File, WorkerThreads ? WorkerThreads.getPointer() : nullptr, Barrier,
-        CppFile(File, StorePreamblesInMemory, PCHOps, ASTCallback),
+        *IdleASTs,
+        CppFile(File, StorePreamblesInMemory, PCHOps, ASTCallback,
+                &Preambles, StoredPreambles.get()),
         UpdateDebounce);
     FD = std::unique_ptr<FileData>(new FileData{
         Inputs.Contents, Inputs.CompileCommand, std::move(Worker)});
@@ -475,7 +669,8 @@ void TUScheduler::remove(PathRef File) {
 
 void TUScheduler::runWithAST(
     llvm::StringRef Name, PathRef File,
-    UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action) {
+    UniqueFunction<void(llvm::Expected<InputsAndAST>)> Action,
+    TaskPriority Priority, ReadPolicy Policy) {
   auto It = Files.find(File);
   if (It == Files.end()) {
     Action(llvm::make_error<llvm::StringError>(
@@ -484,12 +679,14 @@ void TUScheduler::runWithAST(
     return;
   }
 
-  It->second->Worker->runWithAST(Name, std::move(Action));
+  It->second->Worker->runWithAST(Name, std::move(Action), Priority,
+                                 It->second->scheduleRead(Name, Policy));
 }
 
 void TUScheduler::runWithPreamble(
     llvm::StringRef Name, PathRef File,
-    UniqueFunction<void(llvm::Expected<InputsAndPreamble>)> Action) {
+    UniqueFunction<void(llvm::Expected<InputsAndPreamble>)> Action,
+    TaskPriority Priority, ReadPolicy Policy) {
   auto It = Files.find(File);
   if (It == Files.end()) {
     Action(llvm::make_error<llvm::StringError>(
@@ -503,23 +700,32 @@ void TUScheduler::runWithPreamble(
     SPAN_ATTACH(Tracer, "file", File);
     std::shared_ptr<const PreambleData> Preamble =
         It->second->Worker->getPossiblyStalePreamble();
-    Action(InputsAndPreamble{It->second->Contents, It->second->Command,
-                             Preamble.get()});
+    std::string Contents = It->second->Contents.str();
+    Action(InputsAndPreamble{Contents, It->second->Command, Preamble.get()});
     return;
   }
 
   std::shared_ptr<const ASTWorker> Worker = It->second->Worker.lock();
-  auto Task = [Worker, this](std::string Name, std::string File,
-                             std::string Contents,
-                             tooling::CompileCommand Command, Context Ctx,
-                             decltype(Action) Action) mutable {
-    std::lock_guard<Semaphore> BarrierLock(Barrier);
+  auto IsSuperseded = It->second->scheduleRead(Name, Policy);
+  auto Task = [Worker, IsSuperseded, Priority,
+               this](std::string Name, std::string File, Rope Contents,
+                     tooling::CompileCommand Command, Context Ctx,
+                     decltype(Action) Action) mutable {
+    Barrier.lock(Priority);
+    auto BarrierUnlock = llvm::make_scope_exit([&] { Barrier.unlock(); });
     WithContext Guard(std::move(Ctx));
+    if (IsSuperseded && IsSuperseded())
+      return Action(supersededError());
+    if (isCancelled())
+      return Action(cancelledError());
     trace::Span Tracer(Name);
     SPAN_ATTACH(Tracer, "file", File);
     std::shared_ptr<const PreambleData> Preamble =
         Worker->getPossiblyStalePreamble();
-    Action(InputsAndPreamble{Contents, Command, Preamble.get()});
+    // Flatten the contents here rather than when scheduling the task, to keep
+    // the copy off the thread handling the requests.
+    std::string Flat = Contents.str();
+    Action(InputsAndPreamble{Flat, Command, Preamble.get()});
   };
 
   PreambleTasks->runAsync("task:" + llvm::sys::path::filename(File),
@@ -530,11 +736,30 @@ void TUScheduler::runWithPreamble(
 
 std::vector<std::pair<Path, std::size_t>>
 TUScheduler::getUsedBytesPerFile() const {
+  // Preambles stored on disk don't use memory.
+  std::vector<std::shared_ptr<const PreambleData>> Preambles;
+  llvm::DenseMap<const PreambleData *, unsigned> PreambleUsers;
+  Preambles.reserve(Files.size());
+  for (auto &&PathAndFile : Files) {
+    Preambles.push_back(StorePreamblesInMemory
+                            ? PathAndFile.second->Worker
+                                  ->getPossiblyStalePreamble()
+                            : nullptr);
+    if (Preambles.back())
+      ++PreambleUsers[Preambles.back().get()];
+  }
+
   std::vector<std::pair<Path, std::size_t>> Result;
   Result.reserve(Files.size());
-  for (auto &&PathAndFile : Files)
-    Result.push_back(
-        {PathAndFile.first(), PathAndFile.second->Worker->getUsedBytes()});
+  auto Preamble = Preambles.begin();
+  for (auto &&PathAndFile : Files) {
+    std::size_t Bytes = PathAndFile.second->Worker->getUsedBytes();
+    if (*Preamble)
+      Bytes += (*Preamble)->Preamble->getSize() /
+               PreambleUsers.lookup(Preamble->get());
+    Result.push_back({PathAndFile.first(), Bytes});
+    ++Preamble;
+  }
   return Result;
 }
 
@@ -18,6 +18,9 @@
 namespace clang {
 namespace clangd {
 
+class ASTCache;
+class DiskPreambleCache;
+
 /// Returns a number of a default async threads to use for TUScheduler.
 /// Returned value is always >= 1 (i.e. will not cause requests to be processed
 /// synchronously).
@@ -34,6 +37,17 @@ struct InputsAndPreamble {
   const PreambleData *Preamble;
 };
 
+/// Determines whether a read may be cancelled because of newer reads.
+enum class ReadPolicy {
+  /// The read always runs.
+  Run,
+  /// The read is cancelled if another read with the same name is scheduled
+  /// for the same file before this one starts running. Its callback receives
+  /// an error. Useful for requests that only matter for the latest cursor
+  /// position, e.g. code completion.
+  CancelIfSuperseded,
+};
+
 /// Determines whether diagnostics should be generated for a file snapshot.
 enum class WantDiagnostics {
   Yes,  /// Diagnostics must be generated for this snapshot.
@@ -51,17 +65,35 @@ enum class WantDiagnostics {
 /// FIXME(sammccall): pull out a scheduler options struct.
 class TUScheduler {
 public:
+  /// Files with identical preambles and compile flags share their preamble.
+  /// If \p PreambleCacheBytes is non-zero, up to that many bytes of preambles
+  /// are also kept after the files using them are closed, so that they can be
+  /// reused when the files are opened again.
+  /// If \p ASTCacheBytes is non-zero, the ASTs of the least recently used files
+  /// are evicted when all ASTs take more memory than that. Evicted ASTs are
+  /// rebuilt on the next read.
+  /// If \p PreambleCacheDir is not empty, preambles are stored there, up to
+  /// \p PreambleCacheDirBytes bytes, and reused after restarts (see
+  /// DiskPreambleCache).
   TUScheduler(unsigned AsyncThreadsCount, bool StorePreamblesInMemory,
               ASTParsedCallback ASTCallback,
-              std::chrono::steady_clock::duration UpdateDebounce);
+              std::chrono::steady_clock::duration UpdateDebounce,
+              std::size_t PreambleCacheBytes = 0,
+              std::size_t ASTCacheBytes = 0,
+              llvm::StringRef PreambleCacheDir = "",
+              std::size_t PreambleCacheDirBytes = 0);
   ~TUScheduler();
 
   /// Returns estimated memory usage for each of the currently open files.
+  /// The size of a preamble shared by several files is split evenly between
+  /// them, so that the sum is the total memory usage.
   /// The order of results is unspecified.
   std::vector<std::pair<Path, std::size_t>> getUsedBytesPerFile() const;
 
   /// Schedule an update for \p File. Adds \p File to a list of tracked files if
   /// \p File was not part of it before.
+  /// Updates run with TaskPriority::Diagnostics, or TaskPriority::Background
+  /// if no diagnostics are needed.
   /// FIXME(ibiryukov): remove the callback from this function.
   void update(PathRef File, ParseInputs Inputs, WantDiagnostics WD,
               UniqueFunction<void(std::vector<Diag>)> OnUpdated);
@@ -76,8 +108,12 @@ public:
   /// \p Action is executed.
   /// If an error occurs during processing, it is forwarded to the \p Action
   /// callback.
+  /// When the number of running tasks is limited, tasks with a higher
+  /// \p Priority run first. Reads of the same file still run in order.
   void runWithAST(llvm::StringRef Name, PathRef File,
-                  Callback<InputsAndAST> Action);
+                  Callback<InputsAndAST> Action,
+                  TaskPriority Priority = TaskPriority::Interactive,
+                  ReadPolicy Policy = ReadPolicy::Run);
 
   /// Schedule an async read of the Preamble.
   /// The preamble may be stale, generated from an older version of the file.
@@ -88,8 +124,11 @@ public:
   ///   source code from headers.
   /// If an error occurs during processing, it is forwarded to the \p Action
   /// callback.
+  /// \p Priority and \p Policy are handled as in runWithAST().
   void runWithPreamble(llvm::StringRef Name, PathRef File,
-                       Callback<InputsAndPreamble> Action);
+                       Callback<InputsAndPreamble> Action,
+                       TaskPriority Priority = TaskPriority::Interactive,
+                       ReadPolicy Policy = ReadPolicy::Run);
 
   /// Wait until there are no scheduled or running tasks.
   /// Mostly useful for synchronizing tests.
@@ -102,6 +141,11 @@ private:
   const bool StorePreamblesInMemory;
   const std::shared_ptr<PCHContainerOperations> PCHOps;
   const ASTParsedCallback ASTCallback;
+  PreambleCache Preambles;
+  /// Null if preambles are not stored on disk.
+  std::unique_ptr<DiskPreambleCache> StoredPreambles;
+  /// Holds the ASTs of the files between requests.
+  std::unique_ptr<ASTCache> IdleASTs;
   Semaphore Barrier;
   llvm::StringMap<std::unique_ptr<FileData>> Files;
   // None when running tasks synchronously and non-None when running tasks
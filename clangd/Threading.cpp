@@ -20,12 +20,40 @@ void Notification::wait() const {
   CV.wait(Lock, [this] { return Notified; });
 }
 
-Semaphore::Semaphore(std::size_t MaxLocks) : FreeSlots(MaxLocks) {}
+Semaphore::Semaphore(std::size_t MaxLocks, unsigned MaxPasses)
+    : FreeSlots(MaxLocks), MaxPasses(MaxPasses) {}
 
-void Semaphore::lock() {
+constexpr unsigned Semaphore::NumPriorities;
+
+unsigned Semaphore::nextPriority() const {
+  // Waiters that were passed over too often go first.
+  for (unsigned P = 0; P < NumPriorities; ++P)
+    if (Waiting[P] > 0 && Passed[P] >= MaxPasses)
+      return P;
+  for (unsigned P = 0; P < NumPriorities; ++P)
+    if (Waiting[P] > 0)
+      return P;
+  return NumPriorities;
+}
+
+void Semaphore::lock(TaskPriority Priority) {
+  unsigned P = static_cast<unsigned>(Priority);
   std::unique_lock<std::mutex> Lock(Mutex);
-  SlotsChanged.wait(Lock, [&]() { return FreeSlots > 0; });
+  ++Waiting[P];
+  SlotsChanged.wait(Lock,
+                    [&]() { return FreeSlots > 0 && nextPriority() == P; });
+  --Waiting[P];
   --FreeSlots;
+  Passed[P] = 0;
+  for (unsigned Lower = P + 1; Lower < NumPriorities; ++Lower)
+    if (Waiting[Lower] > 0)
+      ++Passed[Lower];
+  bool WakeOthers = FreeSlots > 0;
+  Lock.unlock();
+
+  // Lower priority threads may have been waiting for us to take our slot.
+  if (WakeOthers)
+    SlotsChanged.notify_all();
 }
 
 void Semaphore::unlock() {
@@ -33,7 +61,17 @@ void Semaphore::unlock() {
   ++FreeSlots;
   Lock.unlock();
 
-  SlotsChanged.notify_one();
+  // Wake up all waiters, as only the ones with the highest priority may
+  // proceed.
+  SlotsChanged.notify_all();
+}
+
+std::size_t Semaphore::waiting() const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  std::size_t Total = 0;
+  for (std::size_t N : Waiting)
+    Total += N;
+  return Total;
 }
 
 AsyncTaskRunner::~AsyncTaskRunner() { wait(); }
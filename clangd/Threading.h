@@ -36,18 +36,49 @@ private:
   mutable std::mutex Mu;
 };
 
+/// Priorities of tasks competing for limited resources, e.g. a Semaphore.
+/// Tasks with a lower value are served first.
+enum class TaskPriority {
+  /// Requests the user is waiting for, e.g. code completion.
+  Interactive = 0,
+  /// Producing diagnostics for the latest version of a file.
+  Diagnostics = 1,
+  /// Work whose results are not immediately needed.
+  Background = 2,
+};
+
 /// Limits the number of threads that can acquire the lock at the same time.
+/// When threads are waiting, the free slots are given to the ones with the
+/// highest priority first. To avoid starving lower priorities, a waiter that
+/// was passed over \p MaxPasses times by higher priorities is served next.
 class Semaphore {
 public:
-  Semaphore(std::size_t MaxLocks);
+  Semaphore(std::size_t MaxLocks, unsigned MaxPasses = 8);
 
-  void lock();
+  void lock(TaskPriority Priority);
+  /// Same as lock(TaskPriority::Diagnostics), e.g. for std::lock_guard.
+  void lock() { lock(TaskPriority::Diagnostics); }
   void unlock();
 
+  /// Returns the number of threads blocked in lock(). Mostly useful in tests.
+  std::size_t waiting() const;
+
 private:
-  std::mutex Mutex;
+  static constexpr unsigned NumPriorities = 3;
+
+  /// The priority that gets the next free slot, or NumPriorities if no thread
+  /// is waiting. Requires Mutex.
+  unsigned nextPriority() const;
+
+  mutable std::mutex Mutex;
   std::condition_variable SlotsChanged;
   std::size_t FreeSlots;
+  const unsigned MaxPasses;
+  /// Number of threads waiting in lock(), by priority.
+  std::size_t Waiting[NumPriorities] = {0, 0, 0};
+  /// Number of slots given to higher priorities since a thread of this
+  /// priority last got one, counted only while threads of it are waiting.
+  unsigned Passed[NumPriorities] = {0, 0, 0};
 };
 
 /// A point in time we can wait for.
@@ -31,7 +31,7 @@ class JSONTracer : public EventTracer {
 public:
   JSONTracer(raw_ostream &Out, bool Pretty)
       : Out(Out), Sep(""), Start(std::chrono::system_clock::now()),
-        JSONFormat(Pretty ? "{0:2}" : "{0}") {
+        IndentSize(Pretty ? 2 : 0) {
     // The displayTimeUnit must be ns to avoid low-precision overlap
     // calculations!
     Out << R"({"displayTimeUnit":"ns","traceEvents":[)"
@@ -75,7 +75,7 @@ public:
     Contents["ts"] = Timestamp ? Timestamp : timestamp();
     Contents["tid"] = TID;
     std::lock_guard<std::mutex> Lock(Mu);
-    rawEvent(Phase, std::move(Contents));
+    rawEvent(Phase, Contents);
   }
 
 private:
@@ -146,11 +146,17 @@ private:
 
   // Record an event. ph and pid are set.
   // Contents must be a list of the other JSON key/values.
-  void rawEvent(StringRef Phase, json::obj &&Event) /*REQUIRES(Mu)*/ {
-    // PID 0 represents the clangd process.
-    Event["pid"] = 0;
-    Event["ph"] = Phase;
-    Out << Sep << formatv(JSONFormat, json::Expr(std::move(Event)));
+  void rawEvent(StringRef Phase, const json::obj &Event) /*REQUIRES(Mu)*/ {
+    Out << Sep;
+    // Stream the event rather than adding to it and copying it into an Expr.
+    json::OStream J(Out, IndentSize);
+    J.object([&] {
+      for (const auto &P : Event)
+        J.attribute(P.first, P.second);
+      // PID 0 represents the clangd process.
+      J.attribute("pid", 0);
+      J.attribute("ph", Phase);
+    });
     Sep = ",\n";
   }
 
@@ -181,7 +187,7 @@ private:
   const char *Sep /*GUARDED_BY(Mu)*/;
   DenseSet<uint64_t> ThreadsWithMD /*GUARDED_BY(Mu)*/;
   const sys::TimePoint<> Start;
-  const char *JSONFormat;
+  const unsigned IndentSize;
 };
 
 Key<std::unique_ptr<JSONTracer::JSONSpan>> JSONTracer::SpanKey;
@@ -0,0 +1,155 @@
+//===--- IndexBenchmark.cpp - Clangd index benchmarks -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "benchmark/benchmark.h"
+#include "index/Index.h"
+#include "index/MemIndex.h"
+#include "index/Serialization.h"
+#include "index/SymbolYAML.h"
+#include "index/dex/DexIndex.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Symbols with names made of a few random words, spread over many scopes, like
+// the symbols of a large project.
+std::vector<std::string> generateWords(std::mt19937 &Generator) {
+  std::vector<std::string> Words;
+  for (unsigned I = 0; I < 2000; ++I) {
+    std::string Word;
+    for (unsigned J = 0, E = 3 + Generator() % 6; J < E; ++J)
+      Word += 'a' + Generator() % 26;
+    Word[0] -= 'a' - 'A';
+    Words.push_back(Word);
+  }
+  return Words;
+}
+
+SymbolSlab generateSymbols(size_t NumSymbols) {
+  std::mt19937 Generator(42);
+  std::vector<std::string> Words = generateWords(Generator);
+  SymbolSlab::Builder Builder;
+  for (size_t I = 0; I < NumSymbols; ++I) {
+    std::string Name;
+    for (unsigned J = 0, E = 1 + Generator() % 3; J < E; ++J)
+      Name += Words[Generator() % Words.size()];
+    std::string Scope = "ns" + std::to_string(Generator() % 1000) + "::";
+    Symbol Sym;
+    Sym.ID = SymbolID(Scope + Name + std::to_string(I));
+    Sym.Name = Name;
+    Sym.Scope = Scope;
+    Sym.References = Generator() % 100;
+    Builder.insert(Sym);
+  }
+  return std::move(Builder).build();
+}
+
+// Requests like the ones of code completion: short prefixes of words, with or
+// without a scope.
+std::vector<FuzzyFindRequest> generateRequests() {
+  std::mt19937 Generator(7);
+  std::vector<std::string> Words = generateWords(Generator);
+  std::vector<FuzzyFindRequest> Requests;
+  for (unsigned I = 0; I < 100; ++I) {
+    FuzzyFindRequest Req;
+    const std::string &Word = Words[Generator() % Words.size()];
+    Req.Query = Word.substr(0, 1 + Generator() % Word.size());
+    if (I % 2)
+      Req.Scopes = {"ns" + std::to_string(Generator() % 1000) + "::"};
+    Req.MaxCandidateCount = 100;
+    Requests.push_back(Req);
+  }
+  return Requests;
+}
+
+// Runs the fuzzy find requests on Index.
+void fuzzyFind(benchmark::State &State, const SymbolIndex &Index) {
+  std::vector<FuzzyFindRequest> Requests = generateRequests();
+  for (auto _ : State)
+    for (const FuzzyFindRequest &Req : Requests)
+      llvm::cantFail(Index.fuzzyFind(Req, [](const Symbol &Sym) {
+        benchmark::DoNotOptimize(&Sym);
+      }));
+  State.SetItemsProcessed(State.iterations() * Requests.size());
+}
+
+void MemIndexFuzzyFind(benchmark::State &State) {
+  fuzzyFind(State, *MemIndex::build(generateSymbols(State.range(0))));
+}
+BENCHMARK(MemIndexFuzzyFind)
+    ->RangeMultiplier(8)
+    ->Range(10000, 5000000)
+    ->Unit(benchmark::kMillisecond);
+
+void DexIndexFuzzyFind(benchmark::State &State) {
+  fuzzyFind(State, *dex::DexIndex::build(generateSymbols(State.range(0))));
+}
+BENCHMARK(DexIndexFuzzyFind)
+    ->RangeMultiplier(8)
+    ->Range(10000, 5000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Loads an index of State.range(0) symbols stored in the YAML format, which is
+// parsed into a SymbolSlab.
+void YAMLIndexLoad(benchmark::State &State) {
+  std::string Data;
+  {
+    llvm::raw_string_ostream OS(Data);
+    SymbolsToYAML(generateSymbols(State.range(0)), OS);
+  }
+  for (auto _ : State)
+    benchmark::DoNotOptimize(MemIndex::build(SymbolsFromYAML(Data)));
+  State.SetBytesProcessed(State.iterations() * Data.size());
+}
+BENCHMARK(YAMLIndexLoad)
+    ->RangeMultiplier(10)
+    ->Range(10000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Loads the same index stored in the binary format, which is served in place.
+void BinaryIndexLoad(benchmark::State &State) {
+  std::string Data;
+  {
+    llvm::raw_string_ostream OS(Data);
+    writeBinaryIndex(generateSymbols(State.range(0)), OS);
+  }
+  for (auto _ : State)
+    benchmark::DoNotOptimize(llvm::cantFail(loadBinaryIndex(
+        llvm::MemoryBuffer::getMemBuffer(Data, "", false))));
+  State.SetBytesProcessed(State.iterations() * Data.size());
+}
+BENCHMARK(BinaryIndexLoad)
+    ->RangeMultiplier(10)
+    ->Range(10000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+void BinaryIndexFuzzyFind(benchmark::State &State) {
+  std::string Data;
+  {
+    llvm::raw_string_ostream OS(Data);
+    writeBinaryIndex(generateSymbols(State.range(0)), OS);
+  }
+  fuzzyFind(State, *llvm::cantFail(loadBinaryIndex(
+                       llvm::MemoryBuffer::getMemBuffer(Data, "", false))));
+}
+BENCHMARK(BinaryIndexFuzzyFind)
+    ->RangeMultiplier(10)
+    ->Range(10000, 1000000)
+    ->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -0,0 +1,83 @@
+//===--- JSONBenchmark.cpp - Clangd JSON output benchmarks ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "JSONExpr.h"
+#include "Protocol.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// A completion list shaped like the ones clangd sends for a member access.
+CompletionList generateCompletionList(size_t NumItems) {
+  CompletionList List;
+  for (size_t I = 0; I < NumItems; ++I) {
+    CompletionItem Item;
+    Item.label = "item" + std::to_string(I) + "(int x, int y)";
+    Item.kind = CompletionItemKind::Function;
+    Item.detail = "int";
+    Item.sortText = std::to_string(I);
+    Item.filterText = "item" + std::to_string(I);
+    Item.insertTextFormat = InsertTextFormat::Snippet;
+    TextEdit Edit;
+    Edit.range.start.line = Edit.range.end.line = 10;
+    Edit.range.start.character = 4;
+    Edit.range.end.character = 7;
+    Edit.newText = "item" + std::to_string(I) + "(${1:int x}, ${2:int y})";
+    Item.textEdit = Edit;
+    List.items.push_back(std::move(Item));
+  }
+  return List;
+}
+
+// Builds an Expr for the whole list before writing it, like reply() does.
+void CompletionListExpr(benchmark::State &State) {
+  CompletionList List = generateCompletionList(State.range(0));
+  size_t Bytes = 0;
+  for (auto _ : State) {
+    std::string S;
+    llvm::raw_string_ostream OS(S);
+    json::OStream(OS).value(toJSON(List));
+    Bytes += OS.str().size();
+  }
+  State.SetBytesProcessed(Bytes);
+}
+BENCHMARK(CompletionListExpr)
+    ->RangeMultiplier(10)
+    ->Range(100, 100000)
+    ->Unit(benchmark::kMicrosecond);
+
+// Writes the list one item at a time, like replyStreamed() does.
+void CompletionListStreamed(benchmark::State &State) {
+  CompletionList List = generateCompletionList(State.range(0));
+  size_t Bytes = 0;
+  for (auto _ : State) {
+    std::string S;
+    llvm::raw_string_ostream OS(S);
+    {
+      json::OStream J(OS);
+      writeJSON(J, List);
+    }
+    Bytes += OS.str().size();
+  }
+  State.SetBytesProcessed(Bytes);
+}
+BENCHMARK(CompletionListStreamed)
+    ->RangeMultiplier(10)
+    ->Range(100, 100000)
+    ->Unit(benchmark::kMicrosecond);
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
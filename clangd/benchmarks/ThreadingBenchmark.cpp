@@ -0,0 +1,81 @@
+//===--- ThreadingBenchmark.cpp - Semaphore contention benchmark -*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures how long a request waits for a worker slot while background tasks
+// keep every slot busy, for interactive and background priorities.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Threading.h"
+#include "benchmark/benchmark.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+// Each background task holds a slot for this long, roughly a short parse.
+constexpr std::chrono::microseconds BackgroundWork(200);
+
+void acquireUnderLoad(benchmark::State &State, TaskPriority Priority) {
+  const std::size_t Slots = State.range(0);
+  Semaphore Barrier(Slots);
+  std::atomic<bool> Stop(false);
+  // Twice as many background threads as slots, so there is always a queue.
+  std::vector<std::thread> Background;
+  for (std::size_t I = 0; I < 2 * Slots; ++I)
+    Background.emplace_back([&]() {
+      while (!Stop) {
+        Barrier.lock(TaskPriority::Background);
+        std::this_thread::sleep_for(BackgroundWork);
+        Barrier.unlock();
+      }
+    });
+
+  for (auto _ : State) {
+    Barrier.lock(Priority);
+    Barrier.unlock();
+    // Let the background threads take every slot again, so that each
+    // iteration waits in the queue instead of reusing the slot it just freed.
+    State.PauseTiming();
+    std::this_thread::sleep_for(BackgroundWork);
+    State.ResumeTiming();
+  }
+
+  Stop = true;
+  for (auto &T : Background)
+    T.join();
+}
+
+void BM_InteractiveAcquire(benchmark::State &State) {
+  acquireUnderLoad(State, TaskPriority::Interactive);
+}
+BENCHMARK(BM_InteractiveAcquire)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+void BM_BackgroundAcquire(benchmark::State &State) {
+  acquireUnderLoad(State, TaskPriority::Background);
+}
+BENCHMARK(BM_BackgroundAcquire)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+} // namespace
+} // namespace clangd
+} // namespace clang
+
+BENCHMARK_MAIN();
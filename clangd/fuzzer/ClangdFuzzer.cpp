@@ -16,7 +16,7 @@
 #include "ClangdLSPServer.h"
 #include "ClangdServer.h"
 #include "CodeComplete.h"
-#include <sstream>
+#include <cstdio>
 
 extern "C" int LLVMFuzzerTestOneInput(uint8_t *data, size_t size) {
   clang::clangd::JSONOutput Out(llvm::nulls(), llvm::nulls(), nullptr);
@@ -27,7 +27,13 @@ extern "C" int LLVMFuzzerTestOneInput(uint8_t *data, size_t size) {
   // Initialize and run ClangdLSPServer.
   clang::clangd::ClangdLSPServer LSPServer(Out, CCOpts, llvm::None, Opts);
 
-  std::istringstream In(std::string(reinterpret_cast<char *>(data), size));
-  LSPServer.run(In);
+  // The server reads its input from a file descriptor. It is a regular file,
+  // so the server is done with it when run() returns.
+  std::FILE *In = std::tmpfile();
+  std::fwrite(data, 1, size, In);
+  std::fflush(In);
+  std::rewind(In);
+  LSPServer.run(fileno(In));
+  std::fclose(In);
   return 0;
 }
@@ -16,6 +16,7 @@
 #include "index/CanonicalIncludes.h"
 #include "index/Index.h"
 #include "index/Merge.h"
+#include "index/Serialization.h"
 #include "index/SymbolCollector.h"
 #include "index/SymbolYAML.h"
 #include "clang/Frontend/CompilerInstance.h"
@@ -28,9 +29,10 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
 #include "llvm/Support/Signals.h"
-#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <mutex>
 
 using namespace llvm;
 using namespace clang::tooling;
@@ -49,22 +51,85 @@ static llvm::cl::opt<std::string> AssumedHeaderDir(
                    "not given, such headers will have relative paths."),
     llvm::cl::init(""));
 
+enum class IndexFormat { YAML, Binary };
+static llvm::cl::opt<IndexFormat> OutputFormat(
+    "format", llvm::cl::desc("Format of the emitted index"),
+    llvm::cl::values(clEnumValN(IndexFormat::YAML, "yaml",
+                                "YAML symbol format"),
+                     clEnumValN(IndexFormat::Binary, "binary",
+                                "memory-mappable binary format, which clangd "
+                                "can load without parsing")),
+    llvm::cl::init(IndexFormat::YAML));
+
+static llvm::cl::opt<unsigned> MergeShards(
+    "merge-shards",
+    llvm::cl::desc("Number of shards (at most 256) the symbols are split into "
+                   "by SymbolID, so that they can be merged in parallel."),
+    llvm::cl::init(64), llvm::cl::Hidden);
+
+// Combines occurrences of the same symbol across translation units. Symbols
+// are merged as soon as their translation unit is indexed, so the per-TU
+// results are never buffered: memory only grows with the unique symbols.
+//
+// The symbols are split into shards by SymbolID (see symbolShard()), each with
+// its own lock, so that translation units indexed in parallel rarely wait for
+// each other.
+class SymbolMerger {
+public:
+  SymbolMerger(unsigned NumShards) : Shards(NumShards) {}
+
+  void add(const SymbolSlab &Symbols) {
+    // Slabs are sorted by SymbolID and shards are ranges of IDs, so each shard
+    // is locked once, and in the same order by all threads.
+    std::unique_lock<std::mutex> Lock;
+    Shard *Current = nullptr;
+    for (const Symbol &Sym : Symbols) {
+      Shard &S = Shards[symbolShard(Sym.ID, Shards.size())];
+      if (&S != Current) {
+        if (Lock)
+          Lock.unlock();
+        Lock = std::unique_lock<std::mutex>(S.Mutex);
+        Current = &S;
+      }
+      if (const auto *Existing = S.Symbols.find(Sym.ID))
+        S.Symbols.insert(mergeSymbol(*Existing, Sym, &S.Scratch));
+      else
+        S.Symbols.insert(Sym);
+    }
+  }
+
+  // Calls OnShard with each merged shard, in SymbolID order. A shard is freed
+  // by OnShard, so the output can be streamed.
+  void build(llvm::function_ref<void(SymbolSlab)> OnShard) && {
+    for (Shard &S : Shards)
+      OnShard(std::move(S.Symbols).build());
+  }
+
+private:
+  struct Shard {
+    std::mutex Mutex;
+    SymbolSlab::Builder Symbols;
+    Symbol::Details Scratch;
+  };
+  std::vector<Shard> Shards;
+};
+
 class SymbolIndexActionFactory : public tooling::FrontendActionFactory {
 public:
-  SymbolIndexActionFactory(tooling::ExecutionContext *Ctx) : Ctx(Ctx) {}
+  SymbolIndexActionFactory(SymbolMerger &Merger) : Merger(Merger) {}
 
   clang::FrontendAction *create() override {
-    // Wraps the index action and reports collected symbols to the execution
-    // context at the end of each translation unit.
+    // Wraps the index action and merges the collected symbols at the end of
+    // each translation unit.
     class WrappedIndexAction : public WrapperFrontendAction {
     public:
       WrappedIndexAction(std::shared_ptr<SymbolCollector> C,
                          std::unique_ptr<CanonicalIncludes> Includes,
                          const index::IndexingOptions &Opts,
-                         tooling::ExecutionContext *Ctx)
+                         SymbolMerger &Merger)
           : WrapperFrontendAction(
                 index::createIndexingAction(C, Opts, nullptr)),
-            Ctx(Ctx), Collector(C), Includes(std::move(Includes)),
+            Merger(Merger), Collector(C), Includes(std::move(Includes)),
             PragmaHandler(collectIWYUHeaderMaps(this->Includes.get())) {}
 
       std::unique_ptr<ASTConsumer>
@@ -76,17 +141,11 @@ public:
       void EndSourceFileAction() override {
         WrapperFrontendAction::EndSourceFileAction();
 
-        auto Symbols = Collector->takeSymbols();
-        for (const auto &Sym : Symbols) {
-          std::string IDStr;
-          llvm::raw_string_ostream OS(IDStr);
-          OS << Sym.ID;
-          Ctx->reportResult(OS.str(), SymbolToYAML(Sym));
-        }
+        Merger.add(Collector->takeSymbols());
       }
 
     private:
-      tooling::ExecutionContext *Ctx;
+      SymbolMerger &Merger;
       std::shared_ptr<SymbolCollector> Collector;
       std::unique_ptr<CanonicalIncludes> Includes;
       std::unique_ptr<CommentHandler> PragmaHandler;
@@ -105,31 +164,12 @@ public:
     CollectorOpts.Includes = Includes.get();
     return new WrappedIndexAction(
         std::make_shared<SymbolCollector>(std::move(CollectorOpts)),
-        std::move(Includes), IndexOpts, Ctx);
+        std::move(Includes), IndexOpts, Merger);
   }
 
-  tooling::ExecutionContext *Ctx;
+  SymbolMerger &Merger;
 };
 
-// Combine occurrences of the same symbol across translation units.
-SymbolSlab mergeSymbols(tooling::ToolResults *Results) {
-  SymbolSlab::Builder UniqueSymbols;
-  llvm::BumpPtrAllocator Arena;
-  Symbol::Details Scratch;
-  Results->forEachResult([&](llvm::StringRef Key, llvm::StringRef Value) {
-    Arena.Reset();
-    llvm::yaml::Input Yin(Value, &Arena);
-    auto Sym = clang::clangd::SymbolFromYAML(Yin, Arena);
-    clang::clangd::SymbolID ID;
-    Key >> ID;
-    if (const auto *Existing = UniqueSymbols.find(ID))
-      UniqueSymbols.insert(mergeSymbol(*Existing, Sym, &Scratch));
-    else
-      UniqueSymbols.insert(Sym);
-  });
-  return std::move(UniqueSymbols).build();
-}
-
 } // namespace
 } // namespace clangd
 } // namespace clang
@@ -155,19 +195,33 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
-  // Map phase: emit symbols found in each translation unit.
+  if (clang::clangd::MergeShards == 0 || clang::clangd::MergeShards > 256) {
+    llvm::errs() << "--merge-shards must be between 1 and 256.\n";
+    return 1;
+  }
+
+  // Map and reduce phases: collect the symbols found in each translation unit
+  // and combine them using the ID as a key.
+  clang::clangd::SymbolMerger Merger(clang::clangd::MergeShards);
   auto Err = Executor->get()->execute(
-      llvm::make_unique<clang::clangd::SymbolIndexActionFactory>(
-          Executor->get()->getExecutionContext()));
+      llvm::make_unique<clang::clangd::SymbolIndexActionFactory>(Merger));
   if (Err) {
     llvm::errs() << llvm::toString(std::move(Err)) << "\n";
   }
 
-  // Reduce phase: combine symbols using the ID as a key.
-  auto UniqueSymbols =
-      clang::clangd::mergeSymbols(Executor->get()->getToolResults());
-
-  // Output phase: emit YAML for result symbols.
-  SymbolsToYAML(UniqueSymbols, llvm::outs());
+  // Output phase: emit result symbols in the requested format. YAML output is
+  // streamed shard by shard, the binary format needs all symbols to lay out
+  // its header.
+  std::vector<SymbolSlab> Shards;
+  std::move(Merger).build([&](SymbolSlab Shard) {
+    if (clang::clangd::OutputFormat == clang::clangd::IndexFormat::YAML)
+      SymbolsToYAML(Shard, llvm::outs());
+    else
+      Shards.push_back(std::move(Shard));
+  });
+  if (clang::clangd::OutputFormat == clang::clangd::IndexFormat::Binary) {
+    llvm::sys::ChangeStdoutToBinary();
+    clang::clangd::writeBinaryIndex(Shards, llvm::outs());
+  }
   return 0;
 }
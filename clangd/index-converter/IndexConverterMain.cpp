@@ -0,0 +1,89 @@
+//===--- IndexConverterMain.cpp ----------------------------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Converts symbol indexes between the YAML format produced by
+// global-symbol-builder and the memory-mappable binary format. The format of
+// the input is detected automatically.
+//
+//===---------------------------------------------------------------------===//
+
+#include "index/Serialization.h"
+#include "index/SymbolYAML.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using namespace clang::clangd;
+
+namespace {
+enum class IndexFormat { YAML, Binary };
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::Required,
+                                      cl::desc("<input index>"));
+
+static cl::opt<std::string> OutputFile("o", cl::Required,
+                                       cl::desc("Output index file"),
+                                       cl::value_desc("filename"));
+
+static cl::opt<IndexFormat> OutputFormat(
+    "format", cl::desc("Format of the output index"),
+    cl::values(clEnumValN(IndexFormat::YAML, "yaml", "YAML symbol format"),
+               clEnumValN(IndexFormat::Binary, "binary",
+                          "memory-mappable binary format")),
+    cl::init(IndexFormat::Binary));
+} // namespace
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Converts clangd symbol indexes between YAML and binary formats.");
+
+  auto Buffer = MemoryBuffer::getFile(InputFile, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!Buffer) {
+    errs() << "Can't open " << InputFile << ": " << Buffer.getError().message()
+           << "\n";
+    return 1;
+  }
+
+  SymbolSlab Symbols;
+  StringRef Data = Buffer.get()->getBuffer();
+  if (isBinaryIndex(Data)) {
+    auto Read = readBinaryIndex(Data);
+    if (!Read) {
+      errs() << InputFile << ": " << toString(Read.takeError()) << "\n";
+      return 1;
+    }
+    Symbols = std::move(*Read);
+  } else {
+    Symbols = SymbolsFromYAML(Data);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFile, EC,
+                    OutputFormat == IndexFormat::Binary ? sys::fs::F_None
+                                                        : sys::fs::F_Text);
+  if (EC) {
+    errs() << "Can't open " << OutputFile << ": " << EC.message() << "\n";
+    return 1;
+  }
+  switch (OutputFormat) {
+  case IndexFormat::YAML:
+    SymbolsToYAML(Symbols, OS);
+    break;
+  case IndexFormat::Binary:
+    writeBinaryIndex(Symbols, OS);
+    break;
+  }
+  return 0;
+}
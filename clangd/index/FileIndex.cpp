@@ -8,8 +8,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "FileIndex.h"
+#include "../Cancellation.h"
+#include "../FuzzyMatch.h"
+#include "../Trace.h"
+#include "Merge.h"
 #include "SymbolCollector.h"
 #include "clang/Index/IndexingAction.h"
+#include "llvm/ADT/STLExtras.h"
+#include <deque>
+#include <queue>
 
 namespace clang {
 namespace clangd {
@@ -42,61 +49,142 @@ std::unique_ptr<SymbolSlab> indexAST(ASTContext &Ctx,
   return Symbols;
 }
 
+/// Calls \p Callback with a symbol found in one or several files.
+void reportSymbol(llvm::ArrayRef<const Symbol *> Occurrences,
+                  llvm::function_ref<void(const Symbol &)> Callback) {
+  if (Occurrences.size() == 1)
+    return Callback(*Occurrences.front());
+  // A merged symbol may point to the scratch space of the previous merge.
+  std::deque<Symbol::Details> Scratch;
+  Symbol Merged = *Occurrences.front();
+  for (const Symbol *Sym : Occurrences.drop_front()) {
+    Scratch.emplace_back();
+    Merged = mergeSymbol(Merged, *Sym, &Scratch.back());
+  }
+  Callback(Merged);
+}
+
 } // namespace
 
 void FileSymbols::update(PathRef Path, std::unique_ptr<SymbolSlab> Slab) {
   std::lock_guard<std::mutex> Lock(Mutex);
-  if (!Slab)
-    FileToSlabs.erase(Path);
-  else
-    FileToSlabs[Path] = std::move(Slab);
-}
+  // Queries may still use the current snapshot. The new one starts as a copy,
+  // and only the symbols of Path are removed from it and added to it.
+  auto NewSnap = std::make_shared<Snapshot>();
+  NewSnap->Symbols = std::atomic_load(&Snap)->Symbols;
+  SymbolsByID &Symbols = NewSnap->Symbols;
 
-std::shared_ptr<std::vector<const Symbol *>> FileSymbols::allSymbols() {
-  // The snapshot manages life time of symbol slabs and provides pointers of all
-  // symbols in all slabs.
-  struct Snapshot {
-    std::vector<const Symbol *> Pointers;
-    std::vector<std::shared_ptr<SymbolSlab>> KeepAlive;
-  };
-  auto Snap = std::make_shared<Snapshot>();
-  {
-    std::lock_guard<std::mutex> Lock(Mutex);
-
-    for (const auto &FileAndSlab : FileToSlabs) {
-      Snap->KeepAlive.push_back(FileAndSlab.second);
-      for (const auto &Iter : *FileAndSlab.second)
-        Snap->Pointers.push_back(&Iter);
+  auto It = FileToSlabs.find(Path);
+  if (It != FileToSlabs.end()) {
+    for (const Symbol &Sym : *It->second) {
+      auto I = Symbols.find(Sym.ID);
+      assert(I != Symbols.end() && "symbol of a slab is not indexed");
+      I->second.erase(llvm::find(I->second, &Sym));
+      if (I->second.empty())
+        Symbols.erase(I);
     }
+    TotalSymbols -= It->second->size();
+    TotalBytes -= It->second->bytes();
+    FileToSlabs.erase(It);
   }
-  auto *Pointers = &Snap->Pointers;
-  // Use aliasing constructor to keep the snapshot alive along with the
-  // pointers.
-  return {std::move(Snap), Pointers};
+  if (Slab) {
+    for (const Symbol &Sym : *Slab)
+      Symbols[Sym.ID].push_back(&Sym);
+    TotalSymbols += Slab->size();
+    TotalBytes += Slab->bytes();
+    FileToSlabs[Path] = std::move(Slab);
+  }
+
+  NewSnap->Slabs.reserve(FileToSlabs.size());
+  for (const auto &FileAndSlab : FileToSlabs)
+    NewSnap->Slabs.push_back(FileAndSlab.second);
+  // The old snapshot is released by the last query still using it.
+  std::atomic_store(&Snap, std::shared_ptr<const Snapshot>(std::move(NewSnap)));
+}
+
+std::shared_ptr<const FileSymbols::SymbolsByID> FileSymbols::snapshot() const {
+  std::shared_ptr<const Snapshot> S = std::atomic_load(&Snap);
+  // The returned pointer shares the ownership of the whole snapshot.
+  return {S, &S->Symbols};
+}
+
+void FileSymbols::getStats(size_t &Files, size_t &Symbols,
+                           size_t &Bytes) const {
+  std::lock_guard<std::mutex> Lock(Mutex);
+  Files = FileToSlabs.size();
+  Symbols = TotalSymbols;
+  Bytes = TotalBytes;
 }
 
 void FileIndex::update(PathRef Path, ParsedAST *AST) {
-  if (!AST) {
-    FSymbols.update(Path, nullptr);
-  } else {
-    auto Slab = indexAST(AST->getASTContext(), AST->getPreprocessorPtr(),
-                         AST->getTopLevelDecls());
-    FSymbols.update(Path, std::move(Slab));
+  trace::Span Tracer("Update file index");
+  SPAN_ATTACH(Tracer, "file", Path);
+  std::unique_ptr<SymbolSlab> Slab;
+  if (AST) {
+    Slab = indexAST(AST->getASTContext(), AST->getPreprocessorPtr(),
+                    AST->getTopLevelDecls());
+    SPAN_ATTACH(Tracer, "symbols", Slab->size());
+    SPAN_ATTACH(Tracer, "bytes", Slab->bytes());
+  }
+
+  // Only the symbols of Path are removed from and added to the index.
+  FSymbols.update(Path, std::move(Slab));
+  if (Tracer.Args) {
+    size_t Files, TotalSymbols, TotalBytes;
+    FSymbols.getStats(Files, TotalSymbols, TotalBytes);
+    SPAN_ATTACH(Tracer, "files", Files);
+    SPAN_ATTACH(Tracer, "total_symbols", TotalSymbols);
+    SPAN_ATTACH(Tracer, "total_bytes", TotalBytes);
   }
-  auto Symbols = FSymbols.allSymbols();
-  Index.build(std::move(Symbols));
 }
 
-bool FileIndex::fuzzyFind(
+llvm::Expected<bool> FileIndex::fuzzyFind(
     const FuzzyFindRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
-  return Index.fuzzyFind(Req, Callback);
+  assert(!StringRef(Req.Query).contains("::") &&
+         "There must be no :: in query.");
+
+  using Occurrences = llvm::SmallVector<const Symbol *, 1>;
+  FuzzyMatcher Filter(Req.Query);
+  bool More = false;
+  // Keeps the symbols alive until all callbacks have run.
+  std::shared_ptr<const FileSymbols::SymbolsByID> Symbols = FSymbols.snapshot();
+  std::priority_queue<std::pair<float, const Occurrences *>> Top;
+  unsigned Scanned = 0;
+  for (const auto &IDAndSymbols : *Symbols) {
+    // Checking for cancellation is not free, only do it once in a while.
+    if (++Scanned % 1024 == 0 && isCancelled())
+      return cancelledError();
+    // All occurrences of a symbol have the same name and scope.
+    const Symbol &Sym = *IDAndSymbols.second.front();
+
+    // Exact match against all possible scopes.
+    if (!Req.Scopes.empty() && !llvm::is_contained(Req.Scopes, Sym.Scope))
+      continue;
+
+    if (auto Score = Filter.match(Sym.Name)) {
+      Top.emplace(-*Score, &IDAndSymbols.second);
+      if (Top.size() > Req.MaxCandidateCount) {
+        More = true;
+        Top.pop();
+      }
+    }
+  }
+  for (; !Top.empty(); Top.pop())
+    reportSymbol(*Top.top().second, Callback);
+  return More;
 }
 
 void FileIndex::lookup(
     const LookupRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
-  Index.lookup(Req, Callback);
+  // Keeps the symbols alive until all callbacks have run.
+  std::shared_ptr<const FileSymbols::SymbolsByID> Symbols = FSymbols.snapshot();
+  for (const auto &ID : Req.IDs) {
+    auto I = Symbols->find(ID);
+    if (I != Symbols->end())
+      reportSymbol(I->second, Callback);
+  }
 }
 
 } // namespace clangd
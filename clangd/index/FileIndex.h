@@ -18,7 +18,10 @@
 
 #include "../ClangdUnit.h"
 #include "Index.h"
-#include "MemIndex.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include <memory>
+#include <mutex>
 
 namespace clang {
 namespace clangd {
@@ -27,39 +30,62 @@ namespace clangd {
 /// at source-file granularity, replacing all symbols from one file with a new
 /// set.
 ///
-/// This implements a snapshot semantics for symbols in a file. Each update to a
-/// file will create a new snapshot for all symbols in the file. Snapshots are
-/// managed with shared pointers that are shared between this class and the
-/// users. For each file, this class only stores a pointer pointing to the
-/// newest snapshot, and an outdated snapshot is deleted by the last owner of
-/// the snapshot, either this class or the symbol index.
+/// Symbols are indexed by ID. The index is maintained incrementally: an update
+/// only adds and removes the symbols of the updated file. Symbols from headers
+/// may be in several files' slabs, in which case the index holds all of them.
 ///
-/// The snapshot semantics keeps critical sections minimal since we only need
-/// locking when we swap or obtain refereces to snapshots.
+/// Each update publishes an immutable snapshot of the index, which owns the
+/// slabs of its symbols. Queries use a snapshot without holding any lock, so
+/// they never block each other or the updates.
 class FileSymbols {
 public:
+  using SymbolsByID =
+      llvm::DenseMap<SymbolID, llvm::SmallVector<const Symbol *, 1>>;
+
   /// \brief Updates all symbols in a file. If \p Slab is nullptr, symbols for
   /// \p Path will be removed.
   void update(PathRef Path, std::unique_ptr<SymbolSlab> Slab);
 
-  // The shared_ptr keeps the symbols alive
-  std::shared_ptr<std::vector<const Symbol *>> allSymbols();
+  /// \brief Returns the symbols of all files as of the last update. The
+  /// snapshot is not affected by later updates, and keeps its symbols alive.
+  std::shared_ptr<const SymbolsByID> snapshot() const;
+
+  /// \brief Returns the number of files and the total number of symbols and
+  /// bytes of their slabs.
+  void getStats(size_t &Files, size_t &Symbols, size_t &Bytes) const;
 
 private:
+  struct Snapshot {
+    /// \brief The symbols of all slabs in FileToSlabs, in the order the files
+    /// were updated.
+    SymbolsByID Symbols;
+    /// \brief Owns the symbols in Symbols.
+    std::vector<std::shared_ptr<SymbolSlab>> Slabs;
+  };
+
+  /// Serializes the updates. Queries only use Snap.
   mutable std::mutex Mutex;
 
   /// \brief Stores the latest snapshots for all active files.
   llvm::StringMap<std::shared_ptr<SymbolSlab>> FileToSlabs;
+  size_t TotalSymbols = 0;
+  size_t TotalBytes = 0;
+  /// Only accessed via std::atomic_load and std::atomic_store.
+  std::shared_ptr<const Snapshot> Snap = std::make_shared<Snapshot>();
 };
 
 /// \brief This manages symbls from files and an in-memory index on all symbols.
+///
+/// An update only indexes the symbols of the updated file. Symbols found in
+/// several files (e.g. declared in headers) are reported once, merged with
+/// mergeSymbol().
 class FileIndex : public SymbolIndex {
 public:
   /// \brief Update symbols in \p Path with symbols in \p AST. If \p AST is
   /// nullptr, this removes all symbols in the file
   void update(PathRef Path, ParsedAST *AST);
 
-  bool
+  llvm::Expected<bool>
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override;
 
@@ -68,7 +94,6 @@ public:
 
 private:
   FileSymbols FSymbols;
-  MemIndex Index;
 };
 
 } // namespace clangd
@@ -26,6 +26,15 @@ raw_ostream &operator<<(raw_ostream &OS, const SymbolLocation &L) {
 SymbolID::SymbolID(StringRef USR)
     : HashValue(SHA1::hash(arrayRefFromStringRef(USR))) {}
 
+constexpr unsigned SymbolID::HashByteLength;
+
+SymbolID SymbolID::fromRaw(StringRef Raw) {
+  SymbolID ID;
+  assert(Raw.size() == ID.HashValue.size());
+  std::copy(Raw.begin(), Raw.end(), ID.HashValue.begin());
+  return ID;
+}
+
 raw_ostream &operator<<(raw_ostream &OS, const SymbolID &ID) {
   OS << toHex(toStringRef(ID.HashValue));
   return OS;
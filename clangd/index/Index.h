@@ -17,6 +17,7 @@
 #include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Error.h"
 #include <array>
 #include <string>
 
@@ -69,9 +70,17 @@ public:
     return HashValue < Sym.HashValue;
   }
 
-private:
   static constexpr unsigned HashByteLength = 20;
 
+  // Returns the raw bytes of the hash, e.g. for binary serialization.
+  llvm::StringRef raw() const {
+    return llvm::StringRef(reinterpret_cast<const char *>(HashValue.data()),
+                           HashByteLength);
+  }
+  // Reconstructs a SymbolID from the bytes returned by raw().
+  static SymbolID fromRaw(llvm::StringRef Raw);
+
+private:
   friend llvm::hash_code hash_value(const SymbolID &ID) {
     // We already have a good hash, just return the first bytes.
     static_assert(sizeof(size_t) <= HashByteLength, "size_t longer than SHA1!");
@@ -281,7 +290,10 @@ public:
   /// If returned Symbols are used outside Callback, they must be deep-copied!
   ///
   /// Returns true if there may be more results (limited by MaxCandidateCount).
-  virtual bool
+  /// Implementations should stop early if the current request is cancelled
+  /// (see isCancelled()) and return cancelledError(). Callback may have been
+  /// called for some of the symbols by then.
+  virtual llvm::Expected<bool>
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const = 0;
 
@@ -8,6 +8,7 @@
 //===-------------------------------------------------------------------===//
 
 #include "MemIndex.h"
+#include "../Cancellation.h"
 #include "../FuzzyMatch.h"
 #include "../Logger.h"
 #include <queue>
@@ -16,19 +17,22 @@ namespace clang {
 namespace clangd {
 
 void MemIndex::build(std::shared_ptr<std::vector<const Symbol *>> Syms) {
-  llvm::DenseMap<SymbolID, const Symbol *> TempIndex;
+  auto NewSnap = std::make_shared<IndexSnapshot>();
   for (const Symbol *Sym : *Syms)
-    TempIndex[Sym->ID] = Sym;
+    NewSnap->Index[Sym->ID] = Sym;
+  NewSnap->Symbols = std::move(Syms);
 
-  // Swap out the old symbols and index.
-  {
-    std::lock_guard<std::mutex> Lock(Mutex);
-    Index = std::move(TempIndex);
-    Symbols = std::move(Syms); // Relase old symbols.
-  }
+  // Publish the new snapshot. The old symbols and index are released by the
+  // last query still using them.
+  std::atomic_store(&Snap,
+                    std::shared_ptr<const IndexSnapshot>(std::move(NewSnap)));
+}
+
+std::shared_ptr<const MemIndex::IndexSnapshot> MemIndex::snapshot() const {
+  return std::atomic_load(&Snap);
 }
 
-bool MemIndex::fuzzyFind(
+llvm::Expected<bool> MemIndex::fuzzyFind(
     const FuzzyFindRequest &Req,
     llvm::function_ref<void(const Symbol &)> Callback) const {
   assert(!StringRef(Req.Query).contains("::") &&
@@ -37,34 +41,38 @@ bool MemIndex::fuzzyFind(
   std::priority_queue<std::pair<float, const Symbol *>> Top;
   FuzzyMatcher Filter(Req.Query);
   bool More = false;
-  {
-    std::lock_guard<std::mutex> Lock(Mutex);
-    for (const auto Pair : Index) {
-      const Symbol *Sym = Pair.second;
+  // Keeps the symbols alive until all callbacks have run.
+  auto S = snapshot();
+  unsigned Scanned = 0;
+  for (const auto Pair : S->Index) {
+    // Checking for cancellation is not free, only do it once in a while.
+    if (++Scanned % 1024 == 0 && isCancelled())
+      return cancelledError();
+    const Symbol *Sym = Pair.second;
 
-      // Exact match against all possible scopes.
-      if (!Req.Scopes.empty() && !llvm::is_contained(Req.Scopes, Sym->Scope))
-        continue;
+    // Exact match against all possible scopes.
+    if (!Req.Scopes.empty() && !llvm::is_contained(Req.Scopes, Sym->Scope))
+      continue;
 
-      if (auto Score = Filter.match(Sym->Name)) {
-        Top.emplace(-*Score, Sym);
-        if (Top.size() > Req.MaxCandidateCount) {
-          More = true;
-          Top.pop();
-        }
+    if (auto Score = Filter.match(Sym->Name)) {
+      Top.emplace(-*Score, Sym);
+      if (Top.size() > Req.MaxCandidateCount) {
+        More = true;
+        Top.pop();
       }
     }
-    for (; !Top.empty(); Top.pop())
-      Callback(*Top.top().second);
   }
+  for (; !Top.empty(); Top.pop())
+    Callback(*Top.top().second);
   return More;
 }
 
 void MemIndex::lookup(const LookupRequest &Req,
                       llvm::function_ref<void(const Symbol &)> Callback) const {
+  auto S = snapshot();
   for (const auto &ID : Req.IDs) {
-    auto I = Index.find(ID);
-    if (I != Index.end())
+    auto I = S->Index.find(ID);
+    if (I != S->Index.end())
       Callback(*I->second);
   }
 }
@@ -11,13 +11,17 @@
 #define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_MEMINDEX_H
 
 #include "Index.h"
-#include <mutex>
+#include <memory>
 
 namespace clang {
 namespace clangd {
 
 /// \brief This implements an index for a (relatively small) set of symbols that
 /// can be easily managed in memory.
+///
+/// The symbols are published as immutable snapshots: build() atomically swaps
+/// in a new snapshot, while queries keep using the one they started with. Thus
+/// readers never block each other or the writer.
 class MemIndex : public SymbolIndex {
 public:
   /// \brief (Re-)Build index for `Symbols`. All symbol pointers must remain
@@ -27,7 +31,7 @@ public:
   /// \brief Build index from a symbol slab.
   static std::unique_ptr<SymbolIndex> build(SymbolSlab Slab);
 
-  bool
+  llvm::Expected<bool>
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override;
 
@@ -36,11 +40,17 @@ public:
          llvm::function_ref<void(const Symbol &)> Callback) const override;
 
 private:
-  std::shared_ptr<std::vector<const Symbol *>> Symbols;
-  // Index is a set of symbols that are deduplicated by symbol IDs.
-  // FIXME: build smarter index structure.
-  llvm::DenseMap<SymbolID, const Symbol *> Index;
-  mutable std::mutex Mutex;
+  struct IndexSnapshot {
+    std::shared_ptr<std::vector<const Symbol *>> Symbols;
+    // Index is a set of symbols that are deduplicated by symbol IDs.
+    // FIXME: build smarter index structure.
+    llvm::DenseMap<SymbolID, const Symbol *> Index;
+  };
+  /// Returns the latest published snapshot, never null.
+  std::shared_ptr<const IndexSnapshot> snapshot() const;
+
+  /// Only accessed via std::atomic_load and std::atomic_store.
+  std::shared_ptr<const IndexSnapshot> Snap = std::make_shared<IndexSnapshot>();
 };
 
 } // namespace clangd
@@ -24,32 +24,38 @@ class MergedIndex : public SymbolIndex {
    //          - find the generating file from each Symbol which is Static-only
    //          - ask Dynamic if it has that file (needs new SymbolIndex method)
    //          - if so, drop the Symbol.
-   bool fuzzyFind(const FuzzyFindRequest &Req,
-                  function_ref<void(const Symbol &)> Callback) const override {
+   Expected<bool>
+   fuzzyFind(const FuzzyFindRequest &Req,
+             function_ref<void(const Symbol &)> Callback) const override {
      // We can't step through both sources in parallel. So:
      //  1) query all dynamic symbols, slurping results into a slab
      //  2) query the static symbols, for each one:
      //    a) if it's not in the dynamic slab, yield it directly
      //    b) if it's in the dynamic slab, merge it and yield the result
      //  3) now yield all the dynamic symbols we haven't processed.
-     bool More = false; // We'll be incomplete if either source was.
      SymbolSlab::Builder DynB;
-     More |= Dynamic->fuzzyFind(Req, [&](const Symbol &S) { DynB.insert(S); });
+     auto DynMore =
+         Dynamic->fuzzyFind(Req, [&](const Symbol &S) { DynB.insert(S); });
+     if (!DynMore)
+       return DynMore.takeError();
      SymbolSlab Dyn = std::move(DynB).build();
 
      DenseSet<SymbolID> SeenDynamicSymbols;
      Symbol::Details Scratch;
-     More |= Static->fuzzyFind(Req, [&](const Symbol &S) {
+     auto StaticMore = Static->fuzzyFind(Req, [&](const Symbol &S) {
        auto DynS = Dyn.find(S.ID);
        if (DynS == Dyn.end())
          return Callback(S);
        SeenDynamicSymbols.insert(S.ID);
        Callback(mergeSymbol(*DynS, S, &Scratch));
      });
+     if (!StaticMore)
+       return StaticMore.takeError();
      for (const Symbol &S : Dyn)
        if (!SeenDynamicSymbols.count(S.ID))
          Callback(S);
-     return More;
+     // We'll be incomplete if either source was.
+     return *DynMore || *StaticMore;
   }
 
   void
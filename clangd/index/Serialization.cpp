@@ -0,0 +1,323 @@
+//===--- Serialization.cpp - Binary symbol index format ----------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Serialization.h"
+#include "../Cancellation.h"
+#include "../FuzzyMatch.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Errc.h"
+#include <queue>
+
+namespace clang {
+namespace clangd {
+using namespace llvm;
+namespace {
+
+constexpr char Magic[] = {'C', 'd', 'I', 'x'};
+constexpr uint32_t Version = 1;
+constexpr size_t HeaderSize = 16;
+
+// The strings referenced by a symbol record, in the order they are stored.
+enum StringField : unsigned {
+  Name,
+  Scope,
+  DeclarationURI,
+  DefinitionURI,
+  CompletionLabel,
+  CompletionFilterText,
+  CompletionPlainInsertText,
+  CompletionSnippetInsertText,
+  Documentation,
+  CompletionDetail,
+  IncludeHeader,
+  NumStringFields,
+};
+
+// Layout of a symbol record:
+//   SymbolID                             20 bytes
+//   Kind, SubKind, Lang, Flags           4 x uint8
+//   Properties, References               2 x uint32
+//   CanonicalDeclaration, Definition     2 x 4 x uint32 (Start/End positions)
+//   Strings                              NumStringFields x 2 x uint32
+constexpr size_t InfoOffset = SymbolID::HashByteLength;
+constexpr size_t PropertiesOffset = InfoOffset + 4;
+constexpr size_t ReferencesOffset = PropertiesOffset + 4;
+constexpr size_t LocationsOffset = ReferencesOffset + 4;
+constexpr size_t StringsOffset = LocationsOffset + 2 * 4 * 4;
+constexpr size_t RecordSize = StringsOffset + NumStringFields * 2 * 4;
+
+// Bits of the Flags byte.
+constexpr uint8_t HasDetail = 1 << 0;
+
+uint8_t read8(StringRef Data, size_t Offset) {
+  return static_cast<uint8_t>(Data[Offset]);
+}
+
+uint32_t read32(StringRef Data, size_t Offset) {
+  return support::endian::read32le(Data.data() + Offset);
+}
+
+void write32(uint32_t V, raw_ostream &OS) {
+  char Buf[4];
+  support::endian::write32le(Buf, V);
+  OS.write(Buf, sizeof(Buf));
+}
+
+// Decoded header of a binary index.
+struct BinaryIndexData {
+  uint32_t NumSymbols;
+  StringRef Records;
+  StringRef Strings;
+};
+
+Expected<BinaryIndexData> parseBinaryIndex(StringRef Data) {
+  auto Invalid = [](const Twine &Message) {
+    return make_error<StringError>("invalid binary index: " + Message,
+                                   errc::invalid_argument);
+  };
+  if (!isBinaryIndex(Data) || Data.size() < HeaderSize)
+    return Invalid("bad magic");
+  if (read32(Data, 4) != Version)
+    return Invalid("unsupported version " + Twine(read32(Data, 4)));
+  BinaryIndexData Result;
+  Result.NumSymbols = read32(Data, 8);
+  uint64_t RecordsSize = uint64_t(Result.NumSymbols) * RecordSize;
+  uint64_t StringsSize = read32(Data, 12);
+  if (HeaderSize + RecordsSize + StringsSize != Data.size())
+    return Invalid("size mismatch");
+  Result.Records = Data.substr(HeaderSize, RecordsSize);
+  Result.Strings = Data.substr(HeaderSize + RecordsSize);
+  return Result;
+}
+
+StringRef readString(StringRef Record, StringField Field, StringRef Strings) {
+  size_t Offset = StringsOffset + Field * 2 * 4;
+  uint32_t Start = read32(Record, Offset), Size = read32(Record, Offset + 4);
+  // Don't trust the file: out-of-bounds strings read as empty.
+  if (uint64_t(Start) + Size > Strings.size())
+    return "";
+  return Strings.substr(Start, Size);
+}
+
+SymbolLocation readLocation(StringRef Record, size_t Offset, StringField URI,
+                            StringRef Strings) {
+  SymbolLocation Loc;
+  Loc.FileURI = readString(Record, URI, Strings);
+  Loc.Start.Line = read32(Record, Offset);
+  Loc.Start.Column = read32(Record, Offset + 4);
+  Loc.End.Line = read32(Record, Offset + 8);
+  Loc.End.Column = read32(Record, Offset + 12);
+  return Loc;
+}
+
+// Decodes a symbol. Strings point into the string table, Detail points to
+// \p Scratch if the symbol has details.
+Symbol readSymbol(StringRef Record, StringRef Strings,
+                  Symbol::Details &Scratch) {
+  Symbol Sym;
+  Sym.ID = SymbolID::fromRaw(Record.substr(0, SymbolID::HashByteLength));
+  Sym.SymInfo.Kind = static_cast<index::SymbolKind>(read8(Record, InfoOffset));
+  Sym.SymInfo.SubKind =
+      static_cast<index::SymbolSubKind>(read8(Record, InfoOffset + 1));
+  Sym.SymInfo.Lang =
+      static_cast<index::SymbolLanguage>(read8(Record, InfoOffset + 2));
+  Sym.SymInfo.Properties =
+      static_cast<index::SymbolPropertySet>(read32(Record, PropertiesOffset));
+  Sym.References = read32(Record, ReferencesOffset);
+  Sym.CanonicalDeclaration =
+      readLocation(Record, LocationsOffset, DeclarationURI, Strings);
+  Sym.Definition =
+      readLocation(Record, LocationsOffset + 16, DefinitionURI, Strings);
+  Sym.Name = readString(Record, Name, Strings);
+  Sym.Scope = readString(Record, Scope, Strings);
+  Sym.CompletionLabel = readString(Record, CompletionLabel, Strings);
+  Sym.CompletionFilterText = readString(Record, CompletionFilterText, Strings);
+  Sym.CompletionPlainInsertText =
+      readString(Record, CompletionPlainInsertText, Strings);
+  Sym.CompletionSnippetInsertText =
+      readString(Record, CompletionSnippetInsertText, Strings);
+  if (read8(Record, InfoOffset + 3) & HasDetail) {
+    Scratch.Documentation = readString(Record, Documentation, Strings);
+    Scratch.CompletionDetail = readString(Record, CompletionDetail, Strings);
+    Scratch.IncludeHeader = readString(Record, IncludeHeader, Strings);
+    Sym.Detail = &Scratch;
+  }
+  return Sym;
+}
+
+// Serves queries from a binary index. Symbols are decoded on demand, which
+// only involves reading fixed-size fields: strings are never copied.
+class BinaryIndex : public SymbolIndex {
+public:
+  BinaryIndex(std::unique_ptr<MemoryBuffer> Buffer, BinaryIndexData Data)
+      : Buffer(std::move(Buffer)), Data(Data) {}
+
+  Expected<bool>
+  fuzzyFind(const FuzzyFindRequest &Req,
+            function_ref<void(const Symbol &)> Callback) const override {
+    assert(!StringRef(Req.Query).contains("::") &&
+           "There must be no :: in query.");
+
+    std::priority_queue<std::pair<float, size_t>> Top;
+    FuzzyMatcher Filter(Req.Query);
+    bool More = false;
+    for (size_t I = 0; I < Data.NumSymbols; ++I) {
+      // Checking for cancellation is not free, only do it once in a while.
+      if ((I + 1) % 1024 == 0 && isCancelled())
+        return cancelledError();
+      StringRef Record = record(I);
+
+      // Exact match against all possible scopes.
+      if (!Req.Scopes.empty() &&
+          !is_contained(Req.Scopes, readString(Record, Scope, Data.Strings)))
+        continue;
+
+      if (auto Score = Filter.match(readString(Record, Name, Data.Strings))) {
+        Top.emplace(-*Score, I);
+        if (Top.size() > Req.MaxCandidateCount) {
+          More = true;
+          Top.pop();
+        }
+      }
+    }
+    Symbol::Details Scratch;
+    for (; !Top.empty(); Top.pop())
+      Callback(readSymbol(record(Top.top().second), Data.Strings, Scratch));
+    return More;
+  }
+
+  void lookup(const LookupRequest &Req,
+              function_ref<void(const Symbol &)> Callback) const override {
+    Symbol::Details Scratch;
+    for (const auto &ID : Req.IDs) {
+      // Records are sorted by SymbolID, whose order is that of the raw bytes.
+      size_t Begin = 0, End = Data.NumSymbols;
+      while (Begin < End) {
+        size_t Mid = Begin + (End - Begin) / 2;
+        if (record(Mid).substr(0, SymbolID::HashByteLength) < ID.raw())
+          Begin = Mid + 1;
+        else
+          End = Mid;
+      }
+      if (Begin < Data.NumSymbols &&
+          record(Begin).substr(0, SymbolID::HashByteLength) == ID.raw())
+        Callback(readSymbol(record(Begin), Data.Strings, Scratch));
+    }
+  }
+
+private:
+  StringRef record(size_t I) const {
+    return Data.Records.substr(I * RecordSize, RecordSize);
+  }
+
+  std::unique_ptr<MemoryBuffer> Buffer;
+  BinaryIndexData Data;
+};
+
+} // namespace
+
+void writeBinaryIndex(const SymbolSlab &Symbols, raw_ostream &OS) {
+  writeBinaryIndex(makeArrayRef(&Symbols, 1), OS);
+}
+
+void writeBinaryIndex(ArrayRef<SymbolSlab> Shards, raw_ostream &OS) {
+  // Records are written first, as the header needs the string table size.
+  std::string Records;
+  raw_string_ostream RecordsOS(Records);
+
+  // Lay out the string table, storing each distinct string once.
+  StringMap<uint32_t> StringOffsets;
+  std::vector<StringRef> OrderedStrings;
+  uint32_t StringsSize = 0;
+  auto WriteString = [&](StringRef S) {
+    auto R = StringOffsets.try_emplace(S, StringsSize);
+    if (R.second) {
+      OrderedStrings.push_back(S);
+      StringsSize += S.size();
+    }
+    write32(R.first->second, RecordsOS);
+    write32(S.size(), RecordsOS);
+  };
+  auto WriteLocation = [&](const SymbolLocation &Loc) {
+    write32(Loc.Start.Line, RecordsOS);
+    write32(Loc.Start.Column, RecordsOS);
+    write32(Loc.End.Line, RecordsOS);
+    write32(Loc.End.Column, RecordsOS);
+  };
+
+  // SymbolSlab is sorted by SymbolID and the shards are in SymbolID order, so
+  // records are sorted, which lookup() relies on.
+  uint32_t NumSymbols = 0;
+  for (const SymbolSlab &Symbols : Shards) {
+    for (const Symbol &Sym : Symbols) {
+      ++NumSymbols;
+      RecordsOS << Sym.ID.raw();
+      RecordsOS << static_cast<char>(Sym.SymInfo.Kind)
+                << static_cast<char>(Sym.SymInfo.SubKind)
+                << static_cast<char>(Sym.SymInfo.Lang)
+                << static_cast<char>(Sym.Detail ? HasDetail : 0);
+      write32(Sym.SymInfo.Properties, RecordsOS);
+      write32(Sym.References, RecordsOS);
+      WriteLocation(Sym.CanonicalDeclaration);
+      WriteLocation(Sym.Definition);
+      // Keep in sync with StringField.
+      Symbol::Details Empty;
+      const Symbol::Details &Detail = Sym.Detail ? *Sym.Detail : Empty;
+      for (StringRef S :
+           {Sym.Name, Sym.Scope, Sym.CanonicalDeclaration.FileURI,
+            Sym.Definition.FileURI, Sym.CompletionLabel,
+            Sym.CompletionFilterText, Sym.CompletionPlainInsertText,
+            Sym.CompletionSnippetInsertText, Detail.Documentation,
+            Detail.CompletionDetail, Detail.IncludeHeader})
+        WriteString(S);
+    }
+  }
+
+  OS.write(Magic, sizeof(Magic));
+  write32(Version, OS);
+  write32(NumSymbols, OS);
+  write32(StringsSize, OS);
+  OS << RecordsOS.str();
+  for (StringRef S : OrderedStrings)
+    OS << S;
+}
+
+bool isBinaryIndex(StringRef Data) {
+  return Data.startswith(StringRef(Magic, sizeof(Magic)));
+}
+
+Expected<SymbolSlab> readBinaryIndex(StringRef Data) {
+  auto Parsed = parseBinaryIndex(Data);
+  if (!Parsed)
+    return Parsed.takeError();
+  SymbolSlab::Builder Symbols;
+  Symbol::Details Scratch;
+  for (size_t I = 0; I < Parsed->NumSymbols; ++I) {
+    StringRef Record = Parsed->Records.substr(I * RecordSize, RecordSize);
+    Symbols.insert(readSymbol(Record, Parsed->Strings, Scratch));
+  }
+  return std::move(Symbols).build();
+}
+
+unsigned symbolShard(const SymbolID &ID, unsigned NumShards) {
+  assert(NumShards > 0 && NumShards <= 256 && "Bad number of shards");
+  return static_cast<uint8_t>(ID.raw()[0]) * NumShards / 256;
+}
+
+Expected<std::unique_ptr<SymbolIndex>>
+loadBinaryIndex(std::unique_ptr<MemoryBuffer> Buffer) {
+  auto Parsed = parseBinaryIndex(Buffer->getBuffer());
+  if (!Parsed)
+    return Parsed.takeError();
+  return llvm::make_unique<BinaryIndex>(std::move(Buffer), *Parsed);
+}
+
+} // namespace clangd
+} // namespace clang
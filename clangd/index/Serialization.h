@@ -0,0 +1,61 @@
+//===--- Serialization.h - Binary symbol index format ------------*- C++-*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A compact binary format for symbol indexes, designed to be memory-mapped and
+// queried in place rather than parsed into a SymbolSlab.
+//
+// All integers are little-endian. The file consists of:
+//  - a header: the "CdIx" magic, the format version, the number of symbols
+//    and the size of the string table (4 x uint32);
+//  - fixed-size symbol records, sorted by SymbolID. Strings are referenced by
+//    (offset, size) pairs into the string table;
+//  - the string table, holding each distinct string once.
+//
+//===---------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
+
+#include "Index.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace clang {
+namespace clangd {
+
+// Writes symbols in the binary index format.
+void writeBinaryIndex(const SymbolSlab &Symbols, llvm::raw_ostream &OS);
+
+// Writes the symbols of several slabs as a single binary index. The SymbolIDs
+// of each slab must all be smaller than those of the following slab, as is the
+// case for the shards of an index (see symbolShard()).
+void writeBinaryIndex(llvm::ArrayRef<SymbolSlab> Shards, llvm::raw_ostream &OS);
+
+// Returns the shard of ID, when splitting the SymbolID space into NumShards
+// (at most 256) contiguous ranges by the first byte of the ID.
+unsigned symbolShard(const SymbolID &ID, unsigned NumShards);
+
+// Returns true if Data looks like a binary index (i.e. starts with the magic).
+bool isBinaryIndex(llvm::StringRef Data);
+
+// Reads all symbols of a binary index into a slab, e.g. to convert them to
+// another format.
+llvm::Expected<SymbolSlab> readBinaryIndex(llvm::StringRef Data);
+
+// Creates an index serving queries directly from the binary index in Buffer,
+// without deserializing it. Buffer is typically a memory-mapped file, which is
+// owned by the returned index.
+llvm::Expected<std::unique_ptr<SymbolIndex>>
+loadBinaryIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_SERIALIZATION_H
@@ -0,0 +1,166 @@
+//===--- DexIndex.cpp - Dex Symbol Index Implementation ---------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DexIndex.h"
+#include "../../Cancellation.h"
+#include "../../FuzzyMatch.h"
+#include "Trigram.h"
+#include <algorithm>
+#include <queue>
+
+namespace clang {
+namespace clangd {
+namespace dex {
+
+namespace {
+
+// Returns the tokens which are the keys of symbol's posting lists.
+std::vector<Token> generateSearchTokens(const Symbol &Sym) {
+  std::vector<Token> Result = generateIdentifierTrigrams(Sym.Name);
+  Result.emplace_back(Token::Kind::Scope, Sym.Scope.str());
+  return Result;
+}
+
+} // namespace
+
+void DexIndex::build(std::shared_ptr<std::vector<const Symbol *>> Syms) {
+  // Deduplicate symbols by ID, the last one wins. The position of the first
+  // occurrence is kept so that the result doesn't depend on hashing.
+  llvm::DenseMap<SymbolID, size_t> Positions;
+  std::vector<const Symbol *> TempDocuments;
+  for (const Symbol *Sym : *Syms) {
+    auto R = Positions.try_emplace(Sym->ID, TempDocuments.size());
+    if (R.second)
+      TempDocuments.push_back(Sym);
+    else
+      TempDocuments[R.first->second] = Sym;
+  }
+
+  // Posting lists are sorted by DocID, so sorting the documents by quality
+  // makes iterators produce the most popular symbols first.
+  std::stable_sort(TempDocuments.begin(), TempDocuments.end(),
+                   [](const Symbol *LHS, const Symbol *RHS) {
+                     return LHS->References > RHS->References;
+                   });
+
+  auto NewSnap = std::make_shared<IndexSnapshot>();
+  for (DocID ID = 0; ID < TempDocuments.size(); ++ID) {
+    const Symbol *Sym = TempDocuments[ID];
+    NewSnap->LookupTable[Sym->ID] = Sym;
+    for (const auto &Token : generateSearchTokens(*Sym))
+      NewSnap->InvertedIndex[Token].push_back(ID);
+  }
+  NewSnap->Documents = std::move(TempDocuments);
+  NewSnap->Symbols = std::move(Syms);
+
+  // Publish the new snapshot. The old symbols and index are released by the
+  // last query still using them.
+  std::atomic_store(&Snap,
+                    std::shared_ptr<const IndexSnapshot>(std::move(NewSnap)));
+}
+
+std::shared_ptr<const DexIndex::IndexSnapshot> DexIndex::snapshot() const {
+  return std::atomic_load(&Snap);
+}
+
+std::unique_ptr<SymbolIndex> DexIndex::build(SymbolSlab Slab) {
+  struct Snapshot {
+    SymbolSlab Slab;
+    std::vector<const Symbol *> Pointers;
+  };
+  auto Snap = std::make_shared<Snapshot>();
+  Snap->Slab = std::move(Slab);
+  for (auto &Sym : Snap->Slab)
+    Snap->Pointers.push_back(&Sym);
+  auto S = std::shared_ptr<std::vector<const Symbol *>>(std::move(Snap),
+                                                        &Snap->Pointers);
+  auto Idx = llvm::make_unique<DexIndex>();
+  Idx->build(std::move(S));
+  return std::move(Idx);
+}
+
+/// Constructs iterators over tokens extracted from the query and exhausts them,
+/// scoring each retrieved candidate with FuzzyMatcher.
+llvm::Expected<bool> DexIndex::fuzzyFind(
+    const FuzzyFindRequest &Req,
+    llvm::function_ref<void(const Symbol &)> Callback) const {
+  assert(!StringRef(Req.Query).contains("::") &&
+         "There must be no :: in query.");
+
+  std::priority_queue<std::pair<float, const Symbol *>> Top;
+  FuzzyMatcher Filter(Req.Query);
+  bool More = false;
+  // Keeps the symbols alive until all callbacks have run.
+  auto S = snapshot();
+  std::vector<std::unique_ptr<Iterator>> TopLevelChildren;
+
+  // Generate query trigrams and construct AND iterator over all query
+  // trigrams. A trigram which is not in the index can't match anything.
+  std::vector<std::unique_ptr<Iterator>> TrigramIterators;
+  for (const auto &Trigram : generateQueryTrigrams(Req.Query)) {
+    const auto It = S->InvertedIndex.find(Trigram);
+    if (It == S->InvertedIndex.end())
+      return false;
+    TrigramIterators.push_back(create(It->second));
+  }
+  if (!TrigramIterators.empty())
+    TopLevelChildren.push_back(createAnd(std::move(TrigramIterators)));
+
+  // Generate scope tokens for search query. Symbols must be in at least one
+  // of the requested scopes.
+  if (!Req.Scopes.empty()) {
+    std::vector<std::unique_ptr<Iterator>> ScopeIterators;
+    for (const auto &Scope : Req.Scopes) {
+      const auto It = S->InvertedIndex.find(Token(Token::Kind::Scope, Scope));
+      if (It != S->InvertedIndex.end())
+        ScopeIterators.push_back(create(It->second));
+    }
+    if (ScopeIterators.empty())
+      return false;
+    TopLevelChildren.push_back(createOr(std::move(ScopeIterators)));
+  }
+
+  // An empty query in no particular scope matches every symbol.
+  auto QueryIterator = TopLevelChildren.empty()
+                           ? createTrue(S->Documents.size())
+                           : createAnd(std::move(TopLevelChildren));
+
+  // Only the retrieved candidates are scored with FuzzyMatcher, which is
+  // more precise than the trigram approximation.
+  unsigned Retrieved = 0;
+  for (; !QueryIterator->reachedEnd(); QueryIterator->advance()) {
+    if (++Retrieved % 1024 == 0 && isCancelled())
+      return cancelledError();
+    const Symbol *Sym = S->Documents[QueryIterator->peek()];
+    if (auto Score = Filter.match(Sym->Name)) {
+      Top.emplace(-*Score, Sym);
+      if (Top.size() > Req.MaxCandidateCount) {
+        More = true;
+        Top.pop();
+      }
+    }
+  }
+  for (; !Top.empty(); Top.pop())
+    Callback(*Top.top().second);
+  return More;
+}
+
+void DexIndex::lookup(const LookupRequest &Req,
+                      llvm::function_ref<void(const Symbol &)> Callback) const {
+  auto S = snapshot();
+  for (const auto &ID : Req.IDs) {
+    auto I = S->LookupTable.find(ID);
+    if (I != S->LookupTable.end())
+      Callback(*I->second);
+  }
+}
+
+} // namespace dex
+} // namespace clangd
+} // namespace clang
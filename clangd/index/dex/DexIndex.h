@@ -0,0 +1,79 @@
+//===--- DexIndex.h - Dex Symbol Index Implementation -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This defines Dex - a symbol index implementation based on query iterators
+// over symbol tokens, such as fuzzy matching trigrams and scopes.
+// While consuming more memory and having longer build stage due to
+// preprocessing, Dex has substantially lower latency than MemIndex: only the
+// symbols which can plausibly match the query are ever scored.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_DEXINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_DEXINDEX_H
+
+#include "../Index.h"
+#include "Iterator.h"
+#include "Token.h"
+#include "llvm/ADT/DenseMap.h"
+#include <memory>
+
+namespace clang {
+namespace clangd {
+namespace dex {
+
+/// \brief In-memory Dex trigram-based index implementation.
+///
+/// The index keeps an inverted index from Tokens (trigrams of the unqualified
+/// name and the scope) to the posting lists of symbols which have them.
+/// fuzzyFind() intersects the posting lists of the query tokens lazily and only
+/// runs FuzzyMatcher on the retrieved candidates.
+///
+/// Like MemIndex, build() atomically publishes an immutable snapshot, so
+/// queries never block each other or the writer.
+class DexIndex : public SymbolIndex {
+public:
+  /// \brief (Re-)Build index for `Symbols`. All symbol pointers must remain
+  /// accessible as long as `Symbols` is kept alive.
+  void build(std::shared_ptr<std::vector<const Symbol *>> Symbols);
+
+  /// \brief Build index from a symbol slab.
+  static std::unique_ptr<SymbolIndex> build(SymbolSlab Slab);
+
+  llvm::Expected<bool>
+  fuzzyFind(const FuzzyFindRequest &Req,
+            llvm::function_ref<void(const Symbol &)> Callback) const override;
+
+  void lookup(const LookupRequest &Req,
+              llvm::function_ref<void(const Symbol &)> Callback) const override;
+
+private:
+  struct IndexSnapshot {
+    std::shared_ptr<std::vector<const Symbol *>> Symbols;
+    /// Symbols deduplicated by symbol IDs and sorted by quality (the number of
+    /// references), so that DocIDs are positions in this vector.
+    std::vector<const Symbol *> Documents;
+    llvm::DenseMap<SymbolID, const Symbol *> LookupTable;
+    /// Inverted index is a mapping from the search token to the posting list,
+    /// which contains all items which can be characterized by such search
+    /// token.
+    llvm::DenseMap<Token, PostingList> InvertedIndex;
+  };
+  /// Returns the latest published snapshot, never null.
+  std::shared_ptr<const IndexSnapshot> snapshot() const;
+
+  /// Only accessed via std::atomic_load and std::atomic_store.
+  std::shared_ptr<const IndexSnapshot> Snap = std::make_shared<IndexSnapshot>();
+};
+
+} // namespace dex
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_DEXINDEX_H
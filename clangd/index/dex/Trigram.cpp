@@ -0,0 +1,109 @@
+//===--- Trigram.cpp - Trigram generation for Fuzzy Matching ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Trigram.h"
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/DenseSet.h"
+#include <string>
+
+using namespace llvm;
+
+namespace clang {
+namespace clangd {
+namespace dex {
+namespace {
+
+// Keeps the alphanumeric characters of Text in lowercase. If Heads is not
+// null, it receives the positions (within the result) which start a segment.
+// The segmentation roughly follows FuzzyMatcher: segments start after a
+// separator, at a lower->Upper transition, at the last Upper before a lower
+// ("HTTPServer" -> "HTTP", "Server") and at letter<->digit transitions.
+std::string normalize(StringRef Text, std::vector<unsigned> *Heads = nullptr) {
+  std::string Result;
+  Result.reserve(Text.size());
+  for (size_t I = 0; I < Text.size(); ++I) {
+    char C = Text[I];
+    if (!isAlphanumeric(C))
+      continue;
+    if (Heads) {
+      char Prev = I == 0 ? 0 : Text[I - 1];
+      char Next = I + 1 == Text.size() ? 0 : Text[I + 1];
+      bool IsHead = !isAlphanumeric(Prev) ||
+                    (isUppercase(C) && isLowercase(Prev)) ||
+                    (isUppercase(C) && isUppercase(Prev) && isLowercase(Next)) ||
+                    isDigit(C) != isDigit(Prev);
+      if (IsHead)
+        Heads->push_back(Result.size());
+    }
+    Result.push_back(toLowercase(C));
+  }
+  return Result;
+}
+
+} // namespace
+
+std::vector<Token> generateIdentifierTrigrams(StringRef Identifier) {
+  std::vector<unsigned> Heads;
+  std::string LowercaseIdentifier = normalize(Identifier, &Heads);
+  const unsigned N = LowercaseIdentifier.size();
+
+  // Successors[I] holds the positions which may follow I in a trigram: the
+  // next character and the start of the next segment (if they differ).
+  std::vector<SmallVector<unsigned, 2>> Successors(N);
+  auto NextHead = Heads.begin();
+  for (unsigned I = 0; I < N; ++I) {
+    while (NextHead != Heads.end() && *NextHead <= I)
+      ++NextHead;
+    if (I + 1 < N)
+      Successors[I].push_back(I + 1);
+    if (NextHead != Heads.end() && *NextHead != I + 1)
+      Successors[I].push_back(*NextHead);
+  }
+
+  DenseSet<Token> UniqueTrigrams;
+  auto Add = [&](std::initializer_list<unsigned> Positions) {
+    std::string Chars;
+    for (unsigned Position : Positions)
+      Chars.push_back(LowercaseIdentifier[Position]);
+    UniqueTrigrams.insert(Token(Token::Kind::Trigram, std::move(Chars)));
+  };
+
+  for (unsigned I = 0; I < N; ++I)
+    for (unsigned J : Successors[I])
+      for (unsigned K : Successors[J])
+        Add({I, J, K});
+
+  // Short queries have to start at a segment start, just like the first
+  // character matched by FuzzyMatcher.
+  for (unsigned Head : Heads) {
+    Add({Head});
+    for (unsigned J : Successors[Head])
+      Add({Head, J});
+  }
+
+  return {UniqueTrigrams.begin(), UniqueTrigrams.end()};
+}
+
+std::vector<Token> generateQueryTrigrams(StringRef Query) {
+  std::string LowercaseQuery = normalize(Query);
+  if (LowercaseQuery.empty())
+    return {};
+  if (LowercaseQuery.size() < 3)
+    return {Token(Token::Kind::Trigram, LowercaseQuery)};
+
+  DenseSet<Token> UniqueTrigrams;
+  for (size_t I = 0; I + 2 < LowercaseQuery.size(); ++I)
+    UniqueTrigrams.insert(
+        Token(Token::Kind::Trigram, LowercaseQuery.substr(I, 3)));
+  return {UniqueTrigrams.begin(), UniqueTrigrams.end()};
+}
+
+} // namespace dex
+} // namespace clangd
+} // namespace clang
@@ -0,0 +1,59 @@
+//===--- Trigram.h - Trigram generation for Fuzzy Matching ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Trigrams are attributes of the symbol unqualified name used to effectively
+// extract symbols which can be fuzzy-matched given user query from the inverted
+// index. To match query with the extracted set of trigrams Q, the set of
+// generated trigrams T for identifier (unqualified symbol name) should contain
+// all items of Q, i.e. Q ⊆ T.
+//
+// Trigram sets are extracted from identifiers, taking the segmentation into
+// account so that "lol" is a trigram of "LaughingOutLoud". This is only an
+// approximation of FuzzyMatcher: every candidate retrieved through trigrams
+// still has to be scored by FuzzyMatcher.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_TRIGRAM_H
+#define LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_TRIGRAM_H
+
+#include "Token.h"
+#include "llvm/ADT/StringRef.h"
+#include <vector>
+
+namespace clang {
+namespace clangd {
+namespace dex {
+
+/// Returns list of unique fuzzy-search trigrams from unqualified symbol.
+///
+/// The trigrams are lowercase alphanumeric characters: separators such as '_'
+/// are skipped. Each trigram consists of characters (I, J, K) such that J is
+/// either the character right after I or the start of the next segment, and
+/// the same holds for K relative to J. E.g. for "FooBar" this yields "foo",
+/// "oob", "oba", "bar", "fob" and "fba".
+///
+/// To support queries shorter than 3 characters, the unigram of each segment
+/// start ("f", "b") and the bigrams starting at segment starts ("fo", "fb",
+/// "ba") are also returned.
+std::vector<Token> generateIdentifierTrigrams(llvm::StringRef Identifier);
+
+/// Returns list of unique fuzzy-search tokens given a query.
+///
+/// Query is segmented by removing separators and converting all letters to
+/// lowercase. If the result is at least 3 characters long, the consecutive
+/// trigrams are returned. Shorter queries produce a single unigram or bigram
+/// token, and an empty query produces no tokens.
+std::vector<Token> generateQueryTrigrams(llvm::StringRef Query);
+
+} // namespace dex
+} // namespace clangd
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_CLANGD_INDEX_DEX_TRIGRAM_H
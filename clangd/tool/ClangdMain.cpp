@@ -11,15 +11,18 @@
 #include "JSONRPCDispatcher.h"
 #include "Path.h"
 #include "Trace.h"
+#include "index/MemIndex.h"
+#include "index/Serialization.h"
 #include "index/SymbolYAML.h"
+#include "index/dex/DexIndex.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/raw_ostream.h"
+#include <cstdio>
 #include <cstdlib>
-#include <iostream>
 #include <memory>
 #include <string>
 #include <thread>
@@ -27,24 +30,41 @@
 using namespace clang;
 using namespace clang::clangd;
 
+static llvm::cl::opt<bool>
+    UseDex("use-dex-index",
+           llvm::cl::desc("Use experimental Dex static index."),
+           llvm::cl::init(false), llvm::cl::Hidden);
+
 namespace {
 enum class PCHStorageFlag { Disk, Memory };
 
-// Build an in-memory static index for global symbols from a YAML-format file.
-// The size of global symbols should be relatively small, so that all symbols
-// can be managed in memory.
+// Build a static index for global symbols from a YAML-format or binary file.
+// A binary index is memory-mapped and served without loading it. Symbols of a
+// YAML index are loaded in memory, so their size should be relatively small.
 std::unique_ptr<SymbolIndex> BuildStaticIndex(llvm::StringRef YamlSymbolFile) {
-  auto Buffer = llvm::MemoryBuffer::getFile(YamlSymbolFile);
+  // Not requiring a null terminator lets large files always be mmapped.
+  auto Buffer = llvm::MemoryBuffer::getFile(YamlSymbolFile, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
   if (!Buffer) {
     llvm::errs() << "Can't open " << YamlSymbolFile << "\n";
     return nullptr;
   }
+  if (isBinaryIndex(Buffer.get()->getBuffer())) {
+    auto Index = loadBinaryIndex(std::move(*Buffer));
+    if (!Index) {
+      llvm::errs() << "Can't load " << YamlSymbolFile << ": "
+                   << llvm::toString(Index.takeError()) << "\n";
+      return nullptr;
+    }
+    return std::move(*Index);
+  }
   auto Slab = SymbolsFromYAML(Buffer.get()->getBuffer());
   SymbolSlab::Builder SymsBuilder;
   for (auto Sym : Slab)
     SymsBuilder.insert(Sym);
 
-  return MemIndex::build(std::move(SymsBuilder).build());
+  return UseDex ? dex::DexIndex::build(std::move(SymsBuilder).build())
+                : MemIndex::build(std::move(SymsBuilder).build());
 }
 } // namespace
 
@@ -96,6 +116,32 @@ static llvm::cl::opt<PCHStorageFlag> PCHStorage(
         clEnumValN(PCHStorageFlag::Memory, "memory", "store PCHs in memory")),
     llvm::cl::init(PCHStorageFlag::Disk));
 
+static llvm::cl::opt<unsigned> PreambleCacheSize(
+    "preamble-cache-size",
+    llvm::cl::desc("Size (in MB) of the preambles kept in memory after closing "
+                   "files, so that reopening them does not rebuild the "
+                   "preamble. 0 disables the cache."),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<Path> PreambleCacheDir(
+    "preamble-cache-dir",
+    llvm::cl::desc("Directory to store preambles in, so that they are reused "
+                   "after clangd restarts. Disabled if empty."),
+    llvm::cl::init(""));
+
+static llvm::cl::opt<unsigned> PreambleCacheDirSize(
+    "preamble-cache-dir-size",
+    llvm::cl::desc("Size (in MB) of the preambles in -preamble-cache-dir. The "
+                   "least recently used ones are removed when exceeded."),
+    llvm::cl::init(4096));
+
+static llvm::cl::opt<unsigned> ASTCacheSize(
+    "ast-cache-size",
+    llvm::cl::desc("Size (in MB) of memory the ASTs of open files can use. "
+                   "When exceeded, the ASTs of the least recently used files "
+                   "are dropped and rebuilt on demand. 0 means no limit."),
+    llvm::cl::init(0));
+
 static llvm::cl::opt<int> LimitResults(
     "limit-results",
     llvm::cl::desc("Limit the number of results returned by clangd. "
@@ -128,8 +174,8 @@ static llvm::cl::opt<bool> EnableIndex(
 static llvm::cl::opt<Path> YamlSymbolFile(
     "yaml-symbol-file",
     llvm::cl::desc(
-        "YAML-format global symbol file to build the static index. Clangd will "
-        "use the static index for global code completion.\n"
+        "YAML-format or binary global symbol file to build the static index. "
+        "Clangd will use the static index for global code completion.\n"
         "WARNING: This option is experimental only, and will be removed "
         "eventually. Don't rely on it."),
     llvm::cl::init(""), llvm::cl::Hidden);
@@ -218,6 +264,10 @@ int main(int argc, char *argv[]) {
     Opts.StorePreamblesInMemory = false;
     break;
   }
+  Opts.PreambleCacheBytes = std::size_t(PreambleCacheSize) * 1024 * 1024;
+  Opts.PreambleCacheDir = PreambleCacheDir;
+  Opts.PreambleCacheDirBytes = std::size_t(PreambleCacheDirSize) * 1024 * 1024;
+  Opts.ASTCacheBytes = std::size_t(ASTCacheSize) * 1024 * 1024;
   if (!ResourceDir.empty())
     Opts.ResourceDir = ResourceDir;
   Opts.BuildDynamicSymbolIndex = EnableIndex;
@@ -238,5 +288,6 @@ int main(int argc, char *argv[]) {
   llvm::set_thread_name("clangd.main");
   // Change stdin to binary to not lose \r\n on windows.
   llvm::sys::ChangeStdinToBinary();
-  return LSPServer.run(std::cin, InputStyle) ? 0 : NoShutdownRequestErrorCode;
+  return LSPServer.run(fileno(stdin), InputStyle) ? 0
+                                                  : NoShutdownRequestErrorCode;
 }
@@ -0,0 +1,279 @@
+//===-- BinarySymbolIndex.cpp ---------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/Errc.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Path.h"
+#include <limits>
+#include <string>
+
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::find_all_symbols::SymbolInfo;
+
+namespace clang {
+namespace include_fixer {
+namespace {
+
+constexpr char Magic[] = {'I', 'F', 'd', 'b'};
+constexpr uint32_t Version = 1;
+constexpr size_t HeaderSize = 20;
+constexpr size_t BucketSize = 8;
+// File path, Seen, Used, kind, number of contexts.
+constexpr size_t RecordHeaderSize = 6 * 4;
+// Context type, context name.
+constexpr size_t ContextSize = 3 * 4;
+
+// The hash is part of the file format, so it must not depend on the host.
+// This is 32-bit FNV-1a.
+uint32_t hashName(llvm::StringRef Name) {
+  uint32_t Hash = 2166136261u;
+  for (unsigned char C : Name) {
+    Hash ^= C;
+    Hash *= 16777619u;
+  }
+  return Hash;
+}
+
+uint32_t read32(llvm::StringRef Data, size_t Offset) {
+  return llvm::support::endian::read32le(Data.data() + Offset);
+}
+
+void write32(uint32_t V, llvm::raw_ostream &OS) {
+  char Buf[4];
+  llvm::support::endian::write32le(Buf, V);
+  OS.write(Buf, sizeof(Buf));
+}
+
+// Reads the integers and strings of an entry. Doesn't trust the file: reading
+// out of bounds sets Failed.
+class EntryReader {
+public:
+  EntryReader(llvm::StringRef Data, size_t Offset, llvm::StringRef Strings)
+      : Data(Data), Offset(Offset), Strings(Strings) {}
+
+  uint32_t readInt() {
+    if (Failed || Offset + 4 > Data.size()) {
+      Failed = true;
+      return 0;
+    }
+    Offset += 4;
+    return read32(Data, Offset - 4);
+  }
+
+  llvm::StringRef readString() {
+    uint32_t Start = readInt(), Size = readInt();
+    if (uint64_t(Start) + Size > Strings.size()) {
+      Failed = true;
+      return "";
+    }
+    return Strings.substr(Start, Size);
+  }
+
+  size_t remaining() const { return Data.size() - Offset; }
+
+  bool Failed = false;
+
+private:
+  llvm::StringRef Data;
+  size_t Offset;
+  llvm::StringRef Strings;
+};
+
+// Collects each distinct string once.
+class StringTableBuilder {
+public:
+  void writeRef(llvm::StringRef S, llvm::raw_ostream &OS) {
+    auto R = Offsets.insert({S, Strings.size()});
+    if (R.second)
+      Strings += S;
+    write32(R.first->second, OS);
+    write32(S.size(), OS);
+  }
+
+  const std::string &data() const { return Strings; }
+
+private:
+  llvm::StringMap<uint32_t> Offsets;
+  std::string Strings;
+};
+
+} // namespace
+
+bool BinarySymbolIndex::isBinarySymbolIndex(llvm::StringRef Data) {
+  return Data.startswith(llvm::StringRef(Magic, sizeof(Magic)));
+}
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromBuffer(
+    std::unique_ptr<llvm::MemoryBuffer> Buffer) {
+  llvm::StringRef Data = Buffer->getBuffer();
+  if (!isBinarySymbolIndex(Data) || Data.size() < HeaderSize ||
+      read32(Data, 4) != Version)
+    return llvm::make_error_code(llvm::errc::invalid_argument);
+  uint32_t NumBuckets = read32(Data, 8);
+  uint64_t StringsOffset = read32(Data, 12);
+  uint64_t StringsSize = read32(Data, 16);
+  if (!llvm::isPowerOf2_32(NumBuckets) ||
+      HeaderSize + uint64_t(NumBuckets) * BucketSize > StringsOffset ||
+      StringsOffset + StringsSize != Data.size())
+    return llvm::make_error_code(llvm::errc::invalid_argument);
+
+  llvm::StringRef Strings = Data.substr(StringsOffset);
+  return std::unique_ptr<BinarySymbolIndex>(
+      new BinarySymbolIndex(std::move(Buffer), NumBuckets, Strings));
+}
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromFile(llvm::StringRef FilePath) {
+  // Large files are memory-mapped rather than read.
+  auto Buffer = llvm::MemoryBuffer::getFile(FilePath, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return Buffer.getError();
+  return createFromBuffer(std::move(*Buffer));
+}
+
+llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+BinarySymbolIndex::createFromDirectory(llvm::StringRef Directory,
+                                       llvm::StringRef Name) {
+  // Walk upwards from Directory, looking for files.
+  for (llvm::SmallString<128> PathStorage = Directory; !Directory.empty();
+       Directory = llvm::sys::path::parent_path(Directory)) {
+    assert(Directory.size() <= PathStorage.size());
+    PathStorage.resize(Directory.size()); // Shrink to parent.
+    llvm::sys::path::append(PathStorage, Name);
+    if (auto DB = createFromFile(PathStorage))
+      return DB;
+  }
+  return llvm::make_error_code(llvm::errc::no_such_file_or_directory);
+}
+
+std::error_code
+BinarySymbolIndex::write(llvm::ArrayRef<SymbolAndSignals> Symbols,
+                         llvm::raw_ostream &OS) {
+  // Group the symbols by name, keeping their order.
+  llvm::StringMap<unsigned> GroupIndex;
+  std::vector<std::vector<const SymbolAndSignals *>> Groups;
+  for (const SymbolAndSignals &Symbol : Symbols) {
+    auto R = GroupIndex.insert({Symbol.Symbol.getName(), Groups.size()});
+    if (R.second)
+      Groups.emplace_back();
+    Groups[R.first->second].push_back(&Symbol);
+  }
+
+  // Keep the hash table at most half full, so that probe sequences are short.
+  uint32_t NumBuckets = llvm::PowerOf2Ceil(std::max<uint64_t>(
+      2 * Groups.size(), 1));
+  uint64_t EntriesOffset = HeaderSize + uint64_t(NumBuckets) * BucketSize;
+  std::vector<std::pair<uint32_t, uint32_t>> Buckets(NumBuckets);
+  StringTableBuilder Strings;
+  std::string Entries;
+  llvm::raw_string_ostream EntriesOS(Entries);
+  for (const auto &Group : Groups) {
+    llvm::StringRef Name = Group.front()->Symbol.getName();
+    uint64_t Offset = EntriesOffset + EntriesOS.tell();
+    if (Offset > std::numeric_limits<uint32_t>::max())
+      return llvm::make_error_code(llvm::errc::file_too_large);
+    uint32_t Hash = hashName(Name);
+    for (uint32_t I = Hash & (NumBuckets - 1);;
+         I = (I + 1) & (NumBuckets - 1)) {
+      if (!Buckets[I].second) {
+        Buckets[I] = {Hash, static_cast<uint32_t>(Offset)};
+        break;
+      }
+    }
+
+    Strings.writeRef(Name, EntriesOS);
+    write32(Group.size(), EntriesOS);
+    for (const SymbolAndSignals *Symbol : Group) {
+      const SymbolInfo &Info = Symbol->Symbol;
+      Strings.writeRef(Info.getFilePath(), EntriesOS);
+      write32(Symbol->Signals.Seen, EntriesOS);
+      write32(Symbol->Signals.Used, EntriesOS);
+      write32(static_cast<uint32_t>(Info.getSymbolKind()), EntriesOS);
+      write32(Info.getContexts().size(), EntriesOS);
+      for (const SymbolInfo::Context &Context : Info.getContexts()) {
+        write32(static_cast<uint32_t>(Context.first), EntriesOS);
+        Strings.writeRef(Context.second, EntriesOS);
+      }
+    }
+  }
+  EntriesOS.flush();
+
+  uint64_t StringsOffset = EntriesOffset + Entries.size();
+  if (StringsOffset + Strings.data().size() >
+      std::numeric_limits<uint32_t>::max())
+    return llvm::make_error_code(llvm::errc::file_too_large);
+
+  OS.write(Magic, sizeof(Magic));
+  write32(Version, OS);
+  write32(NumBuckets, OS);
+  write32(StringsOffset, OS);
+  write32(Strings.data().size(), OS);
+  for (const auto &Bucket : Buckets) {
+    write32(Bucket.first, OS);
+    write32(Bucket.second, OS);
+  }
+  OS << Entries << Strings.data();
+  return std::error_code();
+}
+
+std::vector<SymbolAndSignals>
+BinarySymbolIndex::search(llvm::StringRef Identifier) {
+  llvm::StringRef Data = Buffer->getBuffer();
+  uint32_t Hash = hashName(Identifier);
+  std::vector<SymbolAndSignals> Results;
+  for (uint32_t Probe = 0; Probe < NumBuckets; ++Probe) {
+    size_t Bucket =
+        HeaderSize + ((Hash + Probe) & (NumBuckets - 1)) * BucketSize;
+    uint32_t EntryOffset = read32(Data, Bucket + 4);
+    if (!EntryOffset)
+      break;
+    if (read32(Data, Bucket) != Hash)
+      continue;
+    EntryReader Entry(Data, EntryOffset, Strings);
+    if (Entry.readString() != Identifier)
+      continue;
+
+    uint32_t NumSymbols = Entry.readInt();
+    if (Entry.Failed || NumSymbols > Entry.remaining() / RecordHeaderSize)
+      return {};
+    Results.reserve(NumSymbols);
+    for (uint32_t I = 0; I < NumSymbols; ++I) {
+      llvm::StringRef FilePath = Entry.readString();
+      uint32_t Seen = Entry.readInt();
+      uint32_t Used = Entry.readInt();
+      uint32_t Kind = Entry.readInt();
+      uint32_t NumContexts = Entry.readInt();
+      if (Entry.Failed || NumContexts > Entry.remaining() / ContextSize)
+        return {};
+      std::vector<SymbolInfo::Context> Contexts;
+      Contexts.reserve(NumContexts);
+      for (uint32_t J = 0; J < NumContexts; ++J) {
+        auto Type = static_cast<SymbolInfo::ContextType>(Entry.readInt());
+        Contexts.emplace_back(Type, Entry.readString());
+      }
+      if (Entry.Failed)
+        return {};
+      Results.push_back(
+          {SymbolInfo(Identifier, static_cast<SymbolInfo::SymbolKind>(Kind),
+                      FilePath, Contexts),
+           SymbolInfo::Signals(Seen, Used)});
+    }
+    break;
+  }
+  return Results;
+}
+
+} // namespace include_fixer
+} // namespace clang
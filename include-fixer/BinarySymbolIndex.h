@@ -0,0 +1,81 @@
+//===-- BinarySymbolIndex.h -------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A binary symbol database, designed to be memory-mapped and queried in place
+// instead of being parsed on every invocation like the YAML database.
+//
+// All integers are little-endian uint32. The file consists of:
+//  - a header: the "IFdb" magic, the format version, the number of hash
+//    buckets, and the offset and size of the string table;
+//  - a hash table of (hash, entry offset) buckets with linear probing, keyed
+//    by symbol name. Empty buckets have a zero offset;
+//  - one entry per distinct symbol name: the name, the number of symbols and
+//    their records (the posting list). A record holds the file path, the
+//    signals, the symbol kind and the contexts;
+//  - the string table, holding each distinct string once. Strings are
+//    referenced by (offset, size) pairs.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
+#define LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
+
+#include "SymbolIndex.h"
+#include "find-all-symbols/SymbolInfo.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
+#include <vector>
+
+namespace clang {
+namespace include_fixer {
+
+/// Binary format database. Opening it only validates the header, and each
+/// search only decodes the symbols with the searched name.
+class BinarySymbolIndex : public SymbolIndex {
+public:
+  /// Create a new binary db from a file, which is memory-mapped.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromFile(llvm::StringRef FilePath);
+  /// Look for a file called \c Name in \c Directory and all parent directories.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromDirectory(llvm::StringRef Directory, llvm::StringRef Name);
+  /// Create a new binary db from a buffer in the binary format.
+  static llvm::ErrorOr<std::unique_ptr<BinarySymbolIndex>>
+  createFromBuffer(std::unique_ptr<llvm::MemoryBuffer> Buffer);
+
+  /// Write symbols in the binary format, e.g. to convert a YAML database.
+  /// Symbols with the same name are returned by search() in the given order.
+  /// Fails if the database would be larger than 4GB.
+  static std::error_code
+  write(llvm::ArrayRef<find_all_symbols::SymbolAndSignals> Symbols,
+        llvm::raw_ostream &OS);
+
+  /// Returns true if \p Data starts with the magic of the binary format.
+  static bool isBinarySymbolIndex(llvm::StringRef Data);
+
+  std::vector<find_all_symbols::SymbolAndSignals>
+  search(llvm::StringRef Identifier) override;
+
+private:
+  BinarySymbolIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer,
+                    uint32_t NumBuckets, llvm::StringRef Strings)
+      : Buffer(std::move(Buffer)), NumBuckets(NumBuckets), Strings(Strings) {}
+
+  std::unique_ptr<llvm::MemoryBuffer> Buffer;
+  uint32_t NumBuckets;
+  llvm::StringRef Strings;
+};
+
+} // namespace include_fixer
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_BINARYSYMBOLINDEX_H
@@ -7,7 +7,10 @@
 //
 //===----------------------------------------------------------------------===//
 #include "FuzzySymbolIndex.h"
-#include "llvm/Support/Regex.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include <algorithm>
+#include <numeric>
 
 using clang::find_all_symbols::SymbolAndSignals;
 using llvm::StringRef;
@@ -16,6 +19,22 @@ namespace clang {
 namespace include_fixer {
 namespace {
 
+// A state of the automaton matching queryRegexp(Tokens) against symbol keys.
+// Matched is the number of query characters matched so far.
+struct MatchState {
+  enum ModeKind {
+    TokenStart, // At the start of a symbol token, the next query char must be
+                // its first character.
+    InToken,    // Right after a matched character.
+    Skipping,   // Skipping the rest of a symbol token.
+  } Mode;
+  unsigned Matched;
+
+  bool operator==(const MatchState &Other) const {
+    return Mode == Other.Mode && Matched == Other.Matched;
+  }
+};
+
 class MemSymbolIndex : public FuzzySymbolIndex {
 public:
   MemSymbolIndex(std::vector<SymbolAndSignals> Symbols) {
@@ -25,21 +44,105 @@ public:
           StringRef(llvm::join(Tokens.begin(), Tokens.end(), " ")),
           std::move(Symbol));
     }
+    // Sorting the keys makes the symbols sharing a key prefix contiguous, so
+    // the sorted array can be walked like a trie.
+    Sorted.resize(this->Symbols.size());
+    std::iota(Sorted.begin(), Sorted.end(), 0);
+    std::stable_sort(Sorted.begin(), Sorted.end(), [&](unsigned L, unsigned R) {
+      return key(L) < key(R);
+    });
   }
 
   std::vector<SymbolAndSignals> search(StringRef Query) override {
     auto Tokens = tokenize(Query);
-    llvm::Regex Pattern("^" + queryRegexp(Tokens));
+    std::string Chars;
+    std::vector<bool> StartsToken;
+    for (const auto &Token : Tokens)
+      for (size_t I = 0; I < Token.size(); ++I) {
+        Chars.push_back(Token[I]);
+        StartsToken.push_back(I == 0);
+      }
+    if (Chars.empty())
+      return {};
+
+    std::vector<unsigned> Matches;
+    walk(Chars, StartsToken, /*Depth=*/0, 0, Sorted.size(),
+         {{MatchState::TokenStart, 0}}, Matches);
+    // Return the results in database order, like a linear scan would.
+    std::sort(Matches.begin(), Matches.end());
     std::vector<SymbolAndSignals> Results;
-    for (const Entry &E : Symbols)
-      if (Pattern.match(E.first))
-        Results.push_back(E.second);
+    Results.reserve(Matches.size());
+    for (unsigned I : Matches)
+      Results.push_back(Symbols[I].second);
     return Results;
   }
 
 private:
+  using States = llvm::SmallVector<MatchState, 4>;
+
+  StringRef key(unsigned I) const { return Symbols[I].first; }
+
+  // Visits the keys Sorted[Lo, Hi), which share their first Depth characters,
+  // in the automaton states reached after reading those characters. Subtrees
+  // in which the automaton has no state left are never visited, so the cost
+  // depends on the keys sharing prefixes with the query, not on the index
+  // size.
+  void walk(StringRef Chars, const std::vector<bool> &StartsToken,
+            size_t Depth, size_t Lo, size_t Hi, const States &Current,
+            std::vector<unsigned> &Matches) const {
+    for (const MatchState &S : Current)
+      if (S.Matched == Chars.size()) {
+        // queryRegexp() is not anchored at the end, so every key extending
+        // this prefix matches.
+        Matches.insert(Matches.end(), Sorted.begin() + Lo, Sorted.begin() + Hi);
+        return;
+      }
+
+    // Returns the end of the leading run of Sorted[Lo, Hi) satisfying Pred.
+    auto RunEnd = [&](llvm::function_ref<bool(StringRef)> Pred) -> size_t {
+      return std::partition_point(
+                 Sorted.begin() + Lo, Sorted.begin() + Hi,
+                 [&](unsigned I) { return Pred(key(I)); }) -
+             Sorted.begin();
+    };
+    // Keys ending here sort first, and can't match any more characters.
+    Lo = RunEnd([&](StringRef Key) { return Key.size() == Depth; });
+    while (Lo < Hi) {
+      char C = key(Sorted[Lo])[Depth];
+      size_t End = RunEnd([&](StringRef Key) { return Key[Depth] == C; });
+      States Next;
+      auto Add = [&](MatchState::ModeKind Mode, unsigned Matched) {
+        MatchState S{Mode, Matched};
+        if (llvm::find(Next, S) == Next.end())
+          Next.push_back(S);
+      };
+      for (const MatchState &S : Current) {
+        bool MatchesNext = Chars[S.Matched] == C;
+        switch (S.Mode) {
+        case MatchState::TokenStart:
+          if (MatchesNext)
+            Add(MatchState::InToken, S.Matched + 1);
+          break;
+        case MatchState::InToken:
+          if (MatchesNext && !StartsToken[S.Matched])
+            Add(MatchState::InToken, S.Matched + 1);
+          LLVM_FALLTHROUGH;
+        case MatchState::Skipping:
+          Add(C == ' ' ? MatchState::TokenStart : MatchState::Skipping,
+              S.Matched);
+          break;
+        }
+      }
+      if (!Next.empty())
+        walk(Chars, StartsToken, Depth + 1, Lo, End, Next, Matches);
+      Lo = End;
+    }
+  }
+
   using Entry = std::pair<llvm::SmallString<32>, SymbolAndSignals>;
   std::vector<Entry> Symbols;
+  // Indexes into Symbols, sorted by key.
+  std::vector<unsigned> Sorted;
 };
 
 // Helpers for tokenize state machine.
@@ -135,9 +238,14 @@ FuzzySymbolIndex::createFromYAML(StringRef FilePath) {
   auto Buffer = llvm::MemoryBuffer::getFile(FilePath);
   if (!Buffer)
     return llvm::errorCodeToError(Buffer.getError());
-  return llvm::make_unique<MemSymbolIndex>(
+  return create(
       find_all_symbols::ReadSymbolInfosFromYAML(Buffer.get()->getBuffer()));
 }
 
+std::unique_ptr<FuzzySymbolIndex>
+FuzzySymbolIndex::create(std::vector<SymbolAndSignals> Symbols) {
+  return llvm::make_unique<MemSymbolIndex>(std::move(Symbols));
+}
+
 } // namespace include_fixer
 } // namespace clang
@@ -36,6 +36,11 @@ public:
   static llvm::Expected<std::unique_ptr<FuzzySymbolIndex>>
   createFromYAML(llvm::StringRef File);
 
+  // Returns an index serving the given symbols. The index is built up front,
+  // so that a search only visits the symbols whose names can match.
+  static std::unique_ptr<FuzzySymbolIndex>
+  create(std::vector<find_all_symbols::SymbolAndSignals> Symbols);
+
   // Helpers for implementing indexes:
 
   // Transforms a symbol name or query into a sequence of tokens.
@@ -10,12 +10,14 @@
 #include "IncludeFixer.h"
 #include "clang/Format/Format.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
 #include "clang/Lex/HeaderSearch.h"
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Parse/ParseAST.h"
 #include "clang/Sema/Sema.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 #define DEBUG_TYPE "include-fixer"
 
@@ -72,12 +74,71 @@ private:
 
 } // namespace
 
+IncludeFixerPreambleCache::IncludeFixerPreambleCache(size_t MaxFiles)
+    : MaxFiles(MaxFiles) {}
+
+IncludeFixerPreambleCache::~IncludeFixerPreambleCache() = default;
+
+std::shared_ptr<const PrecompiledPreamble>
+IncludeFixerPreambleCache::get(CompilerInvocation &Invocation,
+                               StringRef CompileCommand,
+                               const llvm::MemoryBuffer &MainFile,
+                               IntrusiveRefCntPtr<vfs::FileSystem> FS,
+                               std::shared_ptr<PCHContainerOperations> PCHs) {
+  StringRef File = Invocation.getFrontendOpts().Inputs[0].getFile();
+  PreambleBounds Bounds =
+      ComputePreambleBounds(*Invocation.getLangOpts(), &MainFile, 0);
+  auto It = std::find_if(Entries.begin(), Entries.end(),
+                         [&](const Entry &E) { return E.File == File; });
+  if (It != Entries.end()) {
+    // CanReuse checks the preamble region of the file, and that the headers
+    // read by the preamble didn't change. It doesn't compare the options, like
+    // include paths or macros, so the command must be the same.
+    if (It->CompileCommand == CompileCommand &&
+        It->Preamble->CanReuse(Invocation, &MainFile, Bounds, FS.get())) {
+      DEBUG(llvm::dbgs() << "Reusing the preamble of " << File << "\n");
+      Entries.splice(Entries.begin(), Entries, It);
+      ++Reused;
+      return It->Preamble;
+    }
+    Entries.erase(It);
+  }
+  if (Bounds.Size == 0)
+    return nullptr;
+
+  // Errors in the preamble, like an unknown identifier or a missing header,
+  // are never seen by the include-fixer sema source. Files with such errors
+  // are parsed without a preamble.
+  DiagnosticConsumer Diagnostics;
+  IntrusiveRefCntPtr<DiagnosticsEngine> Engine =
+      CompilerInstance::createDiagnostics(&Invocation.getDiagnosticOpts(),
+                                          &Diagnostics,
+                                          /*ShouldOwnClient=*/false);
+  PreambleCallbacks Callbacks;
+  llvm::ErrorOr<PrecompiledPreamble> Preamble = PrecompiledPreamble::Build(
+      Invocation, &MainFile, Bounds, *Engine, FS, std::move(PCHs),
+      /*StoreInMemory=*/false, Callbacks);
+  if (!Preamble || Diagnostics.getNumErrors())
+    return nullptr;
+  DEBUG(llvm::dbgs() << "Built a preamble for " << File << "\n");
+  ++Built;
+
+  Entries.push_front(
+      {File, CompileCommand,
+       std::make_shared<PrecompiledPreamble>(std::move(*Preamble))});
+  if (Entries.size() > MaxFiles)
+    Entries.pop_back();
+  return Entries.front().Preamble;
+}
+
 IncludeFixerActionFactory::IncludeFixerActionFactory(
     SymbolIndexManager &SymbolIndexMgr,
     std::vector<IncludeFixerContext> &Contexts, StringRef StyleName,
-    bool MinimizeIncludePaths)
+    bool MinimizeIncludePaths, IncludeFixerPreambleCache *Preambles,
+    StringRef CompileCommand)
     : SymbolIndexMgr(SymbolIndexMgr), Contexts(Contexts),
-      MinimizeIncludePaths(MinimizeIncludePaths) {}
+      MinimizeIncludePaths(MinimizeIncludePaths), Preambles(Preambles),
+      CompileCommand(CompileCommand) {}
 
 IncludeFixerActionFactory::~IncludeFixerActionFactory() = default;
 
@@ -88,6 +149,32 @@ bool IncludeFixerActionFactory::runInvocation(
     clang::DiagnosticConsumer *Diagnostics) {
   assert(Invocation->getFrontendOpts().Inputs.size() == 1);
 
+  // Use a cached preamble if we have one, so that only the code after the
+  // #includes of the file is parsed.
+  std::shared_ptr<const PrecompiledPreamble> Preamble;
+  IntrusiveRefCntPtr<clang::FileManager> PreambleFiles;
+  if (Preambles) {
+    IntrusiveRefCntPtr<vfs::FileSystem> FS = Files->getVirtualFileSystem();
+    StringRef MainFile = Invocation->getFrontendOpts().Inputs[0].getFile();
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buffer =
+        FS->getBufferForFile(MainFile);
+    if (Buffer)
+      Preamble = Preambles->get(*Invocation, CompileCommand, **Buffer, FS,
+                                PCHContainerOps);
+    if (Preamble) {
+      // The invocation takes ownership of the main file buffer. If the
+      // preamble isn't visible in FS, FS is replaced by an overlay.
+      IntrusiveRefCntPtr<vfs::FileSystem> OverlayFS = FS;
+      Preamble->OverridePreamble(*Invocation, OverlayFS, Buffer->get());
+      Buffer->release();
+      if (OverlayFS != FS) {
+        PreambleFiles = new clang::FileManager(Files->getFileSystemOpts(),
+                                               std::move(OverlayFS));
+        Files = PreambleFiles.get();
+      }
+    }
+  }
+
   // Set up Clang.
   clang::CompilerInstance Compiler(PCHContainerOps);
   Compiler.setInvocation(std::move(Invocation));
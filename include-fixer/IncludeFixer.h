@@ -16,6 +16,7 @@
 #include "clang/Sema/ExternalSemaSource.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/Tooling.h"
+#include <list>
 #include <memory>
 #include <vector>
 
@@ -25,19 +26,68 @@ class CompilerInvocation;
 class DiagnosticConsumer;
 class FileManager;
 class PCHContainerOperations;
+class PrecompiledPreamble;
 
 namespace include_fixer {
 
+/// Keeps the preambles of the files fixed most recently, so that fixing one of
+/// them again only parses the code after its #includes. A preamble is rebuilt
+/// when the #includes of the file or the headers they read change.
+///
+/// Entries are keyed by file name and compile command, a preamble is only
+/// reused with the command it was built with.
+class IncludeFixerPreambleCache {
+public:
+  explicit IncludeFixerPreambleCache(size_t MaxFiles = 8);
+  ~IncludeFixerPreambleCache();
+
+  /// Returns the preamble to parse \p MainFile with, building it if there is
+  /// no up-to-date one, or null if the file must be parsed without a preamble.
+  /// \p CompileCommand is the command line \p Invocation was created from.
+  std::shared_ptr<const PrecompiledPreamble>
+  get(CompilerInvocation &Invocation, StringRef CompileCommand,
+      const llvm::MemoryBuffer &MainFile,
+      IntrusiveRefCntPtr<vfs::FileSystem> FS,
+      std::shared_ptr<PCHContainerOperations> PCHs);
+
+  /// The number of files with a cached preamble.
+  size_t size() const { return Entries.size(); }
+
+  /// The number of preambles built, and the number of times a cached one was
+  /// returned by get().
+  size_t getBuilt() const { return Built; }
+  size_t getReused() const { return Reused; }
+
+private:
+  struct Entry {
+    std::string File;
+    std::string CompileCommand;
+    std::shared_ptr<const PrecompiledPreamble> Preamble;
+  };
+
+  size_t MaxFiles;
+  size_t Built = 0;
+  size_t Reused = 0;
+  /// Most recently used first.
+  std::list<Entry> Entries;
+};
+
 class IncludeFixerActionFactory : public clang::tooling::ToolAction {
 public:
   /// \param SymbolIndexMgr A source for matching symbols to header files.
   /// \param Contexts The contexts for the symbols being queried.
   /// \param StyleName Fallback style for reformatting.
   /// \param MinimizeIncludePaths whether inserted include paths are optimized.
+  /// \param Preambles If set, the files are parsed with cached preambles.
+  /// \param CompileCommand The command line the files are compiled with, e.g.
+  /// from the compilation database. Cached preambles are only reused for the
+  /// same command.
   IncludeFixerActionFactory(SymbolIndexManager &SymbolIndexMgr,
                             std::vector<IncludeFixerContext> &Contexts,
                             StringRef StyleName,
-                            bool MinimizeIncludePaths = true);
+                            bool MinimizeIncludePaths = true,
+                            IncludeFixerPreambleCache *Preambles = nullptr,
+                            StringRef CompileCommand = "");
 
   ~IncludeFixerActionFactory() override;
 
@@ -57,6 +107,12 @@ private:
   /// Whether inserted include paths should be optimized.
   bool MinimizeIncludePaths;
 
+  /// The preambles to parse the files with, if any.
+  IncludeFixerPreambleCache *Preambles;
+
+  /// The command line the files are compiled with.
+  std::string CompileCommand;
+
   /// The fallback format style for formatting after insertion if no
   /// clang-format config file was found.
   std::string FallbackStyle;
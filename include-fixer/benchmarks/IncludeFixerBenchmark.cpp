@@ -0,0 +1,352 @@
+//===-- IncludeFixerBenchmark.cpp - include-fixer benchmarks ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "FuzzySymbolIndex.h"
+#include "InMemorySymbolIndex.h"
+#include "IncludeFixer.h"
+#include "SymbolIndexManager.h"
+#include "YamlSymbolIndex.h"
+#include "benchmark/benchmark.h"
+#include "find-all-symbols/SymbolInfo.h"
+#include "find-all-symbols/SymbolMerger.h"
+#include "clang/Basic/VirtualFileSystem.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::find_all_symbols::SymbolInfo;
+using clang::find_all_symbols::SymbolMerger;
+
+namespace clang {
+namespace include_fixer {
+namespace {
+
+// Classes spread over many headers and namespaces, like the database of a
+// large project.
+std::vector<SymbolAndSignals> generateSymbols(size_t NumSymbols) {
+  std::mt19937 Generator(42);
+  std::vector<SymbolAndSignals> Symbols;
+  for (size_t I = 0; I < NumSymbols; ++I) {
+    unsigned Namespace = Generator() % 1000;
+    Symbols.push_back(
+        {SymbolInfo("Class" + std::to_string(I), SymbolInfo::SymbolKind::Class,
+                    "\"dir" + std::to_string(Namespace) + "/header" +
+                        std::to_string(I % 50) + ".h\"",
+                    {{SymbolInfo::ContextType::Namespace,
+                      "ns" + std::to_string(Namespace)}}),
+         SymbolInfo::Signals(Generator() % 100, Generator() % 10)});
+  }
+  return Symbols;
+}
+
+// A database file written by Write, removed at the end of the benchmark.
+class TemporaryDatabase {
+public:
+  template <typename Fn> TemporaryDatabase(llvm::StringRef Suffix, Fn Write) {
+    int FD;
+    if (llvm::sys::fs::createTemporaryFile("include-fixer-db", Suffix, FD,
+                                           Path))
+      llvm::report_fatal_error("cannot create the database file");
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    Write(OS);
+  }
+  ~TemporaryDatabase() { llvm::sys::fs::remove(Path); }
+
+  llvm::StringRef path() const { return Path; }
+
+private:
+  llvm::SmallString<128> Path;
+};
+
+// A clang-include-fixer run opens the database, then searches it for each
+// unresolved identifier of the file.
+template <typename Index>
+void openAndSearch(benchmark::State &State, llvm::StringRef Path) {
+  const size_t NumSymbols = State.range(0);
+  std::vector<std::string> Queries;
+  for (size_t I = 0; I < 10; ++I)
+    Queries.push_back("Class" + std::to_string(I * NumSymbols / 10));
+  for (auto _ : State) {
+    auto DB = Index::createFromFile(Path);
+    if (!DB)
+      llvm::report_fatal_error("cannot open the database");
+    for (const std::string &Query : Queries)
+      benchmark::DoNotOptimize((*DB)->search(Query));
+  }
+}
+
+void YamlIndexOpenAndSearch(benchmark::State &State) {
+  TemporaryDatabase DB("yaml", [&](llvm::raw_ostream &OS) {
+    SymbolInfo::SignalMap Symbols;
+    for (const SymbolAndSignals &Symbol : generateSymbols(State.range(0)))
+      Symbols[Symbol.Symbol] = Symbol.Signals;
+    WriteSymbolInfosToStream(OS, Symbols);
+  });
+  openAndSearch<YamlSymbolIndex>(State, DB.path());
+}
+BENCHMARK(YamlIndexOpenAndSearch)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMillisecond);
+
+void BinaryIndexOpenAndSearch(benchmark::State &State) {
+  TemporaryDatabase DB("idx", [&](llvm::raw_ostream &OS) {
+    if (BinarySymbolIndex::write(generateSymbols(State.range(0)), OS))
+      llvm::report_fatal_error("cannot write the database");
+  });
+  openAndSearch<BinarySymbolIndex>(State, DB.path());
+}
+BENCHMARK(BinaryIndexOpenAndSearch)
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMillisecond);
+
+// Merges the YAML files written by find-all-symbols for 64 translation units
+// with State.range(0) threads, like find-all-symbols -merge-dir -j.
+void MergeThreadScaling(benchmark::State &State) {
+  const unsigned NumFiles = 64;
+  const unsigned SymbolsPerFile = 500;
+  const unsigned DistinctSymbols = 20000;
+
+  // The files share most of their symbols, as TUs including the same headers
+  // do.
+  std::mt19937 Generator(42);
+  std::vector<std::string> Files;
+  for (unsigned I = 0; I < NumFiles; ++I) {
+    SymbolInfo::SignalMap FileSymbols;
+    for (unsigned J = 0; J < SymbolsPerFile; ++J) {
+      unsigned Id = Generator() % DistinctSymbols;
+      SymbolInfo Symbol("symbol" + std::to_string(Id),
+                        SymbolInfo::SymbolKind::Function,
+                        "header" + std::to_string(Id % 100) + ".h",
+                        {{SymbolInfo::ContextType::Namespace, "ns"}});
+      FileSymbols[Symbol] = SymbolInfo::Signals(1, Id % 2);
+    }
+    Files.emplace_back();
+    llvm::raw_string_ostream OS(Files.back());
+    WriteSymbolInfosToStream(OS, FileSymbols);
+  }
+
+  const unsigned NumThreads = State.range(0);
+  for (auto _ : State) {
+    SymbolMerger Merger(4 * NumThreads);
+    {
+      llvm::ThreadPool Pool(NumThreads);
+      for (const std::string &File : Files)
+        Pool.async([&Merger, &File] {
+          Merger.add(find_all_symbols::ReadSymbolInfosFromYAML(File));
+        });
+    }
+    std::string Output;
+    llvm::raw_string_ostream OS(Output);
+    Merger.write(OS);
+    benchmark::DoNotOptimize(OS.str());
+  }
+  State.SetItemsProcessed(State.iterations() * NumFiles);
+}
+BENCHMARK(MergeThreadScaling)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// Symbols named after one to three random words, e.g. "foo_bar", and queries
+// made of prefixes of the words of existing symbols, e.g. "fo ba".
+void generateFuzzyInputs(size_t NumSymbols,
+                         std::vector<SymbolAndSignals> &Symbols,
+                         std::vector<std::string> &Queries) {
+  std::mt19937 Generator(42);
+  std::vector<std::string> Words;
+  for (unsigned I = 0; I < 500; ++I) {
+    std::string Word;
+    for (unsigned J = 0, E = 3 + Generator() % 5; J < E; ++J)
+      Word += 'a' + Generator() % 26;
+    Words.push_back(Word);
+  }
+  for (size_t I = 0; I < NumSymbols; ++I) {
+    std::string Name;
+    for (unsigned J = 0, E = 1 + Generator() % 3; J < E; ++J)
+      Name += (J ? "_" : "") + Words[Generator() % Words.size()];
+    Symbols.push_back(
+        {SymbolInfo(Name, SymbolInfo::SymbolKind::Class, "header.h", {}),
+         SymbolInfo::Signals()});
+  }
+  for (unsigned I = 0; I < 100; ++I) {
+    std::string Query;
+    for (const std::string &Token : FuzzySymbolIndex::tokenize(
+             Symbols[Generator() % Symbols.size()].Symbol.getName()))
+      Query += (Query.empty() ? "" : " ") +
+               Token.substr(0, 1 + Generator() % Token.size());
+    Queries.push_back(Query);
+  }
+}
+
+void FuzzyIndexBuild(benchmark::State &State) {
+  std::vector<SymbolAndSignals> Symbols;
+  std::vector<std::string> Queries;
+  generateFuzzyInputs(State.range(0), Symbols, Queries);
+  for (auto _ : State)
+    benchmark::DoNotOptimize(FuzzySymbolIndex::create(Symbols));
+}
+BENCHMARK(FuzzyIndexBuild)
+    ->Arg(1000)
+    ->Arg(4000)
+    ->Arg(16000)
+    ->Arg(64000)
+    ->Unit(benchmark::kMillisecond);
+
+// The cost of a search should follow the number of results rather than the
+// size of the database.
+void FuzzyIndexSearch(benchmark::State &State) {
+  std::vector<SymbolAndSignals> Symbols;
+  std::vector<std::string> Queries;
+  generateFuzzyInputs(State.range(0), Symbols, Queries);
+  std::unique_ptr<FuzzySymbolIndex> Index = FuzzySymbolIndex::create(Symbols);
+  for (auto _ : State)
+    for (const std::string &Query : Queries)
+      benchmark::DoNotOptimize(Index->search(Query));
+  State.SetItemsProcessed(State.iterations() * Queries.size());
+}
+BENCHMARK(FuzzyIndexSearch)
+    ->Arg(1000)
+    ->Arg(4000)
+    ->Arg(16000)
+    ->Arg(64000)
+    ->Unit(benchmark::kMillisecond);
+
+// The regex scan of every symbol that FuzzySymbolIndex did before it was
+// indexed.
+void FuzzyRegexScan(benchmark::State &State) {
+  std::vector<SymbolAndSignals> Symbols;
+  std::vector<std::string> Queries;
+  generateFuzzyInputs(State.range(0), Symbols, Queries);
+  std::vector<std::string> Keys;
+  for (const SymbolAndSignals &Symbol : Symbols) {
+    auto Tokens = FuzzySymbolIndex::tokenize(Symbol.Symbol.getName());
+    Keys.push_back(llvm::join(Tokens.begin(), Tokens.end(), " "));
+  }
+  for (auto _ : State)
+    for (const std::string &Query : Queries) {
+      llvm::Regex Pattern("^" + FuzzySymbolIndex::queryRegexp(
+                                    FuzzySymbolIndex::tokenize(Query)));
+      std::vector<SymbolAndSignals> Results;
+      for (size_t I = 0; I < Symbols.size(); ++I)
+        if (Pattern.match(Keys[I]))
+          Results.push_back(Symbols[I]);
+      benchmark::DoNotOptimize(Results);
+    }
+  State.SetItemsProcessed(State.iterations() * Queries.size());
+}
+BENCHMARK(FuzzyRegexScan)
+    ->Arg(1000)
+    ->Arg(4000)
+    ->Arg(16000)
+    ->Arg(64000)
+    ->Unit(benchmark::kMillisecond);
+
+// A file that includes a header declaring many classes, and uses a symbol of
+// another header.
+class LargePreamble {
+public:
+  LargePreamble() : Header("namespace big {\n") {
+    SymbolInfo::SignalMap Symbols;
+    for (unsigned I = 0; I < 2000; ++I) {
+      std::string Name = "Class" + std::to_string(I);
+      Header += "class " + Name + " { public: int method(int); };\n" +
+                "int function" + std::to_string(I) + "(" + Name + " &);\n";
+      Symbols[SymbolInfo(Name, SymbolInfo::SymbolKind::Class, "\"big.h\"",
+                         {{SymbolInfo::ContextType::Namespace, "big"}})] =
+          SymbolInfo::Signals();
+    }
+    Header += "}\n";
+    Symbols[SymbolInfo("foo", SymbolInfo::SymbolKind::Class, "\"foo.h\"",
+                       {})] = SymbolInfo::Signals();
+    llvm::raw_string_ostream OS(Database);
+    WriteSymbolInfosToStream(OS, Symbols);
+  }
+
+  // Loads the database into SymbolIndexMgr.
+  void addSymbolIndex(SymbolIndexManager &SymbolIndexMgr) const {
+    SymbolIndexMgr.addSymbolIndex([this] {
+      return llvm::make_unique<InMemorySymbolIndex>(
+          find_all_symbols::ReadSymbolInfosFromYAML(Database));
+    });
+  }
+
+  // Runs include-fixer on the file, like a clang-include-fixer invocation.
+  void fix(SymbolIndexManager &SymbolIndexMgr,
+           IncludeFixerPreambleCache *Preambles) const {
+    llvm::IntrusiveRefCntPtr<vfs::InMemoryFileSystem> InMemoryFileSystem(
+        new vfs::InMemoryFileSystem);
+    InMemoryFileSystem->addFile(
+        "input.cc", 0,
+        llvm::MemoryBuffer::getMemBuffer("#include \"big.h\"\n\nfoo f;\n"));
+    InMemoryFileSystem->addFile("big.h", 0,
+                                llvm::MemoryBuffer::getMemBuffer(Header));
+    llvm::IntrusiveRefCntPtr<FileManager> Files(
+        new FileManager(FileSystemOptions(), InMemoryFileSystem));
+    std::vector<IncludeFixerContext> Contexts;
+    IncludeFixerActionFactory Factory(SymbolIndexMgr, Contexts, "llvm",
+                                      /*MinimizeIncludePaths=*/true,
+                                      Preambles);
+    tooling::ToolInvocation Invocation(
+        {"include_fixer", "-fsyntax-only", "-fno-ms-compatibility", "input.cc"},
+        &Factory, Files.get(), std::make_shared<PCHContainerOperations>());
+    if (!Invocation.run() || Contexts.size() != 1 ||
+        Contexts[0].getHeaderInfos().empty())
+      llvm::report_fatal_error("include-fixer did not find foo.h");
+  }
+
+private:
+  std::string Header;
+  std::string Database;
+};
+
+// A clang-include-fixer process per fix: the symbol database is loaded and the
+// whole file is parsed every time.
+void IncludeFixerCold(benchmark::State &State) {
+  LargePreamble Input;
+  for (auto _ : State) {
+    SymbolIndexManager SymbolIndexMgr;
+    Input.addSymbolIndex(SymbolIndexMgr);
+    Input.fix(SymbolIndexMgr, /*Preambles=*/nullptr);
+  }
+}
+BENCHMARK(IncludeFixerCold)->Unit(benchmark::kMillisecond);
+
+// clang-include-fixer -server: the database stays loaded and the preamble of
+// the file is reused.
+void IncludeFixerWarm(benchmark::State &State) {
+  LargePreamble Input;
+  SymbolIndexManager SymbolIndexMgr;
+  Input.addSymbolIndex(SymbolIndexMgr);
+  IncludeFixerPreambleCache Preambles;
+  // The first fix loads the database and builds the preamble.
+  Input.fix(SymbolIndexMgr, &Preambles);
+  for (auto _ : State)
+    Input.fix(SymbolIndexMgr, &Preambles);
+}
+BENCHMARK(IncludeFixerWarm)->Unit(benchmark::kMillisecond);
+
+} // namespace
+} // namespace include_fixer
+} // namespace clang
+
+BENCHMARK_MAIN();
@@ -0,0 +1,66 @@
+//===-- DBConverterMain.cpp - include-fixer database converter --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Converts a YAML symbol database written by find-all-symbols to the binary
+// format, which clang-include-fixer -db=binary memory-maps instead of parsing
+// it. The signals of the symbols are kept.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "find-all-symbols/SymbolInfo.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::include_fixer::BinarySymbolIndex;
+
+namespace {
+static cl::opt<std::string> InputFile(cl::Positional, cl::Required,
+                                      cl::desc("<input YAML database>"));
+
+static cl::opt<std::string> OutputFile("o", cl::Required,
+                                       cl::desc("Output binary database"),
+                                       cl::value_desc("filename"));
+} // namespace
+
+int main(int argc, const char **argv) {
+  sys::PrintStackTraceOnErrorSignal(argv[0]);
+  cl::ParseCommandLineOptions(
+      argc, argv,
+      "Converts include-fixer symbol databases from YAML to binary.");
+
+  auto Buffer = MemoryBuffer::getFile(InputFile);
+  if (!Buffer) {
+    errs() << "Can't open " << InputFile << ": " << Buffer.getError().message()
+           << "\n";
+    return 1;
+  }
+  if (BinarySymbolIndex::isBinarySymbolIndex(Buffer.get()->getBuffer())) {
+    errs() << InputFile << " is already a binary database\n";
+    return 1;
+  }
+  std::vector<SymbolAndSignals> Symbols =
+      clang::find_all_symbols::ReadSymbolInfosFromYAML(
+          Buffer.get()->getBuffer());
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFile, EC, sys::fs::F_None);
+  if (!EC)
+    EC = BinarySymbolIndex::write(Symbols, OS);
+  if (EC) {
+    errs() << "Can't write " << OutputFile << ": " << EC.message() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -126,6 +126,8 @@ bool WriteSymbolInfosToStream(llvm::raw_ostream &OS,
   return true;
 }
 
+void SymbolInfoYAMLWriter::write(SymbolAndSignals Symbol) { Out << Symbol; }
+
 std::vector<SymbolAndSignals> ReadSymbolInfosFromYAML(llvm::StringRef Yaml) {
   std::vector<SymbolAndSignals> Symbols;
   llvm::yaml::Input yin(Yaml);
@@ -134,6 +134,19 @@ struct SymbolAndSignals {
 bool WriteSymbolInfosToStream(llvm::raw_ostream &OS,
                               const SymbolInfo::SignalMap &Symbols);
 
+/// \brief Writes SymbolInfos to a stream (YAML format) one at a time, so that
+/// they don't need to be collected in a SignalMap first. The output is the
+/// same as WriteSymbolInfosToStream's.
+class SymbolInfoYAMLWriter {
+public:
+  explicit SymbolInfoYAMLWriter(llvm::raw_ostream &OS) : Out(OS) {}
+
+  void write(SymbolAndSignals Symbol);
+
+private:
+  llvm::yaml::Output Out;
+};
+
 /// \brief Read SymbolInfos from a YAML document.
 std::vector<SymbolAndSignals> ReadSymbolInfosFromYAML(llvm::StringRef Yaml);
 
@@ -0,0 +1,61 @@
+//===-- SymbolMerger.cpp - Merge symbols from many files --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolMerger.h"
+#include "llvm/ADT/Hashing.h"
+#include <cassert>
+#include <queue>
+
+namespace clang {
+namespace find_all_symbols {
+
+SymbolMerger::SymbolMerger(unsigned NumShards) : Shards(NumShards) {
+  assert(NumShards > 0 && "SymbolMerger needs at least one shard");
+}
+
+void SymbolMerger::add(llvm::ArrayRef<SymbolAndSignals> Symbols) {
+  // Group the symbols by shard first, to lock each shard once per call.
+  std::vector<std::vector<const SymbolAndSignals *>> ByShard(Shards.size());
+  for (const auto &Symbol : Symbols)
+    ByShard[llvm::hash_value(Symbol.Symbol.getName()) % Shards.size()]
+        .push_back(&Symbol);
+  for (size_t I = 0; I < Shards.size(); ++I) {
+    if (ByShard[I].empty())
+      continue;
+    std::lock_guard<std::mutex> LockGuard(Shards[I].Mutex);
+    for (const SymbolAndSignals *Symbol : ByShard[I])
+      Shards[I].Symbols[Symbol->Symbol] += Symbol->Signals;
+  }
+}
+
+void SymbolMerger::write(llvm::raw_ostream &OS) const {
+  // A symbol is in a single shard, and each shard is sorted. Merge the shards
+  // to write the symbols in the same order as a single SignalMap would.
+  using ShardRange = std::pair<SymbolInfo::SignalMap::const_iterator,
+                               SymbolInfo::SignalMap::const_iterator>;
+  auto Greater = [](const ShardRange &L, const ShardRange &R) {
+    return R.first->first < L.first->first;
+  };
+  std::priority_queue<ShardRange, std::vector<ShardRange>, decltype(Greater)>
+      Queue(Greater);
+  for (const Shard &S : Shards)
+    if (!S.Symbols.empty())
+      Queue.push({S.Symbols.begin(), S.Symbols.end()});
+  SymbolInfoYAMLWriter Writer(OS);
+  while (!Queue.empty()) {
+    ShardRange Top = Queue.top();
+    Queue.pop();
+    Writer.write({Top.first->first, Top.first->second});
+    if (++Top.first != Top.second)
+      Queue.push(Top);
+  }
+}
+
+} // namespace find_all_symbols
+} // namespace clang
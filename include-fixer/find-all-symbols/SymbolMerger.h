@@ -0,0 +1,53 @@
+//===-- SymbolMerger.h - Merge symbols from many files ----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_FIND_ALL_SYMBOLS_SYMBOLMERGER_H
+#define LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_FIND_ALL_SYMBOLS_SYMBOLMERGER_H
+
+#include "SymbolInfo.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+#include <vector>
+
+namespace clang {
+namespace find_all_symbols {
+
+/// \brief Sums the signals of the symbols found in many files.
+///
+/// Several threads can add symbols at the same time. The symbols are kept in
+/// shards, selected by a hash of the symbol name. Each shard is a SignalMap
+/// guarded by its own mutex, so that threads adding different files rarely
+/// wait for each other.
+class SymbolMerger {
+public:
+  /// \p NumShards must be at least 1. A few shards per thread is enough to
+  /// keep contention low.
+  explicit SymbolMerger(unsigned NumShards);
+
+  /// \brief Adds the signals of \p Symbols. This is thread-safe.
+  void add(llvm::ArrayRef<SymbolAndSignals> Symbols);
+
+  /// \brief Writes the merged symbols to \p OS (YAML format). The output is
+  /// the same as WriteSymbolInfosToStream's for a single SignalMap.
+  /// This must not run concurrently with add().
+  void write(llvm::raw_ostream &OS) const;
+
+private:
+  struct Shard {
+    std::mutex Mutex;
+    SymbolInfo::SignalMap Symbols;
+  };
+  std::vector<Shard> Shards;
+};
+
+} // namespace find_all_symbols
+} // namespace clang
+
+#endif // LLVM_CLANG_TOOLS_EXTRA_INCLUDE_FIXER_FIND_ALL_SYMBOLS_SYMBOLMERGER_H
@@ -10,6 +10,7 @@
 #include "FindAllSymbolsAction.h"
 #include "STLPostfixHeaderMap.h"
 #include "SymbolInfo.h"
+#include "SymbolMerger.h"
 #include "SymbolReporter.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
@@ -26,6 +27,7 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <map>
 #include <mutex>
@@ -59,6 +61,11 @@ static cl::opt<std::string> MergeDir("merge-dir", cl::desc(R"(
 The directory for merging symbols.)"),
                                      cl::init(""),
                                      cl::cat(FindAllSymbolsCategory));
+
+static cl::opt<unsigned> Jobs("j", cl::desc(R"(
+The number of threads used by -merge-dir. 0 means one per core.)"),
+                              cl::init(0), cl::cat(FindAllSymbolsCategory));
+
 namespace clang {
 namespace find_all_symbols {
 
@@ -78,38 +85,31 @@ public:
 
 bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
   std::error_code EC;
-  SymbolInfo::SignalMap Symbols;
-  std::mutex SymbolMutex;
-  auto AddSymbols = [&](ArrayRef<SymbolAndSignals> NewSymbols) {
-    // Synchronize set accesses.
-    std::unique_lock<std::mutex> LockGuard(SymbolMutex);
-    for (const auto &Symbol : NewSymbols) {
-      Symbols[Symbol.Symbol] += Symbol.Signals;
-    }
-  };
+  unsigned NumThreads =
+      std::max(Jobs ? Jobs : llvm::hardware_concurrency(), 1u);
+  SymbolMerger Symbols(4 * NumThreads);
 
   // Load all symbol files in MergeDir.
   {
-    llvm::ThreadPool Pool;
+    llvm::ThreadPool Pool(NumThreads);
     for (llvm::sys::fs::directory_iterator Dir(MergeDir, EC), DirEnd;
          Dir != DirEnd && !EC; Dir.increment(EC)) {
       // Parse YAML files in parallel.
       Pool.async(
-          [&AddSymbols](std::string Path) {
+          [&Symbols](std::string Path) {
             auto Buffer = llvm::MemoryBuffer::getFile(Path);
             if (!Buffer) {
               llvm::errs() << "Can't open " << Path << "\n";
               return;
             }
-            std::vector<SymbolAndSignals> Symbols =
+            std::vector<SymbolAndSignals> FileSymbols =
                 ReadSymbolInfosFromYAML(Buffer.get()->getBuffer());
-            for (auto &Symbol : Symbols) {
+            for (auto &Symbol : FileSymbols) {
               // Only count one occurrence per file, to avoid spam.
               Symbol.Signals.Seen = std::min(Symbol.Signals.Seen, 1u);
               Symbol.Signals.Used = std::min(Symbol.Signals.Used, 1u);
             }
-            // FIXME: Merge without creating such a heavy contention point.
-            AddSymbols(Symbols);
+            Symbols.add(FileSymbols);
           },
           Dir->path());
     }
@@ -121,7 +121,8 @@ bool Merge(llvm::StringRef MergeDir, llvm::StringRef OutputFile) {
                  << '\n';
     return false;
   }
-  WriteSymbolInfosToStream(OS, Symbols);
+
+  Symbols.write(OS);
   return true;
 }
 
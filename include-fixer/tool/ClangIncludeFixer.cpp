@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BinarySymbolIndex.h"
 #include "FuzzySymbolIndex.h"
 #include "InMemorySymbolIndex.h"
 #include "IncludeFixer.h"
@@ -19,9 +20,19 @@
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <algorithm>
+#include <string>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 using namespace clang;
 using namespace llvm;
@@ -79,6 +90,33 @@ template <> struct MappingTraits<IncludeFixerContext> {
 } // namespace yaml
 } // namespace llvm
 
+namespace {
+/// A request of the server mode. See the description of -server.
+struct ServerRequest {
+  std::string Command;
+  std::string FilePath;
+  /// The contents of FilePath, if they differ from the file on disk. An empty
+  /// Code is an empty file.
+  llvm::Optional<std::string> Code;
+  std::string Symbol;
+  IncludeFixerContext Context;
+};
+} // namespace
+
+namespace llvm {
+namespace yaml {
+template <> struct MappingTraits<ServerRequest> {
+  static void mapping(IO &IO, ServerRequest &Request) {
+    IO.mapRequired("Command", Request.Command);
+    IO.mapOptional("FilePath", Request.FilePath);
+    IO.mapOptional("Code", Request.Code);
+    IO.mapOptional("Symbol", Request.Symbol);
+    IO.mapOptional("Context", Request.Context);
+  }
+};
+} // namespace yaml
+} // namespace llvm
+
 namespace {
 cl::OptionCategory IncludeFixerCategory("Tool options");
 
@@ -86,13 +124,16 @@ enum DatabaseFormatTy {
   fixed,     ///< Hard-coded mapping.
   yaml,      ///< Yaml database created by find-all-symbols.
   fuzzyYaml, ///< Yaml database with fuzzy-matched identifiers.
+  binary,    ///< Binary database converted from a Yaml database.
 };
 
 cl::opt<DatabaseFormatTy> DatabaseFormat(
     "db", cl::desc("Specify input format"),
     cl::values(clEnumVal(fixed, "Hard-coded mapping"),
                clEnumVal(yaml, "Yaml database created by find-all-symbols"),
-               clEnumVal(fuzzyYaml, "Yaml database, with fuzzy-matched names")),
+               clEnumVal(fuzzyYaml, "Yaml database, with fuzzy-matched names"),
+               clEnumVal(binary, "Binary database converted from a Yaml "
+                                 "database with include-fixer-db-converter")),
     cl::init(yaml), cl::cat(IncludeFixerCategory));
 
 cl::opt<std::string> Input("input",
@@ -152,6 +193,23 @@ cl::opt<std::string> InsertHeader(
              "                     QualifiedName: \"a::foo\"} ]}\""),
     cl::init(""), cl::cat(IncludeFixerCategory));
 
+cl::opt<bool> ServerMode(
+    "server",
+    cl::desc("Keep running and serve requests read from <stdin>, one JSON\n"
+             "object per line. The symbol database stays loaded, and the\n"
+             "preambles of recently fixed files are reused. Each request\n"
+             "gets a JSON object on a line of <stdout>, or an \"Error\":\n"
+             "  {\"Command\": \"fix\", \"FilePath\": \"/path/to/foo.cc\",\n"
+             "   \"Code\": \"foo f;\\n\"}\n"
+             "    Like -output-headers. Without \"Code\" the file is read.\n"
+             "  {\"Command\": \"query\", \"FilePath\": \"/path/to/foo.cc\",\n"
+             "   \"Symbol\": \"a::b::foo\"}\n"
+             "    Like -query-symbol. \"Symbol\" is required.\n"
+             "  {\"Command\": \"insert\", \"Code\": \"foo f;\\n\",\n"
+             "   \"Context\": <the result of a fix or query command>}\n"
+             "    Like -insert-header, answers {\"Code\": <new code>}."),
+    cl::init(false), cl::cat(IncludeFixerCategory));
+
 cl::opt<std::string>
     Style("style",
           cl::desc("Fallback style for reformatting after inserting new\n"
@@ -217,6 +275,33 @@ createSymbolIndexManager(StringRef FilePath) {
     SymbolIndexMgr->addSymbolIndex(std::move(CreateYamlIdx));
     break;
   }
+  case binary: {
+    auto CreateBinaryIdx =
+        [=]() -> std::unique_ptr<include_fixer::SymbolIndex> {
+      llvm::ErrorOr<std::unique_ptr<include_fixer::BinarySymbolIndex>> DB(
+          nullptr);
+      if (!Input.empty()) {
+        DB = include_fixer::BinarySymbolIndex::createFromFile(Input);
+      } else {
+        // If we don't have any input file, look in the directory of the
+        // first file and its parents.
+        SmallString<128> AbsolutePath(tooling::getAbsolutePath(FilePath));
+        StringRef Directory = llvm::sys::path::parent_path(AbsolutePath);
+        DB = include_fixer::BinarySymbolIndex::createFromDirectory(
+            Directory, "find_all_symbols_db.idx");
+      }
+
+      if (!DB) {
+        llvm::errs() << "Couldn't find binary db: " << DB.getError().message()
+                     << '\n';
+        return nullptr;
+      }
+      return std::move(*DB);
+    };
+
+    SymbolIndexMgr->addSymbolIndex(std::move(CreateBinaryIdx));
+    break;
+  }
   case fuzzyYaml: {
     // This mode is not very useful, because we don't correct the identifier.
     // It's main purpose is to expose FuzzySymbolIndex to tests.
@@ -263,12 +348,253 @@ void writeToJson(llvm::raw_ostream &OS, const IncludeFixerContext& Context) {
   OS << "}\n";
 }
 
+/// Returns the context for the symbol \p Query, with quoted header paths.
+IncludeFixerContext
+querySymbol(const include_fixer::SymbolIndexManager &SymbolIndexMgr,
+            StringRef Query, StringRef FilePath) {
+  auto MatchedSymbols =
+      SymbolIndexMgr.search(Query, /*IsNestedSearch=*/true, FilePath);
+  for (auto &Symbol : MatchedSymbols) {
+    std::string HeaderPath = Symbol.getFilePath().str();
+    Symbol.SetFilePath(((HeaderPath[0] == '"' || HeaderPath[0] == '<')
+                            ? HeaderPath
+                            : "\"" + HeaderPath + "\""));
+  }
+
+  // We leave an empty symbol range as we don't know the range of the symbol
+  // being queried in this mode. include-fixer won't add namespace qualifiers
+  // if the symbol range is empty, which also fits this case.
+  IncludeFixerContext::QuerySymbolInfo Symbol;
+  Symbol.RawIdentifier = Query;
+  return IncludeFixerContext(FilePath, {Symbol}, MatchedSymbols);
+}
+
+/// Returns \p Code with the header of \p Context inserted, for -insert-header.
+llvm::Expected<std::string> insertHeader(StringRef Code,
+                                         const IncludeFixerContext &Context) {
+  const auto &HeaderInfos = Context.getHeaderInfos();
+  // We only accept one unique header.
+  // Check all elements in HeaderInfos have the same header.
+  bool IsUniqueHeader =
+      !HeaderInfos.empty() &&
+      std::equal(HeaderInfos.begin() + 1, HeaderInfos.end(),
+                 HeaderInfos.begin(),
+                 [](const IncludeFixerContext::HeaderInfo &LHS,
+                    const IncludeFixerContext::HeaderInfo &RHS) {
+                   return LHS.Header == RHS.Header;
+                 });
+  if (!IsUniqueHeader)
+    return llvm::make_error<llvm::StringError>(
+        "Expect exactly one unique header.", llvm::inconvertibleErrorCode());
+
+  // If a header has multiple symbols, we won't add the missing namespace
+  // qualifiers because we don't know which one is exactly used.
+  //
+  // Check whether all elements in HeaderInfos have the same qualified name.
+  bool IsUniqueQualifiedName = std::equal(
+      HeaderInfos.begin() + 1, HeaderInfos.end(), HeaderInfos.begin(),
+      [](const IncludeFixerContext::HeaderInfo &LHS,
+         const IncludeFixerContext::HeaderInfo &RHS) {
+        return LHS.QualifiedName == RHS.QualifiedName;
+      });
+  auto InsertStyle = format::getStyle("file", Context.getFilePath(), Style);
+  if (!InsertStyle)
+    return InsertStyle.takeError();
+  auto Replacements = clang::include_fixer::createIncludeFixerReplacements(
+      Code, Context, *InsertStyle,
+      /*AddQualifiers=*/IsUniqueQualifiedName);
+  if (!Replacements)
+    return llvm::make_error<llvm::StringError>(
+        "Failed to create replacements: " +
+            llvm::toString(Replacements.takeError()),
+        llvm::inconvertibleErrorCode());
+
+  return tooling::applyAllReplacements(Code, *Replacements);
+}
+
+/// Writes \p S as a double-quoted string, escaped like in writeToJson.
+void writeQuoted(llvm::raw_ostream &OS, StringRef S) {
+  OS << '"' << llvm::yaml::escape(S) << '"';
+}
+
+/// Like writeToJson, but on a single line for the server mode.
+void writeToJsonLine(llvm::raw_ostream &OS,
+                     const IncludeFixerContext &Context) {
+  OS << "{\"FilePath\": ";
+  writeQuoted(OS, Context.getFilePath());
+  OS << ", \"QuerySymbolInfos\": [";
+  for (const auto &Info : Context.getQuerySymbolInfos()) {
+    if (&Info != &Context.getQuerySymbolInfos().front())
+      OS << ", ";
+    OS << "{\"RawIdentifier\": ";
+    writeQuoted(OS, Info.RawIdentifier);
+    OS << ", \"Range\": {\"Offset\": " << Info.Range.getOffset()
+       << ", \"Length\": " << Info.Range.getLength() << "}}";
+  }
+  OS << "], \"HeaderInfos\": [";
+  for (const auto &Info : Context.getHeaderInfos()) {
+    if (&Info != &Context.getHeaderInfos().front())
+      OS << ", ";
+    OS << "{\"Header\": ";
+    writeQuoted(OS, Info.Header);
+    OS << ", \"QualifiedName\": ";
+    writeQuoted(OS, Info.QualifiedName);
+    OS << "}";
+  }
+  OS << "]}";
+}
+
+/// Serves the requests of the server mode. The symbol database and the
+/// preambles are shared by all requests.
+class IncludeFixerServer {
+public:
+  IncludeFixerServer(const tooling::CompilationDatabase &Compilations,
+                     include_fixer::SymbolIndexManager &SymbolIndexMgr)
+      : Compilations(Compilations), SymbolIndexMgr(SymbolIndexMgr) {}
+
+  /// Handles a request, and writes the response without a trailing newline.
+  void handle(StringRef Line, llvm::raw_ostream &OS) {
+    ServerRequest Request;
+    llvm::yaml::Input YIn(Line);
+    YIn >> Request;
+    if (YIn.error())
+      return writeError(OS, "Invalid request: " + YIn.error().message());
+
+    if (Request.Command == "fix") {
+      if (Request.FilePath.empty())
+        return writeError(OS, "Missing FilePath.");
+      std::vector<IncludeFixerContext> Contexts;
+      if (!fix(Request.FilePath, Request.Code, Contexts))
+        return writeError(OS, "Fatal compiler error occurred while parsing "
+                              "file! (incorrect include paths?)");
+      return writeToJsonLine(OS, Contexts.front());
+    }
+    if (Request.Command == "query") {
+      if (Request.Symbol.empty())
+        return writeError(OS, "Missing Symbol.");
+      return writeToJsonLine(
+          OS, querySymbol(SymbolIndexMgr, Request.Symbol, Request.FilePath));
+    }
+    if (Request.Command == "insert") {
+      if (!Request.Code)
+        return writeError(OS, "Missing Code.");
+      auto ChangedCode = insertHeader(*Request.Code, Request.Context);
+      if (!ChangedCode)
+        return writeError(OS, llvm::toString(ChangedCode.takeError()));
+      OS << "{\"Code\": ";
+      writeQuoted(OS, *ChangedCode);
+      OS << "}";
+      return;
+    }
+    writeError(OS, "Unknown command: " + Request.Command);
+  }
+
+private:
+  bool fix(StringRef FilePath, const llvm::Optional<std::string> &Code,
+           std::vector<IncludeFixerContext> &Contexts) {
+    tooling::ClangTool Tool(Compilations, {FilePath});
+    if (Code)
+      Tool.mapVirtualFile(FilePath, *Code);
+    // A preamble is only reused with the command it was built with. A file
+    // with several commands is parsed without preambles, all of its commands
+    // would share the same cache entry.
+    std::vector<tooling::CompileCommand> Commands =
+        Compilations.getCompileCommands(FilePath);
+    std::string CompileCommand;
+    if (Commands.size() == 1)
+      CompileCommand = Commands[0].Directory + "\n" +
+                       llvm::join(Commands[0].CommandLine, " ");
+    include_fixer::IncludeFixerActionFactory Factory(
+        SymbolIndexMgr, Contexts, Style, MinimizeIncludePaths,
+        Commands.size() == 1 ? &Preambles : nullptr, CompileCommand);
+    return Tool.run(&Factory) == 0 && !Contexts.empty();
+  }
+
+  static void writeError(llvm::raw_ostream &OS, const Twine &Message) {
+    OS << "{\"Error\": ";
+    writeQuoted(OS, Message.str());
+    OS << "}";
+  }
+
+  const tooling::CompilationDatabase &Compilations;
+  include_fixer::SymbolIndexManager &SymbolIndexMgr;
+  include_fixer::IncludeFixerPreambleCache Preambles;
+};
+
+/// Reads the lines of <stdin> as they arrive. MemoryBuffer::getSTDIN can't be
+/// used, it only returns at the end of the input.
+class StdinLineReader {
+public:
+  /// Reads the next line, without its '\n'. The last line may not be
+  /// terminated. Returns false at the end of the input.
+  bool readLine(std::string &Line) {
+    size_t Searched = 0;
+    while (true) {
+      size_t Newline = Pending.find('\n', Searched);
+      if (Newline != std::string::npos) {
+        Line = Pending.substr(0, Newline);
+        Pending.erase(0, Newline + 1);
+        return true;
+      }
+      Searched = Pending.size();
+      // Read straight into Pending.
+      const size_t ChunkSize = 4096;
+      Pending.resize(Searched + ChunkSize);
+      int64_t Read = llvm::sys::RetryAfterSignal(-1, readStdin,
+                                                 &Pending[Searched], ChunkSize);
+      Pending.resize(Searched + std::max<int64_t>(Read, 0));
+      if (Read <= 0) {
+        Line = std::move(Pending);
+        Pending.clear();
+        return !Line.empty();
+      }
+    }
+  }
+
+private:
+  static int64_t readStdin(char *Data, size_t Size) {
+#ifdef _WIN32
+    return ::_read(0, Data, Size);
+#else
+    return ::read(0, Data, Size);
+#endif
+  }
+
+  /// Input read after the last returned line.
+  std::string Pending;
+};
+
+int runServer(const tooling::CompilationDatabase &Compilations,
+              StringRef SourceFilePath) {
+  // The database is looked up from the file on the command line, like in the
+  // other modes, and loaded once.
+  std::unique_ptr<include_fixer::SymbolIndexManager> SymbolIndexMgr =
+      createSymbolIndexManager(SourceFilePath);
+  if (!SymbolIndexMgr)
+    return 1;
+
+  IncludeFixerServer Server(Compilations, *SymbolIndexMgr);
+  StdinLineReader Reader;
+  std::string Line;
+  while (Reader.readLine(Line)) {
+    if (StringRef(Line).trim().empty())
+      continue;
+    Server.handle(Line, llvm::outs());
+    llvm::outs() << "\n";
+    llvm::outs().flush();
+  }
+  return 0;
+}
+
 int includeFixerMain(int argc, const char **argv) {
   tooling::CommonOptionsParser options(argc, argv, IncludeFixerCategory);
   tooling::ClangTool tool(options.getCompilations(),
                           options.getSourcePathList());
 
   llvm::StringRef SourceFilePath = options.getSourcePathList().front();
+  if (ServerMode)
+    return runServer(options.getCompilations(), SourceFilePath);
+
   // In STDINMode, we override the file content with the <stdin> input.
   // Since `tool.mapVirtualFile` takes `StringRef`, we define `Code` outside of
   // the if-block so that `Code` is not released after the if-block.
@@ -299,47 +625,8 @@ int includeFixerMain(int argc, const char **argv) {
     IncludeFixerContext Context;
     yin >> Context;
 
-    const auto &HeaderInfos = Context.getHeaderInfos();
-    assert(!HeaderInfos.empty());
-    // We only accept one unique header.
-    // Check all elements in HeaderInfos have the same header.
-    bool IsUniqueHeader = std::equal(
-        HeaderInfos.begin()+1, HeaderInfos.end(), HeaderInfos.begin(),
-        [](const IncludeFixerContext::HeaderInfo &LHS,
-           const IncludeFixerContext::HeaderInfo &RHS) {
-          return LHS.Header == RHS.Header;
-        });
-    if (!IsUniqueHeader) {
-      errs() << "Expect exactly one unique header.\n";
-      return 1;
-    }
-
-    // If a header has multiple symbols, we won't add the missing namespace
-    // qualifiers because we don't know which one is exactly used.
-    //
-    // Check whether all elements in HeaderInfos have the same qualified name.
-    bool IsUniqueQualifiedName = std::equal(
-        HeaderInfos.begin() + 1, HeaderInfos.end(), HeaderInfos.begin(),
-        [](const IncludeFixerContext::HeaderInfo &LHS,
-           const IncludeFixerContext::HeaderInfo &RHS) {
-          return LHS.QualifiedName == RHS.QualifiedName;
-        });
-    auto InsertStyle = format::getStyle("file", Context.getFilePath(), Style);
-    if (!InsertStyle) {
-      llvm::errs() << llvm::toString(InsertStyle.takeError()) << "\n";
-      return 1;
-    }
-    auto Replacements = clang::include_fixer::createIncludeFixerReplacements(
-        Code->getBuffer(), Context, *InsertStyle,
-        /*AddQualifiers=*/IsUniqueQualifiedName);
-    if (!Replacements) {
-      errs() << "Failed to create replacements: "
-             << llvm::toString(Replacements.takeError()) << "\n";
-      return 1;
-    }
-
-    auto ChangedCode =
-        tooling::applyAllReplacements(Code->getBuffer(), *Replacements);
+    assert(!Context.getHeaderInfos().empty());
+    auto ChangedCode = insertHeader(Code->getBuffer(), Context);
     if (!ChangedCode) {
       llvm::errs() << llvm::toString(ChangedCode.takeError()) << "\n";
       return 1;
@@ -356,23 +643,8 @@ int includeFixerMain(int argc, const char **argv) {
 
   // Query symbol mode.
   if (!QuerySymbol.empty()) {
-    auto MatchedSymbols = SymbolIndexMgr->search(
-        QuerySymbol, /*IsNestedSearch=*/true, SourceFilePath);
-    for (auto &Symbol : MatchedSymbols) {
-      std::string HeaderPath = Symbol.getFilePath().str();
-      Symbol.SetFilePath(((HeaderPath[0] == '"' || HeaderPath[0] == '<')
-                              ? HeaderPath
-                              : "\"" + HeaderPath + "\""));
-    }
-
-    // We leave an empty symbol range as we don't know the range of the symbol
-    // being queried in this mode. include-fixer won't add namespace qualifiers
-    // if the symbol range is empty, which also fits this case.
-    IncludeFixerContext::QuerySymbolInfo Symbol;
-    Symbol.RawIdentifier = QuerySymbol;
-    auto Context =
-        IncludeFixerContext(SourceFilePath, {Symbol}, MatchedSymbols);
-    writeToJson(llvm::outs(), Context);
+    writeToJson(llvm::outs(),
+                querySymbol(*SymbolIndexMgr, QuerySymbol, SourceFilePath));
     return 0;
   }
 
@@ -6,6 +6,10 @@
 // RUN: not clang-apply-replacements %T/Inputs/conflict > %T/Inputs/conflict/output.txt 2>&1
 // RUN: diff -b %T/Inputs/conflict/output.txt %T/Inputs/conflict/expected.txt
 //
+// Check that conflicts are reported in the same order when running in parallel.
+// RUN: not clang-apply-replacements -j=4 %T/Inputs/conflict > %T/Inputs/conflict/output.txt 2>&1
+// RUN: diff -b %T/Inputs/conflict/output.txt %T/Inputs/conflict/expected.txt
+//
 // Check that the yaml files are *not* deleted after running clang-apply-replacements without remove-change-desc-files even when there is a failure.
 // RUN: ls -1 %T/Inputs/conflict | FileCheck %s --check-prefix=YAML
 //
@@ -0,0 +1,27 @@
+// RUN: clang-tidy %s -checks='-*,readability-function-size' -export-profile=%t.json -export-profile-trace=%t.trace.json -- 2>&1 | FileCheck --check-prefix=CHECK-OUTPUT %s
+// RUN: FileCheck -input-file=%t.json --check-prefix=CHECK-SUMMARY %s
+// RUN: FileCheck -input-file=%t.trace.json --check-prefix=CHECK-TRACE %s
+
+// The report is only printed with -enable-check-profile.
+// CHECK-OUTPUT-NOT: ---Wall Time---
+
+// CHECK-SUMMARY: "checks": {
+// CHECK-SUMMARY-NEXT: "readability-function-size": {"wall": {{[0-9.]+}}, "user": {{[0-9.]+}}, "sys": {{[0-9.]+}}}
+// CHECK-SUMMARY: "files": [
+// CHECK-SUMMARY: "file": "{{.*}}clang-tidy-export-profile.cpp",
+// CHECK-SUMMARY-NEXT: "thread": 0,
+// CHECK-SUMMARY-NEXT: "parse": {"wall":
+// CHECK-SUMMARY-NEXT: "match": {"wall":
+// CHECK-SUMMARY-NEXT: "checks": {
+// CHECK-SUMMARY-NEXT: "readability-function-size":
+// CHECK-SUMMARY: "cache": {"hits": 0, "misses": 0}
+
+// CHECK-TRACE: {"traceEvents": [
+// CHECK-TRACE-NEXT: {"name": "{{.*}}clang-tidy-export-profile.cpp", "cat": "file", "ph": "X", "pid": 1, "tid": 0, "ts": 0, "dur": {{[0-9]+}}},
+// CHECK-TRACE-NEXT: {"name": "parse", "cat": "phase", "ph": "X", "pid": 1, "tid": 0, "ts": 0, "dur": {{[0-9]+}}},
+// CHECK-TRACE-NEXT: {"name": "match", "cat": "phase", "ph": "X", "pid": 1, "tid": 0, "ts": {{[0-9]+}}, "dur": {{[0-9]+}}, "args": {"readability-function-size": {{[0-9]+}}}}
+
+class A {
+  A() {}
+  ~A() {}
+};
@@ -0,0 +1,45 @@
+// RUN: rm -rf %T/result-cache-test %T/result-cache %T/result-cache-db
+// RUN: mkdir -p %T/result-cache-test/a %T/result-cache-test/b %T/result-cache-test/include
+// RUN: echo 'int *AA = 0;' > %T/result-cache-test/a/a.cpp
+// RUN: echo 'int *HP = 0;' > %T/result-cache-test/include/header.h
+// RUN: echo '#include "header.h"' > %T/result-cache-test/b/d.cpp
+// RUN: mkdir -p %T/result-cache-db
+// RUN: sed 's|test_dir|%/T/result-cache-test|g' %S/Inputs/compilation-database/template.json > %T/result-cache-db/compile_commands.json
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/result-cache-db %T/result-cache-test/a/a.cpp %T/result-cache-test/b/d.cpp -header-filter=.* -cache-dir=%T/result-cache -enable-check-profile 2> %T/result-cache-cold.err | FileCheck %s -check-prefix=CHECK-COLD
+// RUN: FileCheck -input-file=%T/result-cache-cold.err %s -check-prefix=CHECK-COLD-STATS
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/result-cache-db %T/result-cache-test/a/a.cpp %T/result-cache-test/b/d.cpp -header-filter=.* -cache-dir=%T/result-cache -enable-check-profile 2> %T/result-cache-warm.err | FileCheck %s -check-prefix=CHECK-WARM
+// RUN: FileCheck -input-file=%T/result-cache-warm.err %s -check-prefix=CHECK-WARM-STATS
+// RUN: echo 'int *HQ = 0;' > %T/result-cache-test/include/header.h
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/result-cache-db %T/result-cache-test/a/a.cpp %T/result-cache-test/b/d.cpp -header-filter=.* -cache-dir=%T/result-cache -enable-check-profile 2> %T/result-cache-changed.err | FileCheck %s -check-prefix=CHECK-CHANGED
+// RUN: FileCheck -input-file=%T/result-cache-changed.err %s -check-prefix=CHECK-CHANGED-STATS
+// RUN: echo 'int *HS = 0;' > %T/result-cache-test/b/header.h
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/result-cache-db %T/result-cache-test/a/a.cpp %T/result-cache-test/b/d.cpp -header-filter=.* -cache-dir=%T/result-cache -enable-check-profile 2> %T/result-cache-shadowed.err | FileCheck %s -check-prefix=CHECK-SHADOWED
+// RUN: FileCheck -input-file=%T/result-cache-shadowed.err %s -check-prefix=CHECK-SHADOWED-STATS
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr,misc-unused-parameters -p %T/result-cache-db %T/result-cache-test/a/a.cpp %T/result-cache-test/b/d.cpp -header-filter=.* -cache-dir=%T/result-cache -enable-check-profile 2> %T/result-cache-config.err | FileCheck %s -check-prefix=CHECK-CONFIG
+// RUN: FileCheck -input-file=%T/result-cache-config.err %s -check-prefix=CHECK-CONFIG-STATS
+
+// CHECK-COLD: a.cpp:1:11: warning: use nullptr
+// CHECK-COLD: header.h:1:11: warning: use nullptr
+// CHECK-COLD-STATS: Result cache: 0 hits, 2 misses (0.0% hit rate)
+
+// Cached results are reported the same way.
+// CHECK-WARM: a.cpp:1:11: warning: use nullptr
+// CHECK-WARM: header.h:1:11: warning: use nullptr
+// CHECK-WARM-NEXT: int *HP = 0;
+// CHECK-WARM-STATS: Result cache: 2 hits, 0 misses (100.0% hit rate)
+
+// Changing an included file invalidates the results of the including file.
+// CHECK-CHANGED: a.cpp:1:11: warning: use nullptr
+// CHECK-CHANGED: header.h:1:11: warning: use nullptr
+// CHECK-CHANGED-NEXT: int *HQ = 0;
+// CHECK-CHANGED-STATS: Result cache: 1 hits, 1 misses (50.0% hit rate)
+
+// So does adding a header that is found before the one used so far.
+// CHECK-SHADOWED: a.cpp:1:11: warning: use nullptr
+// CHECK-SHADOWED: header.h:1:11: warning: use nullptr
+// CHECK-SHADOWED-NEXT: int *HS = 0;
+// CHECK-SHADOWED-STATS: Result cache: 1 hits, 1 misses (50.0% hit rate)
+
+// So does changing the configuration.
+// CHECK-CONFIG: a.cpp:1:11: warning: use nullptr
+// CHECK-CONFIG-STATS: Result cache: 0 hits, 2 misses (0.0% hit rate)
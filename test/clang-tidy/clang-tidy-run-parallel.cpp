@@ -0,0 +1,36 @@
+// RUN: mkdir -p %T/parallel-test/include
+// RUN: mkdir -p %T/parallel-test/a
+// RUN: mkdir -p %T/parallel-test/b
+// RUN: echo 'int *AA = 0;' > %T/parallel-test/a/a.cpp
+// RUN: echo 'int *AB = 0;' > %T/parallel-test/a/b.cpp
+// RUN: echo 'int *BB = 0;' > %T/parallel-test/b/b.cpp
+// RUN: echo 'int *BC = 0;' > %T/parallel-test/b/c.cpp
+// RUN: echo 'int *HP = 0;' > %T/parallel-test/include/header.h
+// RUN: echo '#include "header.h"' > %T/parallel-test/b/d.cpp
+// RUN: mkdir -p %T/parallel-db
+// RUN: sed 's|test_dir|%/T/parallel-test|g' %S/Inputs/compilation-database/template.json > %T/parallel-db/compile_commands.json
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/parallel-db %T/parallel-test/a/a.cpp %T/parallel-test/a/b.cpp %T/parallel-test/b/b.cpp %T/parallel-test/b/c.cpp %T/parallel-test/b/d.cpp -header-filter=.* -j 4 | FileCheck %s -check-prefix=CHECK-MESSAGES
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr -p %T/parallel-db %T/parallel-test/a/a.cpp %T/parallel-test/a/b.cpp %T/parallel-test/b/b.cpp %T/parallel-test/b/c.cpp %T/parallel-test/b/d.cpp -header-filter=.* -j 4 -fix
+// RUN: FileCheck -input-file=%T/parallel-test/a/a.cpp %s -check-prefix=CHECK-FIX1
+// RUN: FileCheck -input-file=%T/parallel-test/a/b.cpp %s -check-prefix=CHECK-FIX2
+// RUN: FileCheck -input-file=%T/parallel-test/b/b.cpp %s -check-prefix=CHECK-FIX3
+// RUN: FileCheck -input-file=%T/parallel-test/b/c.cpp %s -check-prefix=CHECK-FIX4
+// RUN: FileCheck -input-file=%T/parallel-test/include/header.h %s -check-prefix=CHECK-FIX5
+
+// The diagnostics are reported in the order of the input files.
+// CHECK-MESSAGES: a.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-NEXT: int *AA = 0;
+// CHECK-MESSAGES: b.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-NEXT: int *AB = 0;
+// CHECK-MESSAGES: b.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-NEXT: int *BB = 0;
+// CHECK-MESSAGES: c.cpp:1:11: warning: use nullptr
+// CHECK-MESSAGES-NEXT: int *BC = 0;
+// CHECK-MESSAGES: header.h:1:11: warning: use nullptr
+// CHECK-MESSAGES-NEXT: int *HP = 0;
+
+// CHECK-FIX1: int *AA = nullptr;
+// CHECK-FIX2: int *AB = nullptr;
+// CHECK-FIX3: int *BB = nullptr;
+// CHECK-FIX4: int *BC = nullptr;
+// CHECK-FIX5: int *HP = nullptr;
@@ -0,0 +1,42 @@
+// RUN: rm -rf %T/share-preambles-test
+// RUN: mkdir -p %T/share-preambles-test/include
+// RUN: echo 'int *HP = 0;' > %T/share-preambles-test/include/header.h
+// RUN: printf '#include "header.h"\nint *CC = 0;\n' > %T/share-preambles-test/c.cpp
+// RUN: printf '#include "header.h"\nint *DD = 0;\n' > %T/share-preambles-test/d.cpp
+// RUN: printf '#include "header.h"\n#define VALUE 1\nint *EE = 0;\n#define VALUE 2\n' > %T/share-preambles-test/e.cpp
+// RUN: printf '#include "header.h"\n#define VALUE 1\nint *FF = 0;\n#define VALUE 2\n' > %T/share-preambles-test/f.cpp
+// RUN: printf '#include "header.h"\nint *GG = 0;\n' > %T/share-preambles-test/g.cpp
+// RUN: echo '' > %T/share-preambles-test/include/stdio.h
+// RUN: printf '#include "stdio.h"\nint *HH = 0;\n' > %T/share-preambles-test/h.cpp
+// RUN: printf '#include "stdio.h"\nint *II = 0;\n' > %T/share-preambles-test/i.cpp
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr,clang-diagnostic-macro-redefined %T/share-preambles-test/c.cpp %T/share-preambles-test/d.cpp %T/share-preambles-test/e.cpp %T/share-preambles-test/f.cpp %T/share-preambles-test/g.cpp -header-filter=.* -share-preambles -enable-check-profile -- -I%T/share-preambles-test/include 2> %T/share-preambles.err | FileCheck %s
+// RUN: FileCheck -input-file=%T/share-preambles.err %s -check-prefix=CHECK-STATS
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr,clang-diagnostic-macro-redefined %T/share-preambles-test/c.cpp %T/share-preambles-test/d.cpp %T/share-preambles-test/e.cpp %T/share-preambles-test/f.cpp %T/share-preambles-test/g.cpp -header-filter=.* -share-preambles -j 2 -- -I%T/share-preambles-test/include | FileCheck %s
+// RUN: clang-tidy --checks=-*,modernize-use-nullptr,modernize-deprecated-headers %T/share-preambles-test/h.cpp %T/share-preambles-test/i.cpp -share-preambles -enable-check-profile -- -I%T/share-preambles-test/include 2> %T/share-preambles-callbacks.err | FileCheck %s -check-prefix=CHECK-CALLBACKS
+// RUN: FileCheck -input-file=%T/share-preambles-callbacks.err %s -check-prefix=CHECK-CALLBACKS-STATS
+
+// The checks see the declarations of the shared preamble.
+// CHECK-DAG: c.cpp:2:11: warning: use nullptr
+// CHECK-DAG: d.cpp:2:11: warning: use nullptr
+// CHECK-DAG: g.cpp:2:11: warning: use nullptr
+// CHECK-DAG: header.h:1:11: warning: use nullptr
+
+// The macros defined in the preamble region are reported in their own file:
+// these preambles are not shared.
+// CHECK-DAG: e.cpp:3:11: warning: use nullptr
+// CHECK-DAG: e.cpp:4:9: warning: 'VALUE' macro redefined
+// CHECK-DAG: e.cpp:2:9: note: previous definition is here
+// CHECK-DAG: f.cpp:3:11: warning: use nullptr
+// CHECK-DAG: f.cpp:4:9: warning: 'VALUE' macro redefined
+// CHECK-DAG: f.cpp:2:9: note: previous definition is here
+
+// c.cpp is parsed without a preamble, as it is not known yet whether the
+// checks use preprocessor callbacks. g.cpp uses the preamble built for d.cpp.
+// CHECK-STATS: Shared preambles: 1 built, 1 reused
+
+// Checks using preprocessor callbacks see the directives of every file, the
+// preambles are not shared.
+// CHECK-CALLBACKS: h.cpp:1:10: warning: inclusion of deprecated C++ header 'stdio.h'
+// CHECK-CALLBACKS: i.cpp:1:10: warning: inclusion of deprecated C++ header 'stdio.h'
+// CHECK-CALLBACKS-STATS: warning: preambles were not shared for files whose checks use preprocessor callbacks
+// CHECK-CALLBACKS-STATS-NOT: Shared preambles
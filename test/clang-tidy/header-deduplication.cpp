@@ -0,0 +1,10 @@
+// RUN: mkdir -p %T/header-deduplication
+// RUN: echo 'int *HP = 0;' > %T/header-deduplication/header.h
+// RUN: echo '#include "header.h"' > %T/header-deduplication/a.cpp
+// RUN: echo '#include "header.h"' > %T/header-deduplication/b.cpp
+// RUN: echo '#include "header.h"' > %T/header-deduplication/c.cpp
+// RUN: clang-tidy -checks=-*,modernize-use-nullptr -header-filter=.* %T/header-deduplication/a.cpp %T/header-deduplication/b.cpp %T/header-deduplication/c.cpp -- | FileCheck %s -implicit-check-not='{{warning:}}'
+// RUN: clang-tidy -checks=-*,modernize-use-nullptr -header-filter=.* %T/header-deduplication/a.cpp %T/header-deduplication/b.cpp %T/header-deduplication/c.cpp -j 2 -- | FileCheck %s -implicit-check-not='{{warning:}}'
+
+// A header included by several translation units is reported once.
+// CHECK: header.h:1:11: warning: use nullptr
@@ -0,0 +1,9 @@
+// RUN: include-fixer-db-converter %p/Inputs/fake_yaml_db.yaml -o %t.idx
+// RUN: sed -e 's#//.*$##' %s > %t.cpp
+// RUN: clang-include-fixer -db=binary -input=%t.idx %t.cpp --
+// RUN: FileCheck %s -input-file=%t.cpp
+
+// CHECK: #include "foo.h"
+// CHECK: b::a::foo f;
+
+b::a::foo f;
@@ -0,0 +1,16 @@
+// RUN: echo '{"Command": "fix", "FilePath": "%/t.cpp", "Code": "foo f;\n"}' > %t.in
+// RUN: echo '{"Command": "fix", "FilePath": "%/t.cpp", "Code": "bar b;\n"}' >> %t.in
+// RUN: echo '{"Command": "fix", "FilePath": "%/t.cpp", "Code": ""}' >> %t.in
+// RUN: echo '{"Command": "query", "FilePath": "%/t.cpp", "Symbol": "foo"}' >> %t.in
+// RUN: echo '{"Command": "query", "FilePath": "%/t.cpp"}' >> %t.in
+// RUN: echo '{"Command": "insert", "Code": "foo f;\n", "Context": {"FilePath": "%/t.cpp", "QuerySymbolInfos": [{"RawIdentifier": "foo", "Range": {"Offset": 0, "Length": 3}}], "HeaderInfos": [{"Header": "\"foo.h\"", "QualifiedName": "foo"}]}}' >> %t.in
+// RUN: echo '{"Command": "frobnicate"}' >> %t.in
+// RUN: clang-include-fixer -server -db=fixed -input='foo= "foo.h","bar.h";bar="bar.h"' %t.cpp -- < %t.in | FileCheck %s
+
+// CHECK:      {"FilePath": "{{.*}}.cpp", "QuerySymbolInfos": [{"RawIdentifier": "foo", "Range": {"Offset": 0, "Length": 3}}], "HeaderInfos": [{"Header": "\"foo.h\"", "QualifiedName": "foo"}, {"Header": "\"bar.h\"", "QualifiedName": "foo"}]}
+// CHECK-NEXT: {"FilePath": "{{.*}}.cpp", "QuerySymbolInfos": [{"RawIdentifier": "bar", "Range": {"Offset": 0, "Length": 3}}], "HeaderInfos": [{"Header": "\"bar.h\"", "QualifiedName": "bar"}]}
+// CHECK-NEXT: {"FilePath": "{{.*}}.cpp", "QuerySymbolInfos": [], "HeaderInfos": []}
+// CHECK-NEXT: {"FilePath": "{{.*}}.cpp", "QuerySymbolInfos": [{"RawIdentifier": "foo", "Range": {"Offset": 0, "Length": 0}}], "HeaderInfos": [{"Header": "\"foo.h\"", "QualifiedName": "foo"}, {"Header": "\"bar.h\"", "QualifiedName": "foo"}]}
+// CHECK-NEXT: {"Error": "Missing Symbol."}
+// CHECK-NEXT: {"Code": "#include \"foo.h\"\nfoo f;\n"}
+// CHECK-NEXT: {"Error": "Unknown command: frobnicate"}
@@ -10,6 +10,9 @@
 
 #include "clang-apply-replacements/Tooling/ApplyReplacements.h"
 #include "clang/Format/Format.h"
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "gtest/gtest.h"
 
 using namespace clang::replace;
@@ -56,5 +59,91 @@ TEST(ApplyReplacementsTest, mergeDiagnosticsWithNoFixes) {
   EXPECT_TRUE(ReplacementsMap.empty());
 }
 
+static void writeFile(const Twine &Path, StringRef Contents) {
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Path.str(), EC, llvm::sys::fs::F_None);
+  ASSERT_FALSE(EC) << EC.message();
+  OS << Contents;
+}
+
+// Test that the replacements of many change description files are grouped by
+// file, even when the file is spelled differently.
+TEST(ApplyReplacementsTest, collectReplacementsByFile) {
+  SmallString<128> Dir;
+  ASSERT_FALSE(
+      llvm::sys::fs::createUniqueDirectory("apply-replacements-test", Dir));
+  SmallString<128> Source(Dir), OtherSpelling(Dir);
+  llvm::sys::path::append(Source, "source.cpp");
+  llvm::sys::path::append(OtherSpelling, ".", "source.cpp");
+  writeFile(Source, "0123456789\n");
+
+  for (unsigned I = 0; I < 10; ++I) {
+    TranslationUnitReplacements TU;
+    TU.MainSourceFile = "source.cpp";
+    // Insert backwards, to check that the replacements are sorted.
+    TU.Replacements.emplace_back(I % 2 ? Source : OtherSpelling, 9 - I, 0,
+                                 "x");
+    std::string Yaml;
+    llvm::raw_string_ostream OS(Yaml);
+    llvm::yaml::Output YOut(OS);
+    YOut << TU;
+    writeFile(Dir + "/fixes" + Twine(I) + ".yaml", OS.str());
+  }
+  {
+    TranslationUnitReplacements TU;
+    TU.MainSourceFile = "source.cpp";
+    TU.Replacements.emplace_back(Dir + "/missing.cpp", 0, 0, "x");
+    std::string Yaml;
+    llvm::raw_string_ostream OS(Yaml);
+    llvm::yaml::Output YOut(OS);
+    YOut << TU;
+    writeFile(Dir + "/missing.yaml", OS.str());
+  }
+  writeFile(Dir + "/invalid.yaml", "foo: bar\n");
+
+  std::vector<FileReplacements> Files;
+  TUReplacementFiles TUFiles;
+  std::string CollectErrors;
+  llvm::raw_string_ostream CollectErrorsOS(CollectErrors);
+  EXPECT_FALSE(
+      collectReplacementsByFile(Dir, Files, TUFiles, 4, CollectErrorsOS));
+  EXPECT_EQ(("Described file '" + Dir + "/missing.cpp' doesn't exist. "
+             "Ignoring...\n")
+                .str(),
+            CollectErrorsOS.str());
+  EXPECT_EQ(12u, TUFiles.size());
+  ASSERT_EQ(1u, Files.size());
+  EXPECT_EQ(OtherSpelling, Files[0].FilePath);
+  ASSERT_EQ(10u, Files[0].Replacements.size());
+  for (unsigned I = 0; I < 10; ++I)
+    EXPECT_EQ(I, Files[0].Replacements[I].getOffset());
+
+  std::vector<AtomicChange> Changes;
+  std::string Errors;
+  llvm::raw_string_ostream ErrorsOS(Errors);
+  EXPECT_TRUE(mergeAndDeduplicate(Files[0], Changes, ErrorsOS));
+  EXPECT_EQ("", ErrorsOS.str());
+  IntrusiveRefCntPtr<DiagnosticOptions> DiagOpts(new DiagnosticOptions());
+  DiagnosticsEngine Diagnostics(
+      IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()), DiagOpts.get());
+  llvm::Expected<std::string> NewCode = applyChanges(
+      Files[0].FilePath, Changes, ApplyChangesSpec(), Diagnostics);
+  ASSERT_TRUE(static_cast<bool>(NewCode));
+  EXPECT_EQ("x0x1x2x3x4x5x6x7x8x9\n", *NewCode);
+
+  // Zero threads are treated as one.
+  std::vector<FileReplacements> SerialFiles;
+  TUReplacementFiles SerialTUFiles;
+  std::string SerialErrors;
+  llvm::raw_string_ostream SerialErrorsOS(SerialErrors);
+  EXPECT_FALSE(collectReplacementsByFile(Dir, SerialFiles, SerialTUFiles, 0,
+                                         SerialErrorsOS));
+  EXPECT_EQ(CollectErrorsOS.str(), SerialErrorsOS.str());
+  ASSERT_EQ(1u, SerialFiles.size());
+  EXPECT_EQ(Files[0].Replacements, SerialFiles[0].Replacements);
+
+  llvm::sys::fs::remove_directories(Dir);
+}
+
 } // end namespace tooling
 } // end namespace clang
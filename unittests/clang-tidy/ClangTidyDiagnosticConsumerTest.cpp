@@ -1,94 +1,183 @@
-#include "ClangTidy.h"
-#include "ClangTidyTest.h"
-#include "gtest/gtest.h"
-
-namespace clang {
-namespace tidy {
-namespace test {
-
-class TestCheck : public ClangTidyCheck {
-public:
-  TestCheck(StringRef Name, ClangTidyContext *Context)
-      : ClangTidyCheck(Name, Context) {}
-  void registerMatchers(ast_matchers::MatchFinder *Finder) override {
-    Finder->addMatcher(ast_matchers::varDecl().bind("var"), this);
-  }
-  void check(const ast_matchers::MatchFinder::MatchResult &Result) override {
-    const auto *Var = Result.Nodes.getNodeAs<VarDecl>("var");
-    // Add diagnostics in the wrong order.
-    diag(Var->getLocation(), "variable");
-    diag(Var->getTypeSpecStartLoc(), "type specifier");
-  }
-};
-
-TEST(ClangTidyDiagnosticConsumer, SortsErrors) {
-  std::vector<ClangTidyError> Errors;
-  runCheckOnCode<TestCheck>("int a;", &Errors);
-  EXPECT_EQ(2ul, Errors.size());
-  EXPECT_EQ("type specifier", Errors[0].Message.Message);
-  EXPECT_EQ("variable", Errors[1].Message.Message);
-}
-
-TEST(GlobList, Empty) {
-  GlobList Filter("");
-
-  EXPECT_TRUE(Filter.contains(""));
-  EXPECT_FALSE(Filter.contains("aaa"));
-}
-
-TEST(GlobList, Nothing) {
-  GlobList Filter("-*");
-
-  EXPECT_FALSE(Filter.contains(""));
-  EXPECT_FALSE(Filter.contains("a"));
-  EXPECT_FALSE(Filter.contains("-*"));
-  EXPECT_FALSE(Filter.contains("-"));
-  EXPECT_FALSE(Filter.contains("*"));
-}
-
-TEST(GlobList, Everything) {
-  GlobList Filter("*");
-
-  EXPECT_TRUE(Filter.contains(""));
-  EXPECT_TRUE(Filter.contains("aaaa"));
-  EXPECT_TRUE(Filter.contains("-*"));
-  EXPECT_TRUE(Filter.contains("-"));
-  EXPECT_TRUE(Filter.contains("*"));
-}
-
-TEST(GlobList, Simple) {
-  GlobList Filter("aaa");
-
-  EXPECT_TRUE(Filter.contains("aaa"));
-  EXPECT_FALSE(Filter.contains(""));
-  EXPECT_FALSE(Filter.contains("aa"));
-  EXPECT_FALSE(Filter.contains("aaaa"));
-  EXPECT_FALSE(Filter.contains("bbb"));
-}
-
-TEST(GlobList, WhitespacesAtBegin) {
-  GlobList Filter("-*,   a.b.*");
-
-  EXPECT_TRUE(Filter.contains("a.b.c"));
-  EXPECT_FALSE(Filter.contains("b.c"));
-}
-
-TEST(GlobList, Complex) {
-  GlobList Filter("*,-a.*, -b.*, \r  \n  a.1.* ,-a.1.A.*,-..,-...,-..+,-*$, -*qwe* ");
-
-  EXPECT_TRUE(Filter.contains("aaa"));
-  EXPECT_TRUE(Filter.contains("qqq"));
-  EXPECT_FALSE(Filter.contains("a."));
-  EXPECT_FALSE(Filter.contains("a.b"));
-  EXPECT_FALSE(Filter.contains("b."));
-  EXPECT_FALSE(Filter.contains("b.b"));
-  EXPECT_TRUE(Filter.contains("a.1.b"));
-  EXPECT_FALSE(Filter.contains("a.1.A.a"));
-  EXPECT_FALSE(Filter.contains("qwe"));
-  EXPECT_FALSE(Filter.contains("asdfqweasdf"));
-  EXPECT_TRUE(Filter.contains("asdfqwEasdf"));
-}
-
-} // namespace test
-} // namespace tidy
-} // namespace clang
+#include "ClangTidy.h"
+#include "ClangTidyTest.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace tidy {
+namespace test {
+
+class TestCheck : public ClangTidyCheck {
+public:
+  TestCheck(StringRef Name, ClangTidyContext *Context)
+      : ClangTidyCheck(Name, Context) {}
+  void registerMatchers(ast_matchers::MatchFinder *Finder) override {
+    Finder->addMatcher(ast_matchers::varDecl().bind("var"), this);
+  }
+  void check(const ast_matchers::MatchFinder::MatchResult &Result) override {
+    const auto *Var = Result.Nodes.getNodeAs<VarDecl>("var");
+    // Add diagnostics in the wrong order.
+    diag(Var->getLocation(), "variable");
+    diag(Var->getTypeSpecStartLoc(), "type specifier");
+  }
+};
+
+TEST(ClangTidyDiagnosticConsumer, SortsErrors) {
+  std::vector<ClangTidyError> Errors;
+  runCheckOnCode<TestCheck>("int a;", &Errors);
+  EXPECT_EQ(2ul, Errors.size());
+  EXPECT_EQ("type specifier", Errors[0].Message.Message);
+  EXPECT_EQ("variable", Errors[1].Message.Message);
+}
+
+TEST(GlobList, Empty) {
+  GlobList Filter("");
+
+  EXPECT_TRUE(Filter.contains(""));
+  EXPECT_FALSE(Filter.contains("aaa"));
+}
+
+TEST(GlobList, Nothing) {
+  GlobList Filter("-*");
+
+  EXPECT_FALSE(Filter.contains(""));
+  EXPECT_FALSE(Filter.contains("a"));
+  EXPECT_FALSE(Filter.contains("-*"));
+  EXPECT_FALSE(Filter.contains("-"));
+  EXPECT_FALSE(Filter.contains("*"));
+}
+
+TEST(GlobList, Everything) {
+  GlobList Filter("*");
+
+  EXPECT_TRUE(Filter.contains(""));
+  EXPECT_TRUE(Filter.contains("aaaa"));
+  EXPECT_TRUE(Filter.contains("-*"));
+  EXPECT_TRUE(Filter.contains("-"));
+  EXPECT_TRUE(Filter.contains("*"));
+}
+
+TEST(GlobList, Simple) {
+  GlobList Filter("aaa");
+
+  EXPECT_TRUE(Filter.contains("aaa"));
+  EXPECT_FALSE(Filter.contains(""));
+  EXPECT_FALSE(Filter.contains("aa"));
+  EXPECT_FALSE(Filter.contains("aaaa"));
+  EXPECT_FALSE(Filter.contains("bbb"));
+}
+
+TEST(GlobList, WhitespacesAtBegin) {
+  GlobList Filter("-*,   a.b.*");
+
+  EXPECT_TRUE(Filter.contains("a.b.c"));
+  EXPECT_FALSE(Filter.contains("b.c"));
+}
+
+TEST(GlobList, Complex) {
+  GlobList Filter("*,-a.*, -b.*, \r  \n  a.1.* ,-a.1.A.*,-..,-...,-..+,-*$, -*qwe* ");
+
+  EXPECT_TRUE(Filter.contains("aaa"));
+  EXPECT_TRUE(Filter.contains("qqq"));
+  EXPECT_FALSE(Filter.contains("a."));
+  EXPECT_FALSE(Filter.contains("a.b"));
+  EXPECT_FALSE(Filter.contains("b."));
+  EXPECT_FALSE(Filter.contains("b.b"));
+  EXPECT_TRUE(Filter.contains("a.1.b"));
+  EXPECT_FALSE(Filter.contains("a.1.A.a"));
+  EXPECT_FALSE(Filter.contains("qwe"));
+  EXPECT_FALSE(Filter.contains("asdfqweasdf"));
+  EXPECT_TRUE(Filter.contains("asdfqwEasdf"));
+}
+
+TEST(NolintDirectives, NoDirectives) {
+  NolintDirectives Directives("int a;\nint b;\n");
+
+  EXPECT_FALSE(Directives.suppresses(0, "a"));
+  EXPECT_FALSE(Directives.suppresses(8, "a"));
+}
+
+TEST(NolintDirectives, SameLine) {
+  StringRef Code = "int a; int b; // NOLINT(x, y)\n"
+                   "int c; // NOLINT\n"
+                   "int d;\n";
+  NolintDirectives Directives(Code);
+
+  EXPECT_TRUE(Directives.suppresses(Code.find("a;"), "x"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("b;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("b;"), "z"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("c;"), "z"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("d;"), "z"));
+  // Only a NOLINT after the diagnostic applies to it.
+  EXPECT_FALSE(Directives.suppresses(Code.find("x,"), "x"));
+}
+
+TEST(NolintDirectives, NextLine) {
+  StringRef Code = "// NOLINTNEXTLINE(x)\n"
+                   "int a;\n"
+                   "int b;\n"
+                   "// NOLINTNEXTLINE(missing-bracket\n"
+                   "int c;\n";
+  NolintDirectives Directives(Code);
+
+  EXPECT_TRUE(Directives.suppresses(Code.find("a;"), "x"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("a;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("b;"), "x"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("c;"), "y"));
+  // NOLINTNEXTLINE doesn't apply to its own line.
+  EXPECT_FALSE(Directives.suppresses(0, "x"));
+}
+
+TEST(NolintDirectives, BeginEnd) {
+  StringRef Code = "int a;\n"
+                   "// NOLINTBEGIN(x)\n"
+                   "// NOLINTBEGIN\n"
+                   "int b;\n"
+                   "// NOLINTEND\n"
+                   "int c;\n"
+                   "// NOLINTEND(x)\n"
+                   "int d;\n"
+                   "// NOLINTBEGIN(y)\n"
+                   "int e;\n"
+                   "// NOLINTEND(z)\n"
+                   "int f;\n";
+  NolintDirectives Directives(Code);
+
+  EXPECT_FALSE(Directives.suppresses(Code.find("a;"), "x"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("b;"), "y"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("c;"), "x"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("c;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("d;"), "x"));
+  // Unmatched NOLINTBEGIN and NOLINTEND have no effect.
+  EXPECT_FALSE(Directives.suppresses(Code.find("e;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("f;"), "y"));
+}
+
+TEST(NolintDirectives, EnclosingRange) {
+  StringRef Code = "// NOLINTBEGIN(x)\n"
+                   "// NOLINTBEGIN(y)\n"
+                   "int a;\n"
+                   "// NOLINTEND(y)\n"
+                   "// NOLINTBEGIN(z)\n"
+                   "int b;\n"
+                   "// NOLINTEND(z)\n"
+                   "int c;\n"
+                   "// NOLINTEND(x)\n"
+                   "// NOLINTBEGIN(y)\n"
+                   "int d;\n"
+                   "// NOLINTEND(y)\n";
+  NolintDirectives Directives(Code);
+
+  EXPECT_TRUE(Directives.suppresses(Code.find("a;"), "x"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("a;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("a;"), "z"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("b;"), "z"));
+  // The ranges closed before don't hide the enclosing one.
+  EXPECT_TRUE(Directives.suppresses(Code.find("c;"), "x"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("c;"), "y"));
+  EXPECT_FALSE(Directives.suppresses(Code.find("d;"), "x"));
+  EXPECT_TRUE(Directives.suppresses(Code.find("d;"), "y"));
+}
+
+} // namespace test
+} // namespace tidy
+} // namespace clang
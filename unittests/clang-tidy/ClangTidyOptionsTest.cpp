@@ -1,6 +1,7 @@
 #include "ClangTidyOptions.h"
 #include "gtest/gtest.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
 
 namespace clang {
 namespace tidy {
@@ -99,6 +100,73 @@ TEST(ParseConfiguration, MergeConfigurations) {
             llvm::join(Options.ExtraArgsBefore->begin(),
                        Options.ExtraArgsBefore->end(), ","));
 }
+
+class FileOptionsProviderTest : public ::testing::Test {
+protected:
+  FileOptionsProviderTest() : FS(new vfs::InMemoryFileSystem) {
+    DefaultOptions.User = "default";
+  }
+
+  void addConfig(StringRef Directory, StringRef User) {
+    FS->addFile(Directory + "/.clang-tidy", 0,
+                llvm::MemoryBuffer::getMemBufferCopy(("User: " + User).str()));
+  }
+
+  std::string getUser(FileOptionsProvider &Provider, StringRef File) {
+    return *Provider.getOptions(File).User;
+  }
+
+  llvm::IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS;
+  ClangTidyOptions DefaultOptions;
+};
+
+TEST_F(FileOptionsProviderTest, ClosestConfigFile) {
+  addConfig("/project", "project");
+  addConfig("/project/lib", "lib");
+  FS->addFile("/project/lib/sub/a.cpp", 0,
+              llvm::MemoryBuffer::getMemBuffer(""));
+  FS->addFile("/project/b.cpp", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  FS->addFile("/other/c.cpp", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  FileOptionsProvider Provider(ClangTidyGlobalOptions(), DefaultOptions,
+                               ClangTidyOptions(), FS);
+
+  EXPECT_EQ("lib", getUser(Provider, "/project/lib/sub/a.cpp"));
+  EXPECT_EQ("project", getUser(Provider, "/project/b.cpp"));
+  EXPECT_EQ("default", getUser(Provider, "/other/c.cpp"));
+
+  std::vector<ClangTidyOptionsProvider::OptionsSource> RawOptions =
+      Provider.getRawOptions("/project/lib/sub/a.cpp");
+  ASSERT_EQ(3u, RawOptions.size());
+  EXPECT_EQ("/project/lib/.clang-tidy", RawOptions[1].second);
+}
+
+TEST_F(FileOptionsProviderTest, OverrideOptions) {
+  addConfig("/project", "project");
+  FS->addFile("/project/a.cpp", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  ClangTidyOptions OverrideOptions;
+  OverrideOptions.User = "override";
+  FileOptionsProvider Provider(ClangTidyGlobalOptions(), DefaultOptions,
+                               OverrideOptions, FS);
+  EXPECT_EQ("override", getUser(Provider, "/project/a.cpp"));
+}
+
+TEST_F(FileOptionsProviderTest, Revalidation) {
+  addConfig("/project", "project");
+  FS->addFile("/project/lib/a.cpp", 0, llvm::MemoryBuffer::getMemBuffer(""));
+  FileOptionsProvider Cached(ClangTidyGlobalOptions(), DefaultOptions,
+                             ClangTidyOptions(), FS);
+  FileOptionsProvider Uncached(ClangTidyGlobalOptions(), DefaultOptions,
+                               ClangTidyOptions(), FS);
+  Uncached.setRevalidationInterval(std::chrono::milliseconds(0));
+  EXPECT_EQ("project", getUser(Cached, "/project/lib/a.cpp"));
+  EXPECT_EQ("project", getUser(Uncached, "/project/lib/a.cpp"));
+
+  // New configuration files are found once the directory is checked again.
+  addConfig("/project/lib", "lib");
+  EXPECT_EQ("project", getUser(Cached, "/project/lib/a.cpp"));
+  EXPECT_EQ("lib", getUser(Uncached, "/project/lib/a.cpp"));
+}
+
 } // namespace test
 } // namespace tidy
 } // namespace clang
@@ -0,0 +1,130 @@
+//===-- CancellationTests.cpp -----------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Cancellation.h"
+#include "JSONRPCDispatcher.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <thread>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+TEST(CancellationTest, CancelableTask) {
+  EXPECT_FALSE(isCancelled());
+
+  auto Task = cancelableTask();
+  EXPECT_FALSE(isCancelled(Task.first));
+  {
+    WithContext Cancelable(Task.first.clone());
+    EXPECT_FALSE(isCancelled());
+    Task.second();
+    EXPECT_TRUE(isCancelled());
+  }
+  EXPECT_FALSE(isCancelled());
+  EXPECT_TRUE(isCancelled(Task.first));
+}
+
+TEST(CancellationTest, NestedTasks) {
+  auto Outer = cancelableTask();
+  WithContext OuterCtx(std::move(Outer.first));
+  auto Inner = cancelableTask();
+
+  Inner.second();
+  EXPECT_TRUE(isCancelled(Inner.first));
+  EXPECT_FALSE(isCancelled());
+
+  auto Other = cancelableTask();
+  Outer.second();
+  EXPECT_TRUE(isCancelled(Other.first));
+}
+
+TEST(CancellationTest, CancelFromAnotherThread) {
+  auto Task = cancelableTask();
+  std::thread Canceller(Task.second);
+  Canceller.join();
+  EXPECT_TRUE(isCancelled(Task.first));
+}
+
+TEST(CancellationTest, CancelledError) {
+  auto Err = cancelledError();
+  EXPECT_EQ(llvm::errorToErrorCode(std::move(Err)),
+            std::make_error_code(std::errc::operation_canceled));
+}
+
+TEST(CancellationTest, CancelRequest) {
+  std::string Output;
+  llvm::raw_string_ostream OS(Output);
+  JSONOutput Out(OS, llvm::nulls());
+  JSONRPCDispatcher Dispatcher([](const json::Expr &) {});
+  // Keeps the contexts of the requests, as if they were still running.
+  std::vector<Context> Running;
+  Dispatcher.registerHandler("foo", [&](const json::Expr &) {
+    Running.push_back(Context::current().clone());
+  });
+  auto Request = [](json::Expr ID) {
+    return json::obj{{"jsonrpc", "2.0"}, {"id", ID}, {"method", "foo"}};
+  };
+  auto Cancel = [](json::Expr ID) {
+    return json::obj{{"jsonrpc", "2.0"},
+                     {"method", "$/cancelRequest"},
+                     {"params", json::obj{{"id", ID}}}};
+  };
+
+  ASSERT_TRUE(Dispatcher.call(Request(1), Out));
+  ASSERT_TRUE(Dispatcher.call(Request("two"), Out));
+  ASSERT_EQ(Running.size(), 2u);
+  EXPECT_FALSE(isCancelled(Running[0]));
+  EXPECT_FALSE(isCancelled(Running[1]));
+
+  ASSERT_TRUE(Dispatcher.call(Cancel("two"), Out));
+  EXPECT_FALSE(isCancelled(Running[0]));
+  EXPECT_TRUE(isCancelled(Running[1]));
+
+  // Once a request is done, cancelling its ID has no effect, even if a new
+  // request reuses it.
+  Running.clear();
+  ASSERT_TRUE(Dispatcher.call(Cancel(1), Out));
+  ASSERT_TRUE(Dispatcher.call(Request(1), Out));
+  ASSERT_TRUE(Dispatcher.call(Cancel(3), Out));
+  ASSERT_EQ(Running.size(), 1u);
+  EXPECT_FALSE(isCancelled(Running[0]));
+  ASSERT_TRUE(Dispatcher.call(Cancel(1), Out));
+  EXPECT_TRUE(isCancelled(Running[0]));
+}
+
+TEST(CancellationTest, DuplicateRequestID) {
+  std::string Output;
+  llvm::raw_string_ostream OS(Output);
+  JSONOutput Out(OS, llvm::nulls());
+  JSONRPCDispatcher Dispatcher([](const json::Expr &) {});
+  std::vector<Context> Running;
+  Dispatcher.registerHandler("foo", [&](const json::Expr &) {
+    Running.push_back(Context::current().clone());
+  });
+  auto Request = json::obj{{"jsonrpc", "2.0"}, {"id", 1}, {"method", "foo"}};
+
+  ASSERT_TRUE(Dispatcher.call(Request, Out));
+  // The second request is rejected while the first one is running.
+  ASSERT_TRUE(Dispatcher.call(Request, Out));
+  ASSERT_EQ(Running.size(), 1u);
+  EXPECT_NE(OS.str().find("is already running"), std::string::npos);
+
+  // Rejecting it did not forget the first request.
+  ASSERT_TRUE(Dispatcher.call(json::obj{{"jsonrpc", "2.0"},
+                                        {"method", "$/cancelRequest"},
+                                        {"params", json::obj{{"id", 1}}}},
+                              Out));
+  EXPECT_TRUE(isCancelled(Running[0]));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
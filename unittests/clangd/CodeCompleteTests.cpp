@@ -692,7 +692,7 @@ TEST(SignatureHelpTest, ActiveArg) {
 
 class IndexRequestCollector : public SymbolIndex {
 public:
-  bool
+  llvm::Expected<bool>
   fuzzyFind(const FuzzyFindRequest &Req,
             llvm::function_ref<void(const Symbol &)> Callback) const override {
     Requests.push_back(Req);
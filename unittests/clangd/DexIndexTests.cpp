@@ -0,0 +1,422 @@
+//===-- DexIndexTests.cpp  ----------------------------*- C++ -*-----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Cancellation.h"
+#include "TestIndex.h"
+#include "index/Index.h"
+#include "index/dex/DexIndex.h"
+#include "index/dex/Iterator.h"
+#include "index/dex/Token.h"
+#include "index/dex/Trigram.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using testing::ElementsAre;
+using testing::UnorderedElementsAre;
+
+namespace clang {
+namespace clangd {
+namespace dex {
+namespace {
+
+std::string dump(const Iterator &It) {
+  std::string Result;
+  llvm::raw_string_ostream OS(Result);
+  OS << It;
+  return OS.str();
+}
+
+TEST(DexIndexIterators, DocumentIterator) {
+  const PostingList L = {4, 7, 8, 20, 42, 100};
+  auto DocIterator = create(L);
+
+  EXPECT_EQ(DocIterator->peek(), 4U);
+  EXPECT_FALSE(DocIterator->reachedEnd());
+
+  DocIterator->advance();
+  EXPECT_EQ(DocIterator->peek(), 7U);
+  EXPECT_FALSE(DocIterator->reachedEnd());
+
+  DocIterator->advanceTo(20);
+  EXPECT_EQ(DocIterator->peek(), 20U);
+  EXPECT_FALSE(DocIterator->reachedEnd());
+
+  DocIterator->advanceTo(65);
+  EXPECT_EQ(DocIterator->peek(), 100U);
+  EXPECT_FALSE(DocIterator->reachedEnd());
+
+  DocIterator->advanceTo(420);
+  EXPECT_TRUE(DocIterator->reachedEnd());
+}
+
+TEST(DexIndexIterators, AndWithEmpty) {
+  const PostingList L0;
+  const PostingList L1 = {0, 5, 7, 10, 42, 320, 9000};
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L0));
+  auto AndEmpty = createAnd(std::move(Children));
+  EXPECT_TRUE(AndEmpty->reachedEnd());
+
+  Children.clear();
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  auto AndWithEmpty = createAnd(std::move(Children));
+  EXPECT_TRUE(AndWithEmpty->reachedEnd());
+  EXPECT_THAT(consume(*AndWithEmpty), ElementsAre());
+}
+
+TEST(DexIndexIterators, AndTwoLists) {
+  const PostingList L0 = {0, 5, 7, 10, 42, 320, 9000};
+  const PostingList L1 = {0, 4, 7, 10, 30, 60, 320, 9000};
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  auto And = createAnd(std::move(Children));
+  EXPECT_THAT(consume(*And), ElementsAre(0U, 7U, 10U, 320U, 9000U));
+
+  Children.clear();
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  And = createAnd(std::move(Children));
+  And->advanceTo(0);
+  EXPECT_EQ(And->peek(), 0U);
+  And->advanceTo(5);
+  EXPECT_EQ(And->peek(), 7U);
+  And->advanceTo(10);
+  EXPECT_EQ(And->peek(), 10U);
+  And->advanceTo(42);
+  EXPECT_EQ(And->peek(), 320U);
+  And->advanceTo(8999);
+  EXPECT_EQ(And->peek(), 9000U);
+  And->advanceTo(9001);
+  EXPECT_TRUE(And->reachedEnd());
+}
+
+TEST(DexIndexIterators, AndThreeLists) {
+  const PostingList L0 = {0, 5, 7, 10, 42, 320, 9000};
+  const PostingList L1 = {0, 4, 7, 10, 30, 60, 320, 9000};
+  const PostingList L2 = {1, 4, 7, 11, 30, 60, 320, 9000};
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  Children.push_back(create(L2));
+  auto And = createAnd(std::move(Children));
+  EXPECT_THAT(consume(*And), ElementsAre(7U, 320U, 9000U));
+}
+
+TEST(DexIndexIterators, OrWithEmpty) {
+  const PostingList L0;
+  const PostingList L1 = {0, 5, 7, 10, 42, 320, 9000};
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L0));
+  auto OrEmpty = createOr(std::move(Children));
+  EXPECT_TRUE(OrEmpty->reachedEnd());
+
+  Children.clear();
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  auto OrWithEmpty = createOr(std::move(Children));
+  EXPECT_THAT(consume(*OrWithEmpty),
+              ElementsAre(0U, 5U, 7U, 10U, 42U, 320U, 9000U));
+}
+
+TEST(DexIndexIterators, OrTwoLists) {
+  const PostingList L0 = {0, 5, 7, 10, 42, 320, 9000};
+  const PostingList L1 = {0, 4, 7, 10, 30, 60, 320, 9000};
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  auto Or = createOr(std::move(Children));
+  EXPECT_THAT(consume(*Or),
+              ElementsAre(0U, 4U, 5U, 7U, 10U, 30U, 42U, 60U, 320U, 9000U));
+
+  Children.clear();
+  Children.push_back(create(L0));
+  Children.push_back(create(L1));
+  Or = createOr(std::move(Children));
+  Or->advanceTo(7);
+  EXPECT_EQ(Or->peek(), 7U);
+  Or->advanceTo(31);
+  EXPECT_EQ(Or->peek(), 42U);
+  Or->advanceTo(9001);
+  EXPECT_TRUE(Or->reachedEnd());
+}
+
+// Nesting iterators produces the expected tree:
+//
+//                      +-----+
+//                      |Root |
+//                      +--+--+
+//                         |
+//                   +-----v-----+
+//                   |    AND    |
+//                   +--+-----+--+
+//                      |     |
+//             +--------+     +-------+
+//             |                      |
+//        +----v----+            +----v----+
+//        |   OR    |            |   L2    |
+//        +--+---+--+            +---------+
+//           |   |
+//       +---+   +---+
+//       |           |
+//   +---v---+   +---v---+
+//   |  L0   |   |  L1   |
+//   +-------+   +-------+
+TEST(DexIndexIterators, QueryTree) {
+  const PostingList L0 = {1, 3, 5, 8, 9};
+  const PostingList L1 = {1, 5, 7, 9};
+  const PostingList L2 = {0, 5, 9, 10};
+
+  std::vector<std::unique_ptr<Iterator>> OrChildren;
+  OrChildren.push_back(create(L0));
+  OrChildren.push_back(create(L1));
+  std::vector<std::unique_ptr<Iterator>> AndChildren;
+  AndChildren.push_back(createOr(std::move(OrChildren)));
+  AndChildren.push_back(create(L2));
+  auto Root = createAnd(std::move(AndChildren));
+
+  EXPECT_THAT(consume(*Root), ElementsAre(5U, 9U));
+}
+
+TEST(DexIndexIterators, StringRepresentation) {
+  const PostingList L0 = {4, 7, 8, 20, 42, 100};
+  const PostingList L1 = {1, 3, 5, 8, 9};
+
+  EXPECT_EQ(dump(*create(L0)), "[4, 7, 8, 20, 42, 100]");
+
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(create(L1));
+  Children.push_back(create(L0));
+  EXPECT_EQ(dump(*createOr(std::move(Children))),
+            "(| [1, 3, 5, 8, 9] [4, 7, 8, 20, 42, 100])");
+}
+
+TEST(DexIndexIterators, Limit) {
+  const PostingList L0 = {4, 7, 8, 20, 42, 100};
+  auto DocIterator = create(L0);
+  EXPECT_THAT(consume(*DocIterator, 3), ElementsAre(4U, 7U, 8U));
+  EXPECT_EQ(DocIterator->peek(), 20U);
+}
+
+TEST(DexIndexIterators, True) {
+  auto TrueIterator = createTrue(0U);
+  EXPECT_TRUE(TrueIterator->reachedEnd());
+  EXPECT_THAT(consume(*TrueIterator), ElementsAre());
+
+  const PostingList L0 = {1, 2, 5, 7};
+  std::vector<std::unique_ptr<Iterator>> Children;
+  Children.push_back(createTrue(6U));
+  Children.push_back(create(L0));
+  auto AndIterator = createAnd(std::move(Children));
+  EXPECT_THAT(consume(*AndIterator), ElementsAre(1U, 2U, 5U));
+}
+
+testing::Matcher<std::vector<Token>>
+trigramsAre(std::initializer_list<std::string> Trigrams) {
+  std::vector<Token> Tokens;
+  for (const auto &Symbols : Trigrams)
+    Tokens.push_back(Token(Token::Kind::Trigram, Symbols));
+  return testing::UnorderedElementsAreArray(Tokens);
+}
+
+TEST(DexIndexTrigrams, IdentifierTrigrams) {
+  EXPECT_THAT(generateIdentifierTrigrams("X86"),
+              trigramsAre({"x86", "x", "x8", "8", "86"}));
+
+  EXPECT_THAT(generateIdentifierTrigrams("nl"), trigramsAre({"n", "nl"}));
+
+  EXPECT_THAT(generateIdentifierTrigrams("FooBar"),
+              trigramsAre({"foo", "oob", "oba", "bar", "fob", "fba", "f", "fo",
+                           "fb", "b", "ba"}));
+
+  // Separators are skipped, but start a new segment.
+  EXPECT_THAT(generateIdentifierTrigrams("a_b_c"),
+              trigramsAre({"abc", "a", "ab", "b", "bc", "c"}));
+
+  auto LOL = generateIdentifierTrigrams("LaughingOutLoud");
+  EXPECT_THAT(LOL, testing::Contains(Token(Token::Kind::Trigram, "lol")));
+  EXPECT_THAT(LOL, testing::Contains(Token(Token::Kind::Trigram, "out")));
+  EXPECT_THAT(LOL, testing::Not(testing::Contains(
+                       Token(Token::Kind::Trigram, "u"))));
+
+  // The last upper-case letter before a lower-case one starts a segment.
+  EXPECT_THAT(generateIdentifierTrigrams("HTTPServer"),
+              testing::Contains(Token(Token::Kind::Trigram, "hs")));
+}
+
+TEST(DexIndexTrigrams, QueryTrigrams) {
+  EXPECT_THAT(generateQueryTrigrams(""), trigramsAre({}));
+  EXPECT_THAT(generateQueryTrigrams("c"), trigramsAre({"c"}));
+  EXPECT_THAT(generateQueryTrigrams("cl"), trigramsAre({"cl"}));
+  EXPECT_THAT(generateQueryTrigrams("cla"), trigramsAre({"cla"}));
+  EXPECT_THAT(generateQueryTrigrams("_c_l"), trigramsAre({"cl"}));
+  EXPECT_THAT(generateQueryTrigrams("clangd"),
+              trigramsAre({"cla", "lan", "ang", "ngd"}));
+  EXPECT_THAT(generateQueryTrigrams("abcabc"),
+              trigramsAre({"abc", "bca", "cab"}));
+}
+
+TEST(DexIndex, DexIndexSymbolsRecycled) {
+  DexIndex I;
+  std::weak_ptr<SlabAndPointers> Symbols;
+  I.build(generateNumSymbols(0, 10, &Symbols));
+  FuzzyFindRequest Req;
+  Req.Query = "7";
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("7"));
+
+  EXPECT_FALSE(Symbols.expired());
+  // Release old symbols.
+  I.build(generateNumSymbols(0, 0));
+  EXPECT_TRUE(Symbols.expired());
+}
+
+TEST(DexIndex, DexIndexDeduplicate) {
+  auto Symbols = generateNumSymbols(0, 10);
+
+  // Inject some duplicates and make sure we only match the same symbol once.
+  auto Sym = symbol("7");
+  Symbols->push_back(&Sym);
+  Symbols->push_back(&Sym);
+  Symbols->push_back(&Sym);
+
+  FuzzyFindRequest Req;
+  Req.Query = "7";
+  DexIndex I;
+  I.build(std::move(Symbols));
+  auto Matches = match(I, Req);
+  EXPECT_EQ(Matches.size(), 1u);
+}
+
+TEST(DexIndex, DexIndexLimitedNumMatches) {
+  DexIndex I;
+  I.build(generateNumSymbols(0, 100));
+  FuzzyFindRequest Req;
+  Req.Query = "5";
+  Req.MaxCandidateCount = 3;
+  bool Incomplete;
+  auto Matches = match(I, Req, &Incomplete);
+  EXPECT_EQ(Matches.size(), Req.MaxCandidateCount);
+  EXPECT_TRUE(Incomplete);
+}
+
+TEST(DexIndex, FuzzyMatch) {
+  DexIndex I;
+  I.build(
+      generateSymbols({"LaughingOutLoud", "LionPopulation", "LittleOldLady"}));
+  FuzzyFindRequest Req;
+  Req.Query = "lol";
+  Req.MaxCandidateCount = 2;
+  EXPECT_THAT(match(I, Req),
+              UnorderedElementsAre("LaughingOutLoud", "LittleOldLady"));
+}
+
+TEST(DexIndex, MatchQualifiedNamesWithoutSpecificScope) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "b::y2", "y3"}));
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1", "b::y2", "y3"));
+}
+
+TEST(DexIndex, MatchQualifiedNamesWithGlobalScope) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "b::y2", "y3"}));
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  Req.Scopes = {""};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("y3"));
+}
+
+TEST(DexIndex, MatchQualifiedNamesWithOneScope) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "a::y2", "a::x", "b::y2", "y3"}));
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  Req.Scopes = {"a::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1", "a::y2"));
+}
+
+TEST(DexIndex, MatchQualifiedNamesWithMultipleScopes) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "a::y2", "a::x", "b::y3", "y3"}));
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  Req.Scopes = {"a::", "b::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1", "a::y2", "b::y3"));
+}
+
+TEST(DexIndex, NoMatchNestedScopes) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "a::b::y2"}));
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  Req.Scopes = {"a::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1"));
+}
+
+TEST(DexIndex, EmptyQueryInScope) {
+  DexIndex I;
+  I.build(generateSymbols({"a::y1", "a::b::y2", "c::y3"}));
+  FuzzyFindRequest Req;
+  Req.Scopes = {"a::", "x::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1"));
+  Req.Scopes = {"x::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre());
+  Req.Scopes.clear();
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("a::y1", "a::b::y2", "c::y3"));
+}
+
+TEST(DexIndex, IgnoreCases) {
+  DexIndex I;
+  I.build(generateSymbols({"ns::ABC", "ns::abc"}));
+  FuzzyFindRequest Req;
+  Req.Query = "AB";
+  Req.Scopes = {"ns::"};
+  EXPECT_THAT(match(I, Req), UnorderedElementsAre("ns::ABC", "ns::abc"));
+}
+
+TEST(DexIndex, Lookup) {
+  DexIndex I;
+  I.build(generateSymbols({"ns::abc", "ns::xyz"}));
+  EXPECT_THAT(lookup(I, SymbolID("ns::abc")), UnorderedElementsAre("ns::abc"));
+  EXPECT_THAT(lookup(I, {SymbolID("ns::abc"), SymbolID("ns::xyz")}),
+              UnorderedElementsAre("ns::abc", "ns::xyz"));
+  EXPECT_THAT(lookup(I, {SymbolID("ns::nonono"), SymbolID("ns::xyz")}),
+              UnorderedElementsAre("ns::xyz"));
+  EXPECT_THAT(lookup(I, SymbolID("ns::nonono")), UnorderedElementsAre());
+}
+
+TEST(DexIndex, Cancelled) {
+  DexIndex I;
+  I.build(generateNumSymbols(0, 2000));
+  auto Task = cancelableTask();
+  WithContext Cancelable(std::move(Task.first));
+  Task.second();
+  bool Called = false;
+  auto More = I.fuzzyFind(FuzzyFindRequest(),
+                          [&](const Symbol &) { Called = true; });
+  ASSERT_FALSE(bool(More));
+  EXPECT_EQ(llvm::errorToErrorCode(More.takeError()),
+            std::make_error_code(std::errc::operation_canceled));
+  EXPECT_FALSE(Called);
+}
+
+} // namespace
+} // namespace dex
+} // namespace clangd
+} // namespace clang
@@ -49,10 +49,10 @@ void stepByStep(llvm::ArrayRef<IncrementalTestStep> Steps) {
         Contents.str(),
     };
 
-    llvm::Expected<std::string> Result = DS.updateDraft(Path, {Event});
+    llvm::Expected<Rope> Result = DS.updateDraft(Path, {Event});
     ASSERT_TRUE(!!Result);
-    EXPECT_EQ(*Result, SrcAfter.code());
-    EXPECT_EQ(*DS.getDraft(Path), SrcAfter.code());
+    EXPECT_EQ(Result->str(), SrcAfter.code());
+    EXPECT_EQ(DS.getDraft(Path)->str(), SrcAfter.code());
   }
 }
 
@@ -78,11 +78,11 @@ void allAtOnce(llvm::ArrayRef<IncrementalTestStep> Steps) {
   // Set the initial content.
   DS.addDraft(Path, InitialSrc.code());
 
-  llvm::Expected<std::string> Result = DS.updateDraft(Path, Changes);
+  llvm::Expected<Rope> Result = DS.updateDraft(Path, Changes);
 
   ASSERT_TRUE(!!Result) << llvm::toString(Result.takeError());
-  EXPECT_EQ(*Result, FinalSrc.code());
-  EXPECT_EQ(*DS.getDraft(Path), FinalSrc.code());
+  EXPECT_EQ(Result->str(), FinalSrc.code());
+  EXPECT_EQ(DS.getDraft(Path)->str(), FinalSrc.code());
 }
 
 TEST(DraftStoreIncrementalUpdateTest, Simple) {
@@ -195,7 +195,7 @@ TEST(DraftStoreIncrementalUpdateTest, WrongRangeLength) {
   Change.range->end.character = 2;
   Change.rangeLength = 10;
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(
@@ -216,7 +216,7 @@ TEST(DraftStoreIncrementalUpdateTest, EndBeforeStart) {
   Change.range->end.line = 0;
   Change.range->end.character = 3;
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
@@ -237,7 +237,7 @@ TEST(DraftStoreIncrementalUpdateTest, StartCharOutOfRange) {
   Change.range->end.character = 100;
   Change.text = "foo";
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
@@ -258,7 +258,7 @@ TEST(DraftStoreIncrementalUpdateTest, EndCharOutOfRange) {
   Change.range->end.character = 100;
   Change.text = "foo";
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
@@ -279,7 +279,7 @@ TEST(DraftStoreIncrementalUpdateTest, StartLineOutOfRange) {
   Change.range->end.character = 0;
   Change.text = "foo";
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
@@ -300,7 +300,7 @@ TEST(DraftStoreIncrementalUpdateTest, EndLineOutOfRange) {
   Change.range->end.character = 0;
   Change.text = "foo";
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
@@ -334,15 +334,15 @@ TEST(DraftStoreIncrementalUpdateTest, InvalidRangeInASequence) {
   Change2.range->end.character = 100;
   Change2.text = "something";
 
-  llvm::Expected<std::string> Result = DS.updateDraft(File, {Change1, Change2});
+  llvm::Expected<Rope> Result = DS.updateDraft(File, {Change1, Change2});
 
   EXPECT_TRUE(!Result);
   EXPECT_EQ(llvm::toString(Result.takeError()),
             "Character value is out of range (100)");
 
-  llvm::Optional<std::string> Contents = DS.getDraft(File);
+  llvm::Optional<Rope> Contents = DS.getDraft(File);
   EXPECT_TRUE(Contents);
-  EXPECT_EQ(*Contents, OriginalContents);
+  EXPECT_EQ(Contents->str(), OriginalContents);
 }
 
 } // namespace
@@ -7,6 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "Cancellation.h"
 #include "TestFS.h"
 #include "index/FileIndex.h"
 #include "clang/Frontend/CompilerInvocation.h"
@@ -44,42 +45,60 @@ getSymbolNames(const std::vector<const Symbol *> &Symbols) {
   return Names;
 }
 
+std::vector<std::string> getSymbolNames(const FileSymbols &FS) {
+  std::vector<std::string> Names;
+  for (const auto &IDAndSymbols : *FS.snapshot())
+    for (const Symbol *Sym : IDAndSymbols.second)
+      Names.push_back(Sym->Name);
+  return Names;
+}
+
 TEST(FileSymbolsTest, UpdateAndGet) {
   FileSymbols FS;
-  EXPECT_THAT(getSymbolNames(*FS.allSymbols()), UnorderedElementsAre());
+  EXPECT_THAT(getSymbolNames(FS), UnorderedElementsAre());
 
   FS.update("f1", numSlab(1, 3));
-  EXPECT_THAT(getSymbolNames(*FS.allSymbols()),
-              UnorderedElementsAre("1", "2", "3"));
+  EXPECT_THAT(getSymbolNames(FS), UnorderedElementsAre("1", "2", "3"));
 }
 
 TEST(FileSymbolsTest, Overlap) {
   FileSymbols FS;
   FS.update("f1", numSlab(1, 3));
   FS.update("f2", numSlab(3, 5));
-  EXPECT_THAT(getSymbolNames(*FS.allSymbols()),
+  EXPECT_THAT(getSymbolNames(FS),
               UnorderedElementsAre("1", "2", "3", "3", "4", "5"));
+
+  FS.update("f1", numSlab(2, 3));
+  EXPECT_THAT(getSymbolNames(FS),
+              UnorderedElementsAre("2", "3", "3", "4", "5"));
+  FS.update("f2", nullptr);
+  EXPECT_THAT(getSymbolNames(FS), UnorderedElementsAre("2", "3"));
 }
 
-TEST(FileSymbolsTest, SnapshotAliveAfterRemove) {
+TEST(FileSymbolsTest, SymbolsAliveAfterRemove) {
   FileSymbols FS;
 
   FS.update("f1", numSlab(1, 3));
 
-  auto Symbols = FS.allSymbols();
-  EXPECT_THAT(getSymbolNames(*Symbols), UnorderedElementsAre("1", "2", "3"));
+  auto Snapshot = FS.snapshot();
+  std::vector<const Symbol *> Symbols;
+  for (const auto &IDAndSymbols : *Snapshot)
+    Symbols.push_back(IDAndSymbols.second.front());
+  EXPECT_THAT(getSymbolNames(Symbols), UnorderedElementsAre("1", "2", "3"));
 
   FS.update("f1", nullptr);
-  EXPECT_THAT(getSymbolNames(*FS.allSymbols()), UnorderedElementsAre());
-  EXPECT_THAT(getSymbolNames(*Symbols), UnorderedElementsAre("1", "2", "3"));
+  EXPECT_THAT(getSymbolNames(FS), UnorderedElementsAre());
+  // The snapshot is not affected by the update, and its symbols are alive.
+  EXPECT_EQ(3u, Snapshot->size());
+  EXPECT_THAT(getSymbolNames(Symbols), UnorderedElementsAre("1", "2", "3"));
 }
 
 std::vector<std::string> match(const SymbolIndex &I,
                                const FuzzyFindRequest &Req) {
   std::vector<std::string> Matches;
-  I.fuzzyFind(Req, [&](const Symbol &Sym) {
+  llvm::cantFail(I.fuzzyFind(Req, [&](const Symbol &Sym) {
     Matches.push_back((Sym.Scope + Sym.Name).str());
-  });
+  }));
   return Matches;
 }
 
@@ -122,6 +141,25 @@ TEST(FileIndexTest, IndexAST) {
   EXPECT_THAT(match(M, Req), UnorderedElementsAre("ns::f", "ns::X"));
 }
 
+TEST(FileIndexTest, Cancelled) {
+  std::string Code;
+  for (int I = 0; I < 2000; ++I)
+    Code += "int sym" + std::to_string(I) + ";\n";
+  FileIndex M;
+  M.update("f1", build("f1", Code).getPointer());
+
+  auto Task = cancelableTask();
+  WithContext Cancelable(std::move(Task.first));
+  Task.second();
+  bool Called = false;
+  auto More = M.fuzzyFind(FuzzyFindRequest(),
+                          [&](const Symbol &) { Called = true; });
+  ASSERT_FALSE(bool(More));
+  EXPECT_EQ(llvm::errorToErrorCode(More.takeError()),
+            std::make_error_code(std::errc::operation_canceled));
+  EXPECT_FALSE(Called);
+}
+
 TEST(FileIndexTest, NoLocal) {
   FileIndex M;
   M.update(
@@ -149,6 +187,38 @@ TEST(FileIndexTest, IndexMultiASTAndDeduplicate) {
   EXPECT_THAT(match(M, Req), UnorderedElementsAre("ns::f", "ns::X", "ns::ff"));
 }
 
+TEST(FileIndexTest, MergeSymbolsFromSeveralFiles) {
+  FileIndex M;
+  M.update("f1", build("f1", "namespace ns { class X; }").getPointer());
+  M.update("f2", build("f2", "namespace ns { class X {}; }").getPointer());
+  M.update("f3", build("f3", "namespace ns { class X; }").getPointer());
+
+  FuzzyFindRequest FuzzyReq;
+  FuzzyReq.Query = "X";
+  LookupRequest Req;
+  llvm::cantFail(M.fuzzyFind(FuzzyReq, [&](const Symbol &Sym) {
+    EXPECT_TRUE(Sym.Definition);
+    Req.IDs.insert(Sym.ID);
+  }));
+  ASSERT_EQ(Req.IDs.size(), 1u);
+
+  unsigned Found = 0;
+  M.lookup(Req, [&](const Symbol &Sym) {
+    EXPECT_TRUE(Sym.Definition);
+    ++Found;
+  });
+  EXPECT_EQ(Found, 1u);
+
+  // The definition goes away with f2.
+  M.update("f2", nullptr);
+  Found = 0;
+  M.lookup(Req, [&](const Symbol &Sym) {
+    EXPECT_FALSE(Sym.Definition);
+    ++Found;
+  });
+  EXPECT_EQ(Found, 1u);
+}
+
 TEST(FileIndexTest, RemoveAST) {
   FileIndex M;
   M.update(
@@ -164,6 +234,37 @@ TEST(FileIndexTest, RemoveAST) {
   EXPECT_THAT(match(M, Req), UnorderedElementsAre());
 }
 
+TEST(FileIndexTest, UpdateOnlyReplacesFileSymbols) {
+  FileIndex M;
+  M.update("f1", build("f1", "namespace ns { void f() {} }").getPointer());
+  M.update("f2", build("f2", "namespace ns { void g() {} }").getPointer());
+  M.update("f1", build("f1", "namespace ns { void h() {} }").getPointer());
+
+  FuzzyFindRequest Req;
+  Req.Query = "";
+  Req.Scopes = {"ns::"};
+  EXPECT_THAT(match(M, Req), UnorderedElementsAre("ns::g", "ns::h"));
+}
+
+TEST(FileIndexTest, LookupAcrossFiles) {
+  FileIndex M;
+  M.update("f1", build("f1", "namespace ns { void f() {} }").getPointer());
+  M.update("f2", build("f2", "namespace ns { void g() {} }").getPointer());
+
+  LookupRequest Req;
+  FuzzyFindRequest FuzzyReq;
+  FuzzyReq.Scopes = {"ns::"};
+  llvm::cantFail(M.fuzzyFind(
+      FuzzyReq, [&](const Symbol &Sym) { Req.IDs.insert(Sym.ID); }));
+  ASSERT_EQ(Req.IDs.size(), 2u);
+
+  std::vector<std::string> Found;
+  M.lookup(Req, [&](const Symbol &Sym) {
+    Found.push_back((Sym.Scope + Sym.Name).str());
+  });
+  EXPECT_THAT(Found, UnorderedElementsAre("ns::f", "ns::g"));
+}
+
 TEST(FileIndexTest, RemoveNonExisting) {
   FileIndex M;
   M.update("no", nullptr);
@@ -188,10 +289,10 @@ TEST(FileIndexTest, NoIncludeCollected) {
   FuzzyFindRequest Req;
   Req.Query = "";
   bool SeenSymbol = false;
-  M.fuzzyFind(Req, [&](const Symbol &Sym) {
+  llvm::cantFail(M.fuzzyFind(Req, [&](const Symbol &Sym) {
     EXPECT_TRUE(Sym.Detail->IncludeHeader.empty());
     SeenSymbol = true;
-  });
+  }));
   EXPECT_TRUE(SeenSymbol);
 }
 
@@ -212,7 +313,7 @@ vector<Ty> make_vector(Arg A) {}
   Req.Query = "";
   bool SeenVector = false;
   bool SeenMakeVector = false;
-  M.fuzzyFind(Req, [&](const Symbol &Sym) {
+  llvm::cantFail(M.fuzzyFind(Req, [&](const Symbol &Sym) {
     if (Sym.Name == "vector") {
       EXPECT_EQ(Sym.CompletionLabel, "vector<class Ty>");
       EXPECT_EQ(Sym.CompletionSnippetInsertText, "vector<${1:class Ty}>");
@@ -228,7 +329,7 @@ vector<Ty> make_vector(Arg A) {}
       EXPECT_EQ(Sym.CompletionPlainInsertText, "make_vector");
       SeenMakeVector = true;
     }
-  });
+  }));
   EXPECT_TRUE(SeenVector);
   EXPECT_TRUE(SeenMakeVector);
 }
@@ -109,6 +109,100 @@ TEST(JSONExprTests, PrettyPrinting) {
                  }));
 }
 
+TEST(JSONExprTests, Stream) {
+  auto StreamStuff = [](unsigned Indent) {
+    std::string S;
+    llvm::raw_string_ostream OS(S);
+    OStream J(OS, Indent);
+    J.object([&] {
+      J.attribute("foo", 42);
+      J.attributeArray("bar", [&] {
+        J.value(obj{});
+        J.value(ary{});
+        J.object([&] { J.attribute("baz", "x"); });
+        J.array([&] { J.value(nullptr); });
+      });
+      J.attributeObject("empty", [] {});
+      J.attributeBegin("last");
+      J.value(true);
+      J.attributeEnd();
+    });
+    return OS.str();
+  };
+  // Streamed attributes keep their order.
+  EXPECT_EQ(R"({"foo":42,"bar":[{},[],{"baz":"x"},[null]],"empty":{},)"
+            R"("last":true})",
+            StreamStuff(0));
+  EXPECT_EQ(R"({
+  "foo": 42,
+  "bar": [
+    {},
+    [],
+    {
+      "baz": "x"
+    },
+    [
+      null
+    ]
+  ],
+  "empty": {},
+  "last": true
+})",
+            StreamStuff(2));
+}
+
+// Streams a completion-list-shaped response, and checks that it is written the
+// same way as the equivalent Expr.
+TEST(JSONExprTests, StreamMatchesExpr) {
+  const unsigned NumItems = 100;
+  auto Item = [](unsigned I) {
+    std::string Label = "item" + std::to_string(I);
+    obj Range{{"start", obj{{"line", 1}, {"character", 2}}},
+              {"end", obj{{"line", 1}, {"character", 5}}}};
+    return obj{{"label", Label},
+               {"kind", 3},
+               {"detail", "int"},
+               {"sortText", Label},
+               {"insertTextFormat", 1},
+               {"textEdit",
+                obj{{"newText", Label}, {"range", std::move(Range)}}}};
+  };
+
+  std::string Streamed;
+  {
+    llvm::raw_string_ostream OS(Streamed);
+    OStream J(OS);
+    J.object([&] {
+      J.attribute("isIncomplete", false);
+      J.attributeArray("items", [&] {
+        for (unsigned I = 0; I < NumItems; ++I)
+          J.value(Item(I));
+      });
+    });
+  }
+
+  ary Items;
+  for (unsigned I = 0; I < NumItems; ++I)
+    Items.push_back(Item(I));
+  EXPECT_EQ(Streamed,
+            s(obj{{"isIncomplete", false}, {"items", std::move(Items)}}));
+}
+
+TEST(JSONExprTests, ObjectOperations) {
+  obj O{{"b", 2}, {"a", 1}};
+  EXPECT_EQ(O.size(), 2u);
+  EXPECT_TRUE(O.emplace("c", 3).second);
+  EXPECT_FALSE(O.emplace("a", 4).second);
+  EXPECT_EQ(O.getInteger("a"), llvm::Optional<int64_t>(1));
+  O["a"] = 5;
+  EXPECT_EQ(O.getInteger("a"), llvm::Optional<int64_t>(5));
+  EXPECT_EQ(O.count("b"), 1u);
+  EXPECT_EQ(O.erase("b"), 1u);
+  EXPECT_EQ(O.erase("b"), 0u);
+  EXPECT_EQ(O.count("b"), 0u);
+  EXPECT_EQ(s(std::move(O)), R"({"a":5,"c":3})");
+}
+
 TEST(JSONTest, Parse) {
   auto Compare = [](llvm::StringRef S, Expr Expected) {
     if (auto E = parse(S)) {
@@ -0,0 +1,120 @@
+//===-- JSONRPCDispatcherTests.cpp ------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "JSONRPCDispatcher.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace clang {
+namespace clangd {
+namespace {
+
+using testing::ElementsAre;
+using testing::ElementsAreArray;
+
+// Runs the server loop on Input, read from a file, and returns the params of
+// the "echo" notifications it handled.
+std::vector<std::string> readEchoes(llvm::StringRef Input,
+                                    JSONStreamStyle Style) {
+  llvm::SmallString<128> Path;
+  int FD;
+  if (auto EC = llvm::sys::fs::createTemporaryFile("clangd-input", "txt", FD,
+                                                   Path)) {
+    ADD_FAILURE() << "Could not create the input file: " << EC.message();
+    return {};
+  }
+  auto RemoveFile =
+      llvm::make_scope_exit([&] { llvm::sys::fs::remove(Path); });
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Input;
+  }
+  if (auto EC = llvm::sys::fs::openFileForRead(Path, FD)) {
+    ADD_FAILURE() << "Could not open the input file: " << EC.message();
+    return {};
+  }
+
+  std::vector<std::string> Echoes;
+  JSONOutput Out(llvm::nulls(), llvm::nulls());
+  JSONRPCDispatcher Dispatcher([](const json::Expr &) {});
+  Dispatcher.registerHandler("echo", [&](const json::Expr &Params) {
+    if (auto Text = Params.asString())
+      Echoes.push_back(*Text);
+    else
+      ADD_FAILURE() << llvm::formatv("Unexpected params: {0}", Params).str();
+  });
+  bool IsDone = false;
+  runLanguageServerLoop(FD, Out, Style, Dispatcher, IsDone);
+  // The input thread is done with a regular file.
+  llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+  return Echoes;
+}
+
+std::string echo(llvm::StringRef Text) {
+  std::string JSON;
+  llvm::raw_string_ostream OS(JSON);
+  OS << json::obj{{"jsonrpc", "2.0"}, {"method", "echo"}, {"params", Text}};
+  return OS.str();
+}
+
+std::string withHeaders(llvm::StringRef JSON) {
+  return ("Content-Length: " + llvm::Twine(JSON.size()) + "\r\n\r\n" + JSON)
+      .str();
+}
+
+TEST(JSONRPCDispatcherTest, MessagesAcrossChunks) {
+  // The input is read in 64K chunks. Messages of varied sizes put the chunk
+  // boundaries within headers and bodies, and the unconsumed input is moved to
+  // the front of the buffer many times.
+  std::string Input;
+  std::vector<std::string> Expected;
+  for (int I = 0; I < 2000; ++I) {
+    Expected.push_back(std::string(I * 37 % 1000, 'a' + I % 26));
+    Input += withHeaders(echo(Expected.back()));
+  }
+  EXPECT_THAT(readEchoes(Input, JSONStreamStyle::Standard),
+              ElementsAreArray(Expected));
+}
+
+TEST(JSONRPCDispatcherTest, LargeMessages) {
+  // Messages larger than the buffer make it grow.
+  std::string Small = "small";
+  std::string Large(1 << 20, 'x');
+  std::string Larger(3 << 20, 'y');
+  std::string Input = withHeaders(echo(Small)) + withHeaders(echo(Large)) +
+                      withHeaders(echo(Small)) + withHeaders(echo(Larger)) +
+                      withHeaders(echo(Small));
+  EXPECT_THAT(readEchoes(Input, JSONStreamStyle::Standard),
+              ElementsAre(Small, Large, Small, Larger, Small));
+}
+
+TEST(JSONRPCDispatcherTest, TruncatedMessage) {
+  std::string Input = withHeaders(echo("first"));
+  std::string Truncated = withHeaders(echo("second"));
+  Input += Truncated.substr(0, Truncated.size() - 1);
+  EXPECT_THAT(readEchoes(Input, JSONStreamStyle::Standard),
+              ElementsAre("first"));
+}
+
+TEST(JSONRPCDispatcherTest, DelimitedMessages) {
+  // The last line isn't terminated, and is read after the buffer grew.
+  std::string Large(100000, 'x');
+  std::string Input = "# comment\n" + echo(Large) + "\n---\n" + echo("last");
+  EXPECT_THAT(readEchoes(Input, JSONStreamStyle::Delimited),
+              ElementsAre(Large, "last"));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
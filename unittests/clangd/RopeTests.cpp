@@ -0,0 +1,110 @@
+//===-- RopeTests.cpp -------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Rope.h"
+#include "SourceCode.h"
+#include "llvm/Testing/Support/Error.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <random>
+
+namespace clang {
+namespace clangd {
+namespace {
+
+TEST(RopeTests, Empty) {
+  Rope R;
+  EXPECT_TRUE(R.empty());
+  EXPECT_EQ(R.size(), 0u);
+  EXPECT_EQ(R.str(), "");
+  EXPECT_TRUE(R == "");
+  EXPECT_EQ(R.getLineOffset(0), 0u);
+  EXPECT_EQ(R.getLineOffset(1), StringRef::npos);
+  EXPECT_EQ(R.getLineEnd(0), 0u);
+  EXPECT_EQ(R.countNewlines(0), 0u);
+}
+
+TEST(RopeTests, Lines) {
+  Rope R("ab\ncd\n\nef");
+  EXPECT_EQ(R.newlines(), 3u);
+  EXPECT_EQ(R.getLineOffset(0), 0u);
+  EXPECT_EQ(R.getLineOffset(1), 3u);
+  EXPECT_EQ(R.getLineOffset(2), 6u);
+  EXPECT_EQ(R.getLineOffset(3), 7u);
+  EXPECT_EQ(R.getLineOffset(4), StringRef::npos);
+  EXPECT_EQ(R.getLineEnd(0), 2u);
+  EXPECT_EQ(R.getLineEnd(2), 2u);
+  EXPECT_EQ(R.getLineEnd(3), 5u);
+  EXPECT_EQ(R.getLineEnd(6), 6u);
+  EXPECT_EQ(R.getLineEnd(7), 9u);
+  EXPECT_EQ(R.countNewlines(2), 0u);
+  EXPECT_EQ(R.countNewlines(3), 1u);
+  EXPECT_EQ(R.countNewlines(100), 3u);
+}
+
+TEST(RopeTests, SnapshotsAreImmutable) {
+  Rope Original("int main() {}");
+  Rope Edited = Original.replace(4, 8, "foo");
+  EXPECT_EQ(Original.str(), "int main() {}");
+  EXPECT_EQ(Edited.str(), "int foo() {}");
+  EXPECT_TRUE(Edited == "int foo() {}");
+  EXPECT_TRUE(Edited != "int main() {}");
+  EXPECT_TRUE(Edited != "int foo() {");
+}
+
+// Applies random edits to a large text and checks the rope against a string.
+TEST(RopeTests, RandomEdits) {
+  std::mt19937 Rand(42);
+  auto RandomText = [&](size_t Size) {
+    std::string Text;
+    for (size_t I = 0; I < Size; ++I)
+      Text += (Rand() % 8 == 0) ? '\n' : static_cast<char>('a' + Rand() % 26);
+    return Text;
+  };
+
+  std::string Expected = RandomText(20000);
+  Rope R(Expected);
+  for (int I = 0; I < 500; ++I) {
+    size_t Begin = Rand() % (Expected.size() + 1);
+    size_t End = Begin + Rand() % std::min<size_t>(Expected.size() - Begin + 1,
+                                                   (I % 50 == 0) ? 5000 : 50);
+    std::string Text = RandomText((I % 50 == 1) ? 3000 : Rand() % 20);
+    Expected.replace(Begin, End - Begin, Text);
+    R = R.replace(Begin, End, Text);
+
+    ASSERT_EQ(R.size(), Expected.size());
+    ASSERT_TRUE(R == Expected);
+    size_t Offset = Rand() % (Expected.size() + 1);
+    ASSERT_EQ(offsetToPosition(R, Offset), offsetToPosition(Expected, Offset));
+    Position P = offsetToPosition(Expected, Offset);
+    ASSERT_THAT_EXPECTED(positionToOffset(R, P), llvm::HasValue(Offset));
+  }
+  EXPECT_EQ(R.str(), Expected);
+  EXPECT_EQ(R.toMemoryBuffer("main.cpp")->getBuffer(), Expected);
+  EXPECT_EQ(R.newlines(),
+            static_cast<size_t>(std::count(Expected.begin(), Expected.end(),
+                                           '\n')));
+}
+
+TEST(RopeTests, PositionErrors) {
+  Rope R("ab\ncd");
+  Position P;
+  P.line = 2;
+  P.character = 0;
+  EXPECT_THAT_EXPECTED(positionToOffset(R, P), llvm::Failed());
+  P.line = 0;
+  P.character = 3;
+  EXPECT_THAT_EXPECTED(positionToOffset(R, P, false), llvm::Failed());
+  EXPECT_THAT_EXPECTED(positionToOffset(R, P), llvm::HasValue(2));
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
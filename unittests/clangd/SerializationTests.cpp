@@ -0,0 +1,191 @@
+//===-- SerializationTests.cpp ----------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TestIndex.h"
+#include "index/Serialization.h"
+#include "index/SymbolYAML.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+
+using testing::UnorderedElementsAre;
+
+namespace clang {
+namespace clangd {
+namespace {
+
+const char *YAML = R"(
+---
+ID: 057557CEBF6E6B2DD437FBF60CC58F352D1DF856
+Name:   'Foo1'
+Scope:   'clang::'
+SymInfo:
+  Kind:            Function
+  Lang:            Cpp
+CanonicalDeclaration:
+  FileURI:        file:///path/foo.h
+  Start:
+    Line: 1
+    Column: 0
+  End:
+    Line: 1
+    Column: 1
+References:    3
+CompletionLabel:    'Foo1-label'
+CompletionFilterText:    'filter'
+CompletionPlainInsertText:    'plain'
+Detail:
+  Documentation:    'Foo doc'
+  CompletionDetail:    'int'
+...
+---
+ID: 057557CEBF6E6B2DD437FBF60CC58F352D1DF858
+Name:   'Foo2'
+Scope:   'clang::'
+SymInfo:
+  Kind:            Function
+  Lang:            Cpp
+CanonicalDeclaration:
+  FileURI:        file:///path/bar.h
+  Start:
+    Line: 1
+    Column: 0
+  End:
+    Line: 1
+    Column: 1
+CompletionLabel:    'Foo2-label'
+CompletionFilterText:    'filter'
+CompletionPlainInsertText:    'plain'
+CompletionSnippetInsertText:    'snippet'
+...
+)";
+
+std::string toBinary(const SymbolSlab &Symbols) {
+  std::string Result;
+  llvm::raw_string_ostream OS(Result);
+  writeBinaryIndex(Symbols, OS);
+  return OS.str();
+}
+
+MATCHER_P(QName, Name, "") { return (arg.Scope + arg.Name).str() == Name; }
+
+TEST(SerializationTest, RoundTrip) {
+  auto Symbols = SymbolsFromYAML(YAML);
+  std::string Binary = toBinary(Symbols);
+  EXPECT_TRUE(isBinaryIndex(Binary));
+  EXPECT_FALSE(isBinaryIndex(YAML));
+
+  auto Read = readBinaryIndex(Binary);
+  ASSERT_TRUE(bool(Read)) << llvm::toString(Read.takeError());
+  EXPECT_THAT(*Read, UnorderedElementsAre(QName("clang::Foo1"),
+                                          QName("clang::Foo2")));
+
+  SymbolID ID1;
+  "057557CEBF6E6B2DD437FBF60CC58F352D1DF856" >> ID1;
+  auto Sym1 = Read->find(ID1);
+  ASSERT_NE(Sym1, Read->end());
+  EXPECT_EQ(Sym1->SymInfo.Kind, index::SymbolKind::Function);
+  EXPECT_EQ(Sym1->SymInfo.Lang, index::SymbolLanguage::CXX);
+  EXPECT_EQ(Sym1->CanonicalDeclaration.FileURI, "file:///path/foo.h");
+  EXPECT_EQ(Sym1->CanonicalDeclaration.Start.Line, 1u);
+  EXPECT_EQ(Sym1->CanonicalDeclaration.End.Column, 1u);
+  EXPECT_EQ(Sym1->References, 3u);
+  EXPECT_EQ(Sym1->CompletionLabel, "Foo1-label");
+  ASSERT_TRUE(Sym1->Detail);
+  EXPECT_EQ(Sym1->Detail->Documentation, "Foo doc");
+  EXPECT_EQ(Sym1->Detail->CompletionDetail, "int");
+
+  SymbolID ID2;
+  "057557CEBF6E6B2DD437FBF60CC58F352D1DF858" >> ID2;
+  auto Sym2 = Read->find(ID2);
+  ASSERT_NE(Sym2, Read->end());
+  EXPECT_EQ(Sym2->CompletionSnippetInsertText, "snippet");
+  EXPECT_FALSE(Sym2->Detail);
+
+  // Converting back to YAML yields the same symbols.
+  std::string ReadYAML;
+  llvm::raw_string_ostream OS(ReadYAML);
+  SymbolsToYAML(*Read, OS);
+  std::string OrigYAML;
+  llvm::raw_string_ostream OrigOS(OrigYAML);
+  SymbolsToYAML(Symbols, OrigOS);
+  EXPECT_EQ(OS.str(), OrigOS.str());
+}
+
+TEST(SerializationTest, Index) {
+  SymbolSlab::Builder Builder;
+  for (const char *QName : {"a::y1", "a::y2", "a::x", "b::y2", "y3"})
+    Builder.insert(symbol(QName));
+  std::string Binary = toBinary(std::move(Builder).build());
+  auto Index = loadBinaryIndex(llvm::MemoryBuffer::getMemBufferCopy(Binary));
+  ASSERT_TRUE(bool(Index)) << llvm::toString(Index.takeError());
+
+  FuzzyFindRequest Req;
+  Req.Query = "y";
+  EXPECT_THAT(match(**Index, Req),
+              UnorderedElementsAre("a::y1", "a::y2", "b::y2", "y3"));
+  Req.Scopes = {"a::"};
+  EXPECT_THAT(match(**Index, Req), UnorderedElementsAre("a::y1", "a::y2"));
+  Req.Scopes.clear();
+  Req.MaxCandidateCount = 2;
+  bool Incomplete;
+  EXPECT_EQ(match(**Index, Req, &Incomplete).size(), 2u);
+  EXPECT_TRUE(Incomplete);
+
+  EXPECT_THAT(lookup(**Index, SymbolID("a::x")), UnorderedElementsAre("a::x"));
+  EXPECT_THAT(lookup(**Index, {SymbolID("y3"), SymbolID("b::y2")}),
+              UnorderedElementsAre("y3", "b::y2"));
+  EXPECT_THAT(lookup(**Index, SymbolID("nonono")), UnorderedElementsAre());
+}
+
+TEST(SerializationTest, Shards) {
+  const unsigned NumShards = 4;
+  std::vector<SymbolSlab::Builder> ShardBuilders(NumShards);
+  SymbolSlab::Builder Builder;
+  for (int I = 0; I < 100; ++I) {
+    Symbol Sym = symbol("ns::sym" + std::to_string(I));
+    Builder.insert(Sym);
+    ShardBuilders[symbolShard(Sym.ID, NumShards)].insert(Sym);
+  }
+  std::string Binary = toBinary(std::move(Builder).build());
+
+  // Shards are contiguous ranges of IDs, so the symbols of the shards in order
+  // are sorted.
+  std::vector<SymbolSlab> Shards;
+  std::vector<SymbolID> IDs;
+  for (unsigned Shard = 0; Shard < NumShards; ++Shard) {
+    Shards.push_back(std::move(ShardBuilders[Shard]).build());
+    for (const Symbol &Sym : Shards.back())
+      IDs.push_back(Sym.ID);
+  }
+  EXPECT_EQ(IDs.size(), 100u);
+  EXPECT_TRUE(std::is_sorted(IDs.begin(), IDs.end()));
+
+  // Writing the shards together is the same as writing all symbols at once.
+  std::string ShardedBinary;
+  llvm::raw_string_ostream OS(ShardedBinary);
+  writeBinaryIndex(Shards, OS);
+  EXPECT_EQ(OS.str(), Binary);
+}
+
+TEST(SerializationTest, Invalid) {
+  std::string Binary = toBinary(SymbolsFromYAML(YAML));
+  auto NotBinary = readBinaryIndex(YAML);
+  EXPECT_FALSE(bool(NotBinary));
+  llvm::consumeError(NotBinary.takeError());
+  auto Truncated = loadBinaryIndex(llvm::MemoryBuffer::getMemBufferCopy(
+      llvm::StringRef(Binary).drop_back()));
+  EXPECT_FALSE(bool(Truncated));
+  llvm::consumeError(Truncated.takeError());
+}
+
+} // namespace
+} // namespace clangd
+} // namespace clang
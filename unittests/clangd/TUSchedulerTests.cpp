@@ -8,18 +8,29 @@
 //===----------------------------------------------------------------------===//
 
 #include "Context.h"
+#include "DiskPreambleCache.h"
 #include "TUScheduler.h"
 #include "TestFS.h"
+#include "index/FileIndex.h"
+#include "clang/Frontend/PCHContainerOperations.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/Support/FileSystem.h"
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <thread>
 #include <utility>
 
 namespace clang {
 namespace clangd {
 
+using ::testing::IsEmpty;
+using ::testing::Not;
 using ::testing::Pair;
 using ::testing::Pointee;
+using ::testing::UnorderedElementsAre;
 
 void ignoreUpdate(llvm::Optional<std::vector<Diag>>) {}
 void ignoreError(llvm::Error Err) {
@@ -30,7 +41,7 @@ class TUSchedulerTests : public ::testing::Test {
 protected:
   ParseInputs getInputs(PathRef File, std::string Contents) {
     return ParseInputs{*CDB.getCompileCommand(File), buildTestFS(Files),
-                       std::move(Contents)};
+                       Rope(Contents)};
   }
 
   llvm::StringMap<std::string> Files;
@@ -210,7 +221,8 @@ TEST_F(TUSchedulerTests, ManyUpdates) {
 
                          ASSERT_TRUE((bool)AST);
                          EXPECT_EQ(AST->Inputs.FS, Inputs.FS);
-                         EXPECT_EQ(AST->Inputs.Contents, Inputs.Contents);
+                         EXPECT_EQ(AST->Inputs.Contents.str(),
+                                   Inputs.Contents.str());
 
                          std::lock_guard<std::mutex> Lock(Mut);
                          ++TotalASTReads;
@@ -226,7 +238,7 @@ TEST_F(TUSchedulerTests, ManyUpdates) {
                 EXPECT_THAT(Context::current().get(NonceKey), Pointee(Nonce));
 
                 ASSERT_TRUE((bool)Preamble);
-                EXPECT_EQ(Preamble->Contents, Inputs.Contents);
+                EXPECT_EQ(Preamble->Contents, Inputs.Contents.str());
 
                 std::lock_guard<std::mutex> Lock(Mut);
                 ++TotalPreambleReads;
@@ -242,5 +254,369 @@ TEST_F(TUSchedulerTests, ManyUpdates) {
   EXPECT_EQ(TotalPreambleReads, FilesCount * UpdatesPerFile);
 }
 
+TEST_F(TUSchedulerTests, IndexReadsConcurrentWithRebuilds) {
+  const int FilesCount = 3;
+  const int UpdatesPerFile = 20;
+  const int ReadersCount = 4;
+
+  // The index is rebuilt on the worker threads after each parse, while the
+  // readers keep querying it.
+  FileIndex Index;
+  std::atomic<bool> Done(false);
+  std::atomic<int> TotalReads(0);
+  std::vector<std::thread> Readers;
+  for (int I = 0; I < ReadersCount; ++I)
+    Readers.emplace_back([&]() {
+      FuzzyFindRequest Req;
+      Req.Query = "sym";
+      while (!Done) {
+        llvm::cantFail(Index.fuzzyFind(Req, [&](const Symbol &Sym) {
+          EXPECT_TRUE(Sym.Name.startswith("sym")) << Sym.Name;
+        }));
+        ++TotalReads;
+      }
+    });
+
+  {
+    TUScheduler S(
+        getDefaultAsyncThreadsCount(),
+        /*StorePreamblesInMemory=*/true,
+        /*ASTParsedCallback=*/
+        [&](PathRef Path, ParsedAST *AST) { Index.update(Path, AST); },
+        /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero());
+
+    for (int UpdateI = 0; UpdateI < UpdatesPerFile; ++UpdateI) {
+      for (int FileI = 0; FileI < FilesCount; ++FileI) {
+        auto File = testPath("foo" + std::to_string(FileI) + ".cpp");
+        auto Contents = "int sym" + std::to_string(FileI) + "_" +
+                        std::to_string(UpdateI) + ";";
+        S.update(File, getInputs(File, Contents), WantDiagnostics::Auto,
+                 [](std::vector<Diag>) {});
+      }
+    }
+    ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  }
+
+  Done = true;
+  for (auto &Reader : Readers)
+    Reader.join();
+  EXPECT_GT(TotalReads, 0);
+
+  // Only the symbols of the last update of each file are left.
+  std::vector<std::string> Names;
+  FuzzyFindRequest Req;
+  Req.Query = "sym";
+  llvm::cantFail(Index.fuzzyFind(
+      Req, [&](const Symbol &Sym) { Names.push_back(Sym.Name); }));
+  EXPECT_THAT(Names, UnorderedElementsAre("sym0_19", "sym1_19", "sym2_19"));
+}
+
+TEST_F(TUSchedulerTests, PreambleCache) {
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  Files[Header] = "int x;";
+  std::string Contents = "#include \"foo.h\"\nint y = x;";
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+  PreambleCache Cache(/*MaxBytes=*/std::numeric_limits<std::size_t>::max());
+
+  auto BuildPreamble = [&]() -> std::shared_ptr<const PreambleData> {
+    CppFile File(Foo, /*StorePreamblesInMemory=*/true, PCHs,
+                 /*ASTCallback=*/nullptr, &Cache);
+    EXPECT_TRUE(bool(File.rebuild(getInputs(Foo, Contents))));
+    return File.getPreamble();
+  };
+
+  auto Preamble = BuildPreamble();
+  ASSERT_TRUE(Preamble);
+  EXPECT_EQ(Cache.getUsedBytes(), Preamble->Preamble->getSize());
+
+  // Reopening the file reuses the cached preamble.
+  EXPECT_EQ(BuildPreamble(), Preamble);
+
+  // The cached preamble can't be reused once an included header changed.
+  Files[Header] = "int x = 42;";
+  auto Rebuilt = BuildPreamble();
+  ASSERT_TRUE(Rebuilt);
+  EXPECT_NE(Rebuilt, Preamble);
+  EXPECT_EQ(BuildPreamble(), Rebuilt);
+}
+
+TEST_F(TUSchedulerTests, PreambleCacheEviction) {
+  auto Foo = testPath("foo.cpp");
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+  // The preamble doesn't fit into the cache, so it's evicted immediately.
+  PreambleCache Cache(/*MaxBytes=*/0);
+
+  std::weak_ptr<const PreambleData> Preamble;
+  {
+    CppFile File(Foo, /*StorePreamblesInMemory=*/true, PCHs,
+                 /*ASTCallback=*/nullptr, &Cache);
+    ASSERT_TRUE(bool(File.rebuild(getInputs(Foo, "#define FOO\nint y;"))));
+    Preamble = File.getPreamble();
+    EXPECT_FALSE(Preamble.expired());
+    EXPECT_EQ(Cache.getUsedBytes(), 0u);
+  }
+  // Nothing keeps the preamble alive once the file is closed.
+  EXPECT_TRUE(Preamble.expired());
+}
+
+TEST_F(TUSchedulerTests, StoredPreambles) {
+  llvm::SmallString<128> Dir;
+  ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("clangd-preambles", Dir));
+  auto Cleanup =
+      llvm::make_scope_exit([&] { llvm::sys::fs::remove_directories(Dir); });
+  auto Foo = testPath("foo.cpp");
+  auto Header = testPath("foo.h");
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+
+  // Every build uses a new DiskPreambleCache, like a restarted clangd.
+  auto Build = [&](std::size_t MaxBytes, StringRef HeaderContents,
+                   time_t HeaderModificationTime) {
+    IntrusiveRefCntPtr<vfs::InMemoryFileSystem> FS(
+        new vfs::InMemoryFileSystem);
+    FS->addFile(Header, HeaderModificationTime,
+                llvm::MemoryBuffer::getMemBufferCopy(HeaderContents, Header));
+    ParseInputs Inputs = getInputs(Foo, "#include \"foo.h\"\nint y = x;");
+    Inputs.FS = FS;
+    DiskPreambleCache Stored(Dir, MaxBytes);
+    CppFile File(Foo, /*StorePreamblesInMemory=*/true, PCHs,
+                 /*ASTCallback=*/nullptr, /*Cache=*/nullptr, &Stored);
+    auto Diags = File.rebuild(std::move(Inputs));
+    EXPECT_TRUE(bool(File.getPreamble()));
+    return Diags ? std::move(*Diags) : std::vector<Diag>();
+  };
+  auto NumStored = [&] {
+    unsigned Result = 0;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator It(Dir, EC), End;
+         It != End && !EC; It.increment(EC))
+      ++Result;
+    return Result;
+  };
+  const std::size_t Unlimited = std::numeric_limits<std::size_t>::max();
+
+  EXPECT_THAT(Build(Unlimited, "int x;", 1), IsEmpty());
+  EXPECT_EQ(NumStored(), 1u);
+  // A header with the same size and modification time is assumed unchanged,
+  // so the stored preamble declaring x is used although x is gone.
+  EXPECT_THAT(Build(Unlimited, "int z;", 1), IsEmpty());
+  // When the modification time changes, the contents are compared. Now the
+  // preamble is rebuilt, and x is undeclared.
+  EXPECT_THAT(Build(Unlimited, "int z;", 2), Not(IsEmpty()));
+  EXPECT_EQ(NumStored(), 1u);
+  // Different sizes always invalidate the stored preamble.
+  EXPECT_THAT(Build(Unlimited, "int x = 1;", 2), IsEmpty());
+
+  // Preambles exceeding the limit are removed right away.
+  EXPECT_THAT(Build(/*MaxBytes=*/0, "int x = 42;", 2), IsEmpty());
+  EXPECT_EQ(NumStored(), 0u);
+}
+
+TEST_F(TUSchedulerTests, SharedPreambles) {
+  Files[testPath("foo.h")] = "int x;";
+  Files[testPath("sub/foo.h")] = "int x;";
+  std::string Contents = "#include \"foo.h\"\nint y = x;";
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+  PreambleCache Cache(/*MaxBytes=*/0);
+
+  auto Open = [&](PathRef Path, std::string Code) {
+    auto File = llvm::make_unique<CppFile>(Path,
+                                           /*StorePreamblesInMemory=*/true,
+                                           PCHs, /*ASTCallback=*/nullptr,
+                                           &Cache);
+    EXPECT_TRUE(bool(File->rebuild(getInputs(Path, std::move(Code)))));
+    EXPECT_TRUE(bool(File->getPreamble()));
+    return File;
+  };
+  auto A = Open(testPath("a.cpp"), Contents);
+  auto B = Open(testPath("b.cpp"), Contents);
+  EXPECT_EQ(A->getPreamble(), B->getPreamble());
+  // Quoted includes are resolved relative to the main file, so files in other
+  // directories don't share the preamble.
+  auto C = Open(testPath("sub/c.cpp"), Contents);
+  EXPECT_NE(A->getPreamble(), C->getPreamble());
+  // Only the preamble parts of the files need to match.
+  auto D = Open(testPath("d.cpp"), "#include \"foo.h\"\nint z = x;");
+  EXPECT_EQ(A->getPreamble(), D->getPreamble());
+  auto E = Open(testPath("e.cpp"), "#define FOO\nint y;");
+  EXPECT_NE(A->getPreamble(), E->getPreamble());
+}
+
+TEST_F(TUSchedulerTests, SharedPreamblesIgnoreOutputs) {
+  Files[testPath("foo.h")] = "int x;";
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+  PreambleCache Cache(/*MaxBytes=*/0);
+
+  auto Open = [&](StringRef Name, std::vector<std::string> CommandLine) {
+    auto Path = testPath(Name);
+    ParseInputs Inputs = getInputs(Path, "#include \"foo.h\"\nint y = x;");
+    Inputs.CompileCommand = tooling::CompileCommand(
+        testRoot(), Name, std::move(CommandLine), /*Output=*/"");
+    auto File = llvm::make_unique<CppFile>(Path,
+                                           /*StorePreamblesInMemory=*/true,
+                                           PCHs, /*ASTCallback=*/nullptr,
+                                           &Cache);
+    EXPECT_TRUE(bool(File->rebuild(std::move(Inputs))));
+    EXPECT_TRUE(bool(File->getPreamble()));
+    return File;
+  };
+  auto A = Open("a.cpp", {"clang", "-fsyntax-only", "-o", "a.o", "-MTa.o",
+                          "a.cpp"});
+  auto B = Open("b.cpp", {"clang", "-fsyntax-only", "-o", "b.o", "-MTb.o",
+                          "./b.cpp"});
+  EXPECT_EQ(A->getPreamble(), B->getPreamble());
+  auto C = Open("c.cpp", {"clang", "-fsyntax-only", "-DFOO", "-o", "c.o",
+                          "c.cpp"});
+  EXPECT_NE(A->getPreamble(), C->getPreamble());
+}
+
+TEST_F(TUSchedulerTests, PreamblesDependingOnMainFileAreNotShared) {
+  auto PCHs = std::make_shared<PCHContainerOperations>();
+  PreambleCache Cache(/*MaxBytes=*/0);
+
+  auto Open = [&](PathRef Path, std::string Code) {
+    auto File = llvm::make_unique<CppFile>(Path,
+                                           /*StorePreamblesInMemory=*/true,
+                                           PCHs, /*ASTCallback=*/nullptr,
+                                           &Cache);
+    EXPECT_TRUE(bool(File->rebuild(getInputs(Path, std::move(Code)))));
+    EXPECT_TRUE(bool(File->getPreamble()));
+    return File;
+  };
+  // Macros defined in the preamble would point to the wrong file.
+  std::string Macro = "#define FOO 1\nint y = FOO;";
+  auto A = Open(testPath("a.cpp"), Macro);
+  EXPECT_FALSE(A->getPreamble()->Shareable);
+  EXPECT_NE(A->getPreamble(), Open(testPath("b.cpp"), Macro)->getPreamble());
+  // The preamble is still reused for the same file.
+  EXPECT_EQ(A->getPreamble(), Open(testPath("a.cpp"), Macro)->getPreamble());
+
+  // So would diagnostics in the preamble.
+  std::string Warning = "#warning preamble\nint y;";
+  auto C = Open(testPath("c.cpp"), Warning);
+  EXPECT_FALSE(C->getPreamble()->Shareable);
+  EXPECT_NE(C->getPreamble(), Open(testPath("d.cpp"), Warning)->getPreamble());
+}
+
+TEST_F(TUSchedulerTests, SharedPreamblesAreCountedOnce) {
+  // Run the requests synchronously, so that the results don't depend on the
+  // order in which the workers finish.
+  TUScheduler S(/*AsyncThreadsCount=*/0,
+                /*StorePreamblesInMemory=*/true,
+                /*ASTParsedCallback=*/nullptr,
+                /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero());
+  Files[testPath("foo.h")] = "int x;";
+  std::string Contents = "#include \"foo.h\"\nint y = x;";
+  auto A = testPath("a.cpp");
+  auto B = testPath("b.cpp");
+  auto UsedBytes = [&](PathRef File) -> std::size_t {
+    for (const auto &FileAndBytes : S.getUsedBytesPerFile())
+      if (FileAndBytes.first == File)
+        return FileAndBytes.second;
+    ADD_FAILURE() << "no such file " << File;
+    return 0;
+  };
+  auto GetPreamble = [&](PathRef File) {
+    const PreambleData *Result = nullptr;
+    S.runWithPreamble("GetPreamble", File,
+                      [&](llvm::Expected<InputsAndPreamble> IP) {
+                        ASSERT_TRUE(bool(IP));
+                        Result = IP->Preamble;
+                      });
+    return Result;
+  };
+
+  S.update(A, getInputs(A, Contents), WantDiagnostics::No, ignoreUpdate);
+  const PreambleData *Preamble = GetPreamble(A);
+  ASSERT_TRUE(Preamble);
+  std::size_t PreambleBytes = Preamble->Preamble->getSize();
+  std::size_t AloneBytes = UsedBytes(A);
+  ASSERT_GT(AloneBytes, PreambleBytes);
+
+  S.update(B, getInputs(B, Contents), WantDiagnostics::No, ignoreUpdate);
+  EXPECT_EQ(GetPreamble(B), Preamble);
+  // The AST of A is unchanged, and each file is charged half of the preamble.
+  EXPECT_EQ(UsedBytes(A), AloneBytes - PreambleBytes + PreambleBytes / 2);
+  EXPECT_EQ(UsedBytes(B), UsedBytes(A));
+}
+
+TEST_F(TUSchedulerTests, EvictedASTsAreRebuilt) {
+  std::atomic<int> CallbackCount(0);
+  // Every AST exceeds the limit, so only the last used one is kept.
+  TUScheduler S(getDefaultAsyncThreadsCount(),
+                /*StorePreamblesInMemory=*/false,
+                /*ASTParsedCallback=*/
+                [&](PathRef, ParsedAST *) { ++CallbackCount; },
+                /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero(),
+                /*PreambleCacheBytes=*/0, /*ASTCacheBytes=*/1);
+  auto A = testPath("a.cpp");
+  auto B = testPath("b.cpp");
+  auto UsedBytes = [&](PathRef File) -> std::size_t {
+    for (const auto &FileAndBytes : S.getUsedBytesPerFile())
+      if (FileAndBytes.first == File)
+        return FileAndBytes.second;
+    ADD_FAILURE() << "no such file " << File;
+    return 0;
+  };
+
+  S.update(A, getInputs(A, "int a;"), WantDiagnostics::No, ignoreUpdate);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  S.update(B, getInputs(B, "int b;"), WantDiagnostics::No, ignoreUpdate);
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_EQ(UsedBytes(A), 0u);
+  EXPECT_GT(UsedBytes(B), 0u);
+
+  // Reading the evicted AST rebuilds it, and evicts the other one.
+  bool Read = false;
+  S.runWithAST("Read", A, [&](llvm::Expected<InputsAndAST> AST) {
+    ASSERT_TRUE(bool(AST));
+    EXPECT_EQ(AST->Inputs.Contents.str(), "int a;");
+    Read = true;
+  });
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+  EXPECT_TRUE(Read);
+  EXPECT_GT(UsedBytes(A), 0u);
+  EXPECT_EQ(UsedBytes(B), 0u);
+  // Rebuilding the AST for a read doesn't count as a new version of the file.
+  EXPECT_EQ(CallbackCount, 2);
+}
+
+TEST_F(TUSchedulerTests, CancelSupersededReads) {
+  TUScheduler S(getDefaultAsyncThreadsCount(),
+                /*StorePreamblesInMemory=*/true,
+                /*ASTParsedCallback=*/nullptr,
+                /*UpdateDebounce=*/std::chrono::steady_clock::duration::zero());
+  auto Foo = testPath("foo.cpp");
+  S.update(Foo, getInputs(Foo, "int x;"), WantDiagnostics::No, ignoreUpdate);
+
+  // Keep the worker busy while the other reads are scheduled.
+  Notification Proceed;
+  S.runWithAST("Blocker", Foo,
+               [&](llvm::Expected<InputsAndAST> AST) { Proceed.wait(); });
+
+  std::vector<std::string> Results;
+  auto Read = [&](std::string Name, ReadPolicy Policy) {
+    S.runWithAST(Name, Foo,
+                 [&, Name](llvm::Expected<InputsAndAST> AST) {
+                   if (AST) {
+                     Results.push_back(Name);
+                   } else {
+                     Results.push_back(Name + " cancelled");
+                     ignoreError(AST.takeError());
+                   }
+                 },
+                 TaskPriority::Interactive, Policy);
+  };
+  Read("Hover", ReadPolicy::CancelIfSuperseded);
+  Read("Definitions", ReadPolicy::Run);
+  Read("Definitions", ReadPolicy::Run);
+  Read("Hover", ReadPolicy::CancelIfSuperseded);
+  Proceed.notify();
+  ASSERT_TRUE(S.blockUntilIdle(timeoutSeconds(10)));
+
+  EXPECT_THAT(Results, ::testing::ElementsAre("Hover cancelled", "Definitions",
+                                              "Definitions", "Hover"));
+}
+
 } // namespace clangd
 } // namespace clang
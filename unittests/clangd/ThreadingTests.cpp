@@ -8,12 +8,36 @@
 //===----------------------------------------------------------------------===//
 
 #include "Threading.h"
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include <mutex>
+#include <thread>
 
 namespace clang {
 namespace clangd {
-class ThreadingTest : public ::testing::Test {};
+class ThreadingTest : public ::testing::Test {
+protected:
+  /// Runs a task on \p Tasks that locks \p Barrier with \p Priority and
+  /// appends \p Name to Order, and waits until the task blocks on \p Barrier.
+  void acquire(AsyncTaskRunner &Tasks, Semaphore &Barrier, std::string Name,
+               TaskPriority Priority) {
+    std::size_t Waiting = Barrier.waiting();
+    Tasks.runAsync(Name, [this, &Barrier, Name, Priority]() {
+      Barrier.lock(Priority);
+      {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Order.push_back(Name);
+      }
+      Barrier.unlock();
+    });
+    // Make sure the task waits on the semaphore before we go on.
+    while (Barrier.waiting() == Waiting)
+      std::this_thread::yield();
+  }
+
+  std::mutex Mutex;
+  std::vector<std::string> Order; /* GUARDED_BY(Mutex) */
+};
 
 TEST_F(ThreadingTest, TaskRunner) {
   const int TasksCnt = 100;
@@ -61,5 +85,34 @@ TEST_F(ThreadingTest, TaskRunner) {
   std::lock_guard<std::mutex> Lock(Mutex);
   ASSERT_EQ(Counter, TasksCnt * IncrementsPerTask);
 }
+
+TEST_F(ThreadingTest, SemaphorePriorities) {
+  Semaphore Barrier(1);
+  {
+    AsyncTaskRunner Tasks;
+    Barrier.lock(TaskPriority::Background);
+    acquire(Tasks, Barrier, "background", TaskPriority::Background);
+    acquire(Tasks, Barrier, "diagnostics", TaskPriority::Diagnostics);
+    acquire(Tasks, Barrier, "interactive", TaskPriority::Interactive);
+    Barrier.unlock();
+  }
+  EXPECT_THAT(Order,
+              testing::ElementsAre("interactive", "diagnostics", "background"));
+}
+
+TEST_F(ThreadingTest, SemaphoreDoesNotStarveLowPriorities) {
+  Semaphore Barrier(1, /*MaxPasses=*/2);
+  {
+    AsyncTaskRunner Tasks;
+    Barrier.lock(TaskPriority::Interactive);
+    acquire(Tasks, Barrier, "background", TaskPriority::Background);
+    for (int I = 0; I < 3; ++I)
+      acquire(Tasks, Barrier, "interactive", TaskPriority::Interactive);
+    Barrier.unlock();
+  }
+  // The background task was passed over twice, then it goes first.
+  EXPECT_THAT(Order, testing::ElementsAre("interactive", "interactive",
+                                          "background", "interactive"));
+}
 } // namespace clangd
 } // namespace clang
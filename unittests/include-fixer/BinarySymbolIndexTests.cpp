@@ -0,0 +1,93 @@
+//===-- BinarySymbolIndexTests.cpp - Binary symbol index unit tests -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BinarySymbolIndex.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::find_all_symbols::SymbolInfo;
+using testing::ElementsAre;
+using testing::IsEmpty;
+
+namespace clang {
+namespace include_fixer {
+namespace {
+
+SymbolAndSignals symbol(llvm::StringRef Name, llvm::StringRef FilePath,
+                        const std::vector<SymbolInfo::Context> &Contexts,
+                        unsigned Seen, unsigned Used) {
+  return {SymbolInfo(Name, SymbolInfo::SymbolKind::Class, FilePath, Contexts),
+          SymbolInfo::Signals(Seen, Used)};
+}
+
+std::unique_ptr<BinarySymbolIndex>
+build(const std::vector<SymbolAndSignals> &Symbols) {
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  EXPECT_FALSE(BinarySymbolIndex::write(Symbols, OS));
+  auto Index = BinarySymbolIndex::createFromBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(OS.str()));
+  EXPECT_TRUE(bool(Index));
+  return Index ? std::move(*Index) : nullptr;
+}
+
+TEST(BinarySymbolIndexTest, Search) {
+  std::vector<SymbolAndSignals> Symbols = {
+      symbol("foo", "foo.h", {{SymbolInfo::ContextType::Namespace, "a"}}, 2,
+             1),
+      symbol("bar", "bar.h", {}, 1, 0),
+      symbol("foo", "b/foo.h",
+             {{SymbolInfo::ContextType::Record, "B"},
+              {SymbolInfo::ContextType::Namespace, "a"}},
+             0, 0),
+  };
+  auto Index = build(Symbols);
+  ASSERT_TRUE(Index);
+  // Symbols with the same name keep their order.
+  EXPECT_THAT(Index->search("foo"), ElementsAre(Symbols[0], Symbols[2]));
+  EXPECT_THAT(Index->search("bar"), ElementsAre(Symbols[1]));
+  EXPECT_THAT(Index->search("baz"), IsEmpty());
+  EXPECT_THAT(Index->search(""), IsEmpty());
+}
+
+TEST(BinarySymbolIndexTest, ManySymbols) {
+  std::vector<SymbolAndSignals> Symbols;
+  for (unsigned I = 0; I < 1000; ++I)
+    Symbols.push_back(symbol("sym" + std::to_string(I), "header.h", {}, I, 0));
+  auto Index = build(Symbols);
+  ASSERT_TRUE(Index);
+  for (unsigned I = 0; I < 1000; ++I)
+    EXPECT_THAT(Index->search("sym" + std::to_string(I)),
+                ElementsAre(Symbols[I]));
+  EXPECT_THAT(Index->search("sym1000"), IsEmpty());
+}
+
+TEST(BinarySymbolIndexTest, Empty) {
+  auto Index = build({});
+  ASSERT_TRUE(Index);
+  EXPECT_THAT(Index->search("foo"), IsEmpty());
+}
+
+TEST(BinarySymbolIndexTest, Invalid) {
+  EXPECT_FALSE(BinarySymbolIndex::createFromBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy("---\nName: foo\n")));
+
+  std::string Data;
+  llvm::raw_string_ostream OS(Data);
+  BinarySymbolIndex::write({symbol("foo", "foo.h", {}, 1, 1)}, OS);
+  OS.flush();
+  EXPECT_TRUE(BinarySymbolIndex::isBinarySymbolIndex(Data));
+  EXPECT_FALSE(BinarySymbolIndex::createFromBuffer(
+      llvm::MemoryBuffer::getMemBufferCopy(Data.substr(0, Data.size() - 1))));
+}
+
+} // namespace
+} // namespace include_fixer
+} // namespace clang
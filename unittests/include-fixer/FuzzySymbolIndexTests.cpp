@@ -11,8 +11,12 @@
 #include "gmock/gmock.h"
 #include "llvm/Support/Regex.h"
 #include "gtest/gtest.h"
+#include <random>
 
+using clang::find_all_symbols::SymbolAndSignals;
+using clang::find_all_symbols::SymbolInfo;
 using testing::ElementsAre;
+using testing::IsEmpty;
 using testing::Not;
 
 namespace clang {
@@ -56,6 +60,87 @@ TEST(FuzzySymbolIndexTest, QueryRegexp) {
   EXPECT_THAT(QueryRegexp("UniP"), MatchesSymbol("unique_ptr"));
 }
 
+std::vector<std::string> searchNames(FuzzySymbolIndex &Index,
+                                     llvm::StringRef Query) {
+  std::vector<std::string> Names;
+  for (const SymbolAndSignals &Symbol : Index.search(Query))
+    Names.push_back(Symbol.Symbol.getName());
+  return Names;
+}
+
+SymbolAndSignals symbol(llvm::StringRef Name) {
+  return {SymbolInfo(Name, SymbolInfo::SymbolKind::Class, "header.h", {}),
+          SymbolInfo::Signals()};
+}
+
+TEST(FuzzySymbolIndexTest, Search) {
+  std::vector<SymbolAndSignals> Symbols;
+  for (llvm::StringRef Name :
+       {"URLHandlerCallback", "unique_ptr", "UniqueID", "URL", "string",
+        "StringRef", "string_view", "fee_fie_foe", "fie", "unique_ptr"})
+    Symbols.push_back(symbol(Name));
+  auto Index = FuzzySymbolIndex::create(Symbols);
+
+  EXPECT_THAT(searchNames(*Index, "uhc"), ElementsAre("URLHandlerCallback"));
+  EXPECT_THAT(searchNames(*Index, "urhaca"),
+              ElementsAre("URLHandlerCallback"));
+  EXPECT_THAT(searchNames(*Index, "uc"), IsEmpty()) << "Skip token";
+  // Results are in database order.
+  EXPECT_THAT(searchNames(*Index, "uptr"),
+              ElementsAre("unique_ptr", "unique_ptr"));
+  EXPECT_THAT(searchNames(*Index, "u"),
+              ElementsAre("URLHandlerCallback", "unique_ptr", "UniqueID",
+                          "URL", "unique_ptr"));
+  EXPECT_THAT(searchNames(*Index, "StR"), ElementsAre("StringRef"));
+  EXPECT_THAT(searchNames(*Index, "STr"), IsEmpty());
+  EXPECT_THAT(searchNames(*Index, "strv"), ElementsAre("string_view"));
+  EXPECT_THAT(searchNames(*Index, "string"),
+              ElementsAre("string", "StringRef", "string_view"));
+  EXPECT_THAT(searchNames(*Index, "fe f"), ElementsAre("fee_fie_foe"));
+  EXPECT_THAT(searchNames(*Index, "xyz"), IsEmpty());
+  EXPECT_THAT(searchNames(*Index, "__"), IsEmpty());
+}
+
+// Checks the index against a linear regex scan, the reference implementation,
+// over a large generated database.
+TEST(FuzzySymbolIndexTest, ManySymbols) {
+  const char *Words[] = {"url",  "handler", "callback", "unique", "ptr",
+                         "str",  "string",  "ref",      "view",   "map",
+                         "set",  "vector",  "id",       "u",      "s",
+                         "2",    "16",      "fee",      "fie",    "foe"};
+  std::mt19937 Rand(42);
+  auto RandomWord = [&] { return std::string(Words[Rand() % 20]); };
+
+  std::vector<SymbolAndSignals> Symbols;
+  for (unsigned I = 0; I < 20000; ++I) {
+    std::string Name;
+    for (unsigned J = 0, E = 1 + Rand() % 4; J < E; ++J)
+      Name += (J ? "_" : "") + RandomWord();
+    Symbols.push_back(symbol(Name));
+  }
+  std::vector<std::string> Keys;
+  for (const SymbolAndSignals &Symbol : Symbols) {
+    auto Tokens = FuzzySymbolIndex::tokenize(Symbol.Symbol.getName());
+    Keys.push_back(llvm::join(Tokens.begin(), Tokens.end(), " "));
+  }
+  auto Index = FuzzySymbolIndex::create(Symbols);
+
+  for (unsigned I = 0; I < 100; ++I) {
+    std::string Query;
+    for (unsigned J = 0, E = 1 + Rand() % 3; J < E; ++J) {
+      std::string Word = RandomWord();
+      Query += (J ? " " : "") + Word.substr(0, 1 + Rand() % Word.size());
+    }
+    std::vector<std::string> Expected;
+    llvm::Regex Pattern("^" + FuzzySymbolIndex::queryRegexp(
+                                  FuzzySymbolIndex::tokenize(Query)));
+    for (size_t J = 0; J < Symbols.size(); ++J)
+      if (Pattern.match(Keys[J]))
+        Expected.push_back(Symbols[J].Symbol.getName());
+    ASSERT_EQ(searchNames(*Index, Query), Expected) << Query;
+  }
+}
+
 } // namespace
 } // namespace include_fixer
 } // namespace clang
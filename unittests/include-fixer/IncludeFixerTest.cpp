@@ -12,6 +12,7 @@
 #include "SymbolIndexManager.h"
 #include "unittests/Tooling/RewriterTestContext.h"
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
 #include "gtest/gtest.h"
 
 namespace clang {
@@ -52,7 +53,8 @@ static bool runOnCode(tooling::ToolAction *ToolAction, StringRef Code,
 
 static std::string runIncludeFixer(
     StringRef Code,
-    const std::vector<std::string> &ExtraArgs = std::vector<std::string>()) {
+    const std::vector<std::string> &ExtraArgs = std::vector<std::string>(),
+    IncludeFixerPreambleCache *Preambles = nullptr) {
   std::vector<SymbolAndSignals> Symbols = {
       {SymbolInfo("string", SymbolInfo::SymbolKind::Class, "<string>",
                   {{SymbolInfo::ContextType::Namespace, "std"}}),
@@ -98,7 +100,9 @@ static std::string runIncludeFixer(
       [=]() { return llvm::make_unique<InMemorySymbolIndex>(Symbols); });
 
   std::vector<IncludeFixerContext> FixerContexts;
-  IncludeFixerActionFactory Factory(*SymbolIndexMgr, FixerContexts, "llvm");
+  IncludeFixerActionFactory Factory(*SymbolIndexMgr, FixerContexts, "llvm",
+                                    /*MinimizeIncludePaths=*/true, Preambles,
+                                    llvm::join(ExtraArgs, " "));
   std::string FakeFileName = "input.cc";
   runOnCode(&Factory, Code, FakeFileName, ExtraArgs);
   assert(FixerContexts.size() == 1);
@@ -367,6 +371,51 @@ TEST(IncludeFixer, DontAddQualifiersForMissingCompleteType) {
             runIncludeFixer("class bar;\nvoid f() {\nbar* b;\nb->f();\n}"));
 }
 
+TEST(IncludeFixer, Preamble) {
+  IncludeFixerPreambleCache Preambles;
+  std::string Code = "#include \"foo.h\"\n"
+                     "\n"
+                     "namespace a {\nb::bar b;\n}\n";
+  std::string Expected = "#include \"bar.h\"\n"
+                         "#include \"foo.h\"\n"
+                         "\n"
+                         "namespace a {\nb::bar b;\n}\n";
+  EXPECT_EQ(Expected, runIncludeFixer(Code, {}, &Preambles));
+  EXPECT_EQ(1u, Preambles.getBuilt());
+  EXPECT_EQ(0u, Preambles.getReused());
+  // The preamble is reused.
+  EXPECT_EQ(Expected, runIncludeFixer(Code, {}, &Preambles));
+  EXPECT_EQ(1u, Preambles.getBuilt());
+  EXPECT_EQ(1u, Preambles.getReused());
+  EXPECT_EQ(1u, Preambles.size());
+
+  // The #includes changed, the preamble is rebuilt.
+  Code = "#include \"dir/bar.h\"\n"
+         "\n"
+         "namespace a {\nb::bar b;\n}\n";
+  Expected = "#include \"bar.h\"\n"
+             "#include \"dir/bar.h\"\n"
+             "\n"
+             "namespace a {\nb::bar b;\n}\n";
+  EXPECT_EQ(Expected, runIncludeFixer(Code, {}, &Preambles));
+  EXPECT_EQ(2u, Preambles.getBuilt());
+  EXPECT_EQ(1u, Preambles.getReused());
+  EXPECT_EQ(1u, Preambles.size());
+
+  // The compile command changed, the preamble is rebuilt.
+  EXPECT_EQ(Expected, runIncludeFixer(Code, {"-DFOO"}, &Preambles));
+  EXPECT_EQ(3u, Preambles.getBuilt());
+  EXPECT_EQ(1u, Preambles.getReused());
+  EXPECT_EQ(1u, Preambles.size());
+
+  // The preamble of header.h has an error, so it is not used.
+  Code = "#include \"header.h\"\n";
+  IncludeFixerPreambleCache OtherPreambles;
+  EXPECT_EQ(Code, runIncludeFixer(Code, {}, &OtherPreambles));
+  EXPECT_EQ(0u, OtherPreambles.getBuilt());
+  EXPECT_EQ(0u, OtherPreambles.size());
+}
+
 } // namespace
 } // namespace include_fixer
 } // namespace clang